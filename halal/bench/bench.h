@@ -0,0 +1,86 @@
+/*
+ * bench.h — Microbenchmark harness for the core kernels.
+ *
+ * Each benchmark is a function running its operation n times.  The
+ * harness doubles n until one run takes BENCH_MIN_MS (HS_BENCH_MS in the
+ * environment overrides it), then times BENCH_REPS runs of that length
+ * and reports the median as one TSV row:
+ *
+ *   benchmark  param  ops  ns_per_op  throughput  unit
+ *
+ * where throughput is units_per_op * 1e9 / ns_per_op, e.g. bases/s or
+ * reads/s.  Results go to stdout so runs can be diffed across releases;
+ * progress and log output go to stderr.
+ */
+#ifndef HALALSEQ_BENCH_H
+#define HALALSEQ_BENCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "utils.h"
+
+#define BENCH_MIN_MS 200.0
+#define BENCH_REPS 5
+
+typedef void (*bench_fn_t)(void *arg, int64_t n);
+
+/* Results the compiler must not discard */
+static volatile uint64_t bench_sink;
+
+static inline double bench_min_ms(void) {
+    const char *env = getenv("HS_BENCH_MS");
+    double ms = env ? atof(env) : 0.0;
+    return ms > 0.0 ? ms : BENCH_MIN_MS;
+}
+
+static inline int bench_cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static inline void bench_header(const char *suite) {
+    fprintf(stderr, "=== %s ===\n", suite);
+    printf("benchmark\tparam\tops\tns_per_op\tthroughput\tunit\n");
+    fflush(stdout);
+}
+
+static inline void bench_run(const char *name, const char *param, bench_fn_t fn, void *arg,
+                             double units_per_op, const char *unit) {
+    double min_ms = bench_min_ms();
+    int64_t n = 1;
+    fn(arg, 1);                                     /* warm caches and pages */
+    for (;;) {
+        double t = hs_clock_ms();
+        fn(arg, n);
+        double ms = hs_clock_ms() - t;
+        if (ms >= min_ms || n >= ((int64_t)1 << 40)) break;
+        /* Jump close to the target, at most 10x at a time */
+        int64_t next = ms > 0.0 ? (int64_t)((double)n * min_ms * 1.2 / ms) : n * 10;
+        n = next > n * 10 ? n * 10 : (next > n ? next : n * 2);
+    }
+    double ns[BENCH_REPS];
+    for (int r = 0; r < BENCH_REPS; r++) {
+        double t = hs_clock_ms();
+        fn(arg, n);
+        ns[r] = (hs_clock_ms() - t) * 1e6 / (double)n;
+    }
+    qsort(ns, BENCH_REPS, sizeof(double), bench_cmp_double);
+    double med = ns[BENCH_REPS / 2];
+    printf("%s\t%s\t%lld\t%.1f\t%.4g\t%s\n", name, param, (long long)n, med,
+           med > 0.0 ? units_per_op * 1e9 / med : 0.0, unit);
+    fflush(stdout);
+}
+
+/* Random ACGT sequence of len bases (NUL-terminated) */
+static inline char *bench_random_seq(int len, uint64_t seed) {
+    static const char bases[4] = { 'A', 'C', 'G', 'T' };
+    hs_rng_t rng;
+    hs_rng_seed(&rng, seed);
+    char *s = (char *)hs_malloc((size_t)len + 1);
+    for (int i = 0; i < len; i++) s[i] = bases[hs_rng_next(&rng) & 3];
+    s[len] = '\0';
+    return s;
+}
+
+#endif /* HALALSEQ_BENCH_H */
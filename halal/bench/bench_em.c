@@ -0,0 +1,100 @@
+/*
+ * bench_em.c — EM fit and full nested-model LRT across read counts.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "em.h"
+#include "utils.h"
+#include "bench.h"
+
+#define S 20
+#define M 4
+#define AMP_LEN 150
+
+/* n reads drawn from a skewed mixture of S species: each maps to one
+ * marker and holds its true species plus up to three look-alikes at
+ * lower containment */
+static em_read_t *synth_reads(int n, uint64_t seed) {
+    hs_rng_t rng;
+    hs_rng_seed(&rng, seed);
+    em_read_t *reads = (em_read_t *)hs_calloc((size_t)n, sizeof(em_read_t));
+    for (int i = 0; i < n; i++) {
+        /* Product of two uniforms: low species indices dominate */
+        int s = (int)((hs_rng_next(&rng) % 1000) * (hs_rng_next(&rng) % 1000) / 1000 * S / 1000);
+        int nc = 1 + (int)(hs_rng_next(&rng) % 4);
+        em_read_t *r = &reads[i];
+        r->marker_idx = (int)(hs_rng_next(&rng) % M);
+        r->species_indices = (int *)hs_malloc((size_t)nc * sizeof(int));
+        r->containments = (double *)hs_malloc((size_t)nc * sizeof(double));
+        r->n_candidates = nc;
+        r->species_indices[0] = s;
+        r->containments[0] = 0.9 + 0.1 * (double)(hs_rng_next(&rng) % 1000) / 1000.0;
+        for (int c = 1; c < nc; c++) {
+            r->species_indices[c] = (s + c) % S;
+            r->containments[c] = 0.5 + 0.3 * (double)(hs_rng_next(&rng) % 1000) / 1000.0;
+        }
+    }
+    return reads;
+}
+
+typedef struct {
+    const em_data_t *data;
+    const int *amp_lens;
+    em_config_t cfg;
+    em_result_t *fit;           /* run_lrt: the fit being tested */
+} em_arg_t;
+
+static void run_fit(void *arg, int64_t n) {
+    const em_arg_t *a = (const em_arg_t *)arg;
+    double acc = 0.0;
+    for (int64_t i = 0; i < n; i++) {
+        em_result_t *r = em_fit_data(a->data, S, M, a->amp_lens, &a->cfg);
+        acc += r->log_likelihood;
+        em_result_destroy(r);
+    }
+    bench_sink = (uint64_t)(-acc);
+}
+
+/* em_lrt_full allocates fresh score arrays each call */
+static void run_lrt(void *arg, int64_t n) {
+    em_arg_t *a = (em_arg_t *)arg;
+    double acc = 0.0;
+    for (int64_t i = 0; i < n; i++) {
+        free(a->fit->lrt_scores);
+        free(a->fit->p_values);
+        a->fit->lrt_scores = a->fit->p_values = NULL;
+        em_lrt_full(a->fit, a->data, &a->cfg, a->amp_lens);
+        acc += a->fit->lrt_scores[0];
+    }
+    bench_sink = (uint64_t)acc;
+}
+
+int main(void) {
+    hs_log_set_level(HS_LOG_WARN);
+    bench_header("bench_em");
+    int amp_lens[S * M];
+    for (int i = 0; i < S * M; i++) amp_lens[i] = AMP_LEN;
+    char param[32];
+
+    int counts[3] = { 1000, 10000, 100000 };
+    for (int i = 0; i < 3; i++) {
+        int n = counts[i];
+        em_read_t *reads = synth_reads(n, 7 + (uint64_t)i);
+        em_data_t *data = em_data_from_reads(reads, n);
+        em_reads_free(reads, n);
+
+        em_arg_t ea = { data, amp_lens, em_config_default(), NULL };
+        ea.cfg.n_threads = 1;
+        snprintf(param, sizeof(param), "S=%d,reads=%d", S, n);
+        bench_run("em_fit", param, run_fit, &ea, n, "reads/s");
+
+        /* One nested refit per species, so far slower: skip the largest */
+        if (n <= 10000) {
+            ea.fit = em_fit_data(data, S, M, amp_lens, &ea.cfg);
+            bench_run("em_lrt_full", param, run_lrt, &ea, n, "reads/s");
+            em_result_destroy(ea.fit);
+        }
+        em_data_destroy(data);
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * bench_index.c — Index loading and read classification across database
+ * widths.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "refdb.h"
+#include "index.h"
+#include "classify.h"
+#include "simulate.h"
+#include "utils.h"
+#include "bench.h"
+
+#define N_MARKERS 12
+#define AMP_LEN 120
+#define N_READS 2000
+
+/* S species over N_MARKERS markers of random AMP_LEN bp amplicons, one
+ * species in seven haram */
+static halal_refdb_t *build_wide_db(int S) {
+    halal_refdb_t *db = refdb_create();
+    char name[32];
+    for (int m = 0; m < N_MARKERS; m++) {
+        snprintf(name, sizeof(name), "MK%d", m);
+        refdb_add_marker(db, name, NULL, NULL);
+    }
+    for (int s = 0; s < S; s++) {
+        snprintf(name, sizeof(name), "Species_%d", s);
+        refdb_add_species(db, name, name, s % 7 == 0 ? HARAM : HALAL, 1.0, 1.0);
+    }
+    for (int s = 0; s < S; s++)
+        for (int m = 0; m < N_MARKERS; m++) {
+            char *seq = bench_random_seq(AMP_LEN, (uint64_t)(s * N_MARKERS + m + 1));
+            refdb_add_marker_ref(db, s, m, seq, AMP_LEN);
+            free(seq);
+        }
+    return db;
+}
+
+static halal_refdb_t *make_db(int S) {
+    return S > 0 ? build_wide_db(S) : refdb_build_default();
+}
+
+typedef struct {
+    const char *path;
+} load_arg_t;
+
+static void run_load(void *arg, int64_t n) {
+    const load_arg_t *a = (const load_arg_t *)arg;
+    uint64_t acc = 0;
+    for (int64_t i = 0; i < n; i++) {
+        halal_index_t *idx = index_load(a->path);
+        if (!idx) { fprintf(stderr, "Error: cannot load %s\n", a->path); exit(1); }
+        acc += (uint64_t)idx->db->n_species;
+        index_destroy(idx);
+    }
+    bench_sink = acc;
+}
+
+typedef struct {
+    const halal_index_t *idx;
+    const char **seqs;
+    const int *lens;
+    int n;
+    classify_opts_t opts;
+} classify_arg_t;
+
+/* One batch of n reads per op */
+static void run_classify(void *arg, int64_t n) {
+    const classify_arg_t *a = (const classify_arg_t *)arg;
+    uint64_t acc = 0;
+    for (int64_t i = 0; i < n; i++) {
+        classify_results_t *res = classify_reads(a->idx, a->seqs, a->lens, a->n, &a->opts);
+        acc += res->n_hits;
+        classify_results_free(res);
+    }
+    bench_sink = acc;
+}
+
+static long file_size(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return 0;
+    fseek(f, 0, SEEK_END);
+    long sz = ftell(f);
+    fclose(f);
+    return sz;
+}
+
+int main(void) {
+    hs_log_set_level(HS_LOG_WARN);
+    bench_header("bench_index");
+    const char *path = "/tmp/bench_halal_index.idx";
+    char param[32];
+
+    /* index_load: 0 stands for the built-in database */
+    int load_S[2] = { 0, 100 };
+    for (int i = 0; i < 2; i++) {
+        halal_index_t *idx = index_build(make_db(load_S[i]));
+        if (index_save(idx, path) != 0) { fprintf(stderr, "Error: cannot save %s\n", path); return 1; }
+        int S = idx->db->n_species;
+        index_destroy(idx);
+        long sz = file_size(path);
+        load_arg_t la = { path };
+        snprintf(param, sizeof(param), "S=%d,MB=%.2f", S, (double)sz / 1e6);
+        bench_run("index_load", param, run_load, &la, (double)sz / 1e6, "MB/s");
+    }
+    remove(path);
+
+    /* classify_reads on one thread: an even mixture of every species */
+    int cls_S[3] = { 12, 50, 200 };
+    for (int i = 0; i < 3; i++) {
+        int S = cls_S[i];
+        halal_index_t *idx = index_build(build_wide_db(S));
+        double *comp = (double *)hs_malloc((size_t)S * sizeof(double));
+        for (int s = 0; s < S; s++) comp[s] = 1.0 / S;
+        sim_config_t sc = { 0 };
+        sc.composition = comp;
+        sc.n_species = S;
+        sc.reads_per_marker = N_READS / N_MARKERS + 1;
+        sc.error_rate = 0.001;
+        sc.read_length = AMP_LEN;
+        sc.seed = 42;
+        sim_result_t *sr = simulate_mixture(&sc, idx->db);
+        int n = sr->n_reads < N_READS ? sr->n_reads : N_READS;
+
+        classify_arg_t ca = { idx, (const char **)sr->reads, sr->read_lengths, n,
+                              classify_opts_default() };
+        ca.opts.n_threads = 1;
+        snprintf(param, sizeof(param), "S=%d,reads=%d", S, n);
+        bench_run("classify_reads", param, run_classify, &ca, n, "reads/s");
+
+        sim_result_destroy(sr);
+        free(comp);
+        index_destroy(idx);
+    }
+    return 0;
+}
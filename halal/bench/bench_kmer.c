@@ -0,0 +1,150 @@
+/*
+ * bench_kmer.c — k-mer hashing, FracMinHash and k-mer set kernels.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "kmer.h"
+#include "utils.h"
+#include "bench.h"
+
+#define SEQ_LEN 16384           /* about one mitochondrial genome */
+#define READ_LEN 150
+#define K 21
+
+typedef struct {
+    const char *seq;
+    int len, k;
+} seq_arg_t;
+
+/* One k-mer per op, hashed from scratch at successive offsets */
+static void run_canonical(void *arg, int64_t n) {
+    const seq_arg_t *a = (const seq_arg_t *)arg;
+    int span = a->len - a->k + 1;
+    uint64_t acc = 0;
+    for (int64_t i = 0; i < n; i++) acc ^= hs_kmer_canonical(a->seq + i % span, a->k);
+    bench_sink = acc;
+}
+
+/* One read per op through the rolling iterator */
+static void run_rolling(void *arg, int64_t n) {
+    const seq_arg_t *a = (const seq_arg_t *)arg;
+    int starts = a->len - READ_LEN + 1;
+    uint64_t acc = 0, h;
+    for (int64_t i = 0; i < n; i++) {
+        hs_kmer_iter_t it;
+        hs_kmer_iter_init(&it, a->seq + (i * 97) % starts, READ_LEN, a->k);
+        while (hs_kmer_iter_next(&it, &h, NULL)) acc ^= h;
+    }
+    bench_sink = acc;
+}
+
+typedef struct {
+    fmh_sketch_t *sk;
+    const uint64_t *unsorted;
+    int n;
+} sort_arg_t;
+
+/* Refill the sketch with the same unsorted hashes and sort it */
+static void run_fmh_sort(void *arg, int64_t n) {
+    sort_arg_t *a = (sort_arg_t *)arg;
+    for (int64_t i = 0; i < n; i++) {
+        memcpy(a->sk->hashes, a->unsorted, (size_t)a->n * sizeof(uint64_t));
+        a->sk->n = a->n;
+        fmh_sort(a->sk);
+    }
+    bench_sink = (uint64_t)a->sk->n;
+}
+
+typedef struct {
+    const fmh_sketch_t *query, *ref;
+} cont_arg_t;
+
+static void run_fmh_containment(void *arg, int64_t n) {
+    const cont_arg_t *a = (const cont_arg_t *)arg;
+    double acc = 0.0;
+    for (int64_t i = 0; i < n; i++) acc += fmh_containment(a->query, a->ref);
+    bench_sink = (uint64_t)acc;
+}
+
+typedef struct {
+    const char *reads;          /* read i starts at reads + i * 97 */
+    int starts, k;
+    const kmer_set_t *ref;
+} set_arg_t;
+
+static void run_set_containment(void *arg, int64_t n) {
+    const set_arg_t *a = (const set_arg_t *)arg;
+    double acc = 0.0;
+    for (int64_t i = 0; i < n; i++)
+        acc += kmer_set_containment(a->reads + (i * 97) % a->starts, READ_LEN, a->ref, a->k);
+    bench_sink = (uint64_t)(acc * 1000.0);
+}
+
+/* Sorted sketch of every hash below scale of seq */
+static fmh_sketch_t *sketch_of(const char *seq, int len, double scale) {
+    fmh_sketch_t *sk = fmh_init(K, scale);
+    fmh_add_seq(sk, seq, len);
+    fmh_sort(sk);
+    return sk;
+}
+
+int main(void) {
+    hs_log_set_level(HS_LOG_WARN);
+    bench_header("bench_kmer");
+    char *seq = bench_random_seq(SEQ_LEN, 1);
+    char param[32];
+
+    /* Hashing */
+    seq_arg_t sa = { seq, SEQ_LEN, K };
+    bench_run("hs_kmer_canonical", "k=21", run_canonical, &sa, 1.0, "kmers/s");
+    int ks[3] = { 15, 21, 31 };
+    for (int i = 0; i < 3; i++) {
+        sa.k = ks[i];
+        snprintf(param, sizeof(param), "k=%d,len=%d", ks[i], READ_LEN);
+        bench_run("kmer_iter_rolling", param, run_rolling, &sa, READ_LEN, "bases/s");
+    }
+
+    /* fmh_sort on random hashes */
+    int sizes[3] = { 1000, 10000, 100000 };
+    for (int i = 0; i < 3; i++) {
+        hs_rng_t rng;
+        hs_rng_seed(&rng, 2 + (uint64_t)i);
+        fmh_sketch_t *sk = fmh_init(K, 1.0);
+        for (int j = 0; j < sizes[i]; j++) fmh_add_hash(sk, hs_rng_next(&rng));
+        uint64_t *unsorted = (uint64_t *)hs_malloc((size_t)sk->n * sizeof(uint64_t));
+        memcpy(unsorted, sk->hashes, (size_t)sk->n * sizeof(uint64_t));
+        sort_arg_t so = { sk, unsorted, sk->n };
+        snprintf(param, sizeof(param), "n=%d", sizes[i]);
+        bench_run("fmh_sort", param, run_fmh_sort, &so, sizes[i], "hashes/s");
+        free(unsorted);
+        fmh_destroy(sk);
+    }
+
+    /* fmh_containment: a read's sketch, or a whole reference's, against
+     * a reference sharing half of its sequence */
+    char *other = bench_random_seq(SEQ_LEN, 3);
+    memcpy(other, seq, SEQ_LEN / 2);
+    fmh_sketch_t *ref = sketch_of(other, SEQ_LEN, 1.0);
+    int qlens[2] = { READ_LEN, SEQ_LEN };
+    for (int i = 0; i < 2; i++) {
+        fmh_sketch_t *q = sketch_of(seq, qlens[i], 1.0);
+        cont_arg_t ca = { q, ref };
+        snprintf(param, sizeof(param), "query=%d,ref=%d", q->n, ref->n);
+        bench_run("fmh_containment", param, run_fmh_containment, &ca, 1.0, "pairs/s");
+        fmh_destroy(q);
+    }
+    fmh_destroy(ref);
+
+    /* kmer_set_containment: 150 bp reads against a reference set */
+    kmer_set_t *set = kmer_set_init(K);
+    kmer_set_add_seq(set, other, SEQ_LEN);
+    set_arg_t ka = { seq, SEQ_LEN - READ_LEN + 1, K, set };
+    snprintf(param, sizeof(param), "len=%d,ref=%d", READ_LEN, SEQ_LEN);
+    bench_run("kmer_set_containment", param, run_set_containment, &ka, 1.0, "reads/s");
+    kmer_set_destroy(set);
+
+    free(other);
+    free(seq);
+    return 0;
+}
@@ -2,7 +2,9 @@
  * gui_analysis.c — Background analysis pipeline for HalalSeq GUI.
  *
  * Mirrors the logic in src/main.c cmd_run(), but runs on an SDL thread
- * and reports incremental state/progress to the GUI.
+ * and reports incremental state/progress to the GUI.  Reads are streamed
+ * through the online pipeline with looks that never stop it early, so
+ * each look only refreshes the interim estimates.
  */
 #include "gui_analysis.h"
 #include "utils.h"
@@ -12,10 +14,15 @@
 #include "classify.h"
 #include "em.h"
 #include "report.h"
+#include "pipeline.h"
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define ANALYSIS_THRESHOLD  0.001
+#define ANALYSIS_LOOK_EVERY 50000     /* reads between interim estimates */
+
 /* ------------------------------------------------------------------ */
 /* State labels                                                        */
 /* ------------------------------------------------------------------ */
@@ -28,13 +35,38 @@ static const char *state_labels[] = {
     [ANALYSIS_GENERATING_REPORT] = "Generating report...",
     [ANALYSIS_DONE]              = "Done",
     [ANALYSIS_ERROR]             = "Error",
+    [ANALYSIS_CANCELLED]         = "Cancelled",
 };
 
 const char *analysis_state_label(analysis_state_t s) {
-    if (s < 0 || s > ANALYSIS_ERROR) return "Unknown";
+    if (s < 0 || s > ANALYSIS_CANCELLED) return "Unknown";
     return state_labels[s];
 }
 
+/* ------------------------------------------------------------------ */
+/* Interim estimates                                                   */
+/* ------------------------------------------------------------------ */
+typedef struct {
+    analysis_context_t *ctx;
+    const halal_index_t *idx;
+} interim_arg_t;
+
+static void set_interim(analysis_context_t *ctx, halal_report_t *r) {
+    SDL_LockMutex(ctx->interim_lock);
+    halal_report_t *old = ctx->interim;
+    ctx->interim = r;
+    SDL_UnlockMutex(ctx->interim_lock);
+    if (old) report_destroy(old);
+}
+
+/* Online look callback: publish the fit to the reads so far */
+static void publish_interim(const em_result_t *em,
+                            const classify_summary_t *summary, void *arg) {
+    interim_arg_t *ia = (interim_arg_t *)arg;
+    set_interim(ia->ctx, report_generate_summary(em, ia->idx->db, summary,
+                                                 ANALYSIS_THRESHOLD));
+}
+
 /* ------------------------------------------------------------------ */
 /* Worker thread                                                       */
 /* ------------------------------------------------------------------ */
@@ -51,43 +83,23 @@ static int analysis_worker(void *data) {
         return 1;
     }
 
-    /* 2. Read FASTQ ------------------------------------------------- */
-    ctx->state = ANALYSIS_READING_FASTQ;
-    char **seqs = NULL;
-    char **names = NULL;
-    int  *lens = NULL;
-    int   n_reads = 0;
-
-    if (hs_fasta_read_all(ctx->fastq_path, &seqs, &names, &lens, &n_reads) < 0) {
+    /* 2-3. Stream FASTQ through classification ------------------- */
+    ctx->state = ANALYSIS_CLASSIFYING;
+    hs_seqfile_t *sf = hs_seqfile_open(ctx->fastq_path);
+    if (!sf) {
         snprintf(ctx->error_msg, sizeof(ctx->error_msg),
                  "Failed to read: %s", ctx->fastq_path);
         index_destroy(idx);
         ctx->state = ANALYSIS_ERROR;
         return 1;
     }
-    ctx->progress_total = n_reads;
-    ctx->progress_reads = n_reads;  /* reads are already loaded */
-
-    /* 3. Classify --------------------------------------------------- */
-    ctx->state = ANALYSIS_CLASSIFYING;
     classify_opts_t copts = classify_opts_default();
-    read_result_t *results = classify_reads(idx, (const char **)seqs, lens,
-                                             n_reads, &copts);
-    if (!results) {
-        snprintf(ctx->error_msg, sizeof(ctx->error_msg),
-                 "Classification failed");
-        hs_fasta_free_all(seqs, names, lens, n_reads);
-        index_destroy(idx);
-        ctx->state = ANALYSIS_ERROR;
-        return 1;
-    }
-
-    /* 4. EM --------------------------------------------------------- */
-    ctx->state = ANALYSIS_RUNNING_EM;
-    int n_em_reads = 0;
-    em_read_t *em_reads = em_reads_from_classify(results, n_reads, &n_em_reads);
+    copts.n_threads = ctx->n_threads;
+    copts.cancel = &ctx->cancel;
 
     em_config_t ecfg = em_config_default();
+    ecfg.n_threads = ctx->n_threads;
+    ecfg.cancel = &ctx->cancel;
 
     /* Mito copy number priors */
     double *mito_cn = (double *)hs_malloc(
@@ -96,28 +108,58 @@ static int analysis_worker(void *data) {
         mito_cn[s] = idx->db->species[s].mito_copy_number;
     ecfg.mito_copy_numbers = mito_cn;
 
+    interim_arg_t ia = { ctx, idx };
+    pipeline_online_t online = pipeline_online_default(&ecfg, ANALYSIS_THRESHOLD);
+    online.check_every = online.min_reads = ANALYSIS_LOOK_EVERY;
+    online.stable_looks = INT_MAX;
+    online.on_look = publish_interim;
+    online.look_arg = &ia;
+
+    em_read_t *em_reads = NULL;
+    int n_em_reads = 0;
+    classify_summary_t *summary =
+        (classify_summary_t *)hs_calloc(1, sizeof(classify_summary_t));
+    pipeline_classify_stream_online(idx, sf, &copts, HS_STREAM_BATCH, &online,
+                                    &em_reads, &n_em_reads, summary,
+                                    &ctx->progress_reads, NULL);
+    hs_seqfile_close(sf);
+    int n_reads = summary->total_reads;
+    ctx->progress_total = n_reads;
+
+    /* 4. EM --------------------------------------------------------- */
+    ctx->state = ANALYSIS_RUNNING_EM;
+
     /* Amplicon lengths */
-    int *amp_lens = (int *)hs_calloc(
-        (size_t)(idx->db->n_species * idx->db->n_markers), sizeof(int));
-    for (int i = 0; i < idx->db->n_marker_refs; i++) {
-        int si = idx->db->markers[i].species_idx;
-        int mi = idx->db->markers[i].marker_idx;
-        amp_lens[si * idx->db->n_markers + mi] =
-            idx->db->markers[i].amplicon_length;
-    }
+    const int *amp_lens = idx->db->amp_lens;
 
     em_result_t *em = NULL;
-    if (n_em_reads > 0) {
-        em = em_fit(em_reads, n_em_reads,
-                    idx->db->n_species, idx->db->n_markers,
-                    amp_lens, &ecfg);
+    if (n_em_reads > 0 && !ctx->cancel) {
+        em_data_t *em_data = em_data_from_reads(em_reads, n_em_reads);
+        em_reads_free(em_reads, n_em_reads);
+        em_reads = NULL;
+        n_em_reads = 0;
+        em = em_fit_data(em_data,
+                         idx->db->n_species, idx->db->n_markers,
+                         amp_lens, &ecfg);
+        em_data_destroy(em_data);
+    }
+
+    if (ctx->cancel) {
+        if (em) em_result_destroy(em);
+        em_reads_free(em_reads, n_em_reads);
+        classify_summary_free(summary);
+        free(summary);
+        free(mito_cn);
+        index_destroy(idx);
+        ctx->state = ANALYSIS_CANCELLED;
+        return 1;
     }
 
     /* 5. Report ----------------------------------------------------- */
     ctx->state = ANALYSIS_GENERATING_REPORT;
     halal_report_t *report = NULL;
     if (em) {
-        report = report_generate(em, idx->db, results, n_reads, 0.001);
+        report = report_generate_summary(em, idx->db, summary, ANALYSIS_THRESHOLD);
     } else {
         /* No classified reads — generate a minimal report */
         report = (halal_report_t *)hs_calloc(1, sizeof(halal_report_t));
@@ -131,10 +173,9 @@ static int analysis_worker(void *data) {
     /* Cleanup intermediaries */
     if (em) em_result_destroy(em);
     em_reads_free(em_reads, n_em_reads);
-    classify_results_free(results, n_reads);
-    free(amp_lens);
+    classify_summary_free(summary);
+    free(summary);
     free(mito_cn);
-    hs_fasta_free_all(seqs, names, lens, n_reads);
     index_destroy(idx);
 
     /* Publish result */
@@ -149,6 +190,8 @@ static int analysis_worker(void *data) {
 void analysis_init(analysis_context_t *ctx) {
     memset(ctx, 0, sizeof(*ctx));
     ctx->state = ANALYSIS_IDLE;
+    ctx->n_threads = 0;               /* GUI users get every core */
+    ctx->interim_lock = SDL_CreateMutex();
 }
 
 int analysis_start(analysis_context_t *ctx) {
@@ -159,6 +202,7 @@ int analysis_start(analysis_context_t *ctx) {
     ctx->report       = NULL;
     ctx->progress_reads = 0;
     ctx->progress_total = 0;
+    ctx->cancel         = 0;
     ctx->error_msg[0]   = '\0';
 
     ctx->thread = SDL_CreateThread(analysis_worker, "analysis", ctx);
@@ -171,8 +215,13 @@ int analysis_start(analysis_context_t *ctx) {
     return 0;
 }
 
+void analysis_cancel(analysis_context_t *ctx) {
+    ctx->cancel = 1;
+}
+
 void analysis_cleanup(analysis_context_t *ctx) {
     if (ctx->thread) {
+        analysis_cancel(ctx);
         int status;
         SDL_WaitThread(ctx->thread, &status);
         ctx->thread = NULL;
@@ -181,4 +230,5 @@ void analysis_cleanup(analysis_context_t *ctx) {
         report_destroy(ctx->report);
         ctx->report = NULL;
     }
+    set_interim(ctx, NULL);
 }
@@ -3,7 +3,9 @@
  *
  * Runs index loading, FASTQ reading, classification, EM, and report
  * generation on a background thread.  The main (GUI) thread polls the
- * state/progress fields to update the UI.
+ * state/progress fields to update the UI, can show interim estimates
+ * while reads stream in, and can cancel the run between batches or EM
+ * iterations.
  */
 #ifndef HALALSEQ_GUI_ANALYSIS_H
 #define HALALSEQ_GUI_ANALYSIS_H
@@ -19,20 +21,27 @@ typedef enum {
     ANALYSIS_RUNNING_EM,
     ANALYSIS_GENERATING_REPORT,
     ANALYSIS_DONE,
-    ANALYSIS_ERROR
+    ANALYSIS_ERROR,
+    ANALYSIS_CANCELLED
 } analysis_state_t;
 
 typedef struct {
     /* ---- inputs (set by GUI thread before analysis_start) ---- */
     char fastq_path[1024];
     char index_path[1024];
+    int  n_threads;                   /* classification threads (0 = all)  */
 
     /* ---- observable state (read by GUI thread, written by worker) ---- */
     volatile analysis_state_t state;
     volatile int progress_reads;      /* reads processed so far            */
     volatile int progress_total;      /* total reads (0 until known)       */
+    volatile int cancel;              /* set by analysis_cancel            */
     char error_msg[256];
 
+    /* ---- interim estimates (take interim_lock to read) ---- */
+    halal_report_t *interim;          /* last look at the reads so far     */
+    SDL_mutex *interim_lock;
+
     /* ---- output (valid once state == ANALYSIS_DONE) ---- */
     halal_report_t *report;           /* NULL until done                   */
 
@@ -47,7 +56,12 @@ void analysis_init(analysis_context_t *ctx);
    must already be set.  Returns 0 on success, -1 on error. */
 int  analysis_start(analysis_context_t *ctx);
 
-/* Free any resources held by a previous run (report, thread handle).
+/* Ask a running analysis to stop; it ends in ANALYSIS_CANCELLED after
+   the current batch or EM iteration. */
+void analysis_cancel(analysis_context_t *ctx);
+
+/* Free any resources held by a previous run (report, interim estimates,
+   thread handle), cancelling it first if it is still running.
    Safe to call multiple times or on a freshly-init'd context. */
 void analysis_cleanup(analysis_context_t *ctx);
 
@@ -238,21 +238,8 @@ static halal_refdb_t *load_db_info(const char *index_path) {
     if (!index_path[0]) return NULL;
     halal_index_t *idx = index_load(index_path);
     if (!idx) return NULL;
-    /* Steal the db pointer, then free index parts manually
-       (index_destroy dereferences idx->db, so we can't NULL it) */
-    halal_refdb_t *db = idx->db;
-    int S = db->n_species;
-    int M = db->n_markers;
-    for (int s = 0; s < S; s++) fmh_destroy(idx->coarse[s]);
-    free(idx->coarse);
-    for (int m = 0; m < M; m++) {
-        for (int s = 0; s < S; s++) kmer_set_destroy(idx->fine[m][s]);
-        free(idx->fine[m]);
-    }
-    free(idx->fine);
-    for (int m = 0; m < M; m++) kmer_set_destroy(idx->primer_index[m]);
-    free(idx->primer_index);
-    free(idx);  /* don't call refdb_destroy — we're keeping db */
+    /* Keep the db, free everything else */
+    halal_refdb_t *db = index_release_db(idx);
     return db;
 }
 
@@ -1422,7 +1409,8 @@ static void draw_gui(struct nk_context *ctx, gui_state_t *st,
             int can_run = (analysis->n_fastq_files > 0 &&
                           (analysis->state == ANALYSIS_IDLE ||
                            analysis->state == ANALYSIS_DONE ||
-                           analysis->state == ANALYSIS_ERROR) &&
+                           analysis->state == ANALYSIS_ERROR ||
+                           analysis->state == ANALYSIS_CANCELLED) &&
                           st->index_path[0]);
             if (can_run) {
                 struct nk_style_button green = ctx->style.button;
@@ -1438,6 +1426,10 @@ static void draw_gui(struct nk_context *ctx, gui_state_t *st,
                              st->index_path);
                     analysis_start(analysis);
                 }
+            } else if (analysis->state > ANALYSIS_IDLE &&
+                       analysis->state < ANALYSIS_DONE) {
+                if (nk_button_label(ctx, analysis->cancel ? "Cancelling..." : "Cancel"))
+                    analysis_cancel(analysis);
             } else {
                 struct nk_style_button grey = ctx->style.button;
                 grey.normal = nk_style_item_color(nk_rgb(80, 80, 80));
@@ -1478,11 +1470,12 @@ static void draw_gui(struct nk_context *ctx, gui_state_t *st,
                 case ANALYSIS_CLASSIFYING:
                     if (ns > 1)
                         snprintf(status_buf, sizeof(status_buf),
-                                 "Sample %d/%d: Identifying species...",
-                                 si + 1, ns);
+                                 "Sample %d/%d: Identifying species (%d reads)...",
+                                 si + 1, ns, analysis->progress_reads);
                     else
                         snprintf(status_buf, sizeof(status_buf),
-                                 "Identifying species...");
+                                 "Identifying species (%d reads)...",
+                                 analysis->progress_reads);
                     status_text = status_buf;
                     break;
                 case ANALYSIS_RUNNING_EM:
@@ -1507,6 +1500,7 @@ static void draw_gui(struct nk_context *ctx, gui_state_t *st,
                     break;
                 case ANALYSIS_DONE:              status_text = "Analysis complete"; break;
                 case ANALYSIS_ERROR:             status_text = "Error occurred"; break;
+                case ANALYSIS_CANCELLED:         status_text = "Analysis cancelled"; break;
                 default:                         status_text = ""; break;
             }
             nk_label(ctx, status_text, NK_TEXT_LEFT);
@@ -1528,6 +1522,21 @@ static void draw_gui(struct nk_context *ctx, gui_state_t *st,
             nk_progress(ctx, &pv, 100, NK_FIXED);
         }
 
+        /* Interim estimate while reads are still streaming in */
+        if (analysis->state == ANALYSIS_CLASSIFYING) {
+            SDL_LockMutex(analysis->interim_lock);
+            const halal_report_t *ir = analysis->interim;
+            if (ir) {
+                char head[96];
+                snprintf(head, sizeof(head), "Interim estimate (%d reads):",
+                         ir->total_reads);
+                nk_layout_row_dynamic(ctx, ROW_LABEL, 1);
+                nk_label(ctx, head, NK_TEXT_LEFT);
+                draw_species_bar(ctx, ir);
+            }
+            SDL_UnlockMutex(analysis->interim_lock);
+        }
+
         /* Stacked species bar + legend (after results) */
         {
             halal_report_t *sel_rpt = NULL;
@@ -1,4 +1,5 @@
 #include "classify.h"
+#include "parallel.h"
 #include "utils.h"
 #include <stdlib.h>
 #include <string.h>
@@ -9,6 +10,13 @@ classify_opts_t classify_opts_default(void) {
         .coarse_threshold = 0.05,
         .is_nanopore = 0,
         .n_threads = 1,
+        .dereplicate = 1,
+        .primer_window = PRIMER_DEFAULT_WINDOW,
+        .primer_mismatches = PRIMER_DEFAULT_MISMATCHES,
+        .trim_primers = 1,
+        .max_hits = 0,
+        .eq_class_step = 0.0,
+        .syncmer_s = 0,
     };
 }
 
@@ -18,66 +26,211 @@ classify_opts_t classify_opts_nanopore(void) {
         .coarse_threshold = 0.02,
         .is_nanopore = 1,
         .n_threads = 1,
+        .dereplicate = 1,
+        .primer_window = 150,     /* adapters and barcodes precede the primer */
+        .primer_mismatches = 5,
+        .trim_primers = 1,
+        .max_hits = 0,
+        .eq_class_step = 0.0,
+        .syncmer_s = HS_SYNCMER_S, /* long reads: score about 1 k-mer in 11 */
     };
 }
 
-static read_result_t classify_one(const halal_index_t *idx,
-                                   const char *seq, int len,
-                                   const classify_opts_t *opts) {
-    read_result_t res;
-    memset(&res, 0, sizeof(res));
-    res.marker_idx = -1;
+/* Per-thread scratch reused across reads.  Hits are appended to the
+ * worker's arena, which only grows while it is short of the batch's
+ * needs, so steady state makes no per-read allocation.  Reads are
+ * classified in groups of CLASSIFY_GROUP, each read in its own slot g,
+ * so the group's fine lookups can be batched. */
+#define CLASSIFY_GROUP INDEX_FINE_BATCH
+
+typedef struct {
+    kmer_profile_t qp[CLASSIFY_GROUP];
+    int marker[CLASSIFY_GROUP];               /* by slot: detected marker */
+    char *is_candidate;        /* [CLASSIFY_GROUP * S] */
+    double *coarse;            /* [S] */
+    double *fine;              /* [M * S] */
+    int *fine_counts;          /* [CLASSIFY_GROUP * M * S] */
+    species_hit_t *hits;       /* [hits_cap] hit arena */
+    size_t n_hits, hits_cap;
+    int timed;                 /* accumulate stage_ms (classify_reads_timed) */
+    double stage_ms[4];        /* primer, k-mer, coarse, fine */
+    uint64_t count[8];         /* COUNT_* */
+    char pad[64];              /* keeps workers' counters off each other's cache lines */
+} classify_ws_t;
+
+enum { STAGE_PRIMER, STAGE_KMER, STAGE_COARSE, STAGE_FINE };
+enum {
+    COUNT_SCORED, COUNT_PRIMER, COUNT_PREFILTERED, COUNT_SHORT,
+    COUNT_COARSE_REJECTED, COUNT_CANDIDATES, COUNT_FINE_KMERS, COUNT_HITS,
+};
+
+/* Charge the time since t to a stage; returns the new start time */
+static inline double ws_lap(classify_ws_t *ws, int stage, double t) {
+    if (!ws->timed) return 0.0;
+    double now = hs_clock_ms();
+    ws->stage_ms[stage] += now - t;
+    return now;
+}
+
+static void classify_ws_init(classify_ws_t *ws, int S, int M) {
+    size_t s = S > 0 ? (size_t)S : 1;
+    size_t ms = (size_t)(M > 0 ? M : 1) * s;
+    for (int g = 0; g < CLASSIFY_GROUP; g++) kmer_profile_init(&ws->qp[g]);
+    ws->is_candidate = (char *)hs_malloc(CLASSIFY_GROUP * s);
+    ws->coarse = (double *)hs_malloc(s * sizeof(double));
+    ws->fine = (double *)hs_malloc(ms * sizeof(double));
+    ws->fine_counts = (int *)hs_malloc(CLASSIFY_GROUP * ms * sizeof(int));
+    ws->hits_cap = 4 * s;
+    ws->hits = (species_hit_t *)hs_malloc(ws->hits_cap * sizeof(species_hit_t));
+    ws->n_hits = 0;
+}
+
+static void classify_ws_free(classify_ws_t *ws) {
+    for (int g = 0; g < CLASSIFY_GROUP; g++) kmer_profile_free(&ws->qp[g]);
+    free(ws->is_candidate);
+    free(ws->coarse);
+    free(ws->fine);
+    free(ws->fine_counts);
+    free(ws->hits);
+}
+
+/* Best first; ties keep the lower species index */
+static int cmp_hit_score(const void *a, const void *b) {
+    const species_hit_t *x = (const species_hit_t *)a, *y = (const species_hit_t *)b;
+    if (x->containment != y->containment) return x->containment < y->containment ? 1 : -1;
+    return x->species_idx - y->species_idx;
+}
+
+static int cmp_hit_species(const void *a, const void *b) {
+    return ((const species_hit_t *)a)->species_idx - ((const species_hit_t *)b)->species_idx;
+}
+
+/* Reduce hits to the k best, returned in species order like the full list */
+static int keep_top_hits(species_hit_t *hits, int n, int k) {
+    qsort(hits, (size_t)n, sizeof(species_hit_t), cmp_hit_score);
+    qsort(hits, (size_t)k, sizeof(species_hit_t), cmp_hit_species);
+    return k;
+}
+
+/* Steps 1-2 of classifying one read in slot g; returns 1 if it goes on
+ * to fine scoring (classify_finish), 0 if *res is already final */
+static int classify_prepare(const halal_index_t *idx,
+                            const char *seq, int len,
+                            const uint64_t *packed, const uint64_t *nmask,
+                            const classify_opts_t *opts,
+                            classify_ws_t *ws, int g, read_result_t *res) {
+    memset(res, 0, sizeof(*res));
+    res->marker_idx = -1;
 
     int S = idx->db->n_species;
-    int M = idx->db->n_markers;
+    kmer_profile_t *qp = &ws->qp[g];
+    double t = ws->timed ? hs_clock_ms() : 0.0;
+
+    /* Step 1: Detect marker from a primer at either end, then score only
+     * the insert so primer k-mers do not inflate containment */
+    primer_hit_t ph;
+    int marker = primer_scan(idx->primers, seq, len, opts->primer_window,
+                             opts->primer_mismatches, &ph);
+    int off = 0;
+    if (opts->trim_primers && marker >= 0) {
+        off = ph.trim_start;
+        seq += ph.trim_start;
+        len = ph.trim_end - ph.trim_start;
+    }
+    ws->count[COUNT_SCORED]++;
+    ws->count[COUNT_PRIMER] += marker >= 0;
+    t = ws_lap(ws, STAGE_PRIMER, t);
+
+    /* Hash the read once per k; every query below reuses the profile */
+    kmer_profile_set_packed(qp, seq, len, packed, nmask, off);
+    t = ws_lap(ws, STAGE_KMER, t);
 
-    /* Step 1: Detect marker via primer matching */
-    int marker = index_detect_marker(idx, seq, len);
+    /* Off-target reads (host, plant, primer dimers) are dropped when too
+     * few of their k-mers are in any reference to reach min_containment;
+     * the filter has no false negatives, so no hit is lost */
+    if (idx->fine_filter) {
+        int n;
+        const uint64_t *h = index_fine_hashes(idx, qp, opts->syncmer_s, &n);
+        if (!kmer_bloom_may_reach(idx->fine_filter, h, n, opts->min_containment)) {
+            ws->count[COUNT_PREFILTERED]++;
+            ws_lap(ws, STAGE_COARSE, t);
+            return 0;
+        }
+    }
 
     /* Step 2: Coarse screen -- get candidate species.
      * For short reads (amplicon data), the FracMinHash sketch has too few
      * hashes to be reliable. Skip coarse screening and try all species. */
-    int *is_candidate = (int *)hs_calloc((size_t)S, sizeof(int));
+    char *is_candidate = ws->is_candidate + (size_t)g * (size_t)S;
     int n_candidates = 0;
     int n_expected_hashes = (int)((double)(len - idx->coarse_k + 1) * idx->coarse_scale);
     if (n_expected_hashes <= 2) {
         /* Short read: skip coarse, all species are candidates */
-        for (int s = 0; s < S; s++) is_candidate[s] = 1;
+        memset(is_candidate, 1, (size_t)S);
         n_candidates = S;
+        ws->count[COUNT_SHORT]++;
     } else {
-        double *coarse_scores = (double *)hs_calloc((size_t)S, sizeof(double));
-        index_query_coarse(idx, seq, len, coarse_scores, S);
+        double *coarse_scores = ws->coarse;
+        index_query_coarse_profile(idx, qp, coarse_scores, S);
         for (int s = 0; s < S; s++) {
-            if (coarse_scores[s] >= opts->coarse_threshold) {
-                is_candidate[s] = 1;
-                n_candidates++;
-            }
+            is_candidate[s] = coarse_scores[s] >= opts->coarse_threshold;
+            n_candidates += is_candidate[s];
         }
-        free(coarse_scores);
         if (n_candidates == 0) {
-            free(is_candidate);
-            return res;
+            ws->count[COUNT_COARSE_REJECTED]++;
+            ws_lap(ws, STAGE_COARSE, t);
+            return 0;
         }
     }
+    ws_lap(ws, STAGE_COARSE, t);
+    ws->count[COUNT_CANDIDATES] += (uint64_t)n_candidates;
+    ws->marker[g] = marker;
+    return 1;
+}
+
+/* Step 3 for the read in slot g, once the posting table has been counted
+ * for it (index_count_fine_batch), appending its hits to ws->hits;
+ * res->offset indexes that arena */
+static void classify_finish(const halal_index_t *idx, const classify_opts_t *opts,
+                            classify_ws_t *ws, int g, read_result_t *res) {
+    int S = idx->db->n_species;
+    int M = idx->db->n_markers;
+    kmer_profile_t *qp = &ws->qp[g];
+    const char *is_candidate = ws->is_candidate + (size_t)g * (size_t)S;
+    int marker = ws->marker[g];
+    double t = ws->timed ? hs_clock_ms() : 0.0;
 
-    /* Step 3: Fine resolution for candidates */
-    species_hit_t *hits = (species_hit_t *)hs_malloc((size_t)S * sizeof(species_hit_t));
+    /* Fine resolution for candidates (one posting-table pass scores every
+     * marker x species; without one, hopeless references are abandoned
+     * once min_containment is out of reach) */
+    double *fine = ws->fine;
+    index_query_fine_counted(idx, qp, is_candidate, marker, opts->min_containment,
+                             opts->syncmer_s, fine,
+                             ws->fine_counts + (size_t)g * (size_t)M * (size_t)S);
+    int n_fine_kmers;
+    index_fine_hashes(idx, qp, opts->syncmer_s, &n_fine_kmers);
+    ws->count[COUNT_FINE_KMERS] += (uint64_t)n_fine_kmers;
+    if (ws->n_hits + (size_t)S > ws->hits_cap) {
+        while (ws->n_hits + (size_t)S > ws->hits_cap) ws->hits_cap *= 2;
+        ws->hits = (species_hit_t *)hs_realloc(ws->hits,
+                                               ws->hits_cap * sizeof(species_hit_t));
+    }
+    species_hit_t *hits = ws->hits + ws->n_hits;
     int n_hits = 0;
 
     for (int s = 0; s < S; s++) {
         if (!is_candidate[s]) continue;
 
         double best_fine = 0.0;
-        int best_marker = marker;
 
         if (marker >= 0) {
             /* Marker known: query fine only for that marker */
-            best_fine = index_query_fine(idx, seq, len, marker, s);
+            best_fine = fine[marker * S + s];
         } else {
             /* Marker unknown: try all markers, take best */
             for (int m = 0; m < M; m++) {
-                double f = index_query_fine(idx, seq, len, m, s);
-                if (f > best_fine) { best_fine = f; best_marker = m; }
+                double f = fine[m * S + s];
+                if (f > best_fine) best_fine = f;
             }
         }
 
@@ -85,55 +238,303 @@ static read_result_t classify_one(const halal_index_t *idx,
             hits[n_hits].species_idx = s;
             hits[n_hits].containment = best_fine;
             n_hits++;
-            if (marker < 0) marker = best_marker;
         }
     }
 
-    free(is_candidate);
+    if (n_hits > 0) {
+        if (opts->max_hits > 0 && n_hits > opts->max_hits)
+            n_hits = keep_top_hits(hits, n_hits, opts->max_hits);
+        /* Marker unknown: the first surviving hit's best marker, chosen
+         * after pruning so it never comes from a dropped species */
+        if (marker < 0) {
+            double best_fine = 0.0;
+            for (int m = 0; m < M; m++) {
+                double f = fine[m * S + hits[0].species_idx];
+                if (f > best_fine) { best_fine = f; marker = m; }
+            }
+        }
+        res->marker_idx = marker;
+        res->n_hits = n_hits;
+        res->offset = (uint32_t)ws->n_hits;
+        ws->n_hits += (size_t)n_hits;
+        ws->count[COUNT_HITS] += (uint64_t)n_hits;
+    }
+    ws_lap(ws, STAGE_FINE, t);
+}
+
+/* --- Multithreaded batch classification ---
+ * Reads are independent, so workers pull chunks of CLASSIFY_CHUNK reads
+ * and write straight into their slots of the shared results array, with
+ * hits going to the worker's own arena.  Each chunk records where its
+ * hits landed; afterwards they are copied chunk by chunk into one
+ * exact-size arena in read order, so results do not depend on thread
+ * count. */
+#define CLASSIFY_CHUNK 256
+
+typedef struct {
+    int tid;                        /* worker that classified the chunk */
+    size_t start;                   /* its first hit in that worker's arena */
+} classify_chunk_t;
 
-    if (n_hits == 0) {
-        free(hits);
-        return res;
+typedef struct {
+    const halal_index_t *idx;
+    const char **seqs;
+    const int *lens;
+    const uint64_t *const *packed;  /* NULL: reads are packed as scored */
+    const uint64_t *const *nmasks;
+    const classify_opts_t *opts;
+    read_result_t *results;
+    classify_chunk_t *chunks;       /* [ceil(n_reads / CLASSIFY_CHUNK)] */
+    classify_ws_t *workspaces;      /* one per worker */
+} classify_job_t;
+
+/* Reads r0 .. r1 - 1 (at most CLASSIFY_GROUP): each is prepared in its
+ * slot, the fine lookups of those still in play are made in one batch,
+ * and they are finished in read order, so hits land as if classified
+ * one at a time */
+static void classify_group(classify_job_t *job, classify_ws_t *ws, int r0, int r1) {
+    const halal_index_t *idx = job->idx;
+    size_t cells = (size_t)idx->db->n_markers * (size_t)idx->db->n_species;
+    kmer_profile_t *qps[CLASSIFY_GROUP];
+    int *counts[CLASSIFY_GROUP];
+    int slots[CLASSIFY_GROUP], n = 0;
+    for (int r = r0; r < r1; r++) {
+        int g = r - r0;
+        if (!classify_prepare(idx, job->seqs[r], job->lens[r],
+                              job->packed ? job->packed[r] : NULL,
+                              job->packed ? job->nmasks[r] : NULL,
+                              job->opts, ws, g, &job->results[r]))
+            continue;
+        qps[n] = &ws->qp[g];
+        counts[n] = ws->fine_counts + (size_t)g * cells;
+        slots[n++] = g;
     }
+    double t = ws->timed ? hs_clock_ms() : 0.0;
+    index_count_fine_batch(idx, qps, n, job->opts->syncmer_s, counts);
+    ws_lap(ws, STAGE_FINE, t);
+    for (int i = 0; i < n; i++)
+        classify_finish(idx, job->opts, ws, slots[i], &job->results[r0 + slots[i]]);
+}
 
-    res.marker_idx = marker;
-    res.hits = hits;
-    res.n_hits = n_hits;
-    res.is_classified = 1;
-    return res;
+static void classify_chunk(void *ctx, int tid, int begin, int end) {
+    classify_job_t *job = (classify_job_t *)ctx;
+    classify_ws_t *ws = &job->workspaces[tid];
+    /* A single-threaded run gets the whole range at once */
+    for (int c0 = begin; c0 < end; c0 += CLASSIFY_CHUNK) {
+        int c1 = c0 + CLASSIFY_CHUNK < end ? c0 + CLASSIFY_CHUNK : end;
+        classify_chunk_t *ch = &job->chunks[c0 / CLASSIFY_CHUNK];
+        ch->tid = tid;
+        ch->start = ws->n_hits;
+        for (int r = c0; r < c1; r += CLASSIFY_GROUP)
+            classify_group(job, ws, r, r + CLASSIFY_GROUP < c1 ? r + CLASSIFY_GROUP : c1);
+    }
+}
+
+classify_results_t *classify_reads(const halal_index_t *idx,
+                                   const char **seqs, const int *lens, int n_reads,
+                                   const classify_opts_t *opts) {
+    return classify_reads_timed(idx, seqs, lens, n_reads, opts, NULL);
 }
 
-read_result_t *classify_reads(const halal_index_t *idx,
-                               const char **seqs, const int *lens, int n_reads,
-                               const classify_opts_t *opts) {
-    read_result_t *results = (read_result_t *)hs_calloc((size_t)n_reads, sizeof(read_result_t));
+classify_results_t *classify_reads_timed(const halal_index_t *idx,
+                                         const char **seqs, const int *lens, int n_reads,
+                                         const classify_opts_t *opts,
+                                         classify_timing_t *timing) {
+    return classify_reads_packed(idx, seqs, lens, NULL, NULL, n_reads, opts, timing);
+}
 
-    for (int r = 0; r < n_reads; r++) {
-        results[r] = classify_one(idx, seqs[r], lens[r], opts);
+classify_results_t *classify_reads_packed(const halal_index_t *idx,
+                                          const char **seqs, const int *lens,
+                                          const uint64_t *const *packed,
+                                          const uint64_t *const *nmasks, int n_reads,
+                                          const classify_opts_t *opts,
+                                          classify_timing_t *timing) {
+    double t0 = timing ? hs_clock_ms() : 0.0;
+    classify_results_t *res = (classify_results_t *)hs_calloc(1, sizeof(classify_results_t));
+    res->n_reads = n_reads;
+    res->reads = (read_result_t *)hs_calloc(n_reads > 0 ? (size_t)n_reads : 1,
+                                            sizeof(read_result_t));
+    int n_chunks = (n_reads + CLASSIFY_CHUNK - 1) / CLASSIFY_CHUNK;
+    classify_chunk_t *chunks = (classify_chunk_t *)hs_malloc(
+        (size_t)(n_chunks > 0 ? n_chunks : 1) * sizeof(classify_chunk_t));
+
+    int n_threads = hs_resolve_threads(opts->n_threads);
+    classify_ws_t *workspaces = (classify_ws_t *)hs_calloc((size_t)n_threads,
+                                                           sizeof(classify_ws_t));
+    for (int t = 0; t < n_threads; t++) {
+        classify_ws_init(&workspaces[t], idx->db->n_species, idx->db->n_markers);
+        workspaces[t].timed = timing != NULL;
+    }
+
+    classify_job_t job = {
+        .idx = idx, .seqs = seqs, .lens = lens, .packed = packed, .nmasks = nmasks,
+        .opts = opts, .results = res->reads, .chunks = chunks, .workspaces = workspaces,
+    };
+    hs_parallel_for(n_reads, CLASSIFY_CHUNK, n_threads, classify_chunk, &job);
+
+    /* Gather the hits into read order */
+    for (int t = 0; t < n_threads; t++) res->n_hits += workspaces[t].n_hits;
+    res->hits = (species_hit_t *)hs_malloc(
+        (res->n_hits > 0 ? res->n_hits : 1) * sizeof(species_hit_t));
+    size_t pos = 0;
+    for (int c = 0; c < n_chunks; c++) {
+        const classify_ws_t *ws = &workspaces[chunks[c].tid];
+        int r0 = c * CLASSIFY_CHUNK;
+        int r1 = r0 + CLASSIFY_CHUNK < n_reads ? r0 + CLASSIFY_CHUNK : n_reads;
+        size_t n = 0;
+        for (int r = r0; r < r1; r++) {
+            read_result_t *rr = &res->reads[r];
+            if (rr->n_hits == 0) continue;
+            rr->offset = (uint32_t)(pos + n);
+            n += (size_t)rr->n_hits;
+        }
+        memcpy(res->hits + pos, ws->hits + chunks[c].start, n * sizeof(species_hit_t));
+        pos += n;
     }
 
-    return results;
+    if (timing) {
+        for (int t = 0; t < n_threads; t++) {
+            timing->primer_ms += workspaces[t].stage_ms[STAGE_PRIMER];
+            timing->kmer_ms += workspaces[t].stage_ms[STAGE_KMER];
+            timing->coarse_ms += workspaces[t].stage_ms[STAGE_COARSE];
+            timing->fine_ms += workspaces[t].stage_ms[STAGE_FINE];
+            const uint64_t *c = workspaces[t].count;
+            timing->n_scored += c[COUNT_SCORED];
+            timing->n_primer += c[COUNT_PRIMER];
+            timing->n_prefiltered += c[COUNT_PREFILTERED];
+            timing->n_short += c[COUNT_SHORT];
+            timing->n_coarse_rejected += c[COUNT_COARSE_REJECTED];
+            timing->n_candidates += c[COUNT_CANDIDATES];
+            timing->n_fine_kmers += c[COUNT_FINE_KMERS];
+            timing->n_hits += c[COUNT_HITS];
+        }
+        timing->classify_ms += hs_clock_ms() - t0;
+    }
+    for (int t = 0; t < n_threads; t++) classify_ws_free(&workspaces[t]);
+    free(workspaces);
+    free(chunks);
+    return res;
 }
 
-void classify_results_free(read_result_t *results, int n) {
+void classify_results_free(classify_results_t *results) {
     if (!results) return;
-    for (int i = 0; i < n; i++) free(results[i].hits);
+    free(results->reads);
+    free(results->hits);
     free(results);
 }
 
-void classify_summarize(const read_result_t *results, int n,
-                        const halal_index_t *idx, classify_summary_t *summary) {
-    (void)idx;
+void classify_summary_init(classify_summary_t *summary, int n_species, int n_markers) {
     memset(summary, 0, sizeof(*summary));
-    summary->total_reads = n;
-    for (int i = 0; i < n; i++) {
-        if (!results[i].is_classified) continue;
-        summary->classified_reads++;
-        if (results[i].marker_idx >= 0)
-            summary->per_marker[results[i].marker_idx]++;
-        for (int j = 0; j < results[i].n_hits; j++) {
-            int s = results[i].hits[j].species_idx;
-            if (s >= 0 && s < HS_MAX_SPECIES) summary->per_species[s]++;
+    summary->n_species = n_species;
+    summary->n_markers = n_markers;
+    size_t S = n_species > 0 ? (size_t)n_species : 1;
+    size_t M = n_markers > 0 ? (size_t)n_markers : 1;
+    summary->per_marker = (int *)hs_calloc(M, sizeof(int));
+    summary->per_species = (int *)hs_calloc(S, sizeof(int));
+    summary->per_species_marker = (int *)hs_calloc(S * M, sizeof(int));
+}
+
+void classify_summary_free(classify_summary_t *summary) {
+    if (!summary) return;
+    free(summary->per_marker);
+    free(summary->per_species);
+    free(summary->per_species_marker);
+    summary->per_marker = summary->per_species = summary->per_species_marker = NULL;
+}
+
+void classify_summarize(const classify_results_t *results,
+                        const halal_index_t *idx, classify_summary_t *summary) {
+    classify_summary_init(summary, idx->db->n_species, idx->db->n_markers);
+    classify_summary_add(summary, results, NULL);
+}
+
+void classify_summary_add(classify_summary_t *summary,
+                          const classify_results_t *results, const int *counts) {
+    for (int i = 0; i < results->n_reads; i++) {
+        const read_result_t *rr = &results->reads[i];
+        int c = counts ? counts[i] : 1;
+        summary->total_reads += c;
+        if (rr->n_hits == 0) continue;
+        summary->classified_reads += c;
+        int m = rr->marker_idx;
+        if (m >= summary->n_markers) m = -1;
+        if (m >= 0)
+            summary->per_marker[m] += c;
+        const species_hit_t *hits = classify_read_hits(results, i);
+        for (int j = 0; j < rr->n_hits; j++) {
+            int s = hits[j].species_idx;
+            if (s < 0 || s >= summary->n_species) continue;
+            summary->per_species[s] += c;
+            if (m >= 0) summary->per_species_marker[s * summary->n_markers + m] += c;
+        }
+    }
+}
+
+/* --- Dereplication --- */
+
+/* 0-3 for ACGT (any case), 4 for everything else */
+static inline int derep_code(char c) {
+    int b = hs_base_table[(uint8_t)c];
+    return b < 0 ? 4 : b;
+}
+
+static inline int derep_rc_code(const char *seq, int len, int i) {
+    int b = derep_code(seq[len - 1 - i]);
+    return b < 4 ? 3 - b : 4;
+}
+
+/* Orientation-independent FNV-1a key: min of forward and reverse-complement */
+static uint64_t derep_key(const char *seq, int len) {
+    uint64_t hf = 1469598103934665603ULL, hr = hf;
+    for (int i = 0; i < len; i++) {
+        hf = (hf ^ (uint64_t)derep_code(seq[i])) * 1099511628211ULL;
+        hr = (hr ^ (uint64_t)derep_rc_code(seq, len, i)) * 1099511628211ULL;
+    }
+    hf ^= (uint64_t)len; hr ^= (uint64_t)len;
+    return hf < hr ? hf : hr;
+}
+
+static int derep_same(const char *a, const char *b, int len) {
+    int fwd = 1, rc = 1;
+    for (int i = 0; i < len && (fwd || rc); i++) {
+        int ca = derep_code(a[i]);
+        if (fwd && ca != derep_code(b[i])) fwd = 0;
+        if (rc && ca != derep_rc_code(b, len, i)) rc = 0;
+    }
+    return fwd || rc;
+}
+
+int classify_dereplicate(const char **seqs, const int *lens, int n_reads,
+                         int *first, int *counts) {
+    if (n_reads <= 0) return 0;
+    size_t cap = 16;
+    while (cap < 2 * (size_t)n_reads) cap <<= 1;
+    int *slots = (int *)hs_malloc(cap * sizeof(int));    /* group id, -1 empty */
+    uint64_t *keys = (uint64_t *)hs_malloc(cap * sizeof(uint64_t));
+    for (size_t i = 0; i < cap; i++) slots[i] = -1;
+
+    int n_groups = 0;
+    for (int r = 0; r < n_reads; r++) {
+        uint64_t key = derep_key(seqs[r], lens[r]);
+        size_t i = (size_t)(key & (cap - 1));
+        while (slots[i] >= 0) {
+            int g = slots[i];
+            if (keys[i] == key && lens[first[g]] == lens[r] &&
+                derep_same(seqs[first[g]], seqs[r], lens[r]))
+                break;
+            i = (i + 1) & (cap - 1);
+        }
+        if (slots[i] >= 0) {
+            counts[slots[i]]++;
+        } else {
+            slots[i] = n_groups;
+            keys[i] = key;
+            first[n_groups] = r;
+            counts[n_groups] = 1;
+            n_groups++;
         }
     }
+    free(slots);
+    free(keys);
+    return n_groups;
 }
@@ -8,40 +8,123 @@ typedef struct {
     double containment;
 } species_hit_t;
 
+/* One read's result: its hits are n_hits consecutive entries of the
+ * batch's hit arena starting at offset.  A read is classified iff it
+ * has hits. */
 typedef struct {
-    int marker_idx;           /* Which marker this read maps to (-1 = unknown) */
-    species_hit_t *hits;      /* Candidate species + containment scores */
-    int n_hits;
-    int is_classified;
+    int32_t marker_idx;       /* Which marker this read maps to (-1 = unknown) */
+    int32_t n_hits;           /* Candidate species with their containment */
+    uint32_t offset;          /* First hit in classify_results_t.hits */
 } read_result_t;
 
+/* Results of one classify_reads batch */
+typedef struct {
+    read_result_t *reads;     /* [n_reads] */
+    species_hit_t *hits;      /* [n_hits] every read's hits, in read order */
+    int n_reads;
+    size_t n_hits;
+} classify_results_t;
+
+static inline const species_hit_t *classify_read_hits(const classify_results_t *res, int i) {
+    return res->hits + res->reads[i].offset;
+}
+
 typedef struct {
     double min_containment;   /* Minimum containment to report (Illumina: 0.3) */
     double coarse_threshold;  /* Coarse filter threshold (default: 0.05) */
     int is_nanopore;
-    int n_threads;
+    int n_threads;            /* Worker threads for classify_reads (<= 0: all CPUs) */
+    int dereplicate;          /* Classify identical reads once (streaming pipeline) */
+    int primer_window;        /* Bases searched for primers at each read end */
+    int primer_mismatches;    /* Mismatches tolerated per primer */
+    int trim_primers;         /* Drop detected primers before coarse/fine scoring */
+    int max_hits;             /* Keep only the best max_hits species per read (0 = all) */
+    double eq_class_step;     /* Containment grid for EM equivalence classes (0 = exact) */
+    int syncmer_s;            /* Score reads on their open syncmers (index_fine_hashes; 0 = off) */
+    const volatile int *cancel; /* Streaming pipeline stops before the next batch once
+                                   *cancel is nonzero (NULL = never) */
 } classify_opts_t;
 
 classify_opts_t classify_opts_default(void);
 classify_opts_t classify_opts_nanopore(void);
 
 /* Classify a batch of reads against the index */
-read_result_t *classify_reads(const halal_index_t *idx,
+classify_results_t *classify_reads(const halal_index_t *idx,
                                const char **seqs, const int *lens, int n_reads,
                                const classify_opts_t *opts);
 
+/* --- Stage timing ---
+ * Milliseconds spent per stage and per-read path counts, accumulated
+ * across calls.  parse_ms,
+ * derep_ms and classify_ms are wall time; the per-read stages are summed
+ * over classification workers, so with several threads they add up to
+ * more than classify_ms. */
+typedef struct {
+    double parse_ms;          /* reading and decoding sequence batches */
+    double derep_ms;          /* grouping identical reads */
+    double classify_ms;       /* wall time inside classify_reads */
+    double primer_ms;         /* marker detection from primers */
+    double kmer_ms;           /* hashing the read into its k-mer profile */
+    double coarse_ms;         /* off-target prefilter and sketch screen */
+    double fine_ms;           /* containment scoring and hit selection */
+    /* Per-read path counters, summed over workers (a dereplicated group of
+     * identical reads counts once) */
+    uint64_t n_scored;        /* reads through the classifier */
+    uint64_t n_primer;        /* marker known from a primer */
+    uint64_t n_prefiltered;   /* dropped as off-target by the prefilter */
+    uint64_t n_short;         /* too short for the sketch: every species a candidate */
+    uint64_t n_coarse_rejected; /* no species passed the coarse screen */
+    uint64_t n_candidates;    /* candidate species summed over fine-scored reads */
+    uint64_t n_fine_kmers;    /* read k-mers looked up at the fine level */
+    uint64_t n_hits;          /* species hits kept */
+} classify_timing_t;
+
+/* As classify_reads, adding the batch's stage times to *timing */
+classify_results_t *classify_reads_timed(const halal_index_t *idx,
+                                         const char **seqs, const int *lens, int n_reads,
+                                         const classify_opts_t *opts,
+                                         classify_timing_t *timing);
+/* Same with each read's parse-time packed form (hs_seq_batch_t.pack), so
+ * reads are hashed without re-encoding; packed NULL packs as scored */
+classify_results_t *classify_reads_packed(const halal_index_t *idx,
+                                          const char **seqs, const int *lens,
+                                          const uint64_t *const *packed,
+                                          const uint64_t *const *nmasks, int n_reads,
+                                          const classify_opts_t *opts,
+                                          classify_timing_t *timing);
+
 /* Free classification results */
-void classify_results_free(read_result_t *results, int n);
+void classify_results_free(classify_results_t *results);
 
 /* Summary statistics */
 typedef struct {
     int total_reads;
     int classified_reads;
-    int per_marker[HS_MAX_MARKERS];
-    int per_species[HS_MAX_SPECIES];
+    int n_species, n_markers;
+    int *per_marker;          /* [n_markers] */
+    int *per_species;         /* [n_species] */
+    int *per_species_marker;  /* [n_species * n_markers] hits by marker */
 } classify_summary_t;
 
-void classify_summarize(const read_result_t *results, int n,
+/* Zeroed tallies for an n_species x n_markers database */
+void classify_summary_init(classify_summary_t *summary, int n_species, int n_markers);
+void classify_summary_free(classify_summary_t *summary);
+
+/* (Re)initialises summary for idx's database, then accumulates results */
+void classify_summarize(const classify_results_t *results,
                         const halal_index_t *idx, classify_summary_t *summary);
+/* Accumulate one batch into an initialised summary.
+ * counts[i] is the multiplicity of read i (NULL = 1 each). */
+void classify_summary_add(classify_summary_t *summary,
+                          const classify_results_t *results, const int *counts);
+
+/* --- Dereplication ---
+ * Groups reads that classify identically: same length and the same bases
+ * after folding case, treating every non-ACGT symbol alike, and taking the
+ * read or its reverse complement (k-mers are canonical).  Writes the index
+ * of each group's first read to first[] and its size to counts[] (both
+ * [n_reads]) and returns the number of groups, in first-occurrence order. */
+int classify_dereplicate(const char **seqs, const int *lens, int n_reads,
+                         int *first, int *counts);
 
 #endif /* HALALSEQ_CLASSIFY_H */
@@ -1,6 +1,7 @@
 #include "em.h"
 #include "classify.h"
 #include "utils.h"
+#include "parallel.h"
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
@@ -24,10 +25,36 @@ em_config_t em_config_default(void) {
         .use_advanced_ci = 0,
         .use_brent_lambda = 0,
         .use_full_lrt = 0,
+        .use_squarem = 0,
+        .n_threads = 1,
+        .float_storage = 0,
     };
 }
 
+/* Multiplicity of a (possibly dereplicated) read */
+static inline double read_weight(const em_read_t *r) {
+    return r->count > 0 ? (double)r->count : 1.0;
+}
+
 /* --- Internal EM state --- */
+
+/* Rows per E-step work unit.  Partial sums are kept per chunk and reduced
+ * in chunk order, so a fit gives the same answer for any thread count. */
+#define EM_CHUNK 1024
+
+/* Reads reduced to what the Brent lambda search needs (see
+ * lambda_stats_build).  Rows whose candidates share one amplicon length
+ * fold into base and slope; the rest keep one term per distinct length. */
+typedef struct {
+    int n_rows;                  /* rows with more than one length */
+    int *off;                    /* [n_rows + 1] into dl / la */
+    double *wt;                  /* [n_rows] read weight */
+    double *dl;                  /* [n_entries] length above the row's shortest */
+    double *la;                  /* [n_entries] log-score at that length, <= 0 */
+    double base;                 /* lambda-free log-likelihood */
+    double slope;                /* weighted sum of each row's shortest length */
+} lambda_stats_t;
+
 typedef struct {
     double *w;     /* [S] weight fractions */
     double *d;     /* [S] DNA yield factors */
@@ -36,24 +63,63 @@ typedef struct {
     int S, M;
     const int *amp_lens;         /* [S*M] amplicon lengths (borrowed, not owned) */
     int estimate_degradation;    /* flag: include exp(-lambda*L) term */
+    int n_threads;               /* E-step workers */
+    int masked;                  /* species held at w = 0 (nested LRT), -1 = none */
+    int n_chunks;                /* ceil(n_rows / EM_CHUNK) */
+    const double *row_mass;      /* [S*M] weighted rows listing s at marker m (borrowed) */
+    const double *marker_total;  /* [M] weighted rows per marker (borrowed) */
+    double *log_wdb;             /* [S*M] scratch: per-iteration log-score table */
+    double *cell;                /* [S*M] weighted responsibilities per species x marker */
+    double *partials;            /* [n_chunks * (S*M + 1)] per-chunk E-step sums */
+    double *arena;               /* [2*S] M-step scratch */
+    lambda_stats_t lstats;       /* Brent lambda statistics, allocated on first use */
 } em_params_t;
 
 /* Forward declaration for Brent's method (used in m_step) */
-static double brent_lambda_update(const em_params_t *p, const em_read_t *reads,
-                                   int n_reads, double **gamma);
+static double brent_lambda_update(em_params_t *p, const em_data_t *data);
 
-static em_params_t *params_alloc(int S, int M) {
+static em_params_t *params_alloc(int S, int M, int n_chunks) {
     em_params_t *p = (em_params_t *)hs_calloc(1, sizeof(em_params_t));
     p->S = S; p->M = M;
+    p->n_threads = 1;
+    p->masked = -1;
+    p->n_chunks = n_chunks;
     p->w = (double *)hs_calloc((size_t)S, sizeof(double));
     p->d = (double *)hs_calloc((size_t)S, sizeof(double));
     p->b = (double *)hs_calloc((size_t)(S * M), sizeof(double));
+    p->log_wdb = (double *)hs_malloc((size_t)(S * M) * sizeof(double));
+    p->cell = (double *)hs_malloc((size_t)(S * M) * sizeof(double));
+    p->partials = (double *)hs_malloc(
+        (size_t)(n_chunks > 0 ? n_chunks : 1) * (size_t)(S * M + 1) * sizeof(double));
+    p->arena = (double *)hs_malloc((size_t)(2 * S) * sizeof(double));
     return p;
 }
 
 static void params_free(em_params_t *p) {
     if (!p) return;
-    free(p->w); free(p->d); free(p->b); free(p);
+    free(p->w); free(p->d); free(p->b);
+    free(p->log_wdb); free(p->cell); free(p->partials); free(p->arena);
+    free(p->lstats.off); free(p->lstats.wt); free(p->lstats.dl); free(p->lstats.la);
+    free(p);
+}
+
+/* log(w_s) + log(d_s) + log(b_sm) - lambda * L_sm for every species x marker,
+ * so each candidate costs one lookup plus its cached log-containment.
+ * amp_lens == NULL leaves out the degradation term. */
+static void fill_log_wdb(const double *w, const double *d, const double *b,
+                         int S, int M, double lambda, const int *amp_lens,
+                         double *log_wdb) {
+    for (int s = 0; s < S; s++) {
+        double lwd = log(w[s]) + log(d[s]);
+        for (int m = 0; m < M; m++) {
+            double v = lwd + log(b[s * M + m]);
+            if (amp_lens) {
+                int L = amp_lens[s * M + m];
+                if (L > 0) v -= lambda * (double)L;
+            }
+            log_wdb[s * M + m] = v;
+        }
+    }
 }
 
 static void params_init_random(em_params_t *p, hs_rng_t *rng, const em_config_t *cfg) {
@@ -85,60 +151,194 @@ static void params_init_uniform(em_params_t *p) {
     p->lambda = 0.001;
 }
 
-/* --- E-step: compute responsibilities --- */
-static double e_step(const em_params_t *p, const em_read_t *reads, int n_reads,
-                     double **gamma) {
-    int M = p->M;
+/* Start from an earlier fit.  Weights are floored so that species the
+ * earlier data ruled out can come back with more reads (EM never revives
+ * an exact zero). */
+static void params_init_warm(em_params_t *p, const em_result_t *prev) {
+    int S = p->S, M = p->M;
+    double sum = 0.0;
+    for (int s = 0; s < S; s++) {
+        p->w[s] = prev->w[s] > 1e-6 ? prev->w[s] : 1e-6;
+        sum += p->w[s];
+    }
+    for (int s = 0; s < S; s++) p->w[s] /= sum;
+    memcpy(p->d, prev->d, (size_t)S * sizeof(double));
+    memcpy(p->b, prev->b, (size_t)(S * M) * sizeof(double));
+    p->lambda = prev->lambda_proc > 0.0 ? prev->lambda_proc : 0.001;
+}
+
+/* --- Responsibilities ---
+ * One per CSR entry, kept in double or, for data in float storage
+ * (em_data_to_float), in float; whichever is set of d and f holds them. */
+typedef struct {
+    double *d;
+    float *f;
+} em_gamma_t;
+
+static em_gamma_t gamma_alloc(const em_data_t *data) {
+    size_t ne = (size_t)(data->n_entries > 0 ? data->n_entries : 1);
+    em_gamma_t g = { NULL, NULL };
+    if (data->log_c_f) g.f = (float *)hs_malloc(ne * sizeof(float));
+    else g.d = (double *)hs_malloc(ne * sizeof(double));
+    return g;
+}
+
+static void gamma_free(em_gamma_t g) {
+    free(g.d);
+    free(g.f);
+}
+
+static inline double gamma_at(em_gamma_t g, int e) {
+    return g.f ? (double)g.f[e] : g.d[e];
+}
+
+static inline double data_log_c(const em_data_t *data, int e) {
+    return data->log_c_f ? (double)data->log_c_f[e] : data->log_c[e];
+}
+
+/* Fills gamma for rows [r0, r1) from a fill_log_wdb() table and returns
+ * their weighted observed-data log-likelihood.  With cell != NULL the
+ * weighted responsibilities are also summed into cell[s*M+m].  Entries of
+ * species `masked` get zero responsibility; rows with nothing else are
+ * left out of the likelihood.  Written once for both storage types (fl
+ * is constant in each caller); in float the log-scores are recomputed
+ * rather than stored, and every sum stays in double. */
+static inline __attribute__((always_inline))
+double gamma_rows_body(const em_data_t *data, const double *log_wdb, int M,
+                       int masked, int r0, int r1, em_gamma_t g, double *cell, int fl) {
+    const int *off = data->offsets;
+    const int *sp = data->species;
+    const double *log_c = data->log_c;
+    const float *log_c_f = data->log_c_f;
+    double *gamma = g.d;
+    float *gamma_f = g.f;
     double ll = 0.0;
 
-    for (int r = 0; r < n_reads; r++) {
-        int nc = reads[r].n_candidates;
-        int m = reads[r].marker_idx;
-        if (m < 0) m = 0; /* fallback */
+    for (int r = r0; r < r1; r++) {
+        int m = data->marker[r];
+        int e0 = off[r], e1 = off[r + 1];
 
+        /* gamma holds the log-scores until normalization (double) */
         double max_log = -INFINITY;
-        double *log_g = (double *)hs_malloc((size_t)nc * sizeof(double));
-
-        for (int j = 0; j < nc; j++) {
-            int s = reads[r].species_indices[j];
-            double c = reads[r].containments[j];
-            if (c < 1e-300) c = 1e-300;
-            log_g[j] = log(p->w[s]) + log(p->d[s]) + log(p->b[s * M + m]) + log(c);
-            if (p->estimate_degradation && p->amp_lens) {
-                int L = p->amp_lens[s * M + m];
-                if (L > 0) log_g[j] -= p->lambda * (double)L;
+        const double *row_wdb = log_wdb + m;
+#define GAMMA_LOG_SCORE(e) (sp[e] == masked ? -INFINITY \
+                            : row_wdb[sp[e] * M] + (fl ? (double)log_c_f[e] : log_c[e]))
+        for (int e = e0; e < e1; e++) {
+            double lg = GAMMA_LOG_SCORE(e);
+            if (!fl) gamma[e] = lg;
+            if (lg > max_log) max_log = lg;
+        }
+        if (max_log == -INFINITY) {
+            for (int e = e0; e < e1; e++) {
+                if (fl) gamma_f[e] = 0.0f;
+                else gamma[e] = 0.0;
             }
-            if (log_g[j] > max_log) max_log = log_g[j];
+            continue;
         }
 
         /* logsumexp normalization */
         double sum = 0.0;
-        for (int j = 0; j < nc; j++)
-            sum += exp(log_g[j] - max_log);
+        for (int e = e0; e < e1; e++) {
+            if (fl) {
+                double x = exp(GAMMA_LOG_SCORE(e) - max_log);
+                gamma_f[e] = (float)x;
+                sum += x;
+            } else {
+                sum += exp(gamma[e] - max_log);
+            }
+        }
+#undef GAMMA_LOG_SCORE
         double log_norm = max_log + log(sum);
 
-        for (int j = 0; j < nc; j++)
-            gamma[r][j] = exp(log_g[j] - log_norm);
+        double wt = data->weight[r];
+        double inv_sum = 1.0 / sum;
+        for (int e = e0; e < e1; e++) {
+            double v;
+            if (fl) {
+                v = (double)gamma_f[e] * inv_sum;
+                gamma_f[e] = (float)v;
+            } else {
+                v = gamma[e] = exp(gamma[e] - log_norm);
+            }
+            if (cell) cell[sp[e] * M + m] += wt * v;
+        }
 
-        ll += log_norm;
-        free(log_g);
+        ll += wt * log_norm;
     }
 
     return ll;
 }
 
-/* --- M-step: update parameters --- */
-static void m_step(em_params_t *p, const em_read_t *reads, int n_reads,
-                   double **gamma, const em_config_t *cfg, int single_marker) {
+static double compute_gamma_rows(const em_data_t *data, const double *log_wdb, int M,
+                                 int masked, int r0, int r1,
+                                 em_gamma_t gamma, double *cell) {
+    if (gamma.f) return gamma_rows_body(data, log_wdb, M, masked, r0, r1, gamma, cell, 1);
+    return gamma_rows_body(data, log_wdb, M, masked, r0, r1, gamma, cell, 0);
+}
+
+static double compute_gamma(const em_data_t *data, const double *log_wdb, int M,
+                            em_gamma_t gamma) {
+    return compute_gamma_rows(data, log_wdb, M, -1, 0, data->n_rows, gamma, NULL);
+}
+
+typedef struct {
+    const em_params_t *p;
+    const em_data_t *data;
+    em_gamma_t gamma;
+} estep_job_t;
+
+static void estep_worker(void *ctx, int tid, int begin, int end) {
+    (void)tid;
+    estep_job_t *job = (estep_job_t *)ctx;
+    const em_params_t *p = job->p;
+    int SM = p->S * p->M;
+    for (int c = begin; c < end; c++) {
+        double *part = p->partials + (size_t)c * (size_t)(SM + 1);
+        memset(part, 0, (size_t)SM * sizeof(double));
+        int r0 = c * EM_CHUNK;
+        int r1 = r0 + EM_CHUNK < job->data->n_rows ? r0 + EM_CHUNK : job->data->n_rows;
+        part[SM] = compute_gamma_rows(job->data, p->log_wdb, p->M, p->masked,
+                                      r0, r1, job->gamma, part);
+    }
+}
+
+/* --- E-step: compute responsibilities ---
+ * Chunks of rows run in parallel; their likelihoods and per-cell
+ * responsibility sums are then reduced in chunk order into p->cell. */
+static double e_step(em_params_t *p, const em_data_t *data, em_gamma_t gamma) {
+    int SM = p->S * p->M;
+    fill_log_wdb(p->w, p->d, p->b, p->S, p->M, p->lambda,
+                 p->estimate_degradation ? p->amp_lens : NULL, p->log_wdb);
+
+    estep_job_t job = { p, data, gamma };
+    hs_parallel_for(p->n_chunks, 1, p->n_threads, estep_worker, &job);
+
+    double ll = 0.0;
+    memset(p->cell, 0, (size_t)SM * sizeof(double));
+    for (int c = 0; c < p->n_chunks; c++) {
+        const double *part = p->partials + (size_t)c * (size_t)(SM + 1);
+        for (int i = 0; i < SM; i++) p->cell[i] += part[i];
+        ll += part[SM];
+    }
+    return ll;
+}
+
+/* --- M-step: update parameters ---
+ * Every sufficient statistic is a function of the species x marker cell
+ * sums from the E-step, so this is O(S*M) rather than a pass over reads. */
+static void m_step(em_params_t *p, const em_data_t *data,
+                   const em_config_t *cfg, int single_marker) {
     int S = p->S, M = p->M;
-    double *eff_counts = (double *)hs_calloc((size_t)S, sizeof(double));
+    const double *b_num = p->cell;
+    const double *marker_total = p->marker_total;
+    double *eff_counts = p->arena;
+    double *d_den = p->arena + S;
 
     /* Accumulate effective counts for w */
-    for (int r = 0; r < n_reads; r++) {
-        for (int j = 0; j < reads[r].n_candidates; j++) {
-            int s = reads[r].species_indices[j];
-            eff_counts[s] += gamma[r][j];
-        }
+    for (int s = 0; s < S; s++) {
+        double n = 0.0;
+        for (int m = 0; m < M; m++) n += b_num[s * M + m];
+        eff_counts[s] = n;
     }
 
     /* Update w with Dirichlet MAP.
@@ -147,6 +347,7 @@ static void m_step(em_params_t *p, const em_read_t *reads, int n_reads,
      * species that produce more reads due to higher mito copy number. */
     double w_sum = 0.0;
     for (int s = 0; s < S; s++) {
+        if (s == p->masked) { p->w[s] = 0.0; continue; }
         double adj = single_marker && p->d[s] > 1e-10 ? p->d[s] : 1.0;
         p->w[s] = (eff_counts[s] / adj) + cfg->alpha - 1.0;
         if (p->w[s] < 1e-10) p->w[s] = 1e-10;
@@ -155,25 +356,18 @@ static void m_step(em_params_t *p, const em_read_t *reads, int n_reads,
     for (int s = 0; s < S; s++) p->w[s] /= w_sum;
 
     /* In single-marker mode, d and b are fixed — skip their updates */
-    if (single_marker) {
-        free(eff_counts);
-        return;
-    }
+    if (single_marker) return;
 
     /* Update d: DNA yield factors
      * d_s is proportional to (effective reads for s) / (w_s * sum_m b_sm * reads_at_m)
      * With LogNormal MAP: d_s = exp( (N_s/sigma^2 + mu/sigma_prior^2) / (N_s/sigma^2 + 1/sigma_prior^2) )
      * Simplified: weighted ratio approach */
-    double *d_num = (double *)hs_calloc((size_t)S, sizeof(double));
-    double *d_den = (double *)hs_calloc((size_t)S, sizeof(double));
-    for (int r = 0; r < n_reads; r++) {
-        int m = reads[r].marker_idx;
-        if (m < 0) m = 0;
-        for (int j = 0; j < reads[r].n_candidates; j++) {
-            int s = reads[r].species_indices[j];
-            d_num[s] += gamma[r][j];
-            d_den[s] += p->w[s] * p->b[s * M + m];
-        }
+    const double *d_num = eff_counts;
+    for (int s = 0; s < S; s++) {
+        double den = 0.0;
+        for (int m = 0; m < M; m++)
+            den += p->w[s] * p->b[s * M + m] * p->row_mass[s * M + m];
+        d_den[s] = den;
     }
     for (int s = 0; s < S; s++) {
         if (d_den[s] > 1e-10) {
@@ -191,27 +385,15 @@ static void m_step(em_params_t *p, const em_read_t *reads, int n_reads,
     double log_d_sum = 0.0;
     int d_count = 0;
     for (int s = 0; s < S; s++) {
-        if (p->d[s] > 1e-10) { log_d_sum += log(p->d[s]); d_count++; }
+        if (s != p->masked && p->d[s] > 1e-10) { log_d_sum += log(p->d[s]); d_count++; }
     }
     if (d_count > 0) {
         double geomean = exp(log_d_sum / d_count);
         for (int s = 0; s < S; s++) p->d[s] /= geomean;
     }
-    free(d_num); free(d_den);
 
     /* Update b: PCR bias per species x marker
      * b_sm proportional to (reads assigned to s from marker m) / (d_s * w_s * total_at_m) */
-    double *b_num = (double *)hs_calloc((size_t)(S * M), sizeof(double));
-    double *marker_total = (double *)hs_calloc((size_t)M, sizeof(double));
-    for (int r = 0; r < n_reads; r++) {
-        int m = reads[r].marker_idx;
-        if (m < 0) m = 0;
-        for (int j = 0; j < reads[r].n_candidates; j++) {
-            int s = reads[r].species_indices[j];
-            b_num[s * M + m] += gamma[r][j];
-        }
-        marker_total[m] += 1.0;
-    }
     for (int s = 0; s < S; s++) {
         for (int m = 0; m < M; m++) {
             double expected = p->w[s] * p->d[s] * marker_total[m];
@@ -242,27 +424,21 @@ static void m_step(em_params_t *p, const em_read_t *reads, int n_reads,
             for (int m = 0; m < M; m++) p->b[s * M + m] /= geomean;
         }
     }
-    free(b_num); free(marker_total);
 
     /* Update lambda: degradation rate */
     if (cfg->estimate_degradation && p->amp_lens) {
         if (cfg->use_brent_lambda) {
             /* Brent's method: maximize Q(lambda) exactly */
-            p->lambda = brent_lambda_update(p, reads, n_reads, gamma);
+            p->lambda = brent_lambda_update(p, data);
         } else {
             /* Closed-form moment matching */
             double gamma_L_sum = 0.0;
             double gamma_sum = 0.0;
-            for (int r = 0; r < n_reads; r++) {
-                int m_idx = reads[r].marker_idx;
-                if (m_idx < 0) m_idx = 0;
-                for (int j = 0; j < reads[r].n_candidates; j++) {
-                    int s = reads[r].species_indices[j];
-                    int L = p->amp_lens[s * M + m_idx];
-                    if (L > 0) {
-                        gamma_L_sum += gamma[r][j] * (double)L;
-                        gamma_sum += gamma[r][j];
-                    }
+            for (int i = 0; i < S * M; i++) {
+                int L = p->amp_lens[i];
+                if (L > 0) {
+                    gamma_L_sum += b_num[i] * (double)L;
+                    gamma_sum += b_num[i];
                 }
             }
             if (gamma_L_sum > 0) {
@@ -272,27 +448,22 @@ static void m_step(em_params_t *p, const em_read_t *reads, int n_reads,
             }
         }
     }
+}
 
-    free(eff_counts);
+static inline int em_cancelled(const em_config_t *cfg) {
+    return cfg->cancel && *cfg->cancel;
 }
 
 /* --- Single EM run --- */
-static double em_run_once(em_params_t *p, const em_read_t *reads, int n_reads,
-                          const em_config_t *cfg, int single_marker,
-                          int *out_iters) {
-    int S = p->S;
-    (void)S;
+static double em_run_plain(em_params_t *p, const em_data_t *data, em_gamma_t gamma,
+                           const em_config_t *cfg, int single_marker,
+                           int *out_iters) {
     double prev_ll = -INFINITY;
     int iter;
 
-    /* Allocate gamma (sparse: per-read, per-candidate) */
-    double **gamma = (double **)hs_malloc((size_t)n_reads * sizeof(double *));
-    for (int r = 0; r < n_reads; r++)
-        gamma[r] = (double *)hs_calloc((size_t)reads[r].n_candidates, sizeof(double));
-
-    for (iter = 0; iter < cfg->max_iter; iter++) {
-        double ll = e_step(p, reads, n_reads, gamma);
-        m_step(p, reads, n_reads, gamma, cfg, single_marker);
+    for (iter = 0; iter < cfg->max_iter && !em_cancelled(cfg); iter++) {
+        double ll = e_step(p, data, gamma);
+        m_step(p, data, cfg, single_marker);
 
         double rel_change = fabs(ll - prev_ll) / (fabs(ll) + 1e-10);
         if (iter > 0 && rel_change < cfg->conv_threshold) {
@@ -302,102 +473,435 @@ static double em_run_once(em_params_t *p, const em_read_t *reads, int n_reads,
         prev_ll = ll;
     }
 
-    double final_ll = e_step(p, reads, n_reads, gamma);
-
-    for (int r = 0; r < n_reads; r++) free(gamma[r]);
-    free(gamma);
+    double final_ll = e_step(p, data, gamma);
 
     *out_iters = iter;
     return final_ll;
 }
 
-/* --- Public API --- */
+/* --- SQUAREM acceleration ---
+ * Varadhan & Roland (2008), scheme S3.  Two EM steps x0 -> x1 -> x2 give
+ * r = x1 - x0 and v = x2 - 2 x1 + x0; the extrapolated point is
+ * x0 - 2 a r + a^2 v with a = -|r| / |v| (a = -1 is just x2).  Parameters
+ * are extrapolated in log space so every w, d, b and lambda stays
+ * positive, then renormalised as the M-step would, and followed by one EM
+ * step to stabilise it.  The M-step's MAP shrinkage does not make plain EM
+ * monotone in likelihood, so the safeguard checks both points: if either
+ * scores below x1 the extrapolation is discarded for x2. */
+
+/* x = log of (w[S], d[S], b[S*M], lambda); the masked species maps to 0 */
+static int params_dim(const em_params_t *p) { return 2 * p->S + p->S * p->M + 1; }
+
+static double log_pos(double v) { return log(v > 1e-300 ? v : 1e-300); }
+
+static void params_to_log(const em_params_t *p, double *x) {
+    int S = p->S, SM = p->S * p->M;
+    for (int s = 0; s < S; s++) x[s] = s == p->masked ? 0.0 : log_pos(p->w[s]);
+    for (int s = 0; s < S; s++) x[S + s] = log_pos(p->d[s]);
+    for (int i = 0; i < SM; i++) x[2 * S + i] = log_pos(p->b[i]);
+    x[2 * S + SM] = log_pos(p->lambda);
+}
 
-em_result_t *em_fit(const em_read_t *reads, int n_reads,
-                     int n_species, int n_markers,
-                     const int *amplicon_lengths,
-                     const em_config_t *config) {
-    if (n_reads <= 0 || n_species <= 0) return NULL;
+/* Exact copy of the parameters, same layout without the logs */
+static void params_save(const em_params_t *p, double *x) {
+    int S = p->S, SM = p->S * p->M;
+    memcpy(x, p->w, (size_t)S * sizeof(double));
+    memcpy(x + S, p->d, (size_t)S * sizeof(double));
+    memcpy(x + 2 * S, p->b, (size_t)SM * sizeof(double));
+    x[2 * S + SM] = p->lambda;
+}
 
-    hs_rng_t rng;
-    hs_rng_seed(&rng, config->seed);
+static void params_restore(em_params_t *p, const double *x) {
+    int S = p->S, SM = p->S * p->M;
+    memcpy(p->w, x, (size_t)S * sizeof(double));
+    memcpy(p->d, x + S, (size_t)S * sizeof(double));
+    memcpy(p->b, x + 2 * S, (size_t)SM * sizeof(double));
+    p->lambda = x[2 * S + SM];
+}
 
-    /* Detect single-marker mode: count distinct marker indices across reads */
-    int single_marker = 0;
-    {
-        int marker_seen[8] = {0};  /* HS_MAX_MARKERS = 8 */
-        for (int r = 0; r < n_reads; r++) {
-            int m = reads[r].marker_idx;
-            if (m >= 0 && m < 8) marker_seen[m] = 1;
+/* Inverse of params_to_log, restoring the M-step's normalisations */
+static void params_from_log(em_params_t *p, const double *x, int single_marker) {
+    int S = p->S, M = p->M, SM = S * M;
+    double w_sum = 0.0;
+    for (int s = 0; s < S; s++) {
+        if (s == p->masked) { p->w[s] = 0.0; continue; }
+        double w = exp(x[s]);
+        p->w[s] = w < 1e-300 ? 1e-300 : w;
+        w_sum += p->w[s];
+    }
+    for (int s = 0; s < S; s++) p->w[s] /= w_sum;
+    for (int s = 0; s < S; s++) p->d[s] = exp(x[S + s]);
+    for (int i = 0; i < SM; i++) p->b[i] = exp(x[2 * S + i]);
+    if (!single_marker) {
+        double log_d_sum = 0.0;
+        int d_count = 0;
+        for (int s = 0; s < S; s++)
+            if (s != p->masked) { log_d_sum += x[S + s]; d_count++; }
+        if (d_count > 0) {
+            double geomean = exp(log_d_sum / d_count);
+            for (int s = 0; s < S; s++) p->d[s] /= geomean;
+        }
+        for (int s = 0; s < S; s++) {
+            double log_b_sum = 0.0;
+            for (int m = 0; m < M; m++) log_b_sum += x[2 * S + s * M + m];
+            double geomean = exp(log_b_sum / M);
+            for (int m = 0; m < M; m++) p->b[s * M + m] /= geomean;
         }
-        int n_markers_seen = 0;
-        for (int m = 0; m < 8; m++) n_markers_seen += marker_seen[m];
-        if (n_markers_seen <= 1) single_marker = 1;
     }
+    double lambda = exp(x[2 * S + SM]);
+    p->lambda = lambda < 1e-6 ? 1e-6 : (lambda > 0.1 ? 0.1 : lambda);
+}
 
-    if (single_marker) {
-        HS_LOG_INFO("Single-marker mode: fixing d from mito CN priors, b=1.0");
+static double em_run_squarem(em_params_t *p, const em_data_t *data, em_gamma_t gamma,
+                             const em_config_t *cfg, int single_marker,
+                             int *out_iters, int *out_extrapolations) {
+    int n = params_dim(p);
+    double *x0 = (double *)hs_malloc((size_t)n * sizeof(double));
+    double *x1 = (double *)hs_malloc((size_t)n * sizeof(double));
+    double *x2 = (double *)hs_malloc((size_t)n * sizeof(double));
+    double *xa = (double *)hs_malloc((size_t)n * sizeof(double));
+    double *saved = (double *)hs_malloc((size_t)n * sizeof(double));    /* x2, not logged */
+    double prev_ll = -INFINITY, next_ll = 0.0;
+    int have_ll = 0;                 /* p->cell and next_ll already match p */
+    int iters = 0, accepted = 0, strikes = 0, skip = 0;
+
+    while (iters < cfg->max_iter && !em_cancelled(cfg)) {
+        params_to_log(p, x0);
+        double ll0 = have_ll ? next_ll : e_step(p, data, gamma);
+        have_ll = 0;
+        m_step(p, data, cfg, single_marker);
+        iters++;
+        double rel_change = fabs(ll0 - prev_ll) / (fabs(ll0) + 1e-10);
+        if (iters > 1 && rel_change < cfg->conv_threshold) break;
+        prev_ll = ll0;
+        if (iters >= cfg->max_iter) break;
+
+        params_to_log(p, x1);
+        double ll1 = e_step(p, data, gamma);
+        m_step(p, data, cfg, single_marker);
+        iters++;
+        rel_change = fabs(ll1 - prev_ll) / (fabs(ll1) + 1e-10);
+        if (rel_change < cfg->conv_threshold) break;
+        prev_ll = ll1;
+        params_to_log(p, x2);
+        params_save(p, saved);
+
+        double rr = 0.0, vv = 0.0;
+        for (int i = 0; i < n; i++) {
+            double r = x1[i] - x0[i];
+            double v = x2[i] - 2.0 * x1[i] + x0[i];
+            rr += r * r;
+            vv += v * v;
+        }
+        double a = vv > 0.0 ? -sqrt(rr / vv) : -1.0;
+        /* x2 is already in p.  Each rejection doubles the number of plain
+         * cycles before the next attempt, bounding the wasted E-steps
+         * where the map is too rough to extrapolate. */
+        if (a > -1.0 || iters + 1 >= cfg->max_iter) continue;
+        if (skip > 0) { skip--; continue; }
+
+        /* Keep the extrapolation only if both it and its stabilising EM
+         * step score at least as well as x1; an overlong step is halved
+         * towards a = -1 a few times first */
+        double lla = -INFINITY;
+        for (int tries = 0; tries < 4 && a < -1.0; tries++) {
+            for (int i = 0; i < n; i++) {
+                double r = x1[i] - x0[i];
+                double v = x2[i] - 2.0 * x1[i] + x0[i];
+                xa[i] = x0[i] - 2.0 * a * r + a * a * v;
+            }
+            params_from_log(p, xa, single_marker);
+            lla = e_step(p, data, gamma);
+            if (isfinite(lla) && lla >= ll1) break;
+            a = (a - 1.0) / 2.0;
+        }
+        if (isfinite(lla) && lla >= ll1) {
+            m_step(p, data, cfg, single_marker);
+            iters++;
+            double ll3 = e_step(p, data, gamma);
+            if (isfinite(ll3) && ll3 >= ll1) {
+                accepted++;
+                strikes = 0;
+                prev_ll = lla;
+                next_ll = ll3;
+                have_ll = 1;
+                continue;
+            }
+        }
+        params_restore(p, saved);
+        skip = 1 << (strikes < 6 ? strikes : 6);
+        strikes++;
     }
 
-    em_params_t *best_p = NULL;
-    double best_ll = -INFINITY;
-    int best_iters = 0;
-    int best_converged = 0;
+    double final_ll = have_ll ? next_ll : e_step(p, data, gamma);
+    free(x0); free(x1); free(x2); free(xa); free(saved);
+    *out_iters = iters;
+    if (out_extrapolations) *out_extrapolations = accepted;
+    return final_ll;
+}
 
-    int n_restarts = config->n_restarts > 0 ? config->n_restarts : 1;
+static double em_run_once(em_params_t *p, const em_data_t *data, em_gamma_t gamma,
+                          const em_config_t *cfg, int single_marker,
+                          int *out_iters, int *out_extrapolations) {
+    if (out_extrapolations) *out_extrapolations = 0;
+    if (cfg->use_squarem)
+        return em_run_squarem(p, data, gamma, cfg, single_marker,
+                              out_iters, out_extrapolations);
+    return em_run_plain(p, data, gamma, cfg, single_marker, out_iters);
+}
 
-    for (int restart = 0; restart < n_restarts; restart++) {
-        em_params_t *p = params_alloc(n_species, n_markers);
-        p->amp_lens = amplicon_lengths;
-        p->estimate_degradation = config->estimate_degradation;
-
-        if (restart == 0)
-            params_init_uniform(p);
-        else
-            params_init_random(p, &rng, config);
-
-        /* In single-marker mode, fix d from mito copy numbers and b = 1.0 */
-        if (single_marker) {
-            if (config->mito_copy_numbers) {
-                /* d_s = mito_cn_s / geometric_mean(mito_cn) */
-                double log_sum = 0.0;
-                int cn_count = 0;
-                for (int s = 0; s < n_species; s++) {
-                    if (config->mito_copy_numbers[s] > 0) {
-                        log_sum += log(config->mito_copy_numbers[s]);
-                        cn_count++;
-                    }
-                }
-                double geomean = cn_count > 0 ? exp(log_sum / cn_count) : 1.0;
-                for (int s = 0; s < n_species; s++) {
-                    p->d[s] = config->mito_copy_numbers[s] > 0
-                              ? config->mito_copy_numbers[s] / geomean
-                              : 1.0;
-                }
-            } else {
-                for (int s = 0; s < n_species; s++) p->d[s] = 1.0;
-            }
-            for (int s = 0; s < n_species; s++)
-                for (int m = 0; m < n_markers; m++)
-                    p->b[s * n_markers + m] = 1.0;
+/* --- CSR packing --- */
+
+static em_data_t *data_alloc(int n_rows, int n_entries) {
+    em_data_t *data = (em_data_t *)hs_calloc(1, sizeof(em_data_t));
+    data->n_rows = n_rows;
+    data->n_entries = n_entries;
+    data->offsets = (int *)hs_malloc((size_t)(n_rows + 1) * sizeof(int));
+    data->marker = (int *)hs_malloc((size_t)(n_rows > 0 ? n_rows : 1) * sizeof(int));
+    data->weight = (double *)hs_malloc((size_t)(n_rows > 0 ? n_rows : 1) * sizeof(double));
+    size_t ne = (size_t)(n_entries > 0 ? n_entries : 1);
+    data->species = (int *)hs_malloc(ne * sizeof(int));
+    data->containments = (double *)hs_malloc(ne * sizeof(double));
+    data->log_c = (double *)hs_malloc(ne * sizeof(double));
+    data->offsets[0] = 0;
+    return data;
+}
+
+/* Count distinct markers; called once the rows are filled */
+static void data_count_markers(em_data_t *data) {
+    int n_seen = 0;
+    for (int r = 0; r < data->n_rows; r++)
+        if (data->marker[r] >= n_seen) n_seen = data->marker[r] + 1;
+    char *seen = (char *)hs_calloc(n_seen > 0 ? (size_t)n_seen : 1, 1);
+    for (int r = 0; r < data->n_rows; r++) seen[data->marker[r]] = 1;
+    data->n_markers_seen = 0;
+    for (int m = 0; m < n_seen; m++) data->n_markers_seen += seen[m];
+    free(seen);
+}
+
+static inline double safe_log_c(double c) {
+    return log(c < 1e-300 ? 1e-300 : c);
+}
+
+em_data_t *em_data_from_reads(const em_read_t *reads, int n_reads) {
+    int n_entries = 0;
+    for (int r = 0; r < n_reads; r++) n_entries += reads[r].n_candidates;
+
+    em_data_t *data = data_alloc(n_reads, n_entries);
+    int e = 0;
+    for (int r = 0; r < n_reads; r++) {
+        data->marker[r] = reads[r].marker_idx < 0 ? 0 : reads[r].marker_idx;
+        data->weight[r] = read_weight(&reads[r]);
+        for (int j = 0; j < reads[r].n_candidates; j++, e++) {
+            data->species[e] = reads[r].species_indices[j];
+            data->containments[e] = reads[r].containments[j];
+            data->log_c[e] = safe_log_c(reads[r].containments[j]);
         }
+        data->offsets[r + 1] = e;
+    }
+    data_count_markers(data);
+    return data;
+}
 
-        int iters;
-        double ll = em_run_once(p, reads, n_reads, config, single_marker, &iters);
+void em_data_destroy(em_data_t *data) {
+    if (!data) return;
+    free(data->offsets); free(data->marker); free(data->weight);
+    free(data->species); free(data->containments); free(data->log_c); free(data->log_c_f);
+    free(data);
+}
+
+/* log_c in float; the caller frees it */
+static float *log_c_to_float(const em_data_t *data) {
+    size_t ne = (size_t)(data->n_entries > 0 ? data->n_entries : 1);
+    float *f = (float *)hs_malloc(ne * sizeof(float));
+    for (int e = 0; e < data->n_entries; e++) f[e] = (float)data->log_c[e];
+    return f;
+}
 
-        int converged = (iters < config->max_iter);
+void em_data_to_float(em_data_t *data) {
+    if (!data || data->log_c_f) return;
+    data->log_c_f = log_c_to_float(data);
+    free(data->log_c);
+    free(data->containments);
+    data->log_c = NULL;
+    data->containments = NULL;
+}
+
+static double data_total_weight(const em_data_t *data) {
+    double total = 0.0;
+    for (int r = 0; r < data->n_rows; r++) total += data->weight[r];
+    return total;
+}
 
-        if (ll > best_ll) {
-            params_free(best_p);
-            best_p = p;
-            best_ll = ll;
-            best_iters = iters;
-            best_converged = converged;
+/* --- Restarts ---
+ * Restart 0 starts from uniform parameters (or config->warm_start),
+ * restart k > 0 from a random draw on its own RNG stream, so restarts can
+ * run in any order or concurrently and still give the same fit. */
+typedef struct {
+    const em_data_t *data;
+    const em_config_t *cfg;
+    int S, M;
+    const int *amp_lens;
+    int single_marker;
+    int estep_threads;           /* E-step workers inside each restart */
+    const double *row_mass, *marker_total;
+    em_params_t **params;        /* [n_restarts] out */
+    double *ll;                  /* [n_restarts] out */
+    int *iters;                  /* [n_restarts] out */
+    int *extrapolations;         /* [n_restarts] out, accepted SQUAREM steps */
+} restart_job_t;
+
+static void run_restart(const restart_job_t *job, int restart) {
+    const em_config_t *config = job->cfg;
+    int n_species = job->S, n_markers = job->M;
+    int n_chunks = (job->data->n_rows + EM_CHUNK - 1) / EM_CHUNK;
+
+    em_params_t *p = params_alloc(n_species, n_markers, n_chunks);
+    p->amp_lens = job->amp_lens;
+    p->estimate_degradation = config->estimate_degradation;
+    p->n_threads = job->estep_threads;
+    p->row_mass = job->row_mass;
+    p->marker_total = job->marker_total;
+
+    const em_result_t *warm = config->warm_start;
+    if (restart == 0 && warm && warm->n_species == n_species && warm->n_markers == n_markers) {
+        params_init_warm(p, warm);
+    } else if (restart == 0) {
+        params_init_uniform(p);
+    } else {
+        hs_rng_t rng;
+        hs_rng_seed(&rng, config->seed + (uint64_t)restart * 0xd1b54a32d192ed03ULL);
+        params_init_random(p, &rng, config);
+    }
+
+    /* In single-marker mode, fix d from mito copy numbers and b = 1.0 */
+    if (job->single_marker) {
+        if (config->mito_copy_numbers) {
+            /* d_s = mito_cn_s / geometric_mean(mito_cn) */
+            double log_sum = 0.0;
+            int cn_count = 0;
+            for (int s = 0; s < n_species; s++) {
+                if (config->mito_copy_numbers[s] > 0) {
+                    log_sum += log(config->mito_copy_numbers[s]);
+                    cn_count++;
+                }
+            }
+            double geomean = cn_count > 0 ? exp(log_sum / cn_count) : 1.0;
+            for (int s = 0; s < n_species; s++) {
+                p->d[s] = config->mito_copy_numbers[s] > 0
+                          ? config->mito_copy_numbers[s] / geomean
+                          : 1.0;
+            }
         } else {
-            params_free(p);
+            for (int s = 0; s < n_species; s++) p->d[s] = 1.0;
         }
+        for (int s = 0; s < n_species; s++)
+            for (int m = 0; m < n_markers; m++)
+                p->b[s * n_markers + m] = 1.0;
+    }
+
+    em_gamma_t gamma = gamma_alloc(job->data);
+    job->ll[restart] = em_run_once(p, job->data, gamma, config, job->single_marker,
+                                   &job->iters[restart], &job->extrapolations[restart]);
+    gamma_free(gamma);
+    job->params[restart] = p;
+}
+
+static void restart_worker(void *ctx, int tid, int begin, int end) {
+    (void)tid;
+    for (int k = begin; k < end; k++) run_restart((const restart_job_t *)ctx, k);
+}
+
+/* --- Public API --- */
+
+em_result_t *em_fit(const em_read_t *reads, int n_reads,
+                     int n_species, int n_markers,
+                     const int *amplicon_lengths,
+                     const em_config_t *config) {
+    if (n_reads <= 0 || n_species <= 0) return NULL;
+    em_data_t *data = em_data_from_reads(reads, n_reads);
+    em_result_t *result = em_fit_data(data, n_species, n_markers,
+                                      amplicon_lengths, config);
+    em_data_destroy(data);
+    return result;
+}
+
+em_result_t *em_fit_data(const em_data_t *data,
+                          int n_species, int n_markers,
+                          const int *amplicon_lengths,
+                          const em_config_t *config) {
+    if (!data || data->n_rows <= 0 || n_species <= 0) return NULL;
+    double t_start = hs_clock_ms();
+
+    /* Float storage asked of double data: fit a float view of it */
+    em_data_t fdata;
+    float *log_c_f = NULL;
+    if (config->float_storage && !data->log_c_f) {
+        fdata = *data;
+        fdata.log_c_f = log_c_f = log_c_to_float(data);
+        fdata.log_c = NULL;
+        fdata.containments = NULL;
+        data = &fdata;
     }
 
+    /* Single-marker mode: every read comes from one marker */
+    int single_marker = data->n_markers_seen <= 1;
+
+    if (single_marker) {
+        HS_LOG_INFO("Single-marker mode: fixing d from mito CN priors, b=1.0");
+    }
+
+    /* Data-only M-step totals, shared read-only by every restart */
+    int SM = n_species * n_markers;
+    double *row_mass = (double *)hs_calloc((size_t)SM, sizeof(double));
+    double *marker_total = (double *)hs_calloc((size_t)n_markers, sizeof(double));
+    for (int r = 0; r < data->n_rows; r++) {
+        int m = data->marker[r];
+        double wt = data->weight[r];
+        for (int e = data->offsets[r]; e < data->offsets[r + 1]; e++)
+            row_mass[data->species[e] * n_markers + m] += wt;
+        marker_total[m] += wt;
+    }
+
+    int n_restarts = config->n_restarts > 0 ? config->n_restarts : 1;
+    int n_threads = hs_resolve_threads(config->n_threads);
+    int restart_threads = n_threads < n_restarts ? n_threads : n_restarts;
+
+    restart_job_t job = {
+        .data = data, .cfg = config,
+        .S = n_species, .M = n_markers,
+        .amp_lens = amplicon_lengths,
+        .single_marker = single_marker,
+        .estep_threads = n_threads / restart_threads,
+        .row_mass = row_mass, .marker_total = marker_total,
+        .params = (em_params_t **)hs_calloc((size_t)n_restarts, sizeof(em_params_t *)),
+        .ll = (double *)hs_malloc((size_t)n_restarts * sizeof(double)),
+        .iters = (int *)hs_malloc((size_t)n_restarts * sizeof(int)),
+        .extrapolations = (int *)hs_malloc((size_t)n_restarts * sizeof(int)),
+    };
+    hs_parallel_for(n_restarts, 1, restart_threads, restart_worker, &job);
+    if (em_cancelled(config)) {
+        for (int k = 0; k < n_restarts; k++) params_free(job.params[k]);
+        free(job.params); free(job.ll); free(job.iters); free(job.extrapolations);
+        free(row_mass); free(marker_total);
+        free(log_c_f);
+        return NULL;
+    }
+
+    /* Keep the first restart with the highest likelihood */
+    int best = 0;
+    for (int k = 1; k < n_restarts; k++)
+        if (job.ll[k] > job.ll[best]) best = k;
+    em_params_t *best_p = job.params[best];
+    double best_ll = job.ll[best];
+    int best_iters = job.iters[best];
+    int best_extrapolations = job.extrapolations[best];
+    int best_converged = (best_iters < config->max_iter);
+    for (int k = 0; k < n_restarts; k++)
+        if (k != best) params_free(job.params[k]);
+    free(job.params); free(job.ll); free(job.extrapolations);
+    free(row_mass); free(marker_total);
+
     /* Build result */
     em_result_t *result = (em_result_t *)hs_calloc(1, sizeof(em_result_t));
     result->n_species = n_species;
@@ -414,24 +918,32 @@ em_result_t *em_fit(const em_read_t *reads, int n_reads,
     result->lambda_proc = best_p->lambda;
     result->log_likelihood = best_ll;
     result->n_iterations = best_iters;
+    result->n_restarts = n_restarts;
+    result->restart_iterations = job.iters;
+    result->n_extrapolations = best_extrapolations;
     result->converged = best_converged;
 
     /* BIC = -2*LL + k*ln(n), k = S-1 (w) + S (d) + S*M (b) [+ 1 (lambda)] */
     int n_params = (n_species - 1) + n_species + n_species * n_markers;
     if (config->estimate_degradation) n_params++;
-    result->bic = -2.0 * best_ll + n_params * log((double)n_reads);
+    result->bic = -2.0 * best_ll + n_params * log(data_total_weight(data));
+    double t_ci = hs_clock_ms();
+    result->fit_ms = t_ci - t_start;
 
     /* Compute confidence intervals */
     if (config->use_advanced_ci)
-        em_fisher_info_observed(result, reads, n_reads, n_species, n_markers, amplicon_lengths);
+        em_fisher_info_observed(result, data, n_species, n_markers, amplicon_lengths);
     else
-        em_fisher_info(result, reads, n_reads, n_species, n_markers, amplicon_lengths);
+        em_fisher_info(result, data, n_species, n_markers, amplicon_lengths);
+    double t_lrt = hs_clock_ms();
+    result->ci_ms = t_lrt - t_ci;
 
     /* Perform Likelihood Ratio Test for species detection */
     if (config->use_full_lrt)
-        em_lrt_full(result, reads, n_reads, config, amplicon_lengths);
+        em_lrt_full(result, data, config, amplicon_lengths);
     else
-        em_lrt(result, reads, n_reads, config, amplicon_lengths);
+        em_lrt(result, data, config, amplicon_lengths);
+    result->lrt_ms = hs_clock_ms() - t_lrt;
 
     /* Post-EM species pruning: zero out species below threshold, renormalize */
     if (config->prune_threshold > 0.0) {
@@ -448,48 +960,43 @@ em_result_t *em_fit(const em_read_t *reads, int n_reads,
     }
 
     params_free(best_p);
+    free(log_c_f);
+    if (em_cancelled(config)) {
+        /* Cancelled during the intervals or the LRT */
+        em_result_destroy(result);
+        return NULL;
+    }
     return result;
 }
 
-void em_fisher_info(em_result_t *result,
-                     const em_read_t *reads, int n_reads,
+/* Responsibilities under a fitted result; caller frees them (gamma_free) */
+static em_gamma_t result_gamma(const em_result_t *result, const em_data_t *data,
+                               int S, int M, const int *amplicon_lengths) {
+    double *log_wdb = (double *)hs_malloc((size_t)(S * M) * sizeof(double));
+    fill_log_wdb(result->w, result->d, result->b, S, M, result->lambda_proc,
+                 result->lambda_proc > 1e-8 ? amplicon_lengths : NULL, log_wdb);
+
+    em_gamma_t gamma = gamma_alloc(data);
+    compute_gamma(data, log_wdb, M, gamma);
+    free(log_wdb);
+    return gamma;
+}
+
+void em_fisher_info(em_result_t *result, const em_data_t *data,
                      int n_species, int n_markers,
                      const int *amplicon_lengths) {
     /* Observed Fisher information approximation for w.
      * For Dirichlet-multinomial, Var(w_s) ~ w_s * (1 - w_s) / N_eff
      * where N_eff accounts for classification uncertainty.
      */
-    int M = n_markers;
+    em_gamma_t gamma = result_gamma(result, data, n_species, n_markers, amplicon_lengths);
 
     /* Compute effective sample size per species */
     double *eff_n = (double *)hs_calloc((size_t)n_species, sizeof(double));
-    double **gamma = (double **)hs_malloc((size_t)n_reads * sizeof(double *));
-    for (int r = 0; r < n_reads; r++) {
-        gamma[r] = (double *)hs_calloc((size_t)reads[r].n_candidates, sizeof(double));
-        int nc = reads[r].n_candidates;
-        int m = reads[r].marker_idx;
-        if (m < 0) m = 0;
-        double max_log = -INFINITY;
-        double *log_g = (double *)hs_malloc((size_t)nc * sizeof(double));
-        for (int j = 0; j < nc; j++) {
-            int s = reads[r].species_indices[j];
-            double c = reads[r].containments[j];
-            if (c < 1e-300) c = 1e-300;
-            log_g[j] = log(result->w[s]) + log(result->d[s]) +
-                       log(result->b[s * M + m]) + log(c);
-            if (result->lambda_proc > 1e-8 && amplicon_lengths) {
-                int L = amplicon_lengths[s * M + m];
-                if (L > 0) log_g[j] -= result->lambda_proc * (double)L;
-            }
-            if (log_g[j] > max_log) max_log = log_g[j];
-        }
-        double sum = 0.0;
-        for (int j = 0; j < nc; j++) sum += exp(log_g[j] - max_log);
-        for (int j = 0; j < nc; j++) {
-            gamma[r][j] = exp(log_g[j] - max_log) / sum;
-            eff_n[reads[r].species_indices[j]] += gamma[r][j];
-        }
-        free(log_g);
+    for (int r = 0; r < data->n_rows; r++) {
+        double wt = data->weight[r];
+        for (int e = data->offsets[r]; e < data->offsets[r + 1]; e++)
+            eff_n[data->species[e]] += wt * gamma_at(gamma, e);
     }
 
     /* 95% CI using normal approximation on sqrt(w) transform */
@@ -506,8 +1013,7 @@ void em_fisher_info(em_result_t *result,
         }
     }
 
-    for (int r = 0; r < n_reads; r++) free(gamma[r]);
-    free(gamma);
+    gamma_free(gamma);
     free(eff_n);
 }
 
@@ -518,122 +1024,121 @@ static double chisq_q_df1(double x) {
     return erfc(sqrt(x * 0.5));
 }
 
-void em_lrt(em_result_t *result,
-            const em_read_t *reads, int n_reads,
+/* --- Profile LRT ---
+ * The null model for species s is the fit with w_s = 0 and the other
+ * weights rescaled by 1 / (W - w_s), where W = sum(w).  In each row that
+ * only rescales every score by the same factor and removes s's term, so
+ * with the full-model scores in hand one pass gives every null at once:
+ *   ll_null(s) = ll_full - N log(W - w_s) + sum_{rows with s} wt log(1 - g_rs)
+ * where N is the total read weight and g_rs is s's share of row r's
+ * likelihood.  A row only s could
+ * explain (or none could) takes the fixed -100 per read penalty instead.
+ * Cost is one pass over the CSR entries instead of one per species. */
+void em_lrt(em_result_t *result, const em_data_t *data,
             const em_config_t *config,
             const int *amplicon_lengths) {
     (void)config;
     int S = result->n_species;
     int M = result->n_markers;
+    const int *off = data->offsets;
+    const int *species = data->species;
+    const double *w = result->w;
     result->lrt_scores = (double *)hs_calloc((size_t)S, sizeof(double));
     result->p_values = (double *)hs_calloc((size_t)S, sizeof(double));
 
-    /* For each species, compute log-likelihood of null model (w_s = 0) */
+    const int *amp = result->lambda_proc > 1e-8 ? amplicon_lengths : NULL;
+    double *log_wdb = (double *)hs_malloc((size_t)(S * M) * sizeof(double));
+    fill_log_wdb(w, result->d, result->b, S, M, result->lambda_proc, amp, log_wdb);
+
+    double w_total = 0.0;
+    for (int s = 0; s < S; s++) w_total += w[s];
+    double *log_rest_w = (double *)hs_malloc((size_t)S * sizeof(double));   /* log(W - w_s) */
     for (int s = 0; s < S; s++) {
-        if (result->w[s] < 1e-6) {
-            result->lrt_scores[s] = 0.0;
-            result->p_values[s] = 1.0;
-            continue;
-        }
+        double rest = w_total - w[s];
+        log_rest_w[s] = rest > 0 ? log(rest) : 0.0;
+    }
 
-        /* Re-normalize weights without species s */
-        double *w_null = (double *)hs_malloc((size_t)S * sizeof(double));
-        double sum_null = 0.0;
-        for (int i = 0; i < S; i++) {
-            w_null[i] = (i == s) ? 0.0 : result->w[i];
-            sum_null += w_null[i];
-        }
-        if (sum_null > 0) {
-            for (int i = 0; i < S; i++) w_null[i] /= sum_null;
-        } else {
-            /* All species nullified? Should not happen if data exists */
-            free(w_null);
-            continue;
+    int max_k = 1;
+    for (int r = 0; r < data->n_rows; r++)
+        if (off[r + 1] - off[r] > max_k) max_k = off[r + 1] - off[r];
+    double *t = (double *)hs_malloc((size_t)max_k * sizeof(double));
+    double *corr = (double *)hs_calloc((size_t)S, sizeof(double));
+    double ll_full = 0.0;      /* rows some species explains */
+    double n_full = 0.0;       /* their total weight */
+    double ll_orphan = 0.0;    /* penalty for rows no species explains */
+
+    for (int r = 0; r < data->n_rows; r++) {
+        int m = data->marker[r];
+        int e0 = off[r], e1 = off[r + 1], k = e1 - e0;
+        double wt = data->weight[r];
+
+        /* Scores of the candidates; species with w = 0 score -inf */
+        int top = -1, second = -1;
+        for (int j = 0; j < k; j++) {
+            int sp = species[e0 + j];
+            t[j] = w[sp] > 0 ? log_wdb[sp * M + m] + data_log_c(data, e0 + j) : -INFINITY;
+            if (t[j] == -INFINITY) continue;
+            if (top < 0 || t[j] > t[top]) { second = top; top = j; }
+            else if (second < 0 || t[j] > t[second]) second = j;
         }
+        if (top < 0) { ll_orphan += wt * -100.0; continue; }
 
-        /* Compute log-likelihood under null model */
-        double ll_null = 0.0;
-        for (int r = 0; r < n_reads; r++) {
-            int nc = reads[r].n_candidates;
-            int m = reads[r].marker_idx;
-            if (m < 0) m = 0;
-
-            double max_log = -INFINITY;
-            double *log_g = (double *)hs_malloc((size_t)nc * sizeof(double));
-            int has_valid = 0;
-
-            for (int j = 0; j < nc; j++) {
-                int sp = reads[r].species_indices[j];
-                if (w_null[sp] <= 0) continue;
-                double c = reads[r].containments[j];
-                log_g[j] = log(w_null[sp]) + log(result->d[sp]) +
-                           log(result->b[sp * M + m]) + log(c);
-                if (result->lambda_proc > 1e-8 && amplicon_lengths) {
-                    int L = amplicon_lengths[sp * M + m];
-                    if (L > 0) log_g[j] -= result->lambda_proc * (double)L;
-                }
-                if (log_g[j] > max_log) max_log = log_g[j];
-                has_valid = 1;
-            }
-
-            if (has_valid) {
-                double sum = 0.0;
-                for (int j = 0; j < nc; j++) {
-                    int sp = reads[r].species_indices[j];
-                    if (w_null[sp] > 0) sum += exp(log_g[j] - max_log);
-                }
-                ll_null += max_log + log(sum);
+        double sum = 0.0;
+        for (int j = 0; j < k; j++) sum += exp(t[j] - t[top]);
+        double log_norm = t[top] + log(sum);
+        ll_full += wt * log_norm;
+        n_full += wt;
+
+        for (int j = 0; j < k; j++) {
+            int sp = species[e0 + j];
+            if (t[j] == -INFINITY) continue;
+            /* log of the mass left without this candidate.  Below the top
+             * it is at least the top's own mass, so subtracting is safe;
+             * for the top it is summed afresh around the runner-up. */
+            double log_rest;
+            if (j != top) {
+                log_rest = t[top] + log(sum - exp(t[j] - t[top]));
+            } else if (second >= 0) {
+                double s2 = 0.0;
+                for (int f = 0; f < k; f++)
+                    if (f != top) s2 += exp(t[f] - t[second]);
+                log_rest = t[second] + log(s2);
             } else {
-                /* Read cannot be explained without species s */
-                ll_null += -100.0; /* Penalty for unexplained read */
+                /* Only this species explains the row */
+                corr[sp] += wt * (-100.0 - log_norm + log_rest_w[sp]);
+                continue;
             }
-            free(log_g);
+            corr[sp] += wt * (log_rest - log_norm);
         }
+    }
+
+    for (int s = 0; s < S; s++) {
+        if (w[s] < 1e-6) {
+            result->lrt_scores[s] = 0.0;
+            result->p_values[s] = 1.0;
+            continue;
+        }
+        if (w_total - w[s] <= 0) continue;   /* nothing left to explain the data */
+        double ll_null = ll_full - n_full * log_rest_w[s] + corr[s] + ll_orphan;
 
         /* LRT statistic = 2 * (LL_full - LL_null) */
         double lrt = 2.0 * (result->log_likelihood - ll_null);
         if (lrt < 0) lrt = 0; /* numerical precision */
         result->lrt_scores[s] = lrt;
         result->p_values[s] = chisq_q_df1(lrt);
-
-        free(w_null);
     }
+
+    free(corr); free(t); free(log_rest_w); free(log_wdb);
 }
 
 /* --- Observed Fisher Information CIs (Louis 1982) --- */
-void em_fisher_info_observed(em_result_t *result,
-                              const em_read_t *reads, int n_reads,
+void em_fisher_info_observed(em_result_t *result, const em_data_t *data,
                               int n_species, int n_markers,
                               const int *amplicon_lengths) {
-    int S = n_species, M = n_markers;
+    int S = n_species;
 
     /* Re-run E-step with final parameters to get gamma */
-    double **gamma = (double **)hs_malloc((size_t)n_reads * sizeof(double *));
-    for (int r = 0; r < n_reads; r++) {
-        int nc = reads[r].n_candidates;
-        gamma[r] = (double *)hs_calloc((size_t)nc, sizeof(double));
-        int m = reads[r].marker_idx;
-        if (m < 0) m = 0;
-        double max_log = -INFINITY;
-        double *log_g = (double *)hs_malloc((size_t)nc * sizeof(double));
-        for (int j = 0; j < nc; j++) {
-            int s = reads[r].species_indices[j];
-            double c = reads[r].containments[j];
-            if (c < 1e-300) c = 1e-300;
-            log_g[j] = log(result->w[s]) + log(result->d[s]) +
-                       log(result->b[s * M + m]) + log(c);
-            if (result->lambda_proc > 1e-8 && amplicon_lengths) {
-                int L = amplicon_lengths[s * M + m];
-                if (L > 0) log_g[j] -= result->lambda_proc * (double)L;
-            }
-            if (log_g[j] > max_log) max_log = log_g[j];
-        }
-        double sum = 0.0;
-        for (int j = 0; j < nc; j++) sum += exp(log_g[j] - max_log);
-        for (int j = 0; j < nc; j++)
-            gamma[r][j] = exp(log_g[j] - max_log) / sum;
-        free(log_g);
-    }
+    em_gamma_t gamma = result_gamma(result, data, S, n_markers, amplicon_lengths);
 
     /* Compute observed Fisher information per species with Louis correction */
     for (int s = 0; s < S; s++) {
@@ -646,12 +1151,12 @@ void em_fisher_info_observed(em_result_t *result,
         double I_complete = 0.0;   /* Complete-data Fisher info */
         double I_missing = 0.0;    /* Missing-data correction */
 
-        for (int r = 0; r < n_reads; r++) {
+        for (int r = 0; r < data->n_rows; r++) {
             /* Find gamma for species s in this read */
             double gamma_rs = 0.0;
-            for (int j = 0; j < reads[r].n_candidates; j++) {
-                if (reads[r].species_indices[j] == s) {
-                    gamma_rs = gamma[r][j];
+            for (int e = data->offsets[r]; e < data->offsets[r + 1]; e++) {
+                if (data->species[e] == s) {
+                    gamma_rs = gamma_at(gamma, e);
                     break;
                 }
             }
@@ -661,11 +1166,12 @@ void em_fisher_info_observed(em_result_t *result,
             double score = gamma_rs / ws - (1.0 - gamma_rs) / (1.0 - ws);
 
             /* Complete-data Fisher info: sum of score^2 */
-            I_complete += score * score;
+            double wt = data->weight[r];
+            I_complete += wt * score * score;
 
             /* Louis missing information: Var_Z[score | r, theta] */
             double inv_term = 1.0 / ws + 1.0 / (1.0 - ws);
-            I_missing += gamma_rs * (1.0 - gamma_rs) * inv_term * inv_term;
+            I_missing += wt * gamma_rs * (1.0 - gamma_rs) * inv_term * inv_term;
         }
 
         /* Observed info = complete - missing */
@@ -679,45 +1185,131 @@ void em_fisher_info_observed(em_result_t *result,
         if (result->w_ci_hi[s] > 1.0) result->w_ci_hi[s] = 1.0;
     }
 
-    for (int r = 0; r < n_reads; r++) free(gamma[r]);
-    free(gamma);
+    gamma_free(gamma);
 }
 
-/* --- Brent's method for lambda optimization --- */
-static double brent_obs_ll(double lambda, const em_params_t *p,
-                            const em_read_t *reads, int n_reads) {
-    /* Compute the observed-data log-likelihood at a given lambda,
-     * holding all other parameters (w, d, b) fixed.
-     * This directly maximizes the observed LL with respect to lambda. */
+/* --- Brent's method for lambda optimization ---
+ * With w, d and b held fixed, lambda reaches a row's likelihood only
+ * through the amplicon lengths of its candidates, so
+ *   ll_r(lambda) = -lambda L0_r + log sum_L A_rL exp(-lambda (L - L0_r))
+ * where L0_r is the row's shortest length and A_rL sums the lambda-free
+ * scores of its candidates of length L.  Building the A_rL once per
+ * M-step leaves each Brent evaluation a sum over the rows that mix
+ * lengths, one exp per distinct length and no table lookups. */
+static void lambda_stats_build(em_params_t *p, const em_data_t *data) {
+    lambda_stats_t *ls = &p->lstats;
     int M = p->M;
+    const int *off = data->offsets;
+    const int *sp = data->species;
+    if (!ls->off) {
+        size_t ne = (size_t)(data->n_entries > 0 ? data->n_entries : 1);
+        ls->off = (int *)hs_malloc((size_t)(data->n_rows + 1) * sizeof(int));
+        ls->wt = (double *)hs_malloc((size_t)(data->n_rows > 0 ? data->n_rows : 1) * sizeof(double));
+        ls->dl = (double *)hs_malloc(ne * sizeof(double));
+        ls->la = (double *)hs_malloc(ne * sizeof(double));
+    }
+    ls->n_rows = 0;
+    ls->off[0] = 0;
+    ls->base = 0.0;
+    ls->slope = 0.0;
+    int nt = 0;
+    for (int r = 0; r < data->n_rows; r++) {
+        int m = data->marker[r];
+        int t0 = nt;
+        for (int e = off[r]; e < off[r + 1]; e++) {
+            int s = sp[e];
+            double v = p->log_wdb[s * M + m] + data_log_c(data, e);
+            if (v == -INFINITY) continue;
+            int L = p->amp_lens[s * M + m];
+            double len = L > 0 ? (double)L : 0.0;
+            int t = t0;
+            while (t < nt && ls->dl[t] != len) t++;
+            if (t < nt) {
+                ls->la[t] = hs_log_add(ls->la[t], v);
+            } else {
+                ls->dl[nt] = len;
+                ls->la[nt] = v;
+                nt++;
+            }
+        }
+        if (nt == t0) continue;
+
+        double wt = data->weight[r];
+        double len0 = ls->dl[t0], top = ls->la[t0];
+        for (int t = t0 + 1; t < nt; t++) {
+            if (ls->dl[t] < len0) len0 = ls->dl[t];
+            if (ls->la[t] > top) top = ls->la[t];
+        }
+        ls->base += wt * top;
+        ls->slope += wt * len0;
+        if (nt - t0 == 1) {         /* a single length: linear in lambda */
+            nt = t0;
+            continue;
+        }
+        for (int t = t0; t < nt; t++) {
+            ls->dl[t] -= len0;
+            ls->la[t] -= top;
+        }
+        ls->wt[ls->n_rows++] = wt;
+        ls->off[ls->n_rows] = nt;
+    }
+}
+
+/* Every la <= 0 with one of them 0, and dl >= 0, so no sum can overflow
+ * or vanish and none needs a max shift */
+static double lambda_stats_ll_rows(const lambda_stats_t *ls, double lambda,
+                                   int r0, int r1) {
     double ll = 0.0;
-    for (int r = 0; r < n_reads; r++) {
-        int nc = reads[r].n_candidates;
-        int m = reads[r].marker_idx;
-        if (m < 0) m = 0;
+    for (int r = r0; r < r1; r++) {
+        double sum = 0.0;
+        for (int t = ls->off[r]; t < ls->off[r + 1]; t++)
+            sum += exp(ls->la[t] - lambda * ls->dl[t]);
+        ll += ls->wt[r] * log(sum);
+    }
+    return ll;
+}
 
-        double max_log = -INFINITY;
-        double *log_terms = (double *)hs_malloc((size_t)nc * sizeof(double));
-        for (int j = 0; j < nc; j++) {
-            int s = reads[r].species_indices[j];
-            double c = reads[r].containments[j];
-            if (c < 1e-300) c = 1e-300;
-            log_terms[j] = log(p->w[s]) + log(p->d[s]) + log(p->b[s * M + m])
-                         - lambda * (double)(p->amp_lens ? p->amp_lens[s * M + m] : 0)
-                         + log(c);
-            if (log_terms[j] > max_log) max_log = log_terms[j];
-        }
-        double sum_exp = 0.0;
-        for (int j = 0; j < nc; j++) sum_exp += exp(log_terms[j] - max_log);
-        ll += max_log + log(sum_exp);
-        free(log_terms);
+typedef struct {
+    const em_params_t *p;
+    double lambda;
+} brent_job_t;
+
+static void brent_worker(void *ctx, int tid, int begin, int end) {
+    (void)tid;
+    brent_job_t *job = (brent_job_t *)ctx;
+    const em_params_t *p = job->p;
+    const lambda_stats_t *ls = &p->lstats;
+    int SM = p->S * p->M;
+    for (int c = begin; c < end; c++) {
+        int r0 = c * EM_CHUNK;
+        int r1 = r0 + EM_CHUNK < ls->n_rows ? r0 + EM_CHUNK : ls->n_rows;
+        p->partials[(size_t)c * (size_t)(SM + 1) + (size_t)SM] =
+            lambda_stats_ll_rows(ls, job->lambda, r0, r1);
     }
+}
+
+static double brent_obs_ll(double lambda, const em_params_t *p) {
+    /* Compute the observed-data log-likelihood at a given lambda,
+     * holding all other parameters (w, d, b) fixed.
+     * This directly maximizes the observed LL with respect to lambda.
+     * p->lstats must be built for the current (w, d, b); chunks run like
+     * the E-step and reuse its partials buffer. */
+    const lambda_stats_t *ls = &p->lstats;
+    int SM = p->S * p->M;
+    int n_chunks = (ls->n_rows + EM_CHUNK - 1) / EM_CHUNK;
+    brent_job_t job = { p, lambda };
+    hs_parallel_for(n_chunks, 1, p->n_threads, brent_worker, &job);
+    double ll = ls->base - lambda * ls->slope;
+    for (int c = 0; c < n_chunks; c++)
+        ll += p->partials[(size_t)c * (size_t)(SM + 1) + (size_t)SM];
     return ll;
 }
 
-static double brent_lambda_update(const em_params_t *p, const em_read_t *reads,
-                                   int n_reads, double **gamma) {
-    (void)gamma; /* Not needed — we maximize observed LL directly */
+static double brent_lambda_update(em_params_t *p, const em_data_t *data) {
+    /* w, d and b were just updated by the M-step */
+    fill_log_wdb(p->w, p->d, p->b, p->S, p->M, 0.0, NULL, p->log_wdb);
+    lambda_stats_build(p, data);
+
     /* Brent's method to maximize observed LL w.r.t. lambda over [a, b] */
     double a = 1e-6, b = 0.1;
     double tol = 1e-8;
@@ -728,7 +1320,7 @@ static double brent_lambda_update(const em_params_t *p, const em_read_t *reads,
 
     double x = a + golden * (b - a);
     double w_br = x, v = x;
-    double fx = -brent_obs_ll(x, p, reads, n_reads); /* minimize -Q */
+    double fx = -brent_obs_ll(x, p); /* minimize -Q */
     double fw = fx, fv = fx;
     double d_br = 0.0, e = 0.0;
 
@@ -764,7 +1356,7 @@ static double brent_lambda_update(const em_params_t *p, const em_read_t *reads,
         }
 
         u = (fabs(d_br) >= tol1) ? x + d_br : x + ((d_br > 0) ? tol1 : -tol1);
-        double fu = -brent_obs_ll(u, p, reads, n_reads);
+        double fu = -brent_obs_ll(u, p);
 
         if (fu <= fx) {
             if (u < x) b = x; else a = x;
@@ -785,16 +1377,110 @@ static double brent_lambda_update(const em_params_t *p, const em_read_t *reads,
     return x;
 }
 
-/* --- Full nested-model LRT --- */
-void em_lrt_full(em_result_t *result,
-                 const em_read_t *reads, int n_reads,
+/* --- Full nested-model LRT ---
+ * Each nested model drops one species.  Instead of copying the reads with
+ * remapped indices, the refit runs on a masked view of the shared data:
+ * the species is held at w = 0, its entries are skipped and rows that list
+ * only it drop out.  Refits are warm-started from the full-model fit and
+ * run concurrently. */
+typedef struct {
+    const em_result_t *full;
+    const em_data_t *data;
+    const em_config_t *cfg;
+    const int *amp_lens;
+    int estep_threads;
+    double *ll_reduced;          /* [S] out, -INFINITY = no reduced model */
+} nested_job_t;
+
+static void nested_refit(const nested_job_t *job, int s_test) {
+    const em_result_t *full = job->full;
+    const em_data_t *data = job->data;
+    int S = full->n_species, M = full->n_markers;
+    job->ll_reduced[s_test] = -INFINITY;
+    if (full->w[s_test] < 1e-6 || S < 2) return;
+
+    /* M-step totals over the masked view */
+    double *row_mass = (double *)hs_calloc((size_t)(S * M), sizeof(double));
+    double *marker_total = (double *)hs_calloc((size_t)M, sizeof(double));
+    char *seen = (char *)hs_calloc((size_t)M > 0 ? (size_t)M : 1, 1);
+    int n_kept = 0;
+    for (int r = 0; r < data->n_rows; r++) {
+        int m = data->marker[r];
+        double wt = data->weight[r];
+        int kept = 0;
+        for (int e = data->offsets[r]; e < data->offsets[r + 1]; e++) {
+            if (data->species[e] == s_test) continue;
+            row_mass[data->species[e] * M + m] += wt;
+            kept = 1;
+        }
+        if (!kept) continue;
+        marker_total[m] += wt;
+        seen[m] = 1;
+        n_kept++;
+    }
+    int n_markers_seen = 0;
+    for (int m = 0; m < M; m++) n_markers_seen += seen[m];
+    free(seen);
+
+    if (n_kept > 0) {
+        em_params_t *p = params_alloc(S, M, (data->n_rows + EM_CHUNK - 1) / EM_CHUNK);
+        p->amp_lens = job->amp_lens;
+        p->estimate_degradation = job->cfg->estimate_degradation;
+        p->n_threads = job->estep_threads;
+        p->row_mass = row_mass;
+        p->marker_total = marker_total;
+        p->masked = s_test;
+
+        /* Warm start: full-model parameters with s_test removed */
+        double w_sum = 0.0;
+        for (int s = 0; s < S; s++) if (s != s_test) w_sum += full->w[s];
+        for (int s = 0; s < S; s++)
+            p->w[s] = (s == s_test || w_sum <= 0) ? 0.0 : full->w[s] / w_sum;
+        memcpy(p->d, full->d, (size_t)S * sizeof(double));
+        memcpy(p->b, full->b, (size_t)(S * M) * sizeof(double));
+        p->lambda = full->lambda_proc;
+
+        int single_marker = n_markers_seen <= 1;
+        if (single_marker)
+            for (int i = 0; i < S * M; i++) p->b[i] = 1.0;
+
+        em_config_t sub_cfg = *job->cfg;
+        sub_cfg.max_iter = 50;             /* Warm-start sufficient */
+        sub_cfg.use_brent_lambda = 0;
+
+        em_gamma_t gamma = gamma_alloc(data);
+        int iters;
+        job->ll_reduced[s_test] = em_run_once(p, data, gamma, &sub_cfg,
+                                              single_marker, &iters, NULL);
+        gamma_free(gamma);
+        params_free(p);
+    }
+    free(row_mass);
+    free(marker_total);
+}
+
+static void nested_worker(void *ctx, int tid, int begin, int end) {
+    (void)tid;
+    for (int s = begin; s < end; s++) nested_refit((const nested_job_t *)ctx, s);
+}
+
+void em_lrt_full(em_result_t *result, const em_data_t *data,
                  const em_config_t *config,
                  const int *amplicon_lengths) {
     int S = result->n_species;
-    int M = result->n_markers;
     result->lrt_scores = (double *)hs_calloc((size_t)S, sizeof(double));
     result->p_values = (double *)hs_calloc((size_t)S, sizeof(double));
 
+    int n_threads = hs_resolve_threads(config->n_threads);
+    int refit_threads = n_threads < S ? n_threads : S;
+    nested_job_t job = {
+        .full = result, .data = data, .cfg = config,
+        .amp_lens = amplicon_lengths,
+        .estep_threads = n_threads / refit_threads,
+        .ll_reduced = (double *)hs_malloc((size_t)S * sizeof(double)),
+    };
+    hs_parallel_for(S, 1, refit_threads, nested_worker, &job);
+
     for (int s_test = 0; s_test < S; s_test++) {
         if (result->w[s_test] < 1e-6) {
             result->lrt_scores[s_test] = 0.0;
@@ -802,114 +1488,128 @@ void em_lrt_full(em_result_t *result,
             continue;
         }
 
-        /* Build reduced reads: remove species s_test from each read's candidates */
-        int n_reduced = 0;
-        em_read_t *reduced = (em_read_t *)hs_calloc((size_t)n_reads, sizeof(em_read_t));
-
-        /* Species index remapping: shift indices > s_test down by 1 */
-        for (int r = 0; r < n_reads; r++) {
-            int nc_orig = reads[r].n_candidates;
-            int nc_new = 0;
-
-            /* Count candidates excluding s_test */
-            for (int j = 0; j < nc_orig; j++)
-                if (reads[r].species_indices[j] != s_test) nc_new++;
-
-            if (nc_new == 0) continue; /* Read only had s_test — drop it */
-
-            reduced[n_reduced].marker_idx = reads[r].marker_idx;
-            reduced[n_reduced].n_candidates = nc_new;
-            reduced[n_reduced].species_indices = (int *)hs_malloc((size_t)nc_new * sizeof(int));
-            reduced[n_reduced].containments = (double *)hs_malloc((size_t)nc_new * sizeof(double));
-
-            int k = 0;
-            for (int j = 0; j < nc_orig; j++) {
-                int sp = reads[r].species_indices[j];
-                if (sp == s_test) continue;
-                /* Remap: indices > s_test shift down by 1 */
-                reduced[n_reduced].species_indices[k] = sp > s_test ? sp - 1 : sp;
-                reduced[n_reduced].containments[k] = reads[r].containments[j];
-                k++;
-            }
-            n_reduced++;
-        }
-
-        /* Build reduced amplicon lengths (remove row s_test) */
-        int S_red = S - 1;
-        int *amp_red = NULL;
-        if (amplicon_lengths) {
-            amp_red = (int *)hs_calloc((size_t)(S_red * M), sizeof(int));
-            int dst = 0;
-            for (int s = 0; s < S; s++) {
-                if (s == s_test) continue;
-                for (int m = 0; m < M; m++)
-                    amp_red[dst * M + m] = amplicon_lengths[s * M + m];
-                dst++;
-            }
-        }
-
-        /* Re-fit EM with S-1 species */
-        em_config_t reduced_cfg = *config;
-        reduced_cfg.n_restarts = 1;        /* Warm-start sufficient */
-        reduced_cfg.max_iter = 50;         /* Fewer iterations needed */
-        reduced_cfg.use_advanced_ci = 0;   /* Disable advanced methods in sub-fit */
-        reduced_cfg.use_brent_lambda = 0;
-        reduced_cfg.use_full_lrt = 0;
-        reduced_cfg.prune_threshold = 0.0;
-        reduced_cfg.mito_copy_numbers = NULL; /* Not needed for sub-fit */
-
-        double ll_reduced = -INFINITY;
-        if (n_reduced > 0 && S_red > 0) {
-            em_result_t *res_red = em_fit(reduced, n_reduced, S_red, M,
-                                           amp_red, &reduced_cfg);
-            if (res_red) {
-                ll_reduced = res_red->log_likelihood;
-                em_result_destroy(res_red);
-            }
-        }
-
         /* LRT = 2 * (LL_full - LL_reduced) */
-        double lrt = 2.0 * (result->log_likelihood - ll_reduced);
+        double lrt = 2.0 * (result->log_likelihood - job.ll_reduced[s_test]);
         if (lrt < 0) lrt = 0;
         result->lrt_scores[s_test] = lrt;
         result->p_values[s_test] = chisq_q_df1(lrt);
-
-        /* Cleanup */
-        free(amp_red);
-        for (int r = 0; r < n_reduced; r++) {
-            free(reduced[r].species_indices);
-            free(reduced[r].containments);
-        }
-        free(reduced);
     }
+    free(job.ll_reduced);
+}
+
+em_read_t *em_reads_from_classify(const void *results_ptr, int *out_n_em_reads) {
+    em_read_t *em_reads = NULL;
+    int n_em = 0, cap = 0;
+    em_reads_append_classify(&em_reads, &n_em, &cap, results_ptr, NULL);
+    *out_n_em_reads = em_reads_collapse(em_reads, n_em);
+    return em_reads;
 }
 
-em_read_t *em_reads_from_classify(const void *results_ptr, int n_reads,
-                                   int *out_n_em_reads) {
-    const read_result_t *results = (const read_result_t *)results_ptr;
+void em_reads_append_classify(em_read_t **reads, int *n, int *cap,
+                              const void *results_ptr, const int *counts) {
+    const classify_results_t *results = (const classify_results_t *)results_ptr;
     /* Count classified reads */
-    int n_em = 0;
-    for (int i = 0; i < n_reads; i++)
-        if (results[i].is_classified && results[i].n_hits > 0) n_em++;
-
-    em_read_t *em_reads = (em_read_t *)hs_calloc((size_t)n_em, sizeof(em_read_t));
-    int idx = 0;
-    for (int i = 0; i < n_reads; i++) {
-        if (!results[i].is_classified || results[i].n_hits == 0) continue;
-        em_reads[idx].marker_idx = results[i].marker_idx;
-        em_reads[idx].n_candidates = results[i].n_hits;
+    int n_new = 0;
+    for (int i = 0; i < results->n_reads; i++)
+        if (results->reads[i].n_hits > 0) n_new++;
+    if (n_new == 0) return;
+
+    if (*n + n_new > *cap) {
+        int new_cap = *cap > 0 ? *cap : 1024;
+        while (new_cap < *n + n_new) new_cap *= 2;
+        *reads = (em_read_t *)hs_realloc(*reads, (size_t)new_cap * sizeof(em_read_t));
+        *cap = new_cap;
+    }
+    em_read_t *em_reads = *reads;
+    int idx = *n;
+    for (int i = 0; i < results->n_reads; i++) {
+        const read_result_t *rr = &results->reads[i];
+        if (rr->n_hits == 0) continue;
+        const species_hit_t *hits = classify_read_hits(results, i);
+        em_reads[idx].marker_idx = rr->marker_idx;
+        em_reads[idx].n_candidates = rr->n_hits;
+        em_reads[idx].count = counts ? counts[i] : 1;
         em_reads[idx].species_indices = (int *)hs_malloc(
-            (size_t)results[i].n_hits * sizeof(int));
+            (size_t)rr->n_hits * sizeof(int));
         em_reads[idx].containments = (double *)hs_malloc(
-            (size_t)results[i].n_hits * sizeof(double));
-        for (int j = 0; j < results[i].n_hits; j++) {
-            em_reads[idx].species_indices[j] = results[i].hits[j].species_idx;
-            em_reads[idx].containments[j] = results[i].hits[j].containment;
+            (size_t)rr->n_hits * sizeof(double));
+        for (int j = 0; j < rr->n_hits; j++) {
+            em_reads[idx].species_indices[j] = hits[j].species_idx;
+            em_reads[idx].containments[j] = hits[j].containment;
         }
         idx++;
     }
-    *out_n_em_reads = n_em;
-    return em_reads;
+    *n = idx;
+}
+
+double em_reads_total(const em_read_t *reads, int n_reads) {
+    double total = 0.0;
+    for (int r = 0; r < n_reads; r++) total += read_weight(&reads[r]);
+    return total;
+}
+
+/* FNV-1a over the fields that determine a read's EM contribution */
+static uint64_t em_read_key(const em_read_t *r) {
+    uint64_t h = 1469598103934665603ULL;
+    const unsigned char *p = (const unsigned char *)&r->marker_idx;
+    for (size_t i = 0; i < sizeof(int); i++) h = (h ^ p[i]) * 1099511628211ULL;
+    p = (const unsigned char *)r->species_indices;
+    for (size_t i = 0; i < (size_t)r->n_candidates * sizeof(int); i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    p = (const unsigned char *)r->containments;
+    for (size_t i = 0; i < (size_t)r->n_candidates * sizeof(double); i++)
+        h = (h ^ p[i]) * 1099511628211ULL;
+    return h;
+}
+
+static int em_read_same(const em_read_t *a, const em_read_t *b) {
+    return a->marker_idx == b->marker_idx && a->n_candidates == b->n_candidates &&
+           memcmp(a->species_indices, b->species_indices,
+                  (size_t)a->n_candidates * sizeof(int)) == 0 &&
+           memcmp(a->containments, b->containments,
+                  (size_t)a->n_candidates * sizeof(double)) == 0;
+}
+
+int em_reads_collapse(em_read_t *reads, int n_reads) {
+    if (n_reads <= 1) return n_reads;
+    size_t cap = 16;
+    while (cap < 2 * (size_t)n_reads) cap <<= 1;
+    int *slots = (int *)hs_malloc(cap * sizeof(int));    /* index into reads, -1 empty */
+    uint64_t *keys = (uint64_t *)hs_malloc(cap * sizeof(uint64_t));
+    for (size_t i = 0; i < cap; i++) slots[i] = -1;
+
+    int n_out = 0;
+    for (int r = 0; r < n_reads; r++) {
+        uint64_t key = em_read_key(&reads[r]);
+        size_t i = (size_t)(key & (cap - 1));
+        while (slots[i] >= 0 && !(keys[i] == key && em_read_same(&reads[slots[i]], &reads[r])))
+            i = (i + 1) & (cap - 1);
+        if (slots[i] >= 0) {
+            em_read_t *dst = &reads[slots[i]];
+            dst->count = (int)read_weight(dst) + (int)read_weight(&reads[r]);
+            free(reads[r].species_indices);
+            free(reads[r].containments);
+        } else {
+            reads[n_out] = reads[r];
+            if (reads[n_out].count <= 0) reads[n_out].count = 1;
+            slots[i] = n_out;
+            keys[i] = key;
+            n_out++;
+        }
+    }
+    free(slots);
+    free(keys);
+    return n_out;
+}
+
+void em_reads_quantize(em_read_t *reads, int n_reads, double step) {
+    if (step <= 0.0) return;
+    for (int r = 0; r < n_reads; r++) {
+        for (int j = 0; j < reads[r].n_candidates; j++) {
+            double q = floor(reads[r].containments[j] / step + 0.5);
+            reads[r].containments[j] = (q < 1.0 ? 1.0 : q) * step;
+        }
+    }
 }
 
 void em_reads_free(em_read_t *reads, int n) {
@@ -926,5 +1626,6 @@ void em_result_destroy(em_result_t *r) {
     free(r->w); free(r->d); free(r->b);
     free(r->w_ci_lo); free(r->w_ci_hi);
     free(r->lrt_scores); free(r->p_values);
+    free(r->restart_iterations);
     free(r);
 }
@@ -3,6 +3,8 @@
 
 #include <stdint.h>
 
+struct em_result_s;
+
 typedef struct {
     int max_iter;
     double conv_threshold;
@@ -18,9 +20,18 @@ typedef struct {
     int use_advanced_ci;       /* 0 = Wald (default), 1 = observed Fisher information */
     int use_brent_lambda;      /* 0 = closed-form (default), 1 = Brent's method */
     int use_full_lrt;          /* 0 = profile LRT (default), 1 = full nested-model refit */
+    int use_squarem;           /* 0 = plain fixed-point EM (default), 1 = SQUAREM-accelerated */
+    int n_threads;             /* Restart / E-step workers (<= 0 = all CPUs, default 1) */
+    int float_storage;         /* 0 = double (default), 1 = per-entry log-containments and
+                                  responsibilities in float, sums in double (the data is
+                                  viewed as by em_data_to_float for the fit) */
+    const struct em_result_s *warm_start; /* Restart 0 starts from this earlier fit of the
+                                             same species/markers (NULL = uniform) */
+    const volatile int *cancel; /* Once *cancel is nonzero every restart stops at its next
+                                   iteration and the fit returns NULL (NULL = never) */
 } em_config_t;
 
-typedef struct {
+typedef struct em_result_s {
     double *w;                 /* [S] species weight fractions */
     double *d;                 /* [S] DNA yield factors */
     double *b;                 /* [S * M] PCR bias matrix (row-major) */
@@ -28,10 +39,16 @@ typedef struct {
     double *w_ci_lo, *w_ci_hi; /* [S] 95% CIs on weight fractions */
     double log_likelihood;
     double bic;
-    int n_iterations;
+    int n_iterations;          /* EM steps taken (per restart, best restart) */
+    int n_restarts;
+    int *restart_iterations;   /* [n_restarts] EM steps taken by each restart */
+    int n_extrapolations;      /* SQUAREM extrapolations accepted (0 = plain EM) */
     int converged;
     double *lrt_scores;   /* [S] Likelihood ratio test scores */
     double *p_values;     /* [S] LRT p-values */
+    double fit_ms;        /* Wall time: EM restarts, confidence intervals, LRT */
+    double ci_ms;
+    double lrt_ms;
     int n_species;
     int n_markers;
 } em_result_t;
@@ -42,43 +59,92 @@ typedef struct {
     int *species_indices;      /* Candidate species for this read */
     double *containments;      /* Containment scores */
     int n_candidates;
+    int count;                 /* Multiplicity of identical reads (0 = 1) */
 } em_read_t;
 
+/* Flat (CSR) EM input.  Row r's candidates are entries
+ * offsets[r] .. offsets[r+1]-1 of species / containments / log_c, and
+ * responsibilities are kept in a parallel [n_entries] array. */
+typedef struct {
+    int n_rows;
+    int n_entries;
+    int n_markers_seen;        /* Distinct marker indices across rows */
+    int *offsets;              /* [n_rows + 1] */
+    int *marker;               /* [n_rows] marker index (negative mapped to 0) */
+    double *weight;            /* [n_rows] read multiplicity */
+    int *species;              /* [n_entries] candidate species */
+    double *containments;      /* [n_entries] containment scores (NULL in float) */
+    double *log_c;             /* [n_entries] log(max(containment, 1e-300)) (NULL in float) */
+    float *log_c_f;            /* [n_entries] log_c in float storage, else NULL */
+} em_data_t;
+
 em_config_t em_config_default(void);
 
+/* Pack an em_read_t array into a single contiguous em_data_t */
+em_data_t *em_data_from_reads(const em_read_t *reads, int n_reads);
+void em_data_destroy(em_data_t *data);
+/* Switch to float storage in place: log_c is kept in float and the
+ * containments, which fitting does not read, are dropped, halving the
+ * per-entry footprint.  Fits of float data keep responsibilities in float
+ * too; accumulated sums stay double. */
+void em_data_to_float(em_data_t *data);
+
 /* THE CORE: fit multi-marker bias-corrected EM */
+em_result_t *em_fit_data(const em_data_t *data,
+                          int n_species, int n_markers,
+                          const int *amplicon_lengths,
+                          const em_config_t *config);
+
+/* Convenience wrapper: packs reads with em_data_from_reads and fits */
 em_result_t *em_fit(const em_read_t *reads, int n_reads,
                      int n_species, int n_markers,
                      const int *amplicon_lengths,
                      const em_config_t *config);
 
 /* Compute Fisher information for confidence intervals (Wald approximation) */
-void em_fisher_info(em_result_t *result,
-                     const em_read_t *reads, int n_reads,
+void em_fisher_info(em_result_t *result, const em_data_t *data,
                      int n_species, int n_markers,
                      const int *amplicon_lengths);
 
 /* Observed Fisher information CIs with Louis (1982) missing-data correction */
-void em_fisher_info_observed(em_result_t *result,
-                              const em_read_t *reads, int n_reads,
+void em_fisher_info_observed(em_result_t *result, const em_data_t *data,
                               int n_species, int n_markers,
                               const int *amplicon_lengths);
 
 /* Perform Likelihood Ratio Test (LRT) for species presence (profile) */
-void em_lrt(em_result_t *result,
-            const em_read_t *reads, int n_reads,
+void em_lrt(em_result_t *result, const em_data_t *data,
             const em_config_t *config,
             const int *amplicon_lengths);
 
 /* Full nested-model LRT: re-fits EM with each species removed */
-void em_lrt_full(em_result_t *result,
-                 const em_read_t *reads, int n_reads,
+void em_lrt_full(em_result_t *result, const em_data_t *data,
                  const em_config_t *config,
                  const int *amplicon_lengths);
 
-/* Build em_read_t array from classify results */
-em_read_t *em_reads_from_classify(const void *results, int n_reads,
-                                   int *out_n_em_reads);
+/* Build weighted equivalence classes from a classify_results_t batch: one
+ * row per distinct (marker, candidates, containments), see
+ * em_reads_collapse */
+em_read_t *em_reads_from_classify(const void *results, int *out_n_em_reads);
+
+/* Append the classified reads of one classify_results_t batch to a growing
+ * em_read_t array (*reads / *n / *cap, all zero initially).  counts[i] is
+ * the multiplicity of read i (NULL = 1 each). */
+void em_reads_append_classify(em_read_t **reads, int *n, int *cap,
+                              const void *results, const int *counts);
+
+/* Merge reads with identical marker, candidates and containments into one
+ * entry carrying the summed count; returns the new number of reads.
+ * First-occurrence order is preserved. */
+int em_reads_collapse(em_read_t *reads, int n_reads);
+
+/* Round every containment to the nearest multiple of step (at least one
+ * step) so that near-identical reads fall into one class when collapsed;
+ * step <= 0 leaves them exact.  EM cost then follows the number of
+ * classes, i.e. sample diversity, rather than sequencing depth. */
+void em_reads_quantize(em_read_t *reads, int n_reads, double step);
+
+/* Total multiplicity of a read set (sum of counts, 0 counted as 1) */
+double em_reads_total(const em_read_t *reads, int n_reads);
 
 void em_reads_free(em_read_t *reads, int n);
 void em_result_destroy(em_result_t *r);
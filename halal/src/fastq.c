@@ -1,15 +1,48 @@
 #include "fastq.h"
 #include "utils.h"
+#include "parallel.h"
+#include "kmer.h"
 #include <zlib.h>
 #include "kseq.h"
 
-KSEQ_INIT(gzFile, gzread)
+#if defined(_WIN32) && !defined(__MINGW32__)
+#define HS_NO_PTHREADS 1
+#else
+#include <pthread.h>
+#endif
+
+/* kseq pulls bytes through seqfile_fill(), which reads the gzFile directly
+ * or, once prefetching, takes inflated chunks from the inflate thread */
+static int seqfile_fill(hs_seqfile_t *sf, void *buf, unsigned len);
+
+KSEQ_INIT(hs_seqfile_t *, seqfile_fill)
+
+typedef struct seq_prefetch_s seq_prefetch_t;
 
 struct hs_seqfile_s {
     gzFile fp;
     kseq_t *ks;
+    char *path;                /* set for regular files, for the BGZF reader */
+    int is_bgzf;
+    int inflate_threads;       /* > 0: prefetch requested */
+    seq_prefetch_t *pf;        /* running prefetch threads */
+    /* Paired input: fragments are built from the two mate readers */
+    hs_seqfile_t *mates[2];
+    hs_seq_batch_t mate_batch[2];
+    char *pair_buf;            /* hs_seqfile_read() fragment */
+    int pair_cap;
+    long n_pairs, n_merged;
+    int warned_unpaired;
 };
 
+/* BGZF: gzip members whose header carries the block size in a "BC" extra
+ * subfield (bgzip, samtools), so blocks can be split without inflating */
+static int is_bgzf_header(const unsigned char *h, size_t n) {
+    return n >= 18 && h[0] == 0x1f && h[1] == 0x8b && h[2] == 8 && (h[3] & 4) &&
+           h[10] + (h[11] << 8) >= 6 && h[12] == 'B' && h[13] == 'C' &&
+           h[14] == 2 && h[15] == 0;
+}
+
 hs_seqfile_t *hs_seqfile_open(const char *path) {
     gzFile fp;
     if (strcmp(path, "-") == 0) {
@@ -20,11 +53,32 @@ hs_seqfile_t *hs_seqfile_open(const char *path) {
     if (!fp) return NULL;
     hs_seqfile_t *sf = (hs_seqfile_t *)hs_calloc(1, sizeof(hs_seqfile_t));
     sf->fp = fp;
-    sf->ks = kseq_init(fp);
+    sf->ks = kseq_init(sf);
+    if (strcmp(path, "-") != 0) {
+        unsigned char h[18];
+        FILE *raw = fopen(path, "rb");
+        if (raw) {
+            sf->is_bgzf = is_bgzf_header(h, fread(h, 1, sizeof(h), raw));
+            fclose(raw);
+        }
+        sf->path = hs_strdup(path);
+    }
+    return sf;
+}
+
+hs_seqfile_t *hs_seqfile_open_fd(int fd) {
+    gzFile fp = gzdopen(fd, "r");
+    if (!fp) return NULL;
+    hs_seqfile_t *sf = (hs_seqfile_t *)hs_calloc(1, sizeof(hs_seqfile_t));
+    sf->fp = fp;
+    sf->ks = kseq_init(sf);
     return sf;
 }
 
+static int read_pair(hs_seqfile_t *sf, hs_seq_t *rec);
+
 int hs_seqfile_read(hs_seqfile_t *sf, hs_seq_t *rec) {
+    if (sf->mates[0]) return read_pair(sf, rec);
     int ret = kseq_read(sf->ks);
     if (ret < 0) return -1;
     rec->name = sf->ks->name.s;
@@ -34,10 +88,578 @@ int hs_seqfile_read(hs_seqfile_t *sf, hs_seq_t *rec) {
     return 0;
 }
 
+void hs_seq_batch_init(hs_seq_batch_t *b) {
+    memset(b, 0, sizeof(*b));
+}
+
+void hs_seq_batch_free(hs_seq_batch_t *b) {
+    free(b->seqs);
+    free(b->quals);
+    free(b->lens);
+    free(b->packed);
+    free(b->nmask);
+    free(b->buf);
+    free(b->pbuf);
+    memset(b, 0, sizeof(*b));
+}
+
+/* Packed forms of the batch's reads, back to back in pbuf */
+static void pack_batch(hs_seq_batch_t *b) {
+    if (!b->pack || b->n == 0) return;
+    b->packed = (uint64_t **)hs_realloc(b->packed, (size_t)b->cap * sizeof(uint64_t *));
+    b->nmask = (uint64_t **)hs_realloc(b->nmask, (size_t)b->cap * sizeof(uint64_t *));
+    size_t need = 0;
+    for (int i = 0; i < b->n; i++)
+        need += (size_t)HS_PACKED_WORDS(b->lens[i]) + (size_t)HS_NMASK_WORDS(b->lens[i]);
+    if (need > b->pbuf_cap) {
+        size_t cap = b->pbuf_cap ? b->pbuf_cap : 8192;
+        while (cap < need) cap *= 2;
+        b->pbuf = (uint64_t *)hs_realloc(b->pbuf, cap * sizeof(uint64_t));
+        b->pbuf_cap = cap;
+    }
+    uint64_t *p = b->pbuf;
+    for (int i = 0; i < b->n; i++) {
+        b->packed[i] = p;
+        p += HS_PACKED_WORDS(b->lens[i]);
+        b->nmask[i] = p;
+        p += HS_NMASK_WORDS(b->lens[i]);
+        hs_pack_bases(b->seqs[i], b->lens[i], b->packed[i], b->nmask[i]);
+    }
+}
+
+/* Room for n reads' pointers.  Once allocated, quals grows with cap
+ * whether or not keep_qual is set, so a batch that turns keep_qual on
+ * later finds it at full capacity */
+static void batch_reserve(hs_seq_batch_t *b, int n) {
+    if (n > b->cap) {
+        b->cap = n;
+        b->seqs = (char **)hs_realloc(b->seqs, (size_t)b->cap * sizeof(char *));
+        b->lens = (int *)hs_realloc(b->lens, (size_t)b->cap * sizeof(int));
+        if (b->quals)
+            b->quals = (char **)hs_realloc(b->quals, (size_t)b->cap * sizeof(char *));
+    }
+    if (b->keep_qual && !b->quals && b->cap > 0)
+        b->quals = (char **)hs_malloc((size_t)b->cap * sizeof(char *));
+}
+
+static int read_batch_inline(hs_seqfile_t *sf, hs_seq_batch_t *b, int max_reads) {
+    batch_reserve(b, max_reads);
+    /* Sequences (each followed by its quality with keep_qual) are packed
+     * back to back, NUL-terminated; pointers are set once the batch is
+     * complete, since the buffer may move while growing */
+    size_t used = 0;
+    b->n = 0;
+    hs_seq_t rec;
+    while (b->n < max_reads && hs_seqfile_read(sf, &rec) == 0) {
+        int with_qual = b->keep_qual && rec.qual;
+        size_t need = used + (size_t)(rec.seq_len + 1) * (with_qual ? 2 : 1);
+        if (need > b->buf_cap) {
+            size_t cap = b->buf_cap ? b->buf_cap : 65536;
+            while (cap < need) cap *= 2;
+            b->buf = (char *)hs_realloc(b->buf, cap);
+            b->buf_cap = cap;
+        }
+        memcpy(b->buf + used, rec.seq, (size_t)rec.seq_len + 1);
+        if (with_qual)
+            memcpy(b->buf + used + rec.seq_len + 1, rec.qual, (size_t)rec.seq_len + 1);
+        if (b->keep_qual) b->quals[b->n] = with_qual ? b->buf : NULL;   /* marks a stored quality */
+        b->lens[b->n++] = rec.seq_len;
+        used = need;
+    }
+    char *p = b->buf;
+    for (int i = 0; i < b->n; i++) {
+        b->seqs[i] = p;
+        p += b->lens[i] + 1;
+        if (b->keep_qual && b->quals[i]) {
+            b->quals[i] = p;
+            p += b->lens[i] + 1;
+        }
+    }
+    pack_batch(b);
+    return b->n;
+}
+
+/* --- Prefetching reader ---
+ * inflate thread: gzread (or parallel BGZF block inflation) into chunks
+ * parse thread:   kseq over those chunks into read batches
+ * consumer:       hs_seqfile_read_batch() swaps in the next parsed batch
+ * Both hand-offs are bounded queues, so memory stays at a few chunks and
+ * batches however far ahead the reader could run. */
+
+#define SEQ_CHUNK_SIZE (1 << 20)            /* inflated bytes per chunk */
+#define SEQ_N_CHUNKS 4
+#define BGZF_MAX_BLOCK 65536
+#define BGZF_GROUP (SEQ_CHUNK_SIZE / BGZF_MAX_BLOCK)   /* blocks per chunk */
+
+#ifndef HS_NO_PTHREADS
+
+typedef struct {
+    void *items[SEQ_N_CHUNKS + HS_SEQ_PREFETCH];
+    int cap, head, n;
+    int closed;                /* no more pushes; pops drain then return NULL */
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty, not_full;
+} seq_queue_t;
+
+static void queue_init(seq_queue_t *q, int cap) {
+    memset(q, 0, sizeof(*q));
+    q->cap = cap;
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+}
+
+static void queue_destroy(seq_queue_t *q) {
+    pthread_cond_destroy(&q->not_full);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_mutex_destroy(&q->lock);
+}
+
+/* Returns -1 (item not queued) once the queue is closed */
+static int queue_push(seq_queue_t *q, void *item) {
+    pthread_mutex_lock(&q->lock);
+    while (q->n == q->cap && !q->closed) pthread_cond_wait(&q->not_full, &q->lock);
+    int ok = !q->closed;
+    if (ok) {
+        q->items[(q->head + q->n++) % q->cap] = item;
+        pthread_cond_signal(&q->not_empty);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ok ? 0 : -1;
+}
+
+static void *queue_pop(seq_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    while (q->n == 0 && !q->closed) pthread_cond_wait(&q->not_empty, &q->lock);
+    void *item = NULL;
+    if (q->n > 0) {
+        item = q->items[q->head];
+        q->head = (q->head + 1) % q->cap;
+        q->n--;
+        pthread_cond_signal(&q->not_full);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+static void queue_close(seq_queue_t *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_cond_broadcast(&q->not_full);
+    pthread_mutex_unlock(&q->lock);
+}
+
+typedef struct {
+    char *data;
+    int len;
+} seq_chunk_t;
+
+struct seq_prefetch_s {
+    hs_seqfile_t *sf;
+    int batch_size;
+    seq_chunk_t chunks[SEQ_N_CHUNKS];
+    hs_seq_batch_t batches[HS_SEQ_PREFETCH];
+    seq_queue_t free_chunks, full_chunks;
+    seq_queue_t free_batches, full_batches;
+    seq_chunk_t *cur;          /* parse thread: chunk being consumed */
+    int cur_pos;
+    pthread_t inflate_th, parse_th;
+};
+
+/* One BGZF group: blocks [i] at raw + in_off[i], inflated to out + out_off[i] */
+typedef struct {
+    const unsigned char *raw;
+    const size_t *in_off;
+    const int *in_len;
+    const uint32_t *crc;
+    char *out;
+    const int *out_off;
+    const int *out_len;
+    int *failed;
+} bgzf_group_t;
+
+static void bgzf_inflate_worker(void *ctx, int tid, int begin, int end) {
+    (void)tid;
+    bgzf_group_t *g = (bgzf_group_t *)ctx;
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (inflateInit2(&zs, -15) != Z_OK) { g->failed[begin] = 1; return; }
+    for (int i = begin; i < end; i++) {
+        inflateReset(&zs);
+        zs.next_in = (Bytef *)(g->raw + g->in_off[i]);
+        zs.avail_in = (uInt)g->in_len[i];
+        zs.next_out = (Bytef *)(g->out + g->out_off[i]);
+        zs.avail_out = (uInt)g->out_len[i];
+        int ret = inflate(&zs, Z_FINISH);
+        if (ret != Z_STREAM_END || zs.avail_out != 0 ||
+            crc32(0L, (const Bytef *)(g->out + g->out_off[i]), (uInt)g->out_len[i]) != g->crc[i])
+            g->failed[i] = 1;
+    }
+    inflateEnd(&zs);
+}
+
+/* Read up to BGZF_GROUP blocks and inflate them in parallel into c; returns
+ * 1 with c->len bytes, 0 at end of file, -1 on a malformed block */
+static int bgzf_read_group(FILE *fp, unsigned char *raw, seq_chunk_t *c, int n_threads) {
+    size_t in_off[BGZF_GROUP];
+    int in_len[BGZF_GROUP], out_off[BGZF_GROUP], out_len[BGZF_GROUP];
+    uint32_t crc[BGZF_GROUP];
+    int failed[BGZF_GROUP] = { 0 };
+    size_t used = 0;
+    int nb = 0, total = 0;
+    while (nb < BGZF_GROUP) {
+        unsigned char *h = raw + used;
+        size_t got = fread(h, 1, 18, fp);
+        if (got == 0) break;
+        if (!is_bgzf_header(h, got)) return -1;
+        int xlen = h[10] + (h[11] << 8);
+        int bsize = h[16] + (h[17] << 8) + 1;           /* whole block */
+        if (bsize < 18 + 8 || xlen > bsize - 12 - 8) return -1;
+        if (fread(h + 18, 1, (size_t)bsize - 18, fp) != (size_t)bsize - 18) return -1;
+        const unsigned char *t = h + bsize - 8;
+        uint32_t isize = t[4] | (t[5] << 8) | (t[6] << 16) | ((uint32_t)t[7] << 24);
+        if (isize > BGZF_MAX_BLOCK) return -1;
+        in_off[nb] = used + 12 + (size_t)xlen;
+        in_len[nb] = bsize - 12 - xlen - 8;
+        crc[nb] = t[0] | (t[1] << 8) | (t[2] << 16) | ((uint32_t)t[3] << 24);
+        out_off[nb] = total;
+        out_len[nb] = (int)isize;
+        total += (int)isize;
+        used += (size_t)bsize;
+        nb++;
+    }
+    if (nb == 0) return 0;
+    bgzf_group_t g = { raw, in_off, in_len, crc, c->data, out_off, out_len, failed };
+    hs_parallel_for(nb, 1, n_threads < nb ? n_threads : nb, bgzf_inflate_worker, &g);
+    for (int i = 0; i < nb; i++)
+        if (failed[i]) return -1;
+    c->len = total;
+    return 1;
+}
+
+static void *inflate_thread(void *arg) {
+    seq_prefetch_t *pf = (seq_prefetch_t *)arg;
+    hs_seqfile_t *sf = pf->sf;
+    FILE *raw_fp = NULL;
+    unsigned char *raw = NULL;
+    if (sf->is_bgzf && sf->inflate_threads > 1 && (raw_fp = fopen(sf->path, "rb")))
+        raw = (unsigned char *)hs_malloc((size_t)BGZF_GROUP * BGZF_MAX_BLOCK);
+    seq_chunk_t *c;
+    while ((c = (seq_chunk_t *)queue_pop(&pf->free_chunks)) != NULL) {
+        int ok;
+        if (raw_fp) {
+            ok = bgzf_read_group(raw_fp, raw, c, sf->inflate_threads);
+            if (ok < 0) HS_LOG_ERROR("Corrupt BGZF block in %s", sf->path);
+        } else {
+            c->len = gzread(sf->fp, c->data, SEQ_CHUNK_SIZE);
+            ok = c->len > 0 ? 1 : c->len;
+            if (ok < 0) HS_LOG_ERROR("Read error in %s", sf->path ? sf->path : "input stream");
+        }
+        if (ok <= 0 || queue_push(&pf->full_chunks, c) < 0) break;
+    }
+    queue_close(&pf->full_chunks);
+    if (raw_fp) fclose(raw_fp);
+    free(raw);
+    return NULL;
+}
+
+static void *parse_thread(void *arg) {
+    seq_prefetch_t *pf = (seq_prefetch_t *)arg;
+    hs_seq_batch_t *b;
+    while ((b = (hs_seq_batch_t *)queue_pop(&pf->free_batches)) != NULL) {
+        if (read_batch_inline(pf->sf, b, pf->batch_size) == 0 ||
+            queue_push(&pf->full_batches, b) < 0)
+            break;
+    }
+    queue_close(&pf->full_batches);
+    /* Unblock the inflate thread if parsing stopped before end of input */
+    queue_close(&pf->free_chunks);
+    return NULL;
+}
+
+static int prefetch_fill(seq_prefetch_t *pf, void *buf, unsigned len) {
+    while (!pf->cur || pf->cur_pos == pf->cur->len) {
+        if (pf->cur) queue_push(&pf->free_chunks, pf->cur);
+        pf->cur = (seq_chunk_t *)queue_pop(&pf->full_chunks);
+        pf->cur_pos = 0;
+        if (!pf->cur) return 0;
+    }
+    int n = pf->cur->len - pf->cur_pos;
+    if ((unsigned)n > len) n = (int)len;
+    memcpy(buf, pf->cur->data + pf->cur_pos, (size_t)n);
+    pf->cur_pos += n;
+    return n;
+}
+
+/* Batches are filled like the consumer's b, whose buffers they swap with */
+static int prefetch_start(hs_seqfile_t *sf, const hs_seq_batch_t *b, int batch_size) {
+    seq_prefetch_t *pf = (seq_prefetch_t *)hs_calloc(1, sizeof(seq_prefetch_t));
+    pf->sf = sf;
+    pf->batch_size = batch_size;
+    queue_init(&pf->free_chunks, SEQ_N_CHUNKS);
+    queue_init(&pf->full_chunks, SEQ_N_CHUNKS);
+    queue_init(&pf->free_batches, HS_SEQ_PREFETCH);
+    queue_init(&pf->full_batches, HS_SEQ_PREFETCH);
+    for (int i = 0; i < SEQ_N_CHUNKS; i++) {
+        pf->chunks[i].data = (char *)hs_malloc(SEQ_CHUNK_SIZE);
+        queue_push(&pf->free_chunks, &pf->chunks[i]);
+    }
+    for (int i = 0; i < HS_SEQ_PREFETCH; i++) {
+        hs_seq_batch_init(&pf->batches[i]);
+        pf->batches[i].keep_qual = b->keep_qual;
+        pf->batches[i].pack = b->pack;
+        queue_push(&pf->free_batches, &pf->batches[i]);
+    }
+    sf->pf = pf;
+    if (pthread_create(&pf->inflate_th, NULL, inflate_thread, pf) != 0) goto fail_inflate;
+    if (pthread_create(&pf->parse_th, NULL, parse_thread, pf) != 0) goto fail_parse;
+    return 0;
+
+fail_parse:
+    queue_close(&pf->free_chunks);
+    pthread_join(pf->inflate_th, NULL);
+fail_inflate:
+    sf->pf = NULL;
+    for (int i = 0; i < SEQ_N_CHUNKS; i++) free(pf->chunks[i].data);
+    queue_destroy(&pf->full_batches);
+    queue_destroy(&pf->free_batches);
+    queue_destroy(&pf->full_chunks);
+    queue_destroy(&pf->free_chunks);
+    free(pf);
+    return -1;
+}
+
+static void prefetch_stop(seq_prefetch_t *pf) {
+    queue_close(&pf->free_batches);
+    queue_close(&pf->full_batches);
+    queue_close(&pf->free_chunks);
+    queue_close(&pf->full_chunks);
+    pthread_join(pf->parse_th, NULL);
+    pthread_join(pf->inflate_th, NULL);
+    for (int i = 0; i < SEQ_N_CHUNKS; i++) free(pf->chunks[i].data);
+    for (int i = 0; i < HS_SEQ_PREFETCH; i++) hs_seq_batch_free(&pf->batches[i]);
+    queue_destroy(&pf->full_batches);
+    queue_destroy(&pf->free_batches);
+    queue_destroy(&pf->full_chunks);
+    queue_destroy(&pf->free_chunks);
+    free(pf);
+}
+
+/* Swap the next parsed batch into b, recycling b's buffers */
+static int prefetch_next(seq_prefetch_t *pf, hs_seq_batch_t *b) {
+    hs_seq_batch_t *got = (hs_seq_batch_t *)queue_pop(&pf->full_batches);
+    if (!got) { b->n = 0; return 0; }
+    hs_seq_batch_t tmp = *b;
+    *b = *got;
+    *got = tmp;
+    queue_push(&pf->free_batches, got);
+    return b->n;
+}
+
+static int seqfile_fill(hs_seqfile_t *sf, void *buf, unsigned len) {
+    if (sf->pf) return prefetch_fill(sf->pf, buf, len);
+    return gzread(sf->fp, buf, len);
+}
+
+#else /* HS_NO_PTHREADS: everything reads inline */
+
+static int seqfile_fill(hs_seqfile_t *sf, void *buf, unsigned len) {
+    return gzread(sf->fp, buf, len);
+}
+
+#endif
+
+/* --- Paired-end merging --- */
+
+static inline char base_complement(char c) {
+    switch (c) {
+        case 'A': return 'T'; case 'C': return 'G'; case 'G': return 'C'; case 'T': return 'A';
+        case 'a': return 't'; case 'c': return 'g'; case 'g': return 'c'; case 't': return 'a';
+        default: return 'N';
+    }
+}
+
+static inline int is_unknown(char c) {
+    return hs_base_table[(unsigned char)c] < 0;
+}
+
+int hs_merge_pair(const char *s1, const char *q1, int len1,
+                  const char *s2, const char *q2, int len2,
+                  char *out, int *overlap) {
+    /* R2's reverse complement placed at offset p of R1 (negative when it
+     * starts before R1, i.e. the insert is shorter than the reads); keep
+     * the offset with the lowest mismatch rate, then the longest overlap */
+    int best_p = 0, best_ov = 0, best_mm = 0;
+    for (int p = len1 - HS_MERGE_MIN_OVERLAP; p >= HS_MERGE_MIN_OVERLAP - len2; p--) {
+        int a0 = p > 0 ? p : 0;
+        int a1 = p + len2 < len1 ? p + len2 : len1;
+        int ov = a1 - a0;
+        if (ov < HS_MERGE_MIN_OVERLAP) continue;
+        int max_mm = (int)(HS_MERGE_MAX_MISMATCH * ov), mm = 0;
+        for (int i = a0; i < a1 && mm <= max_mm; i++) {
+            char c1 = s1[i], c2 = base_complement(s2[len2 - 1 - (i - p)]);
+            if (is_unknown(c1) || is_unknown(c2)) continue;
+            mm += (c1 | 0x20) != (c2 | 0x20);
+        }
+        if (mm > max_mm) continue;
+        if (best_ov == 0 || (long)mm * best_ov < (long)best_mm * ov ||
+            ((long)mm * best_ov == (long)best_mm * ov && ov > best_ov)) {
+            best_p = p;
+            best_ov = ov;
+            best_mm = mm;
+        }
+    }
+    *overlap = best_ov;
+
+    if (best_ov == 0) {
+        memcpy(out, s1, (size_t)len1);
+        out[len1] = 'N';
+        for (int j = 0; j < len2; j++) out[len1 + 1 + j] = base_complement(s2[len2 - 1 - j]);
+        out[len1 + 1 + len2] = '\0';
+        return len1 + 1 + len2;
+    }
+
+    /* The fragment runs from R1's start to R2's start; anything outside
+     * is adapter read-through */
+    int p = best_p, end = p + len2;
+    for (int i = 0; i < end; i++) {
+        int j = len2 - 1 - (i - p);            /* R2 position under R1 position i */
+        int in1 = i < len1, in2 = i >= p;
+        char c1 = in1 ? s1[i] : 'N', c2 = in2 ? base_complement(s2[j]) : 'N';
+        if (!in2 || (in1 && is_unknown(c2))) out[i] = c1;
+        else if (!in1 || is_unknown(c1)) out[i] = c2;
+        else if ((c1 | 0x20) == (c2 | 0x20) || !q1 || !q2) out[i] = c1;
+        else out[i] = q2[j] > q1[i] ? c2 : c1;
+    }
+    out[end] = '\0';
+    return end;
+}
+
+hs_seqfile_t *hs_seqfile_open_paired(const char *path1, const char *path2) {
+    hs_seqfile_t *m1 = hs_seqfile_open(path1);
+    hs_seqfile_t *m2 = m1 ? hs_seqfile_open(path2) : NULL;
+    if (!m2) {
+        hs_seqfile_close(m1);
+        return NULL;
+    }
+    hs_seqfile_t *sf = (hs_seqfile_t *)hs_calloc(1, sizeof(hs_seqfile_t));
+    sf->mates[0] = m1;
+    sf->mates[1] = m2;
+    for (int m = 0; m < 2; m++) {
+        hs_seq_batch_init(&sf->mate_batch[m]);
+        sf->mate_batch[m].keep_qual = 1;
+    }
+    return sf;
+}
+
+void hs_seqfile_pair_stats(const hs_seqfile_t *sf, long *n_pairs, long *n_merged) {
+    *n_pairs = sf->n_pairs;
+    *n_merged = sf->n_merged;
+}
+
+static void warn_unpaired(hs_seqfile_t *sf) {
+    if (sf->warned_unpaired) return;
+    sf->warned_unpaired = 1;
+    HS_LOG_WARN("Mate files have different read counts; unpaired reads ignored");
+}
+
+static int read_pair(hs_seqfile_t *sf, hs_seq_t *rec) {
+    hs_seq_t r1, r2;
+    int got1 = hs_seqfile_read(sf->mates[0], &r1) == 0;
+    int got2 = hs_seqfile_read(sf->mates[1], &r2) == 0;
+    if (got1 != got2) warn_unpaired(sf);
+    if (!got1 || !got2) return -1;
+    int need = r1.seq_len + r2.seq_len + 2;
+    if (need > sf->pair_cap) {
+        sf->pair_cap = need;
+        sf->pair_buf = (char *)hs_realloc(sf->pair_buf, (size_t)need);
+    }
+    int overlap;
+    rec->name = r1.name;
+    rec->seq = sf->pair_buf;
+    rec->qual = NULL;
+    rec->seq_len = hs_merge_pair(r1.seq, r1.qual, r1.seq_len, r2.seq, r2.qual, r2.seq_len,
+                                 sf->pair_buf, &overlap);
+    sf->n_pairs++;
+    sf->n_merged += overlap > 0;
+    return 0;
+}
+
+static int read_pair_batch(hs_seqfile_t *sf, hs_seq_batch_t *b, int max_reads) {
+    hs_seq_batch_t *b1 = &sf->mate_batch[0], *b2 = &sf->mate_batch[1];
+    int n1 = hs_seqfile_read_batch(sf->mates[0], b1, max_reads);
+    int n2 = hs_seqfile_read_batch(sf->mates[1], b2, max_reads);
+    if (n1 != n2) warn_unpaired(sf);
+    int n = n1 < n2 ? n1 : n2;
+    batch_reserve(b, n);
+    size_t need = 0;
+    for (int i = 0; i < n; i++) need += (size_t)b1->lens[i] + (size_t)b2->lens[i] + 2;
+    if (need > b->buf_cap) {
+        size_t cap = b->buf_cap ? b->buf_cap : 65536;
+        while (cap < need) cap *= 2;
+        b->buf = (char *)hs_realloc(b->buf, cap);
+        b->buf_cap = cap;
+    }
+    char *p = b->buf;
+    for (int i = 0; i < n; i++) {
+        int overlap;
+        b->seqs[i] = p;
+        b->lens[i] = hs_merge_pair(b1->seqs[i], b1->quals[i], b1->lens[i],
+                                   b2->seqs[i], b2->quals[i], b2->lens[i], p, &overlap);
+        if (b->keep_qual) b->quals[i] = NULL;
+        p += b->lens[i] + 1;
+        sf->n_merged += overlap > 0;
+    }
+    sf->n_pairs += n;
+    b->n = n;
+    pack_batch(b);
+    return n;
+}
+
+int hs_seqfile_prefetch(hs_seqfile_t *sf, int inflate_threads) {
+#ifdef HS_NO_PTHREADS
+    (void)sf; (void)inflate_threads;
+    return -1;
+#else
+    if (sf->mates[0]) {
+        /* Each mate reads ahead on its own; pairs are merged on demand */
+        hs_seqfile_prefetch(sf->mates[0], inflate_threads);
+        return hs_seqfile_prefetch(sf->mates[1], inflate_threads);
+    }
+    sf->inflate_threads = hs_resolve_threads(inflate_threads);
+    return 0;
+#endif
+}
+
+int hs_seqfile_read_batch(hs_seqfile_t *sf, hs_seq_batch_t *b, int max_reads) {
+    if (sf->mates[0]) return read_pair_batch(sf, b, max_reads);
+#ifndef HS_NO_PTHREADS
+    if (sf->inflate_threads > 0 && !sf->pf && prefetch_start(sf, b, max_reads) < 0)
+        sf->inflate_threads = 0;       /* no threads: keep reading inline */
+    if (sf->pf) return prefetch_next(sf->pf, b);
+#endif
+    return read_batch_inline(sf, b, max_reads);
+}
+
 void hs_seqfile_close(hs_seqfile_t *sf) {
     if (sf) {
-        kseq_destroy(sf->ks);
-        gzclose(sf->fp);
+#ifndef HS_NO_PTHREADS
+        if (sf->pf) prefetch_stop(sf->pf);
+#endif
+        if (sf->mates[0]) {
+            HS_LOG_INFO("Merged %ld of %ld read pairs by overlap (%.1f%%)", sf->n_merged,
+                        sf->n_pairs, sf->n_pairs > 0 ? 100.0 * sf->n_merged / sf->n_pairs : 0.0);
+            for (int m = 0; m < 2; m++) {
+                hs_seqfile_close(sf->mates[m]);
+                hs_seq_batch_free(&sf->mate_batch[m]);
+            }
+            free(sf->pair_buf);
+        } else {
+            kseq_destroy(sf->ks);
+            gzclose(sf->fp);
+        }
+        free(sf->path);
         free(sf);
     }
 }
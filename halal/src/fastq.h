@@ -1,6 +1,7 @@
 #ifndef HALALSEQ_FASTQ_H
 #define HALALSEQ_FASTQ_H
 
+#include <stdint.h>
 #include <stdio.h>
 #include <zlib.h>
 
@@ -16,9 +17,67 @@ typedef struct {
 typedef struct hs_seqfile_s hs_seqfile_t;
 
 hs_seqfile_t *hs_seqfile_open(const char *path);
+/* Read from an open descriptor (pipe, socket); closing the seqfile closes fd */
+hs_seqfile_t *hs_seqfile_open_fd(int fd);
 int hs_seqfile_read(hs_seqfile_t *sf, hs_seq_t *rec);  /* 0 = success, -1 = EOF */
 void hs_seqfile_close(hs_seqfile_t *sf);
 
+/* Batch of reads packed into one reusable buffer (names are dropped, and
+ * qualities too unless keep_qual is set).  seqs[i] and quals[i] point into
+ * buf and stay valid until the next hs_seqfile_read_batch() on the same
+ * batch; quals[i] is NULL for FASTA records. */
+typedef struct {
+    char **seqs;
+    char **quals;              /* filled only with keep_qual */
+    int *lens;
+    int n;
+    int cap;
+    int keep_qual;
+    /* With pack set, packed[i] and nmask[i] hold seqs[i] 2-bit packed (see
+     * hs_pack_bases), filled by the reader, so on prefetched input on the
+     * parse thread */
+    int pack;
+    uint64_t **packed, **nmask;
+    char *buf;
+    size_t buf_cap;
+    uint64_t *pbuf;
+    size_t pbuf_cap;           /* words */
+} hs_seq_batch_t;
+
+void hs_seq_batch_init(hs_seq_batch_t *b);
+void hs_seq_batch_free(hs_seq_batch_t *b);
+/* Read up to max_reads records; returns the number read (0 at EOF) */
+int hs_seqfile_read_batch(hs_seqfile_t *sf, hs_seq_batch_t *b, int max_reads);
+
+/* Read ahead on background threads from the next hs_seqfile_read_batch()
+ * on: one thread inflates (BGZF files across inflate_threads block workers,
+ * <= 0 = all CPUs; other gzip or plain input through zlib), one parses into
+ * batches of that call's max_reads, staying up to HS_SEQ_PREFETCH batches
+ * ahead.  Afterwards only hs_seqfile_read_batch() may read from sf.
+ * Returns -1 (sf keeps reading inline) where threads are unavailable. */
+#define HS_SEQ_PREFETCH 2
+int hs_seqfile_prefetch(hs_seqfile_t *sf, int inflate_threads);
+
+/* --- Paired-end input ---
+ * Reads mates from two files in step and yields one fragment per pair:
+ * R1 and the reverse complement of R2 merged into a consensus where they
+ * overlap by >= HS_MERGE_MIN_OVERLAP bases at <= HS_MERGE_MAX_MISMATCH
+ * mismatches per base (read-through past a short insert is clipped), or
+ * otherwise joined by one 'N' so no k-mer spans the gap.  On mismatches
+ * the higher-quality base wins (R1 without qualities). */
+#define HS_MERGE_MIN_OVERLAP 20
+#define HS_MERGE_MAX_MISMATCH 0.1
+hs_seqfile_t *hs_seqfile_open_paired(const char *path1, const char *path2);
+/* Pairs read so far and how many of them were merged by overlap */
+void hs_seqfile_pair_stats(const hs_seqfile_t *sf, long *n_pairs, long *n_merged);
+
+/* Fragment of one pair into out (room for len1 + len2 + 1); returns its
+ * length and sets *overlap to the merged overlap (0 = joined by 'N').
+ * q1/q2 may be NULL. */
+int hs_merge_pair(const char *s1, const char *q1, int len1,
+                  const char *s2, const char *q2, int len2,
+                  char *out, int *overlap);
+
 /* Read all sequences from a FASTA file into arrays */
 int hs_fasta_read_all(const char *path, char ***seqs, char ***names, int **lens, int *n);
 void hs_fasta_free_all(char **seqs, char **names, int *lens, int n);
@@ -1,4 +1,5 @@
 #include "index.h"
+#include "parallel.h"
 #include "utils.h"
 #include <string.h>
 
@@ -16,187 +17,750 @@ static double auto_scale(int min_seq_len, int k) {
     return DEFAULT_FMH_SCALE;
 }
 
+/* --- Build steps ---
+ * Every coarse sketch and fine set depends only on its own references,
+ * so index_build hands them out to workers; the incremental updates below
+ * reuse the same steps for a single species. */
+static fmh_sketch_t *build_coarse(const halal_index_t *idx, int s) {
+    fmh_sketch_t *sk = fmh_init(idx->coarse_k, idx->coarse_scale);
+    for (int m = 0; m < idx->db->n_markers; m++) {
+        marker_ref_t *mr = refdb_get_marker_ref(idx->db, s, m);
+        if (mr) fmh_add_seq(sk, mr->sequence, mr->seq_len);
+    }
+    fmh_sort(sk);
+    return sk;
+}
+
+static kmer_set_t *build_fine(const halal_index_t *idx, int m, int s) {
+    marker_ref_t *mr = refdb_get_marker_ref(idx->db, s, m);
+    if (!mr) return NULL;
+    /* Use smaller k if sequence is too short */
+    int fk = idx->fine_k;
+    if (mr->seq_len < fk) fk = mr->seq_len > 15 ? mr->seq_len : 15;
+    kmer_set_t *ks = kmer_set_init(fk);
+    if (idx->fine_syncmer_s > 0 && fk == idx->fine_k)
+        kmer_set_add_syncmers(ks, mr->sequence, mr->seq_len, idx->fine_syncmer_s);
+    else
+        kmer_set_add_seq(ks, mr->sequence, mr->seq_len);
+    return ks;
+}
+
+static void build_coarse_chunk(void *ctx, int tid, int begin, int end) {
+    (void)tid;
+    halal_index_t *idx = (halal_index_t *)ctx;
+    for (int s = begin; s < end; s++) idx->coarse[s] = build_coarse(idx, s);
+}
+
+static void build_fine_chunk(void *ctx, int tid, int begin, int end) {
+    (void)tid;
+    halal_index_t *idx = (halal_index_t *)ctx;
+    int S = idx->db->n_species;
+    for (int i = begin; i < end; i++)
+        idx->fine[i / S][i % S] = build_fine(idx, i / S, i % S);
+}
+
+/* Off-target prefilter.  Rejecting a read on it is exact only if every
+ * fine set is filtered, so a fallback-k set disables it. */
+static void build_filter(halal_index_t *idx) {
+    int S = idx->db->n_species;
+    int M = idx->db->n_markers;
+    kmer_bloom_destroy(idx->fine_filter);
+    idx->fine_filter = NULL;
+    for (int m = 0; m < M; m++)
+        for (int s = 0; s < S; s++)
+            if (idx->fine[m][s] && idx->fine[m][s]->k != idx->fine_k) return;
+    idx->fine_filter = kmer_bloom_build((kmer_set_t *const *const *)idx->fine, M, S,
+                                        idx->fine_k);
+}
+
+/* Rebuild the tables derived from the coarse sketches and fine sets */
+static void build_derived(halal_index_t *idx) {
+    fmh_multi_destroy(idx->coarse_multi);
+    idx->coarse_multi = fmh_multi_build(idx->coarse, idx->db->n_species);
+    kmer_posting_destroy(idx->fine_posting);
+    idx->fine_posting = kmer_posting_build((kmer_set_t *const *const *)idx->fine,
+                                           idx->db->n_markers, idx->db->n_species,
+                                           idx->fine_k);
+    build_filter(idx);
+}
+
+static int min_ref_len(const halal_refdb_t *db) {
+    int min_len = INT32_MAX;
+    for (int i = 0; i < db->n_marker_refs; i++) {
+        if (db->markers[i].seq_len < min_len)
+            min_len = db->markers[i].seq_len;
+    }
+    return min_len;
+}
+
 halal_index_t *index_build(halal_refdb_t *db) {
+    return index_build_threads(db, 0);
+}
+
+halal_index_t *index_build_threads(halal_refdb_t *db, int n_threads) {
+    return index_build_sampled(db, n_threads, 0);
+}
+
+halal_index_t *index_build_sampled(halal_refdb_t *db, int n_threads, int syncmer_s) {
     halal_index_t *idx = (halal_index_t *)hs_calloc(1, sizeof(halal_index_t));
     idx->db = db;
     idx->coarse_k = DEFAULT_COARSE_K;
     idx->fine_k = DEFAULT_FINE_K;
+    idx->fine_syncmer_s = syncmer_s > 0 && syncmer_s <= idx->fine_k ? syncmer_s : 0;
 
     int S = db->n_species;
     int M = db->n_markers;
+    n_threads = hs_resolve_threads(n_threads);
 
-    /* Find minimum sequence length for auto-scaling */
-    int min_len = INT32_MAX;
-    for (int i = 0; i < db->n_marker_refs; i++) {
-        if (db->markers[i].seq_len < min_len)
-            min_len = db->markers[i].seq_len;
-    }
-    idx->coarse_scale = auto_scale(min_len, idx->coarse_k);
+    /* Auto-scale for the shortest reference */
+    idx->coarse_scale = auto_scale(min_ref_len(db), idx->coarse_k);
 
     /* Build coarse sketches (one per species, merged across markers) */
     idx->coarse = (fmh_sketch_t **)hs_calloc((size_t)S, sizeof(fmh_sketch_t *));
-    for (int s = 0; s < S; s++) {
-        idx->coarse[s] = fmh_init(idx->coarse_k, idx->coarse_scale);
-        for (int m = 0; m < M; m++) {
-            marker_ref_t *mr = refdb_get_marker_ref(db, s, m);
-            if (mr) fmh_add_seq(idx->coarse[s], mr->sequence, mr->seq_len);
-        }
-        fmh_sort(idx->coarse[s]);
-    }
+    hs_parallel_for(S, 1, n_threads, build_coarse_chunk, idx);
 
     /* Build fine k-mer sets (per marker, per species) */
     idx->fine = (kmer_set_t ***)hs_calloc((size_t)M, sizeof(kmer_set_t **));
-    for (int m = 0; m < M; m++) {
+    for (int m = 0; m < M; m++)
         idx->fine[m] = (kmer_set_t **)hs_calloc((size_t)S, sizeof(kmer_set_t *));
-        for (int s = 0; s < S; s++) {
-            marker_ref_t *mr = refdb_get_marker_ref(db, s, m);
-            if (mr) {
-                /* Use smaller k if sequence is too short */
-                int fk = idx->fine_k;
-                if (mr->seq_len < fk) fk = mr->seq_len > 15 ? mr->seq_len : 15;
-                idx->fine[m][s] = kmer_set_init(fk);
-                kmer_set_add_seq(idx->fine[m][s], mr->sequence, mr->seq_len);
-            }
+    hs_parallel_for(M * S, 1, n_threads, build_fine_chunk, idx);
+
+    build_derived(idx);
+
+    /* Primer scanner for marker detection */
+    idx->primers = primer_scanner_build(db);
+
+    HS_LOG_INFO("Built index: %d species, %d markers, coarse_k=%d, fine_k=%d, scale=%.4f%s",
+                S, M, idx->coarse_k, idx->fine_k, idx->coarse_scale,
+                idx->fine_syncmer_s ? ", fine syncmers" : "");
+    return idx;
+}
+
+/* --- Incremental update --- */
+
+int index_add_species(halal_index_t *idx, const halal_refdb_t *src, int src_species) {
+    halal_refdb_t *db = idx->db;
+    if (src_species < 0 || src_species >= src->n_species || idx->marker_loaded) return -1;
+    const species_info_t *info = &src->species[src_species];
+    if (refdb_find_species(db, info->species_id) >= 0) {
+        HS_LOG_ERROR("Species %s is already in the index", info->species_id);
+        return -1;
+    }
+
+    int s = refdb_add_species(db, info->species_id, info->common_name, info->status,
+                              info->mito_copy_number, info->dna_yield_prior);
+    for (int sm = 0; sm < src->n_markers; sm++) {
+        marker_ref_t *mr = refdb_get_marker_ref(src, src_species, sm);
+        if (!mr) continue;
+        int m = refdb_find_marker(db, src->marker_ids[sm]);
+        if (m < 0) {
+            HS_LOG_WARN("Marker %s is not in the index; %s reference skipped",
+                        src->marker_ids[sm], info->species_id);
+            continue;
         }
+        int r = refdb_add_marker_ref(db, s, m, mr->sequence, mr->seq_len);
+        if (r >= 0) db->markers[r].amplicon_length = mr->amplicon_length;
     }
+    refdb_reindex(db);
 
-    /* Build primer k-mer index for marker detection */
-    idx->primer_index = (kmer_set_t **)hs_calloc((size_t)M, sizeof(kmer_set_t *));
-    int primer_k = 15; /* use shorter k for primer matching */
-    for (int m = 0; m < M; m++) {
-        idx->primer_index[m] = kmer_set_init(primer_k);
-        int flen = (int)strlen(db->primer_f[m]);
-        int rlen = (int)strlen(db->primer_r[m]);
-        if (flen >= primer_k)
-            kmer_set_add_seq(idx->primer_index[m], db->primer_f[m], flen);
-        if (rlen >= primer_k)
-            kmer_set_add_seq(idx->primer_index[m], db->primer_r[m], rlen);
+    /* The scale is part of every stored sketch, so it stays fixed */
+    if (auto_scale(min_ref_len(db), idx->coarse_k) != idx->coarse_scale)
+        HS_LOG_WARN("%s has a shorter reference than the index was scaled for; "
+                    "coarse scale kept at %.4f (rebuild to rescale)",
+                    info->species_id, idx->coarse_scale);
+
+    int S = db->n_species;
+    idx->coarse = (fmh_sketch_t **)hs_realloc(idx->coarse, (size_t)S * sizeof(fmh_sketch_t *));
+    idx->coarse[s] = build_coarse(idx, s);
+    for (int m = 0; m < db->n_markers; m++) {
+        idx->fine[m] = (kmer_set_t **)hs_realloc(idx->fine[m], (size_t)S * sizeof(kmer_set_t *));
+        idx->fine[m][s] = build_fine(idx, m, s);
     }
+    build_derived(idx);
+    return s;
+}
 
-    HS_LOG_INFO("Built index: %d species, %d markers, coarse_k=%d, fine_k=%d, scale=%.4f",
-                S, M, idx->coarse_k, idx->fine_k, idx->coarse_scale);
-    return idx;
+int index_remove_species(halal_index_t *idx, int species_idx) {
+    halal_refdb_t *db = idx->db;
+    int S = db->n_species;
+    if (species_idx < 0 || species_idx >= S || idx->marker_loaded) return -1;
+    size_t tail = (size_t)(S - species_idx - 1);
+
+    fmh_destroy(idx->coarse[species_idx]);
+    memmove(&idx->coarse[species_idx], &idx->coarse[species_idx + 1],
+            tail * sizeof(fmh_sketch_t *));
+    for (int m = 0; m < db->n_markers; m++) {
+        kmer_set_destroy(idx->fine[m][species_idx]);
+        memmove(&idx->fine[m][species_idx], &idx->fine[m][species_idx + 1],
+                tail * sizeof(kmer_set_t *));
+    }
+    refdb_remove_species(db, species_idx);
+    build_derived(idx);
+    return 0;
 }
 
 void index_destroy(halal_index_t *idx) {
     if (!idx) return;
+    refdb_destroy(index_release_db(idx));
+}
+
+halal_refdb_t *index_release_db(halal_index_t *idx) {
+    if (!idx) return NULL;
+    halal_refdb_t *db = idx->db;
     int S = idx->db->n_species;
     int M = idx->db->n_markers;
     for (int s = 0; s < S; s++) fmh_destroy(idx->coarse[s]);
     free(idx->coarse);
+    fmh_multi_destroy(idx->coarse_multi);
     for (int m = 0; m < M; m++) {
         for (int s = 0; s < S; s++) kmer_set_destroy(idx->fine[m][s]);
         free(idx->fine[m]);
     }
     free(idx->fine);
-    for (int m = 0; m < M; m++) kmer_set_destroy(idx->primer_index[m]);
-    free(idx->primer_index);
-    refdb_destroy(idx->db);
+    kmer_posting_destroy(idx->fine_posting);
+    kmer_bloom_destroy(idx->fine_filter);
+    free(idx->marker_loaded);
+    primer_scanner_destroy(idx->primers);
+    hs_unmap_file(idx->map, idx->map_len);
     free(idx);
+    return db;
 }
 
 void index_query_coarse(const halal_index_t *idx, const char *seq, int len,
                         double *scores, int n_species) {
-    fmh_sketch_t *qsk = fmh_init(idx->coarse_k, idx->coarse_scale);
-    fmh_add_seq(qsk, seq, len);
-    fmh_sort(qsk);
-    for (int s = 0; s < n_species; s++)
-        scores[s] = fmh_containment(qsk, idx->coarse[s]);
-    fmh_destroy(qsk);
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+    kmer_profile_set_seq(&qp, seq, len);
+    index_query_coarse_profile(idx, &qp, scores, n_species);
+    kmer_profile_free(&qp);
 }
 
 double index_query_fine(const halal_index_t *idx, const char *seq, int len,
                         int marker_idx, int species_idx) {
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+    kmer_profile_set_seq(&qp, seq, len);
+    double c = index_query_fine_profile(idx, &qp, marker_idx, species_idx);
+    kmer_profile_free(&qp);
+    return c;
+}
+
+int index_detect_marker(const halal_index_t *idx, const char *seq, int len) {
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+    kmer_profile_set_seq(&qp, seq, len);
+    int m = index_detect_marker_profile(idx, &qp);
+    kmer_profile_free(&qp);
+    return m;
+}
+
+void index_query_coarse_profile(const halal_index_t *idx, kmer_profile_t *qp,
+                                double *scores, int n_species) {
+    const fmh_sketch_t *qsk = kmer_profile_sketch(qp, idx->coarse_k, idx->coarse_scale);
+    fmh_multi_containment(idx->coarse_multi, qsk, scores, n_species);
+}
+
+double index_query_fine_profile(const halal_index_t *idx, kmer_profile_t *qp,
+                                int marker_idx, int species_idx) {
     kmer_set_t *ks = idx->fine[marker_idx][species_idx];
     if (!ks) return 0.0;
-    return kmer_set_containment(seq, len, ks, ks->k);
+    int n;
+    const uint64_t *hashes = ks->k == idx->fine_k ? index_fine_hashes(idx, qp, 0, &n)
+                                                  : kmer_profile_hashes(qp, ks->k, &n);
+    return kmer_set_containment_hashes(hashes, n, ks);
 }
 
-int index_detect_marker(const halal_index_t *idx, const char *seq, int len) {
-    int best_m = -1;
-    double best_score = 0.0;
-    for (int m = 0; m < idx->db->n_markers; m++) {
-        kmer_set_t *pk = idx->primer_index[m];
-        if (!pk || pk->n_kmers == 0) continue;
-        double score = kmer_set_containment(seq, len, pk, pk->k);
-        if (score > best_score) { best_score = score; best_m = m; }
+const uint64_t *index_fine_hashes(const halal_index_t *idx, kmer_profile_t *qp,
+                                  int syncmer_s, int *n) {
+    if (idx->fine_syncmer_s > 0) syncmer_s = idx->fine_syncmer_s;
+    return kmer_profile_syncmers(qp, idx->fine_k, syncmer_s, n);
+}
+
+void index_query_fine_all_profile(const halal_index_t *idx, kmer_profile_t *qp,
+                                  double *scores) {
+    size_t n = (size_t)idx->db->n_markers * (size_t)idx->db->n_species;
+    int *counts = (int *)hs_malloc((n > 0 ? n : 1) * sizeof(int));
+    index_query_fine_all_scratch(idx, qp, scores, counts);
+    free(counts);
+}
+
+void index_query_fine_all_scratch(const halal_index_t *idx, kmer_profile_t *qp,
+                                  double *scores, int *counts) {
+    index_query_fine_bounded(idx, qp, NULL, -1, 0.0, 0, scores, counts);
+}
+
+void index_query_fine_bounded(const halal_index_t *idx, kmer_profile_t *qp,
+                              const char *candidates, int marker_idx, double floor,
+                              int syncmer_s, double *scores, int *counts) {
+    index_count_fine_batch(idx, &qp, 1, syncmer_s, &counts);
+    index_query_fine_counted(idx, qp, candidates, marker_idx, floor, syncmer_s,
+                             scores, counts);
+}
+
+void index_count_fine_batch(const halal_index_t *idx, kmer_profile_t *const *qps,
+                            int n_reads, int syncmer_s, int *const *counts) {
+    if (!idx->fine_posting) return;
+    size_t cells = (size_t)idx->db->n_markers * (size_t)idx->db->n_species;
+    const uint64_t *hashes[INDEX_FINE_BATCH];
+    int n[INDEX_FINE_BATCH];
+    for (int r0 = 0; r0 < n_reads; r0 += INDEX_FINE_BATCH) {
+        int nb = n_reads - r0 < INDEX_FINE_BATCH ? n_reads - r0 : INDEX_FINE_BATCH;
+        for (int r = 0; r < nb; r++) {
+            hashes[r] = index_fine_hashes(idx, qps[r0 + r], syncmer_s, &n[r]);
+            memset(counts[r0 + r], 0, cells * sizeof(int));
+        }
+        kmer_posting_count_batch(idx->fine_posting, hashes, n, nb, counts + r0);
+    }
+}
+
+void index_query_fine_counted(const halal_index_t *idx, kmer_profile_t *qp,
+                              const char *candidates, int marker_idx, double floor,
+                              int syncmer_s, double *scores, const int *counts) {
+    int S = idx->db->n_species;
+    int M = idx->db->n_markers;
+    int n;
+    const uint64_t *hashes = index_fine_hashes(idx, qp, syncmer_s, &n);
+
+    for (int s = 0; s < S; s++) {
+        /* Across markers only the species' best score matters, so later
+         * markers need only reach it */
+        double best = floor;
+        for (int m = 0; m < M; m++) {
+            const kmer_set_t *ks = idx->fine[m][s];
+            double *out = &scores[m * S + s];
+            if (!ks || (candidates && !candidates[s]) ||
+                (marker_idx >= 0 && m != marker_idx)) {
+                *out = 0.0;
+            } else if (ks->k == idx->fine_k && idx->fine_posting) {
+                *out = n > 0 ? (double)counts[m * S + s] / (double)n : 0.0;
+            } else {
+                /* No posting table, or a short reference indexed at a
+                 * fallback k */
+                int nk = n;
+                const uint64_t *hk = ks->k == idx->fine_k ? hashes
+                                                          : kmer_profile_hashes(qp, ks->k, &nk);
+                *out = kmer_set_containment_bounded(hk, nk, ks, best);
+            }
+            if (floor > 0.0 && *out > best) best = *out;
+        }
     }
-    /* Require at least some primer k-mer match */
-    return best_score >= 0.1 ? best_m : -1;
 }
 
-/* --- Serialization --- */
+int index_detect_marker_profile(const halal_index_t *idx, kmer_profile_t *qp) {
+    return primer_scan(idx->primers, qp->seq, qp->len, PRIMER_DEFAULT_WINDOW,
+                       PRIMER_DEFAULT_MISMATCHES, NULL);
+}
+
+/* --- Serialization ---
+ * HIDX v3 layout (native endianness, every uint64_t array 8-byte aligned
+ * so the file can be mmap()ed and queried in place):
+ *   u32 magic, u32 version
+ *   i32 coarse_k, i32 fine_k, f64 coarse_scale, i32 S, i32 M,
+ *   i32 fine_syncmer_s
+ *   refdb: species[S], marker_ids[M], primer_f[M], primer_r[M], f64 threshold_wpw,
+ *          i32 n_refs, n_refs x { i32 species, marker, seq_len, amp_len,
+ *          char seq[seq_len] }, padding
+ *   sections: u64 coarse_off, posting_off, filter_off, fine_off[M]
+ *            (file offsets of the blocks below; fine_off[m] is marker m's)
+ *   coarse:  S     x { u64 n, u64 hashes[n] }          (sorted, unique)
+ *   fine:    M x S x { i32 n, i32 k, u64 keys[n] }      (sorted)
+ *   posting: u64 n_keys, pool_n, i32 n_markers, n_species, k, dir_bits,
+ *            u64 keys[n_keys], u64 dir_key[nb], u64 dir_pool[nb],
+ *            u32 pool[pool_n], padding      (nb = 2^dir_bits + 1)
+ *            (dir_bits = -1: no posting table, fine sets are scored directly)
+ *   filter:  i32 block_bits, k, u64 words[8 << block_bits]
+ *            (block_bits = -1: no prefilter)
+ * Only the small refdb section is copied on load, and the section table
+ * lets a marker-restricted load skip other markers' fine blocks.  v2
+ * files are read by the stream loader and rebuilt in memory. */
 
 #define INDEX_MAGIC 0x48494458  /* "HIDX" */
-#define INDEX_VERSION 2
+#define INDEX_VERSION 3
+
+static void write_pad8(FILE *fp) {
+    static const char zeros[8] = { 0 };
+    long pos = ftell(fp);
+    if (pos % 8) fwrite(zeros, 1, (size_t)(8 - pos % 8), fp);
+}
+
+static void write_set(FILE *fp, const kmer_set_t *ks) {
+    int32_t n = ks ? ks->n_kmers : 0;
+    int32_t k = ks ? ks->k : 0;
+    fwrite(&n, sizeof(n), 1, fp);
+    fwrite(&k, sizeof(k), 1, fp);
+    if (n > 0) {
+        uint64_t *keys = (uint64_t *)hs_malloc((size_t)n * sizeof(uint64_t));
+        kmer_set_sorted_keys(ks, keys);
+        fwrite(keys, sizeof(uint64_t), (size_t)n, fp);
+        free(keys);
+    }
+}
 
 int index_save(const halal_index_t *idx, const char *path) {
-    FILE *fp = fopen(path, "wb");
-    if (!fp) return -1;
+    if (idx->marker_loaded) {
+        HS_LOG_ERROR("Index was loaded for a subset of markers; not saving it");
+        return -1;
+    }
+    /* Written beside the target and renamed over it, so a loaded index
+     * can be saved over the file it is mapped from */
+    size_t plen = strlen(path);
+    char *tmp = (char *)hs_malloc(plen + 5);
+    memcpy(tmp, path, plen);
+    memcpy(tmp + plen, ".tmp", 5);
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) { free(tmp); return -1; }
     uint32_t magic = INDEX_MAGIC, version = INDEX_VERSION;
     fwrite(&magic, 4, 1, fp);
     fwrite(&version, 4, 1, fp);
 
-    int S = idx->db->n_species;
-    int M = idx->db->n_markers;
-    fwrite(&idx->coarse_k, sizeof(int), 1, fp);
-    fwrite(&idx->fine_k, sizeof(int), 1, fp);
+    int32_t S = idx->db->n_species;
+    int32_t M = idx->db->n_markers;
+    int32_t coarse_k = idx->coarse_k, fine_k = idx->fine_k;
+    fwrite(&coarse_k, sizeof(int32_t), 1, fp);
+    fwrite(&fine_k, sizeof(int32_t), 1, fp);
     fwrite(&idx->coarse_scale, sizeof(double), 1, fp);
+    fwrite(&S, sizeof(int32_t), 1, fp);
+    fwrite(&M, sizeof(int32_t), 1, fp);
+    int32_t syncmer_s = idx->fine_syncmer_s;
+    fwrite(&syncmer_s, sizeof(int32_t), 1, fp);
 
-    /* Save refdb inline */
-    /* Write species */
-    fwrite(&S, sizeof(int), 1, fp);
-    fwrite(&M, sizeof(int), 1, fp);
+    /* Reference database */
     fwrite(idx->db->species, sizeof(species_info_t), (size_t)S, fp);
-    fwrite(idx->db->marker_ids, sizeof(idx->db->marker_ids), 1, fp);
-    fwrite(idx->db->primer_f, sizeof(idx->db->primer_f), 1, fp);
-    fwrite(idx->db->primer_r, sizeof(idx->db->primer_r), 1, fp);
+    fwrite(idx->db->marker_ids, sizeof(*idx->db->marker_ids), (size_t)M, fp);
+    fwrite(idx->db->primer_f, sizeof(*idx->db->primer_f), (size_t)M, fp);
+    fwrite(idx->db->primer_r, sizeof(*idx->db->primer_r), (size_t)M, fp);
     fwrite(&idx->db->threshold_wpw, sizeof(double), 1, fp);
-    fwrite(&idx->db->n_marker_refs, sizeof(int), 1, fp);
-    for (int i = 0; i < idx->db->n_marker_refs; i++) {
-        fwrite(&idx->db->markers[i].species_idx, sizeof(int), 1, fp);
-        fwrite(&idx->db->markers[i].marker_idx, sizeof(int), 1, fp);
-        fwrite(&idx->db->markers[i].seq_len, sizeof(int), 1, fp);
-        fwrite(&idx->db->markers[i].amplicon_length, sizeof(int), 1, fp);
-        fwrite(idx->db->markers[i].sequence, 1, (size_t)idx->db->markers[i].seq_len, fp);
+    int32_t n_refs = idx->db->n_marker_refs;
+    fwrite(&n_refs, sizeof(int32_t), 1, fp);
+    for (int i = 0; i < n_refs; i++) {
+        const marker_ref_t *mr = &idx->db->markers[i];
+        int32_t hdr[4] = { mr->species_idx, mr->marker_idx, mr->seq_len, mr->amplicon_length };
+        fwrite(hdr, sizeof(int32_t), 4, fp);
+        fwrite(mr->sequence, 1, (size_t)mr->seq_len, fp);
     }
+    write_pad8(fp);
+
+    /* Section table, filled in once the blocks are written */
+    long table_pos = ftell(fp);
+    uint64_t *sections = (uint64_t *)hs_calloc((size_t)M + 3, sizeof(uint64_t));
+    fwrite(sections, sizeof(uint64_t), (size_t)M + 3, fp);
 
-    /* Save coarse sketches */
+    /* Coarse sketches */
+    sections[0] = (uint64_t)ftell(fp);
     for (int s = 0; s < S; s++) {
-        fwrite(&idx->coarse[s]->n, sizeof(int), 1, fp);
-        fwrite(idx->coarse[s]->hashes, sizeof(uint64_t), (size_t)idx->coarse[s]->n, fp);
+        uint64_t n = (uint64_t)idx->coarse[s]->n;
+        fwrite(&n, sizeof(uint64_t), 1, fp);
+        fwrite(idx->coarse[s]->hashes, sizeof(uint64_t), (size_t)n, fp);
     }
 
-    /* Save fine k-mer sets */
+    /* Fine k-mer sets */
     for (int m = 0; m < M; m++) {
+        sections[3 + m] = (uint64_t)ftell(fp);
+        for (int s = 0; s < S; s++) write_set(fp, idx->fine[m][s]);
+    }
+
+    /* Posting table (absent when there are too many k-mers to post:
+     * dir_bits = -1) */
+    const kmer_posting_t *pt = idx->fine_posting;
+    uint64_t phdr[2] = { 0, 0 };
+    int32_t pdim[4] = { M, S, idx->fine_k, -1 };
+    if (pt) {
+        phdr[0] = pt->n_keys; phdr[1] = pt->pool_n;
+        pdim[0] = pt->n_markers; pdim[1] = pt->n_species;
+        pdim[2] = pt->k; pdim[3] = pt->dir_bits;
+    }
+    sections[1] = (uint64_t)ftell(fp);
+    fwrite(phdr, sizeof(uint64_t), 2, fp);
+    fwrite(pdim, sizeof(int32_t), 4, fp);
+    if (pt) {
+        size_t nb = ((size_t)1 << pt->dir_bits) + 1;
+        fwrite(pt->keys, sizeof(uint64_t), (size_t)pt->n_keys, fp);
+        fwrite(pt->dir_key, sizeof(uint64_t), nb, fp);
+        fwrite(pt->dir_pool, sizeof(uint64_t), nb, fp);
+        fwrite(pt->pool, sizeof(uint32_t), (size_t)pt->pool_n, fp);
+        write_pad8(fp);
+    }
+
+    /* Prefilter */
+    const kmer_bloom_t *bf = idx->fine_filter;
+    sections[2] = (uint64_t)ftell(fp);
+    int32_t fdim[2] = { bf ? bf->block_bits : -1, idx->fine_k };
+    fwrite(fdim, sizeof(int32_t), 2, fp);
+    if (bf) fwrite(bf->words, sizeof(uint64_t), (size_t)8 << bf->block_bits, fp);
+
+    fseek(fp, table_pos, SEEK_SET);
+    fwrite(sections, sizeof(uint64_t), (size_t)M + 3, fp);
+    free(sections);
+
+    int err = ferror(fp);
+    if (fclose(fp) != 0 || err || rename(tmp, path) != 0) {
+        remove(tmp);
+        free(tmp);
+        return -1;
+    }
+    free(tmp);
+    return 0;
+}
+
+/* Bounds-checked cursor over the mapped file */
+typedef struct {
+    const uint8_t *base, *p, *end;
+    int ok;
+} map_cursor_t;
+
+static const void *cur_take(map_cursor_t *c, size_t n) {
+    if (!c->ok || (size_t)(c->end - c->p) < n) { c->ok = 0; return NULL; }
+    const void *r = c->p;
+    c->p += n;
+    return r;
+}
+
+static void cur_read(map_cursor_t *c, void *dst, size_t n) {
+    const void *src = cur_take(c, n);
+    if (src) memcpy(dst, src, n);
+    else memset(dst, 0, n);
+}
+
+static void cur_align8(map_cursor_t *c) {
+    size_t off = (size_t)(c->p - c->base);
+    if (off % 8) cur_take(c, 8 - off % 8);
+}
+
+/* Jump to an 8-aligned offset from a section table */
+static void cur_seek(map_cursor_t *c, uint64_t off) {
+    if (!c->ok || off > (uint64_t)(c->end - c->base) || off % 8) { c->ok = 0; return; }
+    c->p = c->base + off;
+}
+
+static const uint64_t *cur_u64s(map_cursor_t *c, uint64_t n) {
+    if (n > (uint64_t)(c->end - c->p) / sizeof(uint64_t)) { c->ok = 0; return NULL; }
+    return (const uint64_t *)cur_take(c, (size_t)n * sizeof(uint64_t));
+}
+
+static const uint32_t *cur_u32s(map_cursor_t *c, uint64_t n) {
+    if (n > (uint64_t)(c->end - c->p) / sizeof(uint32_t)) { c->ok = 0; return NULL; }
+    return (const uint32_t *)cur_take(c, (size_t)n * sizeof(uint32_t));
+}
+
+static kmer_set_t *cur_set(map_cursor_t *c) {
+    int32_t n, k;
+    cur_read(c, &n, sizeof(n));
+    cur_read(c, &k, sizeof(k));
+    if (n < 0) c->ok = 0;
+    if (!c->ok || n == 0) return NULL;
+    const uint64_t *keys = cur_u64s(c, (uint64_t)n);
+    return keys ? kmer_set_view(k, keys, n) : NULL;
+}
+
+/* --- Marker-restricted loading --- */
+
+/* Mask over db's markers from a comma-separated ID list; NULL for every
+ * marker (list NULL or empty).  *ok is cleared on an unknown ID. */
+static char *parse_marker_list(const halal_refdb_t *db, const char *list, int *ok) {
+    *ok = 1;
+    if (!list || !*list) return NULL;
+    char *want = (char *)hs_calloc((size_t)db->n_markers > 0 ? (size_t)db->n_markers : 1, 1);
+    const char *p = list;
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        char id[sizeof(*db->marker_ids)];
+        int m = -1;
+        if (len > 0 && len < sizeof(id)) {
+            memcpy(id, p, len);
+            id[len] = '\0';
+            m = refdb_find_marker(db, id);
+        }
+        if (m < 0) {
+            HS_LOG_ERROR("Unknown marker '%.*s' in marker list", (int)len, p);
+            *ok = 0;
+            free(want);
+            return NULL;
+        }
+        want[m] = 1;
+        p += len;
+        if (*p == ',') p++;
+    }
+    return want;
+}
+
+/* Keep only the wanted markers' fine sets (taking ownership of want) and
+ * rebuild the posting table and prefilter over them */
+static void restrict_markers(halal_index_t *idx, char *want) {
+    int S = idx->db->n_species;
+    int M = idx->db->n_markers;
+    for (int m = 0; m < M; m++) {
+        if (want[m]) continue;
         for (int s = 0; s < S; s++) {
-            kmer_set_t *ks = idx->fine[m][s];
-            int n = ks ? ks->n_kmers : 0;
-            int k = ks ? ks->k : 0;
-            fwrite(&n, sizeof(int), 1, fp);
-            fwrite(&k, sizeof(int), 1, fp);
-            if (ks && n > 0) {
-                khint_t ki;
-                for (ki = kh_begin(ks->h); ki != kh_end(ks->h); ki++) {
-                    if (kh_exist(ks->h, ki)) {
-                        uint64_t key = kh_key(ks->h, ki);
-                        fwrite(&key, sizeof(uint64_t), 1, fp);
-                    }
+            kmer_set_destroy(idx->fine[m][s]);
+            idx->fine[m][s] = NULL;
+        }
+    }
+    kmer_posting_destroy(idx->fine_posting);
+    idx->fine_posting = kmer_posting_build((kmer_set_t *const *const *)idx->fine, M, S,
+                                           idx->fine_k);
+    build_filter(idx);
+    idx->marker_loaded = want;
+}
+
+static halal_index_t *index_load_mapped(void *map, size_t map_len, const char *markers) {
+    map_cursor_t c = { (const uint8_t *)map, (const uint8_t *)map,
+                       (const uint8_t *)map + map_len, 1 };
+    cur_take(&c, 8); /* magic, version */
+
+    halal_index_t *idx = (halal_index_t *)hs_calloc(1, sizeof(halal_index_t));
+    int32_t coarse_k, fine_k, S, M;
+    cur_read(&c, &coarse_k, sizeof(int32_t));
+    cur_read(&c, &fine_k, sizeof(int32_t));
+    cur_read(&c, &idx->coarse_scale, sizeof(double));
+    cur_read(&c, &S, sizeof(int32_t));
+    cur_read(&c, &M, sizeof(int32_t));
+    int32_t syncmer_s;
+    cur_read(&c, &syncmer_s, sizeof(int32_t));
+    idx->coarse_k = coarse_k;
+    idx->fine_k = fine_k;
+    idx->fine_syncmer_s = syncmer_s;
+    if (!c.ok || S < 0 || M < 0 || syncmer_s < 0 || syncmer_s > fine_k ||
+        (uint64_t)S * sizeof(species_info_t) > (uint64_t)(c.end - c.p) ||
+        (uint64_t)M * (16 + 2 * HS_MAX_PRIMER_LEN) > (uint64_t)(c.end - c.p)) {
+        HS_LOG_ERROR("Index file is truncated or corrupt");
+        free(idx);
+        hs_unmap_file(map, map_len);
+        return NULL;
+    }
+
+    /* Reference database (copied: it is small and owned by the index) */
+    halal_refdb_t *db = refdb_create();
+    db->n_species = S;
+    refdb_alloc_markers(db, M);
+    db->species = (species_info_t *)hs_calloc((size_t)S > 0 ? (size_t)S : 1,
+                                              sizeof(species_info_t));
+    cur_read(&c, db->species, (size_t)S * sizeof(species_info_t));
+    cur_read(&c, db->marker_ids, sizeof(*db->marker_ids) * (size_t)M);
+    cur_read(&c, db->primer_f, sizeof(*db->primer_f) * (size_t)M);
+    cur_read(&c, db->primer_r, sizeof(*db->primer_r) * (size_t)M);
+    cur_read(&c, &db->threshold_wpw, sizeof(double));
+    int32_t n_refs = 0;
+    cur_read(&c, &n_refs, sizeof(int32_t));
+    if (n_refs < 0 || (uint64_t)n_refs * 16 > (uint64_t)(c.end - c.p)) c.ok = 0;
+    if (c.ok && n_refs > 0) {
+        db->markers = (marker_ref_t *)hs_calloc((size_t)n_refs, sizeof(marker_ref_t));
+        for (int i = 0; i < n_refs && c.ok; i++) {
+            int32_t hdr[4];
+            cur_read(&c, hdr, sizeof(hdr));
+            if (hdr[2] < 0) { c.ok = 0; break; }
+            const char *seq = (const char *)cur_take(&c, (size_t)hdr[2]);
+            if (!seq) break;
+            marker_ref_t *mr = &db->markers[i];
+            mr->species_idx = hdr[0];
+            mr->marker_idx = hdr[1];
+            mr->seq_len = hdr[2];
+            mr->amplicon_length = hdr[3];
+            mr->sequence = (char *)hs_malloc((size_t)hdr[2] + 1);
+            memcpy(mr->sequence, seq, (size_t)hdr[2]);
+            mr->sequence[hdr[2]] = '\0';
+            db->n_marker_refs = i + 1;
+        }
+    }
+    refdb_reindex(db);
+    idx->db = db;
+    cur_align8(&c);
+
+    int markers_ok;
+    char *want = parse_marker_list(db, markers, &markers_ok);
+    const uint64_t *sections = cur_u64s(&c, (uint64_t)M + 3);
+    if (sections) cur_seek(&c, sections[0]);
+
+    /* Coarse sketches: views into the mapping */
+    idx->coarse = (fmh_sketch_t **)hs_calloc((size_t)S > 0 ? (size_t)S : 1,
+                                             sizeof(fmh_sketch_t *));
+    for (int s = 0; s < S; s++) {
+        uint64_t n = 0;
+        cur_read(&c, &n, sizeof(uint64_t));
+        const uint64_t *h = n > INT32_MAX ? NULL : cur_u64s(&c, n);
+        if (!h) { c.ok = 0; n = 0; }
+        idx->coarse[s] = fmh_view(idx->coarse_k, idx->coarse_scale, h, (int)n);
+    }
+    idx->coarse_multi = fmh_multi_build(idx->coarse, S);
+
+    /* Fine sets; unwanted markers' blocks are skipped */
+    idx->fine = (kmer_set_t ***)hs_calloc((size_t)M > 0 ? (size_t)M : 1, sizeof(kmer_set_t **));
+    for (int m = 0; m < M; m++) {
+        idx->fine[m] = (kmer_set_t **)hs_calloc((size_t)S > 0 ? (size_t)S : 1,
+                                                sizeof(kmer_set_t *));
+        if (!sections || (want && !want[m])) continue;
+        cur_seek(&c, sections[3 + m]);
+        for (int s = 0; s < S; s++) idx->fine[m][s] = cur_set(&c);
+    }
+    idx->primers = primer_scanner_build(db);
+
+    /* Posting table and prefilter: mapped in place, unless a marker subset
+     * rebuilds them over its fine sets */
+    if (sections && !want) {
+        cur_seek(&c, sections[1]);
+        uint64_t phdr[2];
+        int32_t pdim[4];
+        cur_read(&c, phdr, sizeof(phdr));
+        cur_read(&c, pdim, sizeof(pdim));
+        if (pdim[3] >= 0) {
+            kmer_posting_t *pt = (kmer_posting_t *)hs_calloc(1, sizeof(kmer_posting_t));
+            pt->borrowed = 1;
+            pt->n_keys = phdr[0];
+            pt->pool_n = phdr[1];
+            pt->n_markers = pdim[0];
+            pt->n_species = pdim[1];
+            pt->k = pdim[2];
+            pt->dir_bits = pdim[3];
+            idx->fine_posting = pt;
+            if (pt->dir_bits > 62 || pt->n_markers != M || pt->n_species != S) {
+                c.ok = 0;
+            } else {
+                uint64_t nb = (1ULL << pt->dir_bits) + 1;
+                pt->keys = (uint64_t *)cur_u64s(&c, pt->n_keys);
+                pt->dir_key = (uint64_t *)cur_u64s(&c, nb);
+                pt->dir_pool = (uint64_t *)cur_u64s(&c, nb);
+                pt->pool = (uint32_t *)cur_u32s(&c, pt->pool_n);
+                cur_align8(&c);
+                /* Scoring indexes counts with the pool's cells, so a table
+                 * that does not check out is rebuilt from the fine sets */
+                if (c.ok && !kmer_posting_valid(pt)) {
+                    HS_LOG_WARN("Index posting table is corrupt; rebuilding it");
+                    kmer_posting_destroy(pt);
+                    idx->fine_posting = kmer_posting_build(
+                        (kmer_set_t *const *const *)idx->fine, M, S, idx->fine_k);
                 }
             }
         }
+
+        cur_seek(&c, sections[2]);
+        int32_t fdim[2];
+        cur_read(&c, fdim, sizeof(fdim));
+        if (fdim[0] > 40 || fdim[1] != idx->fine_k) {
+            c.ok = 0;
+        } else if (fdim[0] >= 0) {
+            const uint64_t *words = cur_u64s(&c, (uint64_t)8 << fdim[0]);
+            if (words) idx->fine_filter = kmer_bloom_view(fdim[1], fdim[0], words);
+        }
     }
 
-    fclose(fp);
-    return 0;
+    idx->map = map;
+    idx->map_len = map_len;
+    if (!c.ok || !markers_ok) {
+        if (!c.ok) HS_LOG_ERROR("Index file is truncated or corrupt");
+        free(want);
+        index_destroy(idx);
+        return NULL;
+    }
+    if (want) restrict_markers(idx, want);
+    return idx;
 }
 
-halal_index_t *index_load(const char *path) {
+/* Version 2: stream format with per-key fine sets (read-only support) */
+static halal_index_t *index_load_v2(const char *path, const char *markers) {
     FILE *fp = fopen(path, "rb");
     if (!fp) return NULL;
     uint32_t magic, version;
     if (fread(&magic, 4, 1, fp) != 1 || magic != INDEX_MAGIC) { fclose(fp); return NULL; }
-    if (fread(&version, 4, 1, fp) != 1 || version != INDEX_VERSION) { fclose(fp); return NULL; }
+    if (fread(&version, 4, 1, fp) != 1 || version != 2) { fclose(fp); return NULL; }
 
     halal_index_t *idx = (halal_index_t *)hs_calloc(1, sizeof(halal_index_t));
     fread(&idx->coarse_k, sizeof(int), 1, fp);
@@ -208,14 +772,24 @@ halal_index_t *index_load(const char *path) {
     fread(&S, sizeof(int), 1, fp);
     fread(&M, sizeof(int), 1, fp);
 
+    if (S < 0 || M < 0 || M > HS_LEGACY_MARKER_SLOTS) {
+        HS_LOG_ERROR("Index file is truncated or corrupt");
+        free(idx);
+        fclose(fp);
+        return NULL;
+    }
     halal_refdb_t *db = refdb_create();
     db->n_species = S;
-    db->n_markers = M;
+    refdb_alloc_markers(db, M);
     db->species = (species_info_t *)hs_malloc((size_t)S * sizeof(species_info_t));
     fread(db->species, sizeof(species_info_t), (size_t)S, fp);
-    fread(db->marker_ids, sizeof(db->marker_ids), 1, fp);
-    fread(db->primer_f, sizeof(db->primer_f), 1, fp);
-    fread(db->primer_r, sizeof(db->primer_r), 1, fp);
+    long unused = HS_LEGACY_MARKER_SLOTS - M;
+    fread(db->marker_ids, sizeof(*db->marker_ids), (size_t)M, fp);
+    fseek(fp, unused * (long)sizeof(*db->marker_ids), SEEK_CUR);
+    fread(db->primer_f, sizeof(*db->primer_f), (size_t)M, fp);
+    fseek(fp, unused * (long)sizeof(*db->primer_f), SEEK_CUR);
+    fread(db->primer_r, sizeof(*db->primer_r), (size_t)M, fp);
+    fseek(fp, unused * (long)sizeof(*db->primer_r), SEEK_CUR);
     fread(&db->threshold_wpw, sizeof(double), 1, fp);
 
     fread(&db->n_marker_refs, sizeof(int), 1, fp);
@@ -229,6 +803,7 @@ halal_index_t *index_load(const char *path) {
         fread(db->markers[i].sequence, 1, (size_t)db->markers[i].seq_len, fp);
         db->markers[i].sequence[db->markers[i].seq_len] = '\0';
     }
+    refdb_reindex(db);
     idx->db = db;
 
     /* Load coarse sketches */
@@ -243,6 +818,7 @@ halal_index_t *index_load(const char *path) {
         }
         fread(idx->coarse[s]->hashes, sizeof(uint64_t), (size_t)idx->coarse[s]->n, fp);
     }
+    idx->coarse_multi = fmh_multi_build(idx->coarse, S);
 
     /* Load fine k-mer sets */
     idx->fine = (kmer_set_t ***)hs_calloc((size_t)M, sizeof(kmer_set_t **));
@@ -253,30 +829,89 @@ halal_index_t *index_load(const char *path) {
             fread(&n, sizeof(int), 1, fp);
             fread(&k, sizeof(int), 1, fp);
             if (n > 0) {
+                uint64_t *keys = (uint64_t *)hs_malloc((size_t)n * sizeof(uint64_t));
+                fread(keys, sizeof(uint64_t), (size_t)n, fp);
                 idx->fine[m][s] = kmer_set_init(k);
-                for (int j = 0; j < n; j++) {
-                    uint64_t key;
-                    fread(&key, sizeof(uint64_t), 1, fp);
-                    int ret;
-                    kh_put(kmer64, idx->fine[m][s]->h, key, &ret);
-                    idx->fine[m][s]->n_kmers++;
-                }
+                kmer_set_add_hashes(idx->fine[m][s], keys, n);
+                free(keys);
             }
         }
     }
 
-    /* Rebuild primer index from loaded primers */
-    idx->primer_index = (kmer_set_t **)hs_calloc((size_t)M, sizeof(kmer_set_t *));
-    int primer_k = 15;
-    for (int m = 0; m < M; m++) {
-        idx->primer_index[m] = kmer_set_init(primer_k);
-        int flen = (int)strlen(db->primer_f[m]);
-        int rlen = (int)strlen(db->primer_r[m]);
-        if (flen >= primer_k)
-            kmer_set_add_seq(idx->primer_index[m], db->primer_f[m], flen);
-        if (rlen >= primer_k)
-            kmer_set_add_seq(idx->primer_index[m], db->primer_r[m], rlen);
-    }
+    idx->fine_posting = kmer_posting_build((kmer_set_t *const *const *)idx->fine,
+                                           M, S, idx->fine_k);
+    build_filter(idx);
+
+    idx->primers = primer_scanner_build(db);
 
+    int markers_ok;
+    char *want = parse_marker_list(db, markers, &markers_ok);
+    if (!markers_ok) { index_destroy(idx); return NULL; }
+    if (want) restrict_markers(idx, want);
     return idx;
 }
+
+halal_index_t *index_load(const char *path) {
+    return index_load_markers(path, NULL);
+}
+
+halal_index_t *index_load_markers(const char *path, const char *markers) {
+    size_t map_len = 0;
+    void *map = hs_map_file(path, &map_len);
+    if (!map) return NULL;
+    uint32_t hdr[2] = { 0, 0 };
+    if (map_len >= sizeof(hdr)) memcpy(hdr, map, sizeof(hdr));
+    if (hdr[0] != INDEX_MAGIC) { hs_unmap_file(map, map_len); return NULL; }
+    if (hdr[1] == INDEX_VERSION) return index_load_mapped(map, map_len, markers);
+    hs_unmap_file(map, map_len);
+    if (hdr[1] == 2) return index_load_v2(path, markers);
+    HS_LOG_ERROR("Unsupported index version %u in %s", hdr[1], path);
+    return NULL;
+}
+
+int index_file_sections(const char *path, uint64_t *bounds, int max) {
+    size_t map_len = 0;
+    void *map = hs_map_file(path, &map_len);
+    if (!map) return -1;
+    map_cursor_t c = { (const uint8_t *)map, (const uint8_t *)map,
+                       (const uint8_t *)map + map_len, 1 };
+    uint32_t hdr[2] = { 0, 0 };
+    cur_read(&c, hdr, sizeof(hdr));
+    int n = 0;
+    if (c.ok && hdr[0] == INDEX_MAGIC && hdr[1] == INDEX_VERSION) {
+        /* k, scale, S, M, s, then the refdb up to the section table */
+        int32_t S, M;
+        cur_take(&c, 2 * sizeof(int32_t) + sizeof(double));
+        cur_read(&c, &S, sizeof(int32_t));
+        cur_read(&c, &M, sizeof(int32_t));
+        cur_take(&c, sizeof(int32_t));
+        if (S < 0 || M < 0 || M + 4 > max) c.ok = 0;
+        if (c.ok) {
+            cur_take(&c, (size_t)S * sizeof(species_info_t) +
+                         (size_t)M * (16 + 2 * HS_MAX_PRIMER_LEN) + sizeof(double));
+            int32_t n_refs = 0;
+            cur_read(&c, &n_refs, sizeof(int32_t));
+            for (int i = 0; i < n_refs && c.ok; i++) {
+                int32_t ref[4];
+                cur_read(&c, ref, sizeof(ref));
+                if (ref[2] < 0) c.ok = 0;
+                else cur_take(&c, (size_t)ref[2]);
+            }
+            cur_align8(&c);
+        }
+        const uint64_t *table = c.ok ? cur_u64s(&c, (uint64_t)M + 3) : NULL;
+        if (table) {
+            /* Blocks in file order: coarse, fine[0..M), posting, filter */
+            bounds[n++] = 0;
+            bounds[n++] = table[0];
+            for (int m = 0; m < M; m++) bounds[n++] = table[3 + m];
+            bounds[n++] = table[1];
+            bounds[n++] = table[2];
+            bounds[n] = (uint64_t)map_len;
+            for (int i = 0; i < n; i++)
+                if (bounds[i] > bounds[i + 1]) n = 0;
+        }
+    }
+    hs_unmap_file(map, map_len);
+    return n;
+}
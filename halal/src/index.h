@@ -2,25 +2,82 @@
 #define HALALSEQ_INDEX_H
 
 #include "kmer.h"
+#include "primer.h"
 #include "refdb.h"
 
 typedef struct {
     /* Coarse level: one FracMinHash per species (merged across markers) */
     fmh_sketch_t **coarse;         /* [n_species] */
+    /* Union of the coarse sketches for one-pass screening (derived, not saved) */
+    fmh_multi_t *coarse_multi;
     /* Fine level: per-marker per-species exact k-mer sets */
     kmer_set_t ***fine;            /* [n_markers][n_species], NULL if no ref */
-    /* Marker detection: primer k-mer sets for each marker */
-    kmer_set_t **primer_index;     /* [n_markers] */
+    /* Inverted view of every fine set built at fine_k (derived, not saved) */
+    kmer_posting_t *fine_posting;
+    /* Bloom filter over every fine k-mer for rejecting off-target reads
+     * (derived, not saved; NULL if some fine set uses a fallback k) */
+    kmer_bloom_t *fine_filter;
+    /* Marker detection: primers near the read ends (derived, not saved) */
+    primer_scanner_t *primers;
     halal_refdb_t *db;             /* reference (owned) */
     int coarse_k;                  /* 21 */
     int fine_k;                    /* 31 */
     double coarse_scale;           /* FracMinHash scale */
+    /* Fine sets at fine_k hold only the open (fine_k, s)-syncmers of their
+     * references (0 = every k-mer); see index_build_sampled */
+    int fine_syncmer_s;
+    /* Markers whose fine sets were loaded ([n_markers], NULL = all; see
+     * index_load_markers) */
+    char *marker_loaded;
+    /* HIDX mapping backing coarse/fine/posting arrays (NULL if built) */
+    void *map;
+    size_t map_len;
 } halal_index_t;
 
+/* Build from db (taking ownership) on all CPUs */
 halal_index_t *index_build(halal_refdb_t *db);
+/* Same with n_threads workers (<= 0: all CPUs); the result does not
+ * depend on the thread count */
+halal_index_t *index_build_threads(halal_refdb_t *db, int n_threads);
+/* Same, sampling the fine sets to their open syncmers with s-mer size
+ * syncmer_s (0 = every k-mer; see hs_syncmer_hashes) for about
+ * fine_k - syncmer_s + 1 times fewer k-mers.  Reads are then scored on
+ * their syncmers too.  Sets of short references indexed at a fallback k
+ * stay dense. */
+halal_index_t *index_build_sampled(halal_refdb_t *db, int n_threads, int syncmer_s);
+/* Writes path.tmp and renames it over path */
 int index_save(const halal_index_t *idx, const char *path);
 halal_index_t *index_load(const char *path);
+/* As index_load, keeping only the fine sets of a comma-separated list of
+ * marker IDs (NULL or "" = all), for runs of a single assay.  The file's
+ * section table lets other markers' fine blocks, and the full posting
+ * table, stay unread, so startup and memory follow the markers kept.
+ * Reads of other markers go unclassified.  The result cannot be saved or
+ * updated.  NULL on an unknown marker ID. */
+halal_index_t *index_load_markers(const char *path, const char *markers);
+/* Byte ranges of a saved index's blocks, for comparing two versions of a
+ * file section by section (see update.h): bounds[0..n] with block i at
+ * [bounds[i], bounds[i+1]) and bounds[n] the file size.  The blocks are
+ * the header and reference database, the coarse sketches, each marker's
+ * fine sets, the posting table and the prefilter, so n = n_markers + 4;
+ * bounds needs n + 1 entries, at most max + 1.  Returns 0 for files
+ * without a section table (v2) or with more than max blocks, and
+ * -1 if the file cannot be read. */
+int index_file_sections(const char *path, uint64_t *bounds, int max);
 void index_destroy(halal_index_t *idx);
+/* Free everything except the reference database, which is returned */
+halal_refdb_t *index_release_db(halal_index_t *idx);
+
+/* --- Incremental update ---
+ * Patch a built or loaded index in place instead of rebuilding it: only
+ * the affected species' sketch and fine sets are built, then the derived
+ * tables.  k and the coarse scale are kept, so the result matches a full
+ * rebuild unless the new references would have changed the scale. */
+/* Copy species src_species and its references for markers the index
+ * already has; returns its new index, -1 if invalid or already present */
+int index_add_species(halal_index_t *idx, const halal_refdb_t *src, int src_species);
+/* Later species shift down by one */
+int index_remove_species(halal_index_t *idx, int species_idx);
 
 /* Query: get coarse containment for a read against all species */
 void index_query_coarse(const halal_index_t *idx, const char *seq, int len,
@@ -30,7 +87,53 @@ void index_query_coarse(const halal_index_t *idx, const char *seq, int len,
 double index_query_fine(const halal_index_t *idx, const char *seq, int len,
                         int marker_idx, int species_idx);
 
-/* Detect marker from read using primer k-mer matching */
+/* Detect marker from a primer near either read end (primer_scan() with
+ * the default window and mismatch limit) */
 int index_detect_marker(const halal_index_t *idx, const char *seq, int len);
 
+/* Profile-based variants: reuse the read's cached k-mer hashes (see
+ * kmer_profile_t) instead of re-hashing the sequence on every call */
+void index_query_coarse_profile(const halal_index_t *idx, kmer_profile_t *qp,
+                                double *scores, int n_species);
+double index_query_fine_profile(const halal_index_t *idx, kmer_profile_t *qp,
+                                int marker_idx, int species_idx);
+int index_detect_marker_profile(const halal_index_t *idx, kmer_profile_t *qp);
+
+/* Fine containment against every marker x species in one pass over the
+ * read: scores[m * n_species + s], 0 where no reference exists */
+void index_query_fine_all_profile(const halal_index_t *idx, kmer_profile_t *qp,
+                                  double *scores);
+/* Same, with caller-owned counts[n_markers * n_species] scratch */
+void index_query_fine_all_scratch(const halal_index_t *idx, kmer_profile_t *qp,
+                                  double *scores, int *counts);
+/* The read's fine_k hashes that fine scoring looks up: its open
+ * syncmers when the index is sampled (with the index's s) or when
+ * syncmer_s > 0, else every k-mer.  A syncmer is a syncmer in both read
+ * and reference, so the fraction of sampled read k-mers found estimates
+ * the dense containment without rescaling. */
+const uint64_t *index_fine_hashes(const halal_index_t *idx, kmer_profile_t *qp,
+                                  int syncmer_s, int *n);
+/* Bounded variant for classification.  Only species with candidates[s]
+ * set (all if NULL) and only marker_idx (all if < 0) are scored; the rest
+ * read 0.  Scoring against a reference set stops once it cannot reach
+ * floor, nor the species' best score at an earlier marker, so only the
+ * per-species maximum over markers is exact when it is >= floor.
+ * floor <= 0 scores everything exactly.  Reads are sampled as
+ * index_fine_hashes(syncmer_s). */
+void index_query_fine_bounded(const halal_index_t *idx, kmer_profile_t *qp,
+                              const char *candidates, int marker_idx, double floor,
+                              int syncmer_s, double *scores, int *counts);
+/* The posting-table half of index_query_fine_bounded for several reads
+ * at once: counts[r] (n_markers * n_species) is filled for qps[r], with
+ * the table lookups of up to INDEX_FINE_BATCH reads interleaved and
+ * prefetched (kmer_posting_count_batch), so their cache misses on a large
+ * index overlap.  Nothing is counted without a posting table. */
+#define INDEX_FINE_BATCH 16
+void index_count_fine_batch(const halal_index_t *idx, kmer_profile_t *const *qps,
+                            int n_reads, int syncmer_s, int *const *counts);
+/* index_query_fine_bounded from counts filled by index_count_fine_batch */
+void index_query_fine_counted(const halal_index_t *idx, kmer_profile_t *qp,
+                              const char *candidates, int marker_idx, double floor,
+                              int syncmer_s, double *scores, const int *counts);
+
 #endif /* HALALSEQ_INDEX_H */
@@ -3,24 +3,38 @@
 #include <string.h>
 #include <stdlib.h>
 
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define KMER_SIMD_X86 1
+#include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define KMER_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
 /* --- Base encoding --- */
 
-static int base_table_init = 0;
-static int base_table[256];
+#define B4(x) x, x, x, x
+#define B16(x) B4(x), B4(x), B4(x), B4(x)
 
-static void init_base_table(void) {
-    if (base_table_init) return;
-    for (int i = 0; i < 256; i++) base_table[i] = -1;
-    base_table['A'] = 0; base_table['a'] = 0;
-    base_table['C'] = 1; base_table['c'] = 1;
-    base_table['G'] = 2; base_table['g'] = 2;
-    base_table['T'] = 3; base_table['t'] = 3;
-    base_table_init = 1;
-}
+const int8_t hs_base_table[256] = {
+    B16(-1), B16(-1), B16(-1), B16(-1),          /* 0x00-0x3f */
+    -1, 0, -1, 1, -1, -1, -1, 2,                  /* @ A B C D E F G */
+    -1, -1, -1, -1, -1, -1, -1, -1,               /* H-O */
+    -1, -1, -1, -1, 3, -1, -1, -1,                /* P Q R S T U V W */
+    -1, -1, -1, -1, -1, -1, -1, -1,               /* X-_ */
+    -1, 0, -1, 1, -1, -1, -1, 2,                  /* ` a b c d e f g */
+    -1, -1, -1, -1, -1, -1, -1, -1,               /* h-o */
+    -1, -1, -1, -1, 3, -1, -1, -1,                /* p q r s t u v w */
+    -1, -1, -1, -1, -1, -1, -1, -1,               /* x-DEL */
+    B16(-1), B16(-1), B16(-1), B16(-1),          /* 0x80-0xbf */
+    B16(-1), B16(-1), B16(-1), B16(-1),          /* 0xc0-0xff */
+};
+
+#undef B16
+#undef B4
 
 int hs_base_encode(char c) {
-    init_base_table();
-    return base_table[(unsigned char)c];
+    return hs_base_table[(unsigned char)c];
 }
 
 /* --- MurmurHash3 64-bit finalizer --- */
@@ -37,10 +51,9 @@ uint64_t hs_hash64(uint64_t key) {
 /* --- k-mer hashing --- */
 
 uint64_t hs_kmer_hash(const char *seq, int k) {
-    init_base_table();
     uint64_t kmer = 0;
     for (int i = 0; i < k; i++) {
-        int b = base_table[(unsigned char)seq[i]];
+        int b = hs_base_table[(unsigned char)seq[i]];
         if (b < 0) return UINT64_MAX; /* invalid base */
         kmer = (kmer << 2) | (uint64_t)b;
     }
@@ -52,7 +65,7 @@ static const int comp_table[4] = { 3, 2, 1, 0 }; /* A<->T, C<->G */
 uint64_t hs_kmer_revcomp_hash(const char *seq, int k) {
     uint64_t kmer = 0;
     for (int i = k - 1; i >= 0; i--) {
-        int b = base_table[(unsigned char)seq[i]];
+        int b = hs_base_table[(unsigned char)seq[i]];
         if (b < 0) return UINT64_MAX;
         kmer = (kmer << 2) | (uint64_t)comp_table[b];
     }
@@ -66,21 +79,349 @@ uint64_t hs_kmer_canonical(const char *seq, int k) {
     return fwd < rev ? fwd : rev;
 }
 
+/* --- Rolling iterator --- */
+
+void hs_kmer_iter_init(hs_kmer_iter_t *it, const char *seq, int len, int k) {
+    it->seq = seq;
+    it->len = (k >= 1 && k <= 32 && len >= k) ? len : 0;
+    it->k = k;
+    it->pos = 0;
+    it->filled = 0;
+    it->shift = 2 * (k - 1);
+    it->mask = k >= 32 ? UINT64_MAX : ((uint64_t)1 << (2 * k)) - 1;
+    it->fwd = it->rev = 0;
+}
+
+/* --- Packed bases ---
+ * ASCII to 2-bit: bits 1-2 of A, C, G, T (either case) are 00, 01, 11,
+ * 10, so code = (c >> 1 & 3) ^ (c >> 2 & 1); a base is valid when
+ * c | 0x20 is one of "acgt".  The vector kernels turn 16 or 32 bases into
+ * their codes and validity mask, fold the codes pairwise into 2-bit
+ * fields with shifts, narrow them to one 32- or 64-bit word and take the
+ * N-mask from the compare's sign bits.  Invalid bases pack as 0. */
+
+static inline uint64_t pack_scalar(const char *p, int n, uint64_t *bad) {
+    uint64_t w = 0, m = 0;
+    for (int i = 0; i < n; i++) {
+        int b = hs_base_table[(unsigned char)p[i]];
+        if (b < 0) m |= (uint64_t)1 << i;
+        else w |= (uint64_t)b << (2 * i);
+    }
+    *bad = m;
+    return w;
+}
+
+#if defined(KMER_SIMD_X86) && defined(__SSE2__)
+static inline uint32_t pack16_sse2(const char *p, uint32_t *bad) {
+    __m128i c = _mm_loadu_si128((const __m128i *)p);
+    __m128i u = _mm_or_si128(c, _mm_set1_epi8(0x20));
+    __m128i ok = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(u, _mm_set1_epi8('a')), _mm_cmpeq_epi8(u, _mm_set1_epi8('c'))),
+        _mm_or_si128(_mm_cmpeq_epi8(u, _mm_set1_epi8('g')), _mm_cmpeq_epi8(u, _mm_set1_epi8('t'))));
+    __m128i x = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(c, 1), _mm_set1_epi8(3)),
+                              _mm_and_si128(_mm_srli_epi16(c, 2), _mm_set1_epi8(1)));
+    x = _mm_and_si128(x, ok);
+    x = _mm_and_si128(_mm_or_si128(x, _mm_srli_epi16(x, 6)), _mm_set1_epi16(0x0f));
+    x = _mm_and_si128(_mm_or_si128(x, _mm_srli_epi32(x, 12)), _mm_set1_epi32(0xff));
+    x = _mm_packs_epi32(x, x);
+    x = _mm_packus_epi16(x, x);
+    *bad = ~(uint32_t)_mm_movemask_epi8(ok) & 0xffff;
+    return (uint32_t)_mm_cvtsi128_si32(x);
+}
+#endif
+
+#ifdef KMER_SIMD_X86
+__attribute__((target("avx2")))
+static uint64_t pack32_avx2(const char *p, uint64_t *bad) {
+    __m256i c = _mm256_loadu_si256((const __m256i *)p);
+    __m256i u = _mm256_or_si256(c, _mm256_set1_epi8(0x20));
+    __m256i ok = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(u, _mm256_set1_epi8('a')),
+                        _mm256_cmpeq_epi8(u, _mm256_set1_epi8('c'))),
+        _mm256_or_si256(_mm256_cmpeq_epi8(u, _mm256_set1_epi8('g')),
+                        _mm256_cmpeq_epi8(u, _mm256_set1_epi8('t'))));
+    __m256i x = _mm256_xor_si256(_mm256_and_si256(_mm256_srli_epi16(c, 1), _mm256_set1_epi8(3)),
+                                 _mm256_and_si256(_mm256_srli_epi16(c, 2), _mm256_set1_epi8(1)));
+    x = _mm256_and_si256(x, ok);
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi16(x, 6)), _mm256_set1_epi16(0x0f));
+    x = _mm256_and_si256(_mm256_or_si256(x, _mm256_srli_epi32(x, 12)), _mm256_set1_epi32(0xff));
+    x = _mm256_packs_epi32(x, x);       /* per 128-bit lane */
+    x = _mm256_packus_epi16(x, x);
+    uint64_t lo = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(x));
+    uint64_t hi = (uint32_t)_mm_cvtsi128_si32(_mm256_extracti128_si256(x, 1));
+    *bad = ~(uint64_t)(uint32_t)_mm256_movemask_epi8(ok) & 0xffffffffULL;
+    return lo | hi << 32;
+}
+#endif
+
+#ifdef KMER_SIMD_NEON
+static inline uint32_t pack16_neon(const char *p, uint32_t *bad) {
+    static const uint8_t bit[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t c = vld1q_u8((const uint8_t *)p);
+    uint8x16_t u = vorrq_u8(c, vdupq_n_u8(0x20));
+    uint8x16_t ok = vorrq_u8(vorrq_u8(vceqq_u8(u, vdupq_n_u8('a')), vceqq_u8(u, vdupq_n_u8('c'))),
+                             vorrq_u8(vceqq_u8(u, vdupq_n_u8('g')), vceqq_u8(u, vdupq_n_u8('t'))));
+    uint8x16_t x = veorq_u8(vandq_u8(vshrq_n_u8(c, 1), vdupq_n_u8(3)),
+                            vandq_u8(vshrq_n_u8(c, 2), vdupq_n_u8(1)));
+    uint16x8_t x16 = vreinterpretq_u16_u8(vandq_u8(x, ok));
+    x16 = vandq_u16(vorrq_u16(x16, vshrq_n_u16(x16, 6)), vdupq_n_u16(0x0f));
+    uint32x4_t x32 = vreinterpretq_u32_u16(x16);
+    x32 = vandq_u32(vorrq_u32(x32, vshrq_n_u32(x32, 12)), vdupq_n_u32(0xff));
+    uint16x4_t n16 = vmovn_u32(x32);
+    uint8x8_t n8 = vmovn_u16(vcombine_u16(n16, n16));
+    uint32_t m = 0;
+    if (vminvq_u8(ok) != 0xff) {
+        uint8x16_t bits = vandq_u8(ok, vld1q_u8(bit));
+        m = (uint32_t)vaddv_u8(vget_low_u8(bits)) | (uint32_t)vaddv_u8(vget_high_u8(bits)) << 8;
+        m = ~m & 0xffff;
+    }
+    *bad = m;
+    return vget_lane_u32(vreinterpret_u32_u8(n8), 0);
+}
+#endif
+
+/* 32 bases at p into one packed word and 32 N-mask bits */
+static inline uint64_t pack32(const char *p, uint64_t *bad, int use_avx2) {
+#if defined(KMER_SIMD_X86)
+    if (use_avx2) return pack32_avx2(p, bad);
+#if defined(__SSE2__)
+    uint32_t b0, b1;
+    uint64_t lo = pack16_sse2(p, &b0), hi = pack16_sse2(p + 16, &b1);
+    *bad = (uint64_t)b0 | (uint64_t)b1 << 16;
+    return lo | hi << 32;
+#endif
+#elif defined(KMER_SIMD_NEON)
+    (void)use_avx2;
+    uint32_t b0, b1;
+    uint64_t lo = pack16_neon(p, &b0), hi = pack16_neon(p + 16, &b1);
+    *bad = (uint64_t)b0 | (uint64_t)b1 << 16;
+    return lo | hi << 32;
+#endif
+    (void)use_avx2;
+    return pack_scalar(p, 32, bad);
+}
+
+void hs_pack_bases(const char *seq, int len, uint64_t *packed, uint64_t *nmask) {
+    int use_avx2 = 0;
+#ifdef KMER_SIMD_X86
+    use_avx2 = __builtin_cpu_supports("avx2");
+#endif
+    int nw = HS_PACKED_WORDS(len);
+    if (len > 0) memset(nmask, 0, (size_t)HS_NMASK_WORDS(len) * sizeof(uint64_t));
+    for (int w = 0; w < nw; w++) {
+        int i = w * 32, n = len - i < 32 ? len - i : 32;
+        uint64_t bad;
+        packed[w] = n == 32 ? pack32(seq + i, &bad, use_avx2) : pack_scalar(seq + i, n, &bad);
+        nmask[w >> 1] |= bad << (32 * (w & 1));
+    }
+}
+
+/* --- Sequence kernels ---
+ * The loops that hash a whole (packed) sequence are written once as
+ * always-inline bodies taking k (and s) and stamped out by the *_INIT
+ * macros below for the k values the index uses, so masks, shifts and
+ * window bounds become constants; any other k runs the body with runtime
+ * values.  Each call dispatches once on k.  Bases come a word at a time
+ * from the packed form, so no per-base table lookup is left. */
+#define HS_INLINE static inline __attribute__((always_inline))
+
+/* Bases off .. off + len - 1 of a packed sequence are walked a word at a
+ * time: w holds the word's remaining codes and m its N-mask bits, both
+ * shifted down one base per step.  A word without N inside a run already
+ * k long skips the N and fill tests. */
+HS_INLINE int hash_seq_body(const uint64_t *packed, const uint64_t *nmask, int off,
+                            int len, int k, uint64_t *out) {
+    int shift = 2 * (k - 1);
+    uint64_t mask = k >= 32 ? UINT64_MAX : ((uint64_t)1 << (2 * k)) - 1;
+    uint64_t fwd = 0, rev = 0;
+    int filled = 0, n = 0;
+    for (int i = off, end = off + len; i < end; ) {
+        int stop = ((i >> 5) + 1) << 5 < end ? ((i >> 5) + 1) << 5 : end;
+        uint64_t w = packed[i >> 5] >> (2 * (i & 31));
+        uint64_t m = nmask[i >> 6] >> (i & 63);
+        if (!(m & (((uint64_t)1 << (stop - i)) - 1)) && filled >= k) {
+            for (; i < stop; i++, w >>= 2) {
+                uint64_t b = w & 3;
+                fwd = ((fwd << 2) | b) & mask;
+                rev = (rev >> 2) | ((3 - b) << shift);
+                uint64_t hf = hs_hash64(fwd), hr = hs_hash64(rev);
+                out[n++] = hf < hr ? hf : hr;
+            }
+            continue;
+        }
+        for (; i < stop; i++, w >>= 2, m >>= 1) {
+            if (m & 1) { filled = 0; fwd = rev = 0; continue; }
+            uint64_t b = w & 3;
+            fwd = ((fwd << 2) | b) & mask;
+            rev = (rev >> 2) | ((3 - b) << shift);
+            if (++filled < k) continue;
+            uint64_t hf = hs_hash64(fwd), hr = hs_hash64(rev);
+            out[n++] = hf < hr ? hf : hr;
+        }
+    }
+    return n;
+}
+
+/* Open syncmers: the rolling s-mer and k-mer encodings are kept in step,
+ * the last k - s + 1 s-mer orders sit in a ring, and the window minimum
+ * is carried along, rescanning the ring only when the minimum slides out
+ * (about once per window).  Only the selected k-mers are hashed.  Words
+ * are walked as in hash_seq_body. */
+/* Enters the order o of the s-mer starting at p; s-mers start validly
+ * from valid_from on, and first marks the first of a run */
+HS_INLINE void syncmer_step(uint64_t *ring, uint64_t *min, int *min_pos, int p, int w,
+                            uint64_t o, int first, int valid_from) {
+    ring[p & 31] = o;
+    int start = p - w + 1;
+    if (first || o <= *min) {
+        *min = o;
+        *min_pos = p;
+    } else if (*min_pos < start) {
+        *min = UINT64_MAX;
+        for (int q = p; q >= start && q >= valid_from; q--)
+            if (ring[q & 31] < *min) { *min = ring[q & 31]; *min_pos = q; }
+    }
+}
+
+HS_INLINE int syncmer_body(const uint64_t *packed, const uint64_t *nmask, int off,
+                           int len, int k, int s, uint64_t *out) {
+    int w = k - s + 1, t0 = (k - s) / 2, t1 = k - s - t0;
+    int sshift = 2 * (s - 1), kshift = 2 * (k - 1);
+    uint64_t smask = s >= 32 ? UINT64_MAX : ((uint64_t)1 << (2 * s)) - 1;
+    uint64_t kmask = k >= 32 ? UINT64_MAX : ((uint64_t)1 << (2 * k)) - 1;
+    uint64_t sf = 0, sr = 0, kf = 0, kr = 0;
+    uint64_t ring[32];          /* s-mer order by start position mod 32 */
+    uint64_t min = UINT64_MAX;  /* lowest order in the window */
+    int min_pos = 0;            /* its latest start */
+    int filled = 0, n = 0;
+    for (int i = off, end = off + len; i < end; ) {
+        int stop = ((i >> 5) + 1) << 5 < end ? ((i >> 5) + 1) << 5 : end;
+        uint64_t bits = packed[i >> 5] >> (2 * (i & 31));
+        uint64_t m = nmask[i >> 6] >> (i & 63);
+        if (!(m & (((uint64_t)1 << (stop - i)) - 1)) && filled >= k) {
+            for (; i < stop; i++, bits >>= 2) {
+                uint64_t b = bits & 3;
+                sf = ((sf << 2) | b) & smask;
+                sr = (sr >> 2) | ((3 - b) << sshift);
+                kf = ((kf << 2) | b) & kmask;
+                kr = (kr >> 2) | ((3 - b) << kshift);
+                int p = i - s + 1, start = p - w + 1;
+                syncmer_step(ring, &min, &min_pos, p, w, hs_syncmer_order(sf < sr ? sf : sr),
+                             0, start);
+                if (ring[(start + t0) & 31] == min || ring[(start + t1) & 31] == min) {
+                    uint64_t hf = hs_hash64(kf), hr = hs_hash64(kr);
+                    out[n++] = hf < hr ? hf : hr;
+                }
+            }
+            filled += 32;               /* only its being >= k matters now */
+            continue;
+        }
+        for (; i < stop; i++, bits >>= 2, m >>= 1) {
+            if (m & 1) { filled = 0; sf = sr = kf = kr = 0; continue; }
+            uint64_t b = bits & 3;
+            sf = ((sf << 2) | b) & smask;
+            sr = (sr >> 2) | ((3 - b) << sshift);
+            kf = ((kf << 2) | b) & kmask;
+            kr = (kr >> 2) | ((3 - b) << kshift);
+            if (++filled < s) continue;
+            int p = i - s + 1, start = p - w + 1;
+            syncmer_step(ring, &min, &min_pos, p, w, hs_syncmer_order(sf < sr ? sf : sr),
+                         filled == s, i - filled + 1);
+            if (filled < k) continue;
+            if (ring[(start + t0) & 31] == min || ring[(start + t1) & 31] == min) {
+                uint64_t hf = hs_hash64(kf), hr = hs_hash64(kr);
+                out[n++] = hf < hr ? hf : hr;
+            }
+        }
+    }
+    return n;
+}
+
+#define KMER_HASH_INIT(k_) \
+    static int hash_seq_##k_(const uint64_t *packed, const uint64_t *nmask, int off, \
+                             int len, uint64_t *out) { \
+        return hash_seq_body(packed, nmask, off, len, k_, out); \
+    }
+#define KMER_SYNCMER_INIT(k_, s_) \
+    static int syncmers_##k_##_##s_(const uint64_t *packed, const uint64_t *nmask, int off, \
+                                    int len, uint64_t *out) { \
+        return syncmer_body(packed, nmask, off, len, k_, s_, out); \
+    }
+
+KMER_HASH_INIT(15)     /* shortest fallback k for short references */
+KMER_HASH_INIT(21)     /* coarse and fine k */
+KMER_SYNCMER_INIT(21, 11)
+
+int hs_kmer_hash_packed(const uint64_t *packed, const uint64_t *nmask, int off, int len,
+                        int k, uint64_t *out) {
+    if (k < 1 || k > 32 || len < k) return 0;
+    switch (k) {
+        case 15: return hash_seq_15(packed, nmask, off, len, out);
+        case 21: return hash_seq_21(packed, nmask, off, len, out);
+        default: return hash_seq_body(packed, nmask, off, len, k, out);
+    }
+}
+
+int hs_syncmer_hashes_packed(const uint64_t *packed, const uint64_t *nmask, int off,
+                             int len, int k, int s, uint64_t *out) {
+    if (s < 1 || s > k || k > 32 || len < k) return 0;
+    if (k == 21 && s == 11) return syncmers_21_11(packed, nmask, off, len, out);
+    return syncmer_body(packed, nmask, off, len, k, s, out);
+}
+
+/* ASCII entry points pack into a scratch buffer first (on the stack for
+ * read-sized input) */
+#define PACK_STACK_BASES 4096
+
+int hs_kmer_hash_seq(const char *seq, int len, int k, uint64_t *out) {
+    if (k < 1 || k > 32 || len < k) return 0;
+    uint64_t stack[HS_PACKED_WORDS(PACK_STACK_BASES) + HS_NMASK_WORDS(PACK_STACK_BASES)];
+    uint64_t *buf = len <= PACK_STACK_BASES ? stack : (uint64_t *)hs_malloc(
+        (size_t)(HS_PACKED_WORDS(len) + HS_NMASK_WORDS(len)) * sizeof(uint64_t));
+    hs_pack_bases(seq, len, buf, buf + HS_PACKED_WORDS(len));
+    int n = hs_kmer_hash_packed(buf, buf + HS_PACKED_WORDS(len), 0, len, k, out);
+    if (buf != stack) free(buf);
+    return n;
+}
+
+int hs_syncmer_hashes(const char *seq, int len, int k, int s, uint64_t *out) {
+    if (s < 1 || s > k || k > 32 || len < k) return 0;
+    uint64_t stack[HS_PACKED_WORDS(PACK_STACK_BASES) + HS_NMASK_WORDS(PACK_STACK_BASES)];
+    uint64_t *buf = len <= PACK_STACK_BASES ? stack : (uint64_t *)hs_malloc(
+        (size_t)(HS_PACKED_WORDS(len) + HS_NMASK_WORDS(len)) * sizeof(uint64_t));
+    hs_pack_bases(seq, len, buf, buf + HS_PACKED_WORDS(len));
+    int n = hs_syncmer_hashes_packed(buf, buf + HS_PACKED_WORDS(len), 0, len, k, s, out);
+    if (buf != stack) free(buf);
+    return n;
+}
+
 /* --- FracMinHash sketch --- */
 
 fmh_sketch_t *fmh_init(int k, double scale) {
     fmh_sketch_t *sk = (fmh_sketch_t *)hs_calloc(1, sizeof(fmh_sketch_t));
     sk->k = k;
     sk->scale = scale;
-    sk->threshold = (uint64_t)(scale * (double)UINT64_MAX);
+    /* (double)UINT64_MAX rounds up to 2^64, which does not convert back */
+    sk->threshold = scale >= 1.0 ? UINT64_MAX : (uint64_t)(scale * (double)UINT64_MAX);
     sk->cap = 256;
     sk->hashes = (uint64_t *)hs_malloc(sk->cap * sizeof(uint64_t));
     sk->n = 0;
     return sk;
 }
 
+fmh_sketch_t *fmh_view(int k, double scale, const uint64_t *hashes, int n) {
+    fmh_sketch_t *sk = (fmh_sketch_t *)hs_calloc(1, sizeof(fmh_sketch_t));
+    sk->k = k;
+    sk->scale = scale;
+    sk->threshold = scale >= 1.0 ? UINT64_MAX : (uint64_t)(scale * (double)UINT64_MAX);
+    sk->hashes = (uint64_t *)hashes;
+    sk->n = sk->cap = n;
+    sk->borrowed = 1;
+    return sk;
+}
+
 void fmh_destroy(fmh_sketch_t *sk) {
-    if (sk) { free(sk->hashes); free(sk); }
+    if (sk) { if (!sk->borrowed) free(sk->hashes); free(sk); }
 }
 
 void fmh_add_hash(fmh_sketch_t *sk, uint64_t h) {
@@ -93,39 +434,80 @@ void fmh_add_hash(fmh_sketch_t *sk, uint64_t h) {
 }
 
 void fmh_add_seq(fmh_sketch_t *sk, const char *seq, int len) {
-    if (len < sk->k) return;
-    for (int i = 0; i <= len - sk->k; i++) {
-        uint64_t h = hs_kmer_canonical(seq + i, sk->k);
-        if (h != UINT64_MAX) fmh_add_hash(sk, h);
+    hs_kmer_iter_t it;
+    uint64_t h;
+    hs_kmer_iter_init(&it, seq, len, sk->k);
+    while (hs_kmer_iter_next(&it, &h, NULL))
+        fmh_add_hash(sk, h);
+}
+
+/* --- Hash sorting ---
+ * A read contributes few sketch hashes, so small arrays are insertion
+ * sorted; larger ones go through an LSD radix sort that skips the byte
+ * positions every key shares (the high bytes, below a FracMinHash
+ * threshold).  Both leave the array sorted and deduplicated. */
+#define SORT_INSERTION_MAX 48
+
+static void insertion_sort_u64(uint64_t *v, int n) {
+    for (int i = 1; i < n; i++) {
+        uint64_t x = v[i];
+        int j = i - 1;
+        while (j >= 0 && v[j] > x) { v[j + 1] = v[j]; j--; }
+        v[j + 1] = x;
     }
 }
 
-static int cmp_u64(const void *a, const void *b) {
-    uint64_t va = *(const uint64_t *)a, vb = *(const uint64_t *)b;
-    return (va > vb) - (va < vb);
+/* tmp must hold n values */
+static void radix_sort_u64(uint64_t *v, int n, uint64_t *tmp) {
+    int hist[8][256];
+    memset(hist, 0, sizeof(hist));
+    for (int i = 0; i < n; i++)
+        for (int b = 0; b < 8; b++) hist[b][(v[i] >> (8 * b)) & 0xff]++;
+    uint64_t *src = v, *dst = tmp;
+    for (int b = 0; b < 8; b++) {
+        int *h = hist[b];
+        if (h[(v[0] >> (8 * b)) & 0xff] == n) continue; /* all keys share this byte */
+        int sum = 0;
+        for (int d = 0; d < 256; d++) { int c = h[d]; h[d] = sum; sum += c; }
+        for (int i = 0; i < n; i++) dst[h[(src[i] >> (8 * b)) & 0xff]++] = src[i];
+        uint64_t *t = src; src = dst; dst = t;
+    }
+    if (src != v) memcpy(v, src, (size_t)n * sizeof(uint64_t));
 }
 
-void fmh_sort(fmh_sketch_t *sk) {
-    qsort(sk->hashes, (size_t)sk->n, sizeof(uint64_t), cmp_u64);
-    /* deduplicate */
-    if (sk->n <= 1) return;
+static int unique_u64(uint64_t *v, int n) {
+    if (n <= 1) return n;
     int w = 1;
-    for (int r = 1; r < sk->n; r++) {
-        if (sk->hashes[r] != sk->hashes[r - 1])
-            sk->hashes[w++] = sk->hashes[r];
+    for (int r = 1; r < n; r++)
+        if (v[r] != v[w - 1]) v[w++] = v[r];
+    return w;
+}
+
+/* Sort and deduplicate v[n]; the tmp buffer is grown on demand for the
+ * radix path.  Returns the unique count. */
+static int sort_unique_u64(uint64_t *v, int n, uint64_t **tmp, int *tmp_cap) {
+    if (n <= SORT_INSERTION_MAX) {
+        insertion_sort_u64(v, n);
+    } else {
+        if (n > *tmp_cap) {
+            *tmp_cap = n;
+            *tmp = (uint64_t *)hs_realloc(*tmp, (size_t)n * sizeof(uint64_t));
+        }
+        radix_sort_u64(v, n, *tmp);
     }
-    sk->n = w;
+    return unique_u64(v, n);
+}
+
+void fmh_sort(fmh_sketch_t *sk) {
+    uint64_t *tmp = NULL;
+    int tmp_cap = 0;
+    sk->n = sort_unique_u64(sk->hashes, sk->n, &tmp, &tmp_cap);
+    free(tmp);
 }
 
 double fmh_containment(const fmh_sketch_t *query, const fmh_sketch_t *ref) {
     if (query->n == 0) return 0.0;
-    int shared = 0;
-    int i = 0, j = 0;
-    while (i < query->n && j < ref->n) {
-        if (query->hashes[i] == ref->hashes[j]) { shared++; i++; j++; }
-        else if (query->hashes[i] < ref->hashes[j]) i++;
-        else j++;
-    }
+    int shared = kmer_sorted_intersect(query->hashes, query->n, ref->hashes, ref->n, NULL);
     return (double)shared / (double)query->n;
 }
 
@@ -134,43 +516,722 @@ void fmh_merge(fmh_sketch_t *dst, const fmh_sketch_t *src) {
         fmh_add_hash(dst, src->hashes[i]);
 }
 
+/* --- Sorted intersection ---
+ * The block kernels compare a block of a against a block of b all-pairs,
+ * then step past whichever block ends lower (both on a tie).  Values are
+ * unique, so a b-value matched in one step cannot match again in the next.
+ * They stop when either side has less than a block left and return the
+ * cursors for the scalar tail. */
+
+#ifdef KMER_SIMD_X86
+__attribute__((target("avx2")))
+static int isect_avx2(const uint64_t *a, int na, const uint64_t *b, int nb,
+                      int *ip, int *jp, int *match_b) {
+    int i = *ip, j = *jp, k = 0;
+    while (i + 4 <= na && j + 4 <= nb) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + j));
+        __m256i r1 = _mm256_permute4x64_epi64(va, _MM_SHUFFLE(0, 3, 2, 1));
+        __m256i r2 = _mm256_permute4x64_epi64(va, _MM_SHUFFLE(1, 0, 3, 2));
+        __m256i r3 = _mm256_permute4x64_epi64(va, _MM_SHUFFLE(2, 1, 0, 3));
+        __m256i eq = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi64(vb, va), _mm256_cmpeq_epi64(vb, r1)),
+            _mm256_or_si256(_mm256_cmpeq_epi64(vb, r2), _mm256_cmpeq_epi64(vb, r3)));
+        unsigned mask = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(eq));
+        if (match_b) {
+            for (; mask; mask &= mask - 1) match_b[k++] = j + __builtin_ctz(mask);
+        } else {
+            k += __builtin_popcount(mask);
+        }
+        uint64_t amax = a[i + 3], bmax = b[j + 3];
+        i += amax <= bmax ? 4 : 0;
+        j += bmax <= amax ? 4 : 0;
+    }
+    *ip = i;
+    *jp = j;
+    return k;
+}
+#endif
+
+#ifdef KMER_SIMD_NEON
+static int isect_neon(const uint64_t *a, int na, const uint64_t *b, int nb,
+                      int *ip, int *jp, int *match_b) {
+    int i = *ip, j = *jp, k = 0;
+    while (i + 2 <= na && j + 2 <= nb) {
+        uint64x2_t va = vld1q_u64(a + i);
+        uint64x2_t vb = vld1q_u64(b + j);
+        uint64x2_t eq = vorrq_u64(vceqq_u64(vb, va), vceqq_u64(vb, vextq_u64(va, va, 1)));
+        if (vgetq_lane_u64(eq, 0)) { if (match_b) match_b[k] = j; k++; }
+        if (vgetq_lane_u64(eq, 1)) { if (match_b) match_b[k] = j + 1; k++; }
+        uint64_t amax = a[i + 1], bmax = b[j + 1];
+        i += amax <= bmax ? 2 : 0;
+        j += bmax <= amax ? 2 : 0;
+    }
+    *ip = i;
+    *jp = j;
+    return k;
+}
+#endif
+
+/* Intersect a against b[*jp..], leaving *jp where a later, larger a can
+ * resume.  match_b receives absolute b-indices. */
+static int isect_from(const uint64_t *a, int na, const uint64_t *b, int nb,
+                      int *jp, int *match_b) {
+    int i = 0, j = *jp, k = 0;
+#if defined(KMER_SIMD_X86)
+    if (__builtin_cpu_supports("avx2"))
+        k = isect_avx2(a, na, b, nb, &i, &j, match_b);
+#elif defined(KMER_SIMD_NEON)
+    k = isect_neon(a, na, b, nb, &i, &j, match_b);
+#endif
+    while (i < na && j < nb) {
+        uint64_t x = a[i], y = b[j];
+        if (x == y) {
+            if (match_b) match_b[k] = j;
+            k++;
+        }
+        i += x <= y;
+        j += y <= x;
+    }
+    *jp = j;
+    return k;
+}
+
+int kmer_sorted_intersect(const uint64_t *a, int na, const uint64_t *b, int nb,
+                          int *match_b) {
+    int j = 0;
+    return isect_from(a, na, b, nb, &j, match_b);
+}
+
+/* --- Batched coarse screening --- */
+
+typedef struct { uint64_t h; int ref; } multi_entry_t;
+
+static int cmp_multi_entry(const void *a, const void *b) {
+    const multi_entry_t *x = (const multi_entry_t *)a, *y = (const multi_entry_t *)b;
+    if (x->h != y->h) return (x->h > y->h) - (x->h < y->h);
+    return (x->ref > y->ref) - (x->ref < y->ref);
+}
+
+fmh_multi_t *fmh_multi_build(fmh_sketch_t *const *refs, int n_refs) {
+    fmh_multi_t *mt = (fmh_multi_t *)hs_calloc(1, sizeof(fmh_multi_t));
+    mt->n_refs = n_refs;
+    size_t total = 0;
+    for (int r = 0; r < n_refs; r++) total += (size_t)refs[r]->n;
+    multi_entry_t *all = (multi_entry_t *)hs_malloc((total > 0 ? total : 1) * sizeof(multi_entry_t));
+    size_t n = 0;
+    for (int r = 0; r < n_refs; r++)
+        for (int i = 0; i < refs[r]->n; i++) {
+            all[n].h = refs[r]->hashes[i];
+            all[n].ref = r;
+            n++;
+        }
+    qsort(all, n, sizeof(multi_entry_t), cmp_multi_entry);
+
+    mt->hashes = (uint64_t *)hs_malloc((n > 0 ? n : 1) * sizeof(uint64_t));
+    mt->offsets = (int *)hs_malloc((n + 1) * sizeof(int));
+    mt->refs = (int *)hs_malloc((n > 0 ? n : 1) * sizeof(int));
+    int u = 0;
+    for (size_t e = 0; e < n; e++) {
+        /* Sketches are deduplicated, so (h, ref) pairs are unique */
+        if (e == 0 || all[e].h != all[e - 1].h) {
+            mt->hashes[u] = all[e].h;
+            mt->offsets[u] = (int)e;
+            u++;
+        }
+        mt->refs[e] = all[e].ref;
+    }
+    mt->offsets[u] = (int)n;
+    mt->n = u;
+    free(all);
+    return mt;
+}
+
+void fmh_multi_destroy(fmh_multi_t *mt) {
+    if (!mt) return;
+    free(mt->hashes);
+    free(mt->offsets);
+    free(mt->refs);
+    free(mt);
+}
+
+#define MULTI_BLOCK 256
+
+void fmh_multi_containment(const fmh_multi_t *mt, const fmh_sketch_t *query,
+                           double *scores, int n_scores) {
+    for (int r = 0; r < n_scores; r++) scores[r] = 0.0;
+    if (query->n == 0) return;
+    /* Shared-hash counts accumulate in scores[]; the query is merged in
+     * blocks so the match buffer stays on the stack */
+    int match[MULTI_BLOCK];
+    int j = 0;
+    for (int i0 = 0; i0 < query->n && j < mt->n; i0 += MULTI_BLOCK) {
+        int len = query->n - i0 < MULTI_BLOCK ? query->n - i0 : MULTI_BLOCK;
+        int k = isect_from(query->hashes + i0, len, mt->hashes, mt->n, &j, match);
+        for (int t = 0; t < k; t++) {
+            int u = match[t];
+            for (int e = mt->offsets[u]; e < mt->offsets[u + 1]; e++)
+                if (mt->refs[e] < n_scores) scores[mt->refs[e]] += 1.0;
+        }
+    }
+    for (int r = 0; r < n_scores; r++) scores[r] /= (double)query->n;
+}
+
 /* --- Exact k-mer set --- */
 
 kmer_set_t *kmer_set_init(int k) {
     kmer_set_t *ks = (kmer_set_t *)hs_calloc(1, sizeof(kmer_set_t));
-    ks->h = kh_init(kmer64);
     ks->k = k;
-    ks->n_kmers = 0;
+    return ks;
+}
+
+kmer_set_t *kmer_set_view(int k, const uint64_t *sorted, int n) {
+    kmer_set_t *ks = (kmer_set_t *)hs_calloc(1, sizeof(kmer_set_t));
+    ks->sorted = sorted;
+    ks->k = k;
+    ks->n_kmers = n;
     return ks;
 }
 
 void kmer_set_destroy(kmer_set_t *ks) {
-    if (ks) { kh_destroy(kmer64, ks->h); free(ks); }
+    if (ks) { free(ks->owned); free(ks); }
+}
+
+void kmer_set_sorted_keys(const kmer_set_t *ks, uint64_t *out) {
+    if (ks->n_kmers > 0)
+        memcpy(out, ks->sorted, (size_t)ks->n_kmers * sizeof(uint64_t));
+}
+
+void kmer_set_add_hashes(kmer_set_t *ks, const uint64_t *hashes, int n) {
+    if (n <= 0) return;
+    uint64_t *add = (uint64_t *)hs_malloc((size_t)n * sizeof(uint64_t));
+    memcpy(add, hashes, (size_t)n * sizeof(uint64_t));
+    uint64_t *tmp = NULL;
+    int tmp_cap = 0;
+    n = sort_unique_u64(add, n, &tmp, &tmp_cap);
+    free(tmp);
+    if (ks->n_kmers == 0) {
+        free(ks->owned);
+        ks->owned = (uint64_t *)hs_realloc(add, (size_t)n * sizeof(uint64_t));
+        ks->sorted = ks->owned;
+        ks->n_kmers = n;
+        return;
+    }
+
+    /* Merge with the current keys (views become owned) */
+    const uint64_t *cur = ks->sorted;
+    int nc = ks->n_kmers, i = 0, j = 0, w = 0;
+    uint64_t *out = (uint64_t *)hs_malloc((size_t)(nc + n) * sizeof(uint64_t));
+    while (i < nc && j < n) {
+        if (cur[i] < add[j]) out[w++] = cur[i++];
+        else if (cur[i] > add[j]) out[w++] = add[j++];
+        else { out[w++] = cur[i++]; j++; }
+    }
+    while (i < nc) out[w++] = cur[i++];
+    while (j < n) out[w++] = add[j++];
+    free(add);
+    free(ks->owned);
+    ks->owned = (uint64_t *)hs_realloc(out, (size_t)w * sizeof(uint64_t));
+    ks->sorted = ks->owned;
+    ks->n_kmers = w;
 }
 
 void kmer_set_add_seq(kmer_set_t *ks, const char *seq, int len) {
     if (len < ks->k) return;
-    for (int i = 0; i <= len - ks->k; i++) {
-        uint64_t h = hs_kmer_canonical(seq + i, ks->k);
-        if (h == UINT64_MAX) continue;
-        int ret;
-        kh_put(kmer64, ks->h, h, &ret);
-        if (ret > 0) ks->n_kmers++;
-    }
+    uint64_t *hashes = (uint64_t *)hs_malloc((size_t)(len - ks->k + 1) * sizeof(uint64_t));
+    int n = hs_kmer_hash_seq(seq, len, ks->k, hashes);
+    kmer_set_add_hashes(ks, hashes, n);
+    free(hashes);
+}
+
+void kmer_set_add_syncmers(kmer_set_t *ks, const char *seq, int len, int s) {
+    if (len < ks->k) return;
+    uint64_t *hashes = (uint64_t *)hs_malloc((size_t)(len - ks->k + 1) * sizeof(uint64_t));
+    int n = hs_syncmer_hashes(seq, len, ks->k, s, hashes);
+    kmer_set_add_hashes(ks, hashes, n);
+    free(hashes);
 }
 
 int kmer_set_contains(const kmer_set_t *ks, uint64_t h) {
-    return kh_get(kmer64, ks->h, h) != kh_end(ks->h);
+    const uint64_t *a = ks->sorted;
+    int n = ks->n_kmers;
+    if (n == 0 || h < a[0] || h > a[n - 1]) return 0;
+
+    /* Predicted rank, then gallop outwards until h is bracketed */
+    uint64_t span = a[n - 1] - a[0];
+    int g = span ? (int)((double)(h - a[0]) / (double)span * (double)(n - 1)) : 0;
+    if (g > n - 1) g = n - 1;
+    if (a[g] == h) return 1;
+    int lo, hi, step = 1;               /* h, if present, lies in [lo, hi) */
+    if (a[g] < h) {
+        int p = g + 1;
+        lo = p;
+        while (p < n && a[p] < h) { lo = p + 1; p += step; step <<= 1; }
+        hi = p < n ? p + 1 : n;
+    } else {
+        int p = g - 1;
+        hi = g;
+        while (p >= 0 && a[p] > h) { hi = p; p -= step; step <<= 1; }
+        lo = p > 0 ? p : 0;
+    }
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (a[mid] < h) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < n && a[lo] == h;
 }
 
 double kmer_set_containment(const char *query, int qlen, const kmer_set_t *ref, int k) {
-    if (qlen < k) return 0.0;
+    hs_kmer_iter_t it;
+    uint64_t h;
     int total = 0, found = 0;
-    for (int i = 0; i <= qlen - k; i++) {
-        uint64_t h = hs_kmer_canonical(query + i, k);
-        if (h == UINT64_MAX) continue;
+    hs_kmer_iter_init(&it, query, qlen, k);
+    while (hs_kmer_iter_next(&it, &h, NULL)) {
         total++;
         if (kmer_set_contains(ref, h)) found++;
     }
     return total > 0 ? (double)found / (double)total : 0.0;
 }
+
+double kmer_set_containment_hashes(const uint64_t *hashes, int n, const kmer_set_t *ref) {
+    if (n <= 0) return 0.0;
+    int found = 0;
+    for (int i = 0; i < n; i++)
+        if (kmer_set_contains(ref, hashes[i])) found++;
+    return (double)found / (double)n;
+}
+
+double kmer_set_containment_bounded(const uint64_t *hashes, int n,
+                                    const kmer_set_t *ref, double floor) {
+    if (n <= 0) return 0.0;
+    if (floor <= 0.0) return kmer_set_containment_hashes(hashes, n, ref);
+    /* Smallest match count whose ratio reaches floor, computed in the
+     * same double arithmetic as the final ratio */
+    int need = (int)(floor * (double)n);
+    while (need > 0 && (double)(need - 1) / (double)n >= floor) need--;
+    while (need <= n && (double)need / (double)n < floor) need++;
+    if (need > n) return 0.0;
+
+    int found = 0;
+    for (int i = 0; i < n; i++) {
+        if (kmer_set_contains(ref, hashes[i])) found++;
+        else if (found + (n - 1 - i) < need) break;
+    }
+    return (double)found / (double)n;
+}
+
+/* --- Inverted k-mer posting table --- */
+
+static inline uint64_t posting_bucket(const kmer_posting_t *pt, uint64_t h) {
+    return pt->dir_bits > 0 ? h >> (64 - pt->dir_bits) : 0;
+}
+
+/* Index of h in keys[], or n_keys if absent */
+static uint64_t posting_find(const kmer_posting_t *pt, uint64_t h) {
+    uint64_t b = posting_bucket(pt, h);
+    for (uint64_t i = pt->dir_key[b], end = pt->dir_key[b + 1]; i < end; i++) {
+        if (pt->keys[i] == h) return i;
+        if (pt->keys[i] > h) break;
+    }
+    return pt->n_keys;
+}
+
+kmer_posting_t *kmer_posting_build(kmer_set_t *const *const *sets,
+                                   int n_markers, int n_species, int k) {
+    uint64_t total = 0;
+    for (int m = 0; m < n_markers; m++)
+        for (int s = 0; s < n_species; s++)
+            if (sets[m][s] && sets[m][s]->k == k) total += (uint64_t)sets[m][s]->n_kmers;
+    if (total > INT32_MAX || (uint64_t)n_markers * (uint64_t)n_species > UINT32_MAX) {
+        HS_LOG_WARN("Too many fine k-mers to post (%llu); fine sets will be scored directly",
+                    (unsigned long long)total);
+        return NULL;
+    }
+
+    kmer_posting_t *pt = (kmer_posting_t *)hs_calloc(1, sizeof(kmer_posting_t));
+    pt->n_markers = n_markers;
+    pt->n_species = n_species;
+    pt->k = k;
+
+    /* Distinct keys, ascending */
+    pt->keys = (uint64_t *)hs_malloc((size_t)(total > 0 ? total : 1) * sizeof(uint64_t));
+    uint64_t n = 0;
+    for (int m = 0; m < n_markers; m++) {
+        for (int s = 0; s < n_species; s++) {
+            const kmer_set_t *ks = sets[m][s];
+            if (!ks || ks->k != k) continue;
+            kmer_set_sorted_keys(ks, pt->keys + n);
+            n += (uint64_t)ks->n_kmers;
+        }
+    }
+    uint64_t *tmp = NULL;
+    int tmp_cap = 0;
+    pt->n_keys = (uint64_t)sort_unique_u64(pt->keys, (int)n, &tmp, &tmp_cap);
+    free(tmp);
+    pt->keys = (uint64_t *)hs_realloc(pt->keys, (size_t)(pt->n_keys > 0 ? pt->n_keys : 1) *
+                                                sizeof(uint64_t));
+
+    /* Directory: four to eight keys per bucket */
+    while (pt->dir_bits < 62 && (pt->n_keys >> (pt->dir_bits + 3)) > 0) pt->dir_bits++;
+    uint64_t nb = 1ULL << pt->dir_bits;
+    pt->dir_key = (uint64_t *)hs_malloc((size_t)(nb + 1) * sizeof(uint64_t));
+    pt->dir_pool = (uint64_t *)hs_malloc((size_t)(nb + 1) * sizeof(uint64_t));
+    uint64_t i = 0;
+    for (uint64_t b = 0; b < nb; b++) {
+        pt->dir_key[b] = i;
+        while (i < pt->n_keys && posting_bucket(pt, pt->keys[i]) == b) i++;
+    }
+    pt->dir_key[nb] = pt->n_keys;
+
+    /* Pass 1: sets per key, then entry offsets */
+    uint64_t *off = (uint64_t *)hs_calloc((size_t)(pt->n_keys + 1), sizeof(uint64_t));
+    for (int m = 0; m < n_markers; m++) {
+        for (int s = 0; s < n_species; s++) {
+            const kmer_set_t *ks = sets[m][s];
+            if (!ks || ks->k != k) continue;
+            for (int j = 0; j < ks->n_kmers; j++) off[posting_find(pt, ks->sorted[j])]++;
+        }
+    }
+    pt->pool_n = pt->n_keys + n;
+    pt->pool = (uint32_t *)hs_malloc((size_t)(pt->pool_n > 0 ? pt->pool_n : 1) * sizeof(uint32_t));
+    uint64_t o = 0;
+    for (i = 0; i < pt->n_keys; i++) {
+        uint64_t c = off[i];
+        pt->pool[o] = (uint32_t)c;
+        off[i] = o + 1;             /* fill cursor */
+        o += 1 + c;
+    }
+    off[pt->n_keys] = o + 1;
+    for (uint64_t b = 0; b <= nb; b++) pt->dir_pool[b] = off[pt->dir_key[b]] - 1;
+
+    /* Pass 2: cells, visited in ascending order */
+    for (int m = 0; m < n_markers; m++) {
+        for (int s = 0; s < n_species; s++) {
+            const kmer_set_t *ks = sets[m][s];
+            if (!ks || ks->k != k) continue;
+            uint32_t cell = (uint32_t)m * (uint32_t)n_species + (uint32_t)s;
+            for (int j = 0; j < ks->n_kmers; j++)
+                pt->pool[off[posting_find(pt, ks->sorted[j])]++] = cell;
+        }
+    }
+    free(off);
+    return pt;
+}
+
+int kmer_posting_valid(const kmer_posting_t *pt) {
+    if (pt->dir_bits < 0 || pt->dir_bits > 62 || pt->n_markers < 0 || pt->n_species < 0)
+        return 0;
+    uint64_t nb = ((uint64_t)1 << pt->dir_bits) + 1;
+    uint64_t n_cells = (uint64_t)pt->n_markers * (uint64_t)pt->n_species;
+    if (pt->dir_key[0] != 0 || pt->dir_key[nb - 1] != pt->n_keys ||
+        pt->dir_pool[0] != 0 || pt->dir_pool[nb - 1] != pt->pool_n)
+        return 0;
+    for (uint64_t b = 0; b + 1 < nb; b++) {
+        uint64_t i = pt->dir_key[b], end = pt->dir_key[b + 1];
+        uint64_t off = pt->dir_pool[b], pool_end = pt->dir_pool[b + 1];
+        if (i > end || off > pool_end) return 0;
+        for (; i < end; i++) {
+            uint64_t key = pt->keys[i];
+            if ((i > 0 && pt->keys[i - 1] >= key) || posting_bucket(pt, key) != b) return 0;
+            /* The entry, count word included, stays in the bucket's run */
+            if (off >= pool_end || pt->pool[off] > pool_end - off - 1) return 0;
+            const uint32_t *e = pt->pool + off;
+            for (uint32_t j = 1; j <= e[0]; j++)
+                if (e[j] >= n_cells) return 0;
+            off += 1 + (uint64_t)e[0];
+        }
+        if (off != pool_end) return 0;
+    }
+    return 1;
+}
+
+void kmer_posting_destroy(kmer_posting_t *pt) {
+    if (!pt) return;
+    if (!pt->borrowed) {
+        free(pt->keys);
+        free(pt->dir_key);
+        free(pt->dir_pool);
+        free(pt->pool);
+    }
+    free(pt);
+}
+
+const uint32_t *kmer_posting_get(const kmer_posting_t *pt, uint64_t h) {
+    uint64_t b = posting_bucket(pt, h);
+    uint64_t off = pt->dir_pool[b];
+    for (uint64_t i = pt->dir_key[b], end = pt->dir_key[b + 1]; i < end; i++) {
+        uint64_t key = pt->keys[i];
+        if (key == h) return pt->pool + off;
+        if (key > h) break;
+        off += 1 + (uint64_t)pt->pool[off];
+    }
+    return NULL;
+}
+
+void kmer_posting_count(const kmer_posting_t *pt, const uint64_t *hashes, int n,
+                        int *counts) {
+    for (int i = 0; i < n; i++) {
+        const uint32_t *e = kmer_posting_get(pt, hashes[i]);
+        if (!e) continue;
+        for (uint32_t j = 1; j <= e[0]; j++) counts[e[j]]++;
+    }
+}
+
+/* Batched probes: a lookup touches the bucket's directory entries, then
+ * its keys and pool entries, each likely a cache miss on a large table.
+ * The hashes of all reads are walked as one stream by three cursors: the
+ * far one prefetches directory entries POSTING_AHEAD hashes ahead, the
+ * near one, half as far, reads them (by then cached) and prefetches the
+ * keys and pool they point at, and the last resolves the lookup, so up
+ * to POSTING_AHEAD misses are in flight instead of one.  A table under
+ * POSTING_PREFETCH_BYTES stays cached, and the prefetches only cost. */
+#define POSTING_AHEAD 16
+#define POSTING_PREFETCH_BYTES ((uint64_t)4 << 20)
+
+typedef struct {
+    int r, i;              /* read, hash within it */
+} posting_cursor_t;
+
+/* Next hash of the stream into *h; 0 past the last read */
+static inline int posting_next(posting_cursor_t *c, const uint64_t *const *hashes,
+                               const int *n, int n_reads, uint64_t *h) {
+    while (c->r < n_reads && c->i >= n[c->r]) { c->r++; c->i = 0; }
+    if (c->r >= n_reads) return 0;
+    *h = hashes[c->r][c->i++];
+    return 1;
+}
+
+HS_INLINE void posting_prefetch_dir(const kmer_posting_t *pt, uint64_t h) {
+    uint64_t b = posting_bucket(pt, h);
+    __builtin_prefetch(pt->dir_key + b);
+    __builtin_prefetch(pt->dir_pool + b);
+}
+
+HS_INLINE void posting_prefetch_bucket(const kmer_posting_t *pt, uint64_t h) {
+    uint64_t b = posting_bucket(pt, h);
+    __builtin_prefetch(pt->keys + pt->dir_key[b]);
+    __builtin_prefetch(pt->pool + pt->dir_pool[b]);
+}
+
+void kmer_posting_count_batch(const kmer_posting_t *pt, const uint64_t *const *hashes,
+                              const int *n, int n_reads, int *const *counts) {
+    uint64_t bytes = pt->n_keys * sizeof(uint64_t) + pt->pool_n * sizeof(uint32_t) +
+                     (((uint64_t)1 << pt->dir_bits) + 1) * 2 * sizeof(uint64_t);
+    if (bytes < POSTING_PREFETCH_BYTES) {
+        for (int r = 0; r < n_reads; r++) kmer_posting_count(pt, hashes[r], n[r], counts[r]);
+        return;
+    }
+    posting_cursor_t far = { 0, 0 }, near = { 0, 0 }, cur = { 0, 0 };
+    uint64_t h, x;
+    for (int d = 0; d < POSTING_AHEAD; d++) {
+        if (posting_next(&far, hashes, n, n_reads, &x)) posting_prefetch_dir(pt, x);
+        if (d >= POSTING_AHEAD / 2 && posting_next(&near, hashes, n, n_reads, &x))
+            posting_prefetch_bucket(pt, x);
+    }
+    while (posting_next(&cur, hashes, n, n_reads, &h)) {
+        if (posting_next(&far, hashes, n, n_reads, &x)) posting_prefetch_dir(pt, x);
+        if (posting_next(&near, hashes, n, n_reads, &x)) posting_prefetch_bucket(pt, x);
+        const uint32_t *e = kmer_posting_get(pt, h);
+        if (!e) continue;
+        int *c = counts[cur.r];
+        for (uint32_t j = 1; j <= e[0]; j++) c[e[j]]++;
+    }
+}
+
+/* --- Blocked Bloom filter --- */
+
+static inline const uint64_t *bloom_block(const kmer_bloom_t *bf, uint64_t h) {
+    uint64_t b = bf->block_bits > 0 ? h >> (64 - bf->block_bits) : 0;
+    return bf->words + 8 * b;
+}
+
+kmer_bloom_t *kmer_bloom_build(kmer_set_t *const *const *sets,
+                               int n_markers, int n_species, int k) {
+    uint64_t total = 0;
+    for (int m = 0; m < n_markers; m++)
+        for (int s = 0; s < n_species; s++)
+            if (sets[m][s] && sets[m][s]->k == k) total += (uint64_t)sets[m][s]->n_kmers;
+
+    kmer_bloom_t *bf = (kmer_bloom_t *)hs_calloc(1, sizeof(kmer_bloom_t));
+    bf->k = k;
+    /* Shared k-mers are counted once per set, which only errs large */
+    while (bf->block_bits < 40 &&
+           (512ULL << bf->block_bits) < total * KMER_BLOOM_BITS_PER_KEY)
+        bf->block_bits++;
+    bf->words = (uint64_t *)hs_calloc((size_t)8 << bf->block_bits, sizeof(uint64_t));
+
+    for (int m = 0; m < n_markers; m++) {
+        for (int s = 0; s < n_species; s++) {
+            const kmer_set_t *ks = sets[m][s];
+            if (!ks || ks->k != k) continue;
+            for (int i = 0; i < ks->n_kmers; i++) {
+                uint64_t h = ks->sorted[i];
+                uint64_t *w = (uint64_t *)bloom_block(bf, h);
+                uint64_t g = hs_hash64(h);
+                for (int p = 0; p < KMER_BLOOM_PROBES; p++, g >>= 9)
+                    w[(g >> 6) & 7] |= 1ULL << (g & 63);
+            }
+        }
+    }
+    return bf;
+}
+
+kmer_bloom_t *kmer_bloom_view(int k, int block_bits, const uint64_t *words) {
+    kmer_bloom_t *bf = (kmer_bloom_t *)hs_calloc(1, sizeof(kmer_bloom_t));
+    bf->words = (uint64_t *)words;
+    bf->block_bits = block_bits;
+    bf->k = k;
+    bf->borrowed = 1;
+    return bf;
+}
+
+void kmer_bloom_destroy(kmer_bloom_t *bf) {
+    if (!bf) return;
+    if (!bf->borrowed) free(bf->words);
+    free(bf);
+}
+
+int kmer_bloom_contains(const kmer_bloom_t *bf, uint64_t h) {
+    const uint64_t *w = bloom_block(bf, h);
+    uint64_t g = hs_hash64(h);
+    for (int p = 0; p < KMER_BLOOM_PROBES; p++, g >>= 9)
+        if (!(w[(g >> 6) & 7] & (1ULL << (g & 63)))) return 0;
+    return 1;
+}
+
+int kmer_bloom_may_reach(const kmer_bloom_t *bf, const uint64_t *hashes, int n,
+                         double floor) {
+    if (floor <= 0.0) return 1;
+    if (n <= 0) return 0;
+    /* Smallest hit count whose ratio reaches floor, as in
+     * kmer_set_containment_bounded */
+    int need = (int)(floor * (double)n);
+    while (need > 0 && (double)(need - 1) / (double)n >= floor) need--;
+    while (need <= n && (double)need / (double)n < floor) need++;
+    if (need > n) return 0;
+
+    int found = 0;
+    for (int i = 0; i < n; i++) {
+        if (kmer_bloom_contains(bf, hashes[i])) {
+            if (++found >= need) return 1;
+        } else if (found + (n - 1 - i) < need) {
+            return 0;
+        }
+    }
+    return 0;
+}
+
+/* --- Per-read query profile --- */
+
+void kmer_profile_init(kmer_profile_t *qp) {
+    memset(qp, 0, sizeof(*qp));
+}
+
+void kmer_profile_free(kmer_profile_t *qp) {
+    for (int i = 0; i < qp->n_slots; i++) free(qp->hashes[i]);
+    free(qp->pack_buf);
+    free(qp->sketch.hashes);
+    free(qp->sort_tmp);
+    memset(qp, 0, sizeof(*qp));
+}
+
+void kmer_profile_set_seq(kmer_profile_t *qp, const char *seq, int len) {
+    kmer_profile_set_packed(qp, seq, len, NULL, NULL, 0);
+}
+
+void kmer_profile_set_packed(kmer_profile_t *qp, const char *seq, int len,
+                             const uint64_t *packed, const uint64_t *nmask, int off) {
+    qp->seq = seq;
+    qp->len = len;
+    qp->packed = packed;
+    qp->nmask = nmask;
+    qp->pack_off = off;
+    for (int i = 0; i < qp->n_slots; i++) qp->n[i] = -1;
+    qp->sketch_valid = 0;
+}
+
+/* The read's packed form, packing it on first use */
+static void profile_pack(kmer_profile_t *qp) {
+    if (qp->packed) return;
+    int need = HS_PACKED_WORDS(qp->len) + HS_NMASK_WORDS(qp->len);
+    if (need > qp->pack_cap) {
+        qp->pack_cap = need;
+        qp->pack_buf = (uint64_t *)hs_realloc(qp->pack_buf, (size_t)need * sizeof(uint64_t));
+    }
+    hs_pack_bases(qp->seq, qp->len, qp->pack_buf, qp->pack_buf + HS_PACKED_WORDS(qp->len));
+    qp->packed = qp->pack_buf;
+    qp->nmask = qp->pack_buf + HS_PACKED_WORDS(qp->len);
+    qp->pack_off = 0;
+}
+
+const fmh_sketch_t *kmer_profile_sketch(kmer_profile_t *qp, int k, double scale) {
+    fmh_sketch_t *sk = &qp->sketch;
+    if (qp->sketch_valid && sk->k == k && sk->scale == scale) return sk;
+    int n;
+    const uint64_t *hashes = kmer_profile_hashes(qp, k, &n);
+    sk->k = k;
+    sk->scale = scale;
+    sk->threshold = scale >= 1.0 ? UINT64_MAX : (uint64_t)(scale * (double)UINT64_MAX);
+    if (n > sk->cap) {
+        sk->cap = n;
+        sk->hashes = (uint64_t *)hs_realloc(sk->hashes, (size_t)n * sizeof(uint64_t));
+    }
+    sk->n = 0;
+    for (int i = 0; i < n; i++)
+        if (hashes[i] <= sk->threshold) sk->hashes[sk->n++] = hashes[i];
+    sk->n = sort_unique_u64(sk->hashes, sk->n, &qp->sort_tmp, &qp->sort_cap);
+    qp->sketch_valid = 1;
+    return sk;
+}
+
+/* Slot caching key (k + 64 * s): its buffer holds room for every k-mer of
+ * the current sequence, and n < 0 until it is filled */
+static int profile_slot(kmer_profile_t *qp, int key, int k) {
+    int slot = -1;
+    for (int i = 0; i < qp->n_slots; i++)
+        if (qp->k[i] == key) { slot = i; break; }
+    if (slot < 0) {
+        if (qp->n_slots < KMER_PROFILE_MAX_K) {
+            slot = qp->n_slots++;
+        } else {
+            slot = qp->next_evict;
+            qp->next_evict = (qp->next_evict + 1) % KMER_PROFILE_MAX_K;
+        }
+        qp->k[slot] = key;
+        qp->n[slot] = -1;
+    }
+    if (qp->n[slot] < 0) {
+        int need = qp->len - k + 1;
+        if (need < 0) need = 0;
+        if (need > qp->cap[slot]) {
+            qp->cap[slot] = need;
+            qp->hashes[slot] = (uint64_t *)hs_realloc(qp->hashes[slot],
+                (size_t)need * sizeof(uint64_t));
+        }
+    }
+    return slot;
+}
+
+const uint64_t *kmer_profile_hashes(kmer_profile_t *qp, int k, int *n) {
+    int slot = profile_slot(qp, k, k);
+    if (qp->n[slot] < 0) {
+        profile_pack(qp);
+        qp->n[slot] = hs_kmer_hash_packed(qp->packed, qp->nmask, qp->pack_off, qp->len, k,
+                                          qp->hashes[slot]);
+    }
+    *n = qp->n[slot];
+    return qp->hashes[slot];
+}
+
+const uint64_t *kmer_profile_syncmers(kmer_profile_t *qp, int k, int s, int *n) {
+    if (s <= 0) return kmer_profile_hashes(qp, k, n);
+    int slot = profile_slot(qp, k + 64 * s, k);
+    if (qp->n[slot] < 0) {
+        profile_pack(qp);
+        qp->n[slot] = hs_syncmer_hashes_packed(qp->packed, qp->nmask, qp->pack_off, qp->len,
+                                               k, s, qp->hashes[slot]);
+    }
+    *n = qp->n[slot];
+    return qp->hashes[slot];
+}
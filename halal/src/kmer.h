@@ -2,10 +2,6 @@
 #define HALALSEQ_KMER_H
 
 #include <stdint.h>
-#include "khash.h"
-
-/* --- Hash table type for exact k-mer sets --- */
-KHASH_SET_INIT_INT64(kmer64)
 
 /* --- Core k-mer operations --- */
 /* Encode base to 2-bit: A=0, C=1, G=2, T=3, other=-1 */
@@ -23,6 +19,88 @@ uint64_t hs_kmer_canonical(const char *seq, int k);
 /* Hash a pre-encoded 2-bit k-mer */
 uint64_t hs_hash64(uint64_t key);
 
+/* 2-bit encoding table shared with the inline iterator (-1 = invalid) */
+extern const int8_t hs_base_table[256];
+
+/* --- Rolling canonical k-mer iterator ---
+ * Walks every k-mer of a sequence in O(1) per position by keeping the
+ * forward and reverse-complement encodings in step.  A non-ACGT base
+ * empties the window, so k-mers spanning it are skipped exactly as
+ * hs_kmer_canonical() rejects them.  Supports 1 <= k <= 32. */
+typedef struct {
+    const char *seq;
+    int len;
+    int k;
+    int pos;            /* next base to consume */
+    int filled;         /* valid bases currently in the window */
+    int shift;          /* 2 * (k - 1): insert position for revcomp */
+    uint64_t mask;
+    uint64_t fwd, rev;
+} hs_kmer_iter_t;
+
+void hs_kmer_iter_init(hs_kmer_iter_t *it, const char *seq, int len, int k);
+
+/* Advance to the next valid k-mer.  Stores the canonical hash (and the
+ * k-mer start offset if pos != NULL) and returns 1, or returns 0 at the
+ * end of the sequence. */
+static inline int hs_kmer_iter_next(hs_kmer_iter_t *it, uint64_t *hash, int *pos) {
+    while (it->pos < it->len) {
+        int b = hs_base_table[(unsigned char)it->seq[it->pos++]];
+        if (b < 0) { it->filled = 0; it->fwd = it->rev = 0; continue; }
+        it->fwd = ((it->fwd << 2) | (uint64_t)b) & it->mask;
+        it->rev = (it->rev >> 2) | ((uint64_t)(3 - b) << it->shift);
+        if (++it->filled < it->k) continue;
+        uint64_t hf = hs_hash64(it->fwd), hr = hs_hash64(it->rev);
+        *hash = hf < hr ? hf : hr;
+        if (pos) *pos = it->pos - it->k;
+        return 1;
+    }
+    return 0;
+}
+
+/* --- Packed bases ---
+ * Base i of a sequence in bits 2(i % 32) of packed[i / 32] (A=0, C=1,
+ * G=2, T=3) and bit i % 64 of nmask[i / 64] set for a non-ACGT base,
+ * which packs as 0: a quarter of the ASCII size, and k-mer kernels take
+ * bases a word at a time.  hs_pack_bases converts 16 or 32 ASCII bases
+ * per step (SSE2/AVX2, NEON). */
+#define HS_PACKED_WORDS(len) (((len) + 31) / 32)
+#define HS_NMASK_WORDS(len)  (((len) + 63) / 64)
+
+void hs_pack_bases(const char *seq, int len, uint64_t *packed, uint64_t *nmask);
+
+/* Canonical hashes of every valid k-mer of seq in read order, as the
+ * iterator yields them, written to out[len - k + 1]; returns their
+ * number.  Runs a kernel compiled for the index's k values (15, 21) when
+ * k is one of them. */
+int hs_kmer_hash_seq(const char *seq, int len, int k, uint64_t *out);
+/* Same over bases off .. off + len - 1 of a packed sequence */
+int hs_kmer_hash_packed(const uint64_t *packed, const uint64_t *nmask, int off, int len,
+                        int k, uint64_t *out);
+
+/* --- Open syncmers ---
+ * A k-mer is an open syncmer when the lowest-ordered of its k - s + 1
+ * s-mers (hs_syncmer_order; ties count) is the middle one, at position
+ * (k - s) / 2, or either middle one when k - s is odd.  Whether a k-mer is selected depends on
+ * its bases alone and not on the strand, so a read and a reference
+ * select the same shared k-mers: about 1 in k - s + 1 of them, and more
+ * evenly spaced than a random sample of that density.  An error only
+ * changes the selection of the k-mers that overlap it. */
+#define HS_SYNCMER_S 11
+
+/* Rank of an s-mer given its canonical (smaller of forward and reverse
+ * complement) 2-bit encoding.  Only the order within a window matters,
+ * so one multiply does. */
+static inline uint64_t hs_syncmer_order(uint64_t smer) {
+    return smer * 0x9e3779b97f4a7c15ULL;
+}
+
+/* Canonical hashes of the open (k, s)-syncmers of seq in read order,
+ * written to out[len - k + 1]; returns their number.  1 <= s <= k <= 32. */
+int hs_syncmer_hashes(const char *seq, int len, int k, int s, uint64_t *out);
+int hs_syncmer_hashes_packed(const uint64_t *packed, const uint64_t *nmask, int off,
+                             int len, int k, int s, uint64_t *out);
+
 /* --- FracMinHash sketch (coarse screening, k=21) --- */
 typedef struct {
     uint64_t *hashes;   /* sorted hash array */
@@ -31,9 +109,12 @@ typedef struct {
     double scale;       /* fraction of hash space to keep */
     int k;
     uint64_t threshold; /* = scale * UINT64_MAX */
+    int borrowed;       /* hashes point into external storage (read-only) */
 } fmh_sketch_t;
 
 fmh_sketch_t *fmh_init(int k, double scale);
+/* Read-only sketch over an external sorted, deduplicated hash array */
+fmh_sketch_t *fmh_view(int k, double scale, const uint64_t *hashes, int n);
 void fmh_destroy(fmh_sketch_t *sk);
 void fmh_add_hash(fmh_sketch_t *sk, uint64_t h);
 void fmh_add_seq(fmh_sketch_t *sk, const char *seq, int len);
@@ -41,17 +122,185 @@ void fmh_sort(fmh_sketch_t *sk);
 double fmh_containment(const fmh_sketch_t *query, const fmh_sketch_t *ref);
 void fmh_merge(fmh_sketch_t *dst, const fmh_sketch_t *src);
 
-/* --- Exact k-mer set (fine resolution, k=31) --- */
+/* Number of values shared by two sorted, duplicate-free arrays.  If
+ * match_b is non-NULL the b-index of each shared value is written to it
+ * (at most min(na, nb) entries).  Uses an AVX2 (x86-64, detected at run
+ * time) or NEON (AArch64) block merge with a branchless scalar tail. */
+int kmer_sorted_intersect(const uint64_t *a, int na, const uint64_t *b, int nb,
+                          int *match_b);
+
+/* --- Batched coarse screening ---
+ * The union of several reference sketches as one sorted hash array, each
+ * hash listing the references that hold it, so a query sketch is merged
+ * once against the union instead of once per reference. */
+typedef struct {
+    uint64_t *hashes;   /* [n] sorted, unique */
+    int *offsets;       /* [n + 1] into refs */
+    int *refs;          /* reference ids per hash, ascending */
+    int n;
+    int n_refs;
+} fmh_multi_t;
+
+fmh_multi_t *fmh_multi_build(fmh_sketch_t *const *refs, int n_refs);
+void fmh_multi_destroy(fmh_multi_t *mt);
+/* scores[r] = fmh_containment(query, refs[r]) for r < n_scores */
+void fmh_multi_containment(const fmh_multi_t *mt, const fmh_sketch_t *query,
+                           double *scores, int n_scores);
+
+/* --- Exact k-mer set (fine resolution, k=31) ---
+ * Sorted unique canonical hashes, 8 bytes per k-mer: either owned (built
+ * with kmer_set_add_seq) or a read-only view over external storage, as
+ * mapped from an HIDX index.  Hashes are uniform, so a lookup starts at
+ * the rank a straight line through the end keys predicts and only
+ * searches the few keys around it. */
 typedef struct {
-    khash_t(kmer64) *h;
+    const uint64_t *sorted;  /* [n_kmers] ascending */
+    uint64_t *owned;         /* == sorted when owned, NULL for views */
     int k;
     int n_kmers;
 } kmer_set_t;
 
 kmer_set_t *kmer_set_init(int k);
+kmer_set_t *kmer_set_view(int k, const uint64_t *sorted, int n);
+/* Write the set's keys to out[n_kmers] in ascending order */
+void kmer_set_sorted_keys(const kmer_set_t *ks, uint64_t *out);
 void kmer_set_destroy(kmer_set_t *ks);
 void kmer_set_add_seq(kmer_set_t *ks, const char *seq, int len);
+/* As kmer_set_add_seq, keeping only the open (k, s)-syncmers */
+void kmer_set_add_syncmers(kmer_set_t *ks, const char *seq, int len, int s);
+/* Merge n hashes (any order, duplicates allowed) into the set */
+void kmer_set_add_hashes(kmer_set_t *ks, const uint64_t *hashes, int n);
 int kmer_set_contains(const kmer_set_t *ks, uint64_t h);
 double kmer_set_containment(const char *query, int qlen, const kmer_set_t *ref, int k);
+/* Containment of a pre-hashed query (one canonical hash per valid k-mer) */
+double kmer_set_containment_hashes(const uint64_t *hashes, int n, const kmer_set_t *ref);
+/* Same, but stops once the containment can no longer reach floor: the
+ * result is exact when >= floor and some value below floor otherwise */
+double kmer_set_containment_bounded(const uint64_t *hashes, int n,
+                                    const kmer_set_t *ref, double floor);
+
+/* --- Inverted k-mer posting table (fine level) ---
+ * Every distinct hash of the posted sets in ascending order, each with a
+ * posting entry laid out in the same order in `pool`:
+ *   pool[off]               number c of sets holding the k-mer
+ *   pool[off + 1 .. off+c]  their cells m * n_species + s, ascending
+ * so a single lookup per read k-mer yields every (marker, species) match
+ * at four bytes each.  The top dir_bits bits of a hash pick its bucket
+ * (four to eight keys); dir_key and dir_pool give the bucket's first key
+ * and its pool offset, and a lookup walks the bucket's entries from
+ * there.  Entry offsets are implicit, so past the keys and pool only the
+ * directory costs space. */
+typedef struct {
+    uint64_t *keys;          /* [n_keys] ascending */
+    uint64_t n_keys;
+    uint64_t *dir_key;       /* [(1 << dir_bits) + 1] */
+    uint64_t *dir_pool;      /* [(1 << dir_bits) + 1] */
+    int dir_bits;
+    uint32_t *pool;
+    uint64_t pool_n;
+    int n_markers;
+    int n_species;
+    int k;
+    int borrowed;            /* arrays point into external storage */
+} kmer_posting_t;
+
+/* Build from sets[m][s] (NULL allowed).  Only sets with k-mer size k are
+ * posted; callers score any other sets directly.  NULL (with a warning)
+ * when the sets hold more than INT32_MAX k-mers. */
+kmer_posting_t *kmer_posting_build(kmer_set_t *const *const *sets,
+                                   int n_markers, int n_species, int k);
+void kmer_posting_destroy(kmer_posting_t *pt);
+/* 1 if the table is internally consistent: the directory is monotone and
+ * spans keys and pool, keys ascend within their own buckets, and every
+ * entry stays within its bucket's pool run with cells below n_markers *
+ * n_species.  Lookups and counting rely on all of it, so a table from a
+ * file must pass before use. */
+int kmer_posting_valid(const kmer_posting_t *pt);
+/* Posting entry for h, or NULL if absent */
+const uint32_t *kmer_posting_get(const kmer_posting_t *pt, uint64_t h);
+/* Add one to counts[m * n_species + s] for every read k-mer found in
+ * (marker m, species s).  counts must be zeroed by the caller. */
+void kmer_posting_count(const kmer_posting_t *pt, const uint64_t *hashes, int n,
+                        int *counts);
+/* Same for n_reads reads at once, read r's n[r] hashes into counts[r],
+ * with the lookups of all of them interleaved and prefetched so cache
+ * misses on a large table overlap; short reads gain the most */
+void kmer_posting_count_batch(const kmer_posting_t *pt, const uint64_t *const *hashes,
+                              const int *n, int n_reads, int *const *counts);
+
+/* --- Blocked Bloom filter (read prefilter) ---
+ * Set membership over the fine k-mers in 64-byte blocks: the top bits of
+ * a hash pick the block and KMER_BLOOM_PROBES bits of its remix are set
+ * there, so a lookup touches one cache line.  There are no false
+ * negatives, so a read whose filter hits cannot reach a containment
+ * falls short of it against every filtered set. */
+#define KMER_BLOOM_BITS_PER_KEY 12
+#define KMER_BLOOM_PROBES 6
+
+typedef struct {
+    uint64_t *words;         /* [8 << block_bits] */
+    int block_bits;
+    int k;
+    int borrowed;            /* words point into external storage */
+} kmer_bloom_t;
+
+/* Filter over every sets[m][s] (NULL allowed) with k-mer size k */
+kmer_bloom_t *kmer_bloom_build(kmer_set_t *const *const *sets,
+                               int n_markers, int n_species, int k);
+/* Read-only filter over words saved from a built one */
+kmer_bloom_t *kmer_bloom_view(int k, int block_bits, const uint64_t *words);
+void kmer_bloom_destroy(kmer_bloom_t *bf);
+int kmer_bloom_contains(const kmer_bloom_t *bf, uint64_t h);
+/* 0 if fewer than a fraction floor of the n hashes are present in the
+ * filter (so in any filtered set), 1 otherwise; stops probing as soon as
+ * either is certain */
+int kmer_bloom_may_reach(const kmer_bloom_t *bf, const uint64_t *hashes, int n,
+                         double floor);
+
+/* --- Per-read query profile ---
+ * Caches a read's canonical k-mer hashes for each k the index asks for
+ * (primer, coarse, fine), so each read is hashed once per k rather than
+ * once per marker x species query.  Buffers are kept across
+ * kmer_profile_set_seq() calls, so one profile can serve a whole batch. */
+#define KMER_PROFILE_MAX_K 8
+
+typedef struct {
+    const char *seq;                         /* borrowed */
+    int len;
+    /* Packed form of seq from base pack_off (kmer_profile_set_packed), or
+     * NULL until packed into pack_buf on first use */
+    const uint64_t *packed, *nmask;
+    int pack_off;
+    uint64_t *pack_buf;
+    int pack_cap;                            /* words */
+    int n_slots;
+    int next_evict;                          /* round-robin slot reuse */
+    int k[KMER_PROFILE_MAX_K];               /* k + 64 * syncmer s */
+    uint64_t *hashes[KMER_PROFILE_MAX_K];
+    int n[KMER_PROFILE_MAX_K];               /* -1 = not computed for seq */
+    int cap[KMER_PROFILE_MAX_K];
+    fmh_sketch_t sketch;                     /* see kmer_profile_sketch() */
+    int sketch_valid;
+    uint64_t *sort_tmp;                      /* radix-sort scratch */
+    int sort_cap;
+} kmer_profile_t;
+
+void kmer_profile_init(kmer_profile_t *qp);
+void kmer_profile_free(kmer_profile_t *qp);
+void kmer_profile_set_seq(kmer_profile_t *qp, const char *seq, int len);
+/* Same, borrowing the read's packed form: base 0 of seq is base off of
+ * packed (a trimmed read keeps its parse-time packing) */
+void kmer_profile_set_packed(kmer_profile_t *qp, const char *seq, int len,
+                             const uint64_t *packed, const uint64_t *nmask, int off);
+/* Canonical hashes of every valid k-mer of the current sequence, in read
+ * order (computed on first request for this k) */
+const uint64_t *kmer_profile_hashes(kmer_profile_t *qp, int k, int *n);
+/* Canonical hashes of the open (k, s)-syncmers of the current sequence
+ * (hs_syncmer_hashes), cached like kmer_profile_hashes; s = 0 gives
+ * every k-mer */
+const uint64_t *kmer_profile_syncmers(kmer_profile_t *qp, int k, int s, int *n);
+/* FracMinHash sketch of the current sequence (sorted, deduplicated),
+ * built in the profile's own buffers on first request */
+const fmh_sketch_t *kmer_profile_sketch(kmer_profile_t *qp, int k, double scale);
 
 #endif /* HALALSEQ_KMER_H */
@@ -0,0 +1,111 @@
+#include "parallel.h"
+#include "utils.h"
+
+#if defined(_WIN32) && !defined(__MINGW32__)
+#define HS_NO_PTHREADS 1
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+int hs_n_cpus(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwNumberOfProcessors > 0 ? (int)si.dwNumberOfProcessors : 1;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#endif
+}
+
+int hs_resolve_threads(int n_threads) {
+    return n_threads > 0 ? n_threads : hs_n_cpus();
+}
+
+#ifdef HS_NO_PTHREADS
+
+void hs_parallel_for(int n_items, int chunk, int n_threads,
+                     hs_parallel_fn fn, void *ctx) {
+    (void)chunk; (void)n_threads;
+    if (n_items > 0) fn(ctx, 0, 0, n_items);
+}
+
+#else
+
+typedef struct {
+    pthread_mutex_t lock;
+    int next;
+    int n_items;
+    int chunk;
+    hs_parallel_fn fn;
+    void *ctx;
+} pool_t;
+
+typedef struct {
+    pool_t *pool;
+    int tid;
+} worker_arg_t;
+
+static void run_worker(pool_t *p, int tid) {
+    for (;;) {
+        pthread_mutex_lock(&p->lock);
+        int begin = p->next;
+        if (begin < p->n_items) p->next = begin + p->chunk;
+        pthread_mutex_unlock(&p->lock);
+        if (begin >= p->n_items) break;
+        int end = begin + p->chunk;
+        if (end > p->n_items) end = p->n_items;
+        p->fn(p->ctx, tid, begin, end);
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_arg_t *wa = (worker_arg_t *)arg;
+    run_worker(wa->pool, wa->tid);
+    return NULL;
+}
+
+void hs_parallel_for(int n_items, int chunk, int n_threads,
+                     hs_parallel_fn fn, void *ctx) {
+    if (n_items <= 0) return;
+    if (chunk < 1) chunk = 1;
+    n_threads = hs_resolve_threads(n_threads);
+    int max_useful = (n_items + chunk - 1) / chunk;
+    if (n_threads > max_useful) n_threads = max_useful;
+    if (n_threads <= 1) {
+        fn(ctx, 0, 0, n_items);
+        return;
+    }
+
+    pool_t pool;
+    pthread_mutex_init(&pool.lock, NULL);
+    pool.next = 0;
+    pool.n_items = n_items;
+    pool.chunk = chunk;
+    pool.fn = fn;
+    pool.ctx = ctx;
+
+    pthread_t *threads = (pthread_t *)hs_calloc((size_t)n_threads, sizeof(pthread_t));
+    worker_arg_t *args = (worker_arg_t *)hs_calloc((size_t)n_threads, sizeof(worker_arg_t));
+    int n_started = 1;
+    for (int t = 1; t < n_threads; t++) {
+        args[t].pool = &pool;
+        args[t].tid = t;
+        if (pthread_create(&threads[t], NULL, worker_main, &args[t]) != 0) {
+            HS_LOG_WARN("pthread_create failed; continuing with %d threads", n_started);
+            break;
+        }
+        n_started++;
+    }
+    /* The calling thread works too */
+    run_worker(&pool, 0);
+    for (int t = 1; t < n_started; t++) pthread_join(threads[t], NULL);
+
+    pthread_mutex_destroy(&pool.lock);
+    free(threads);
+    free(args);
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef HALALSEQ_PARALLEL_H
+#define HALALSEQ_PARALLEL_H
+
+/* --- Minimal pthread work-sharing loop ---
+ * Items [0, n_items) are handed out in chunks of `chunk` from a shared
+ * counter, so threads that finish early pick up more work (dynamic
+ * scheduling).  fn() receives the worker id (0 .. n_threads-1, the caller
+ * runs as worker 0) and a half-open item range.  n_threads <= 0 uses all
+ * online CPUs; with a single thread fn() runs inline. */
+typedef void (*hs_parallel_fn)(void *ctx, int tid, int begin, int end);
+
+void hs_parallel_for(int n_items, int chunk, int n_threads,
+                     hs_parallel_fn fn, void *ctx);
+
+/* Number of online CPUs (at least 1) */
+int hs_n_cpus(void);
+
+/* Resolve a user thread count: <= 0 means all CPUs */
+int hs_resolve_threads(int n_threads);
+
+#endif /* HALALSEQ_PARALLEL_H */
@@ -0,0 +1,513 @@
+#include "pipeline.h"
+#include "fastq.h"
+#include "utils.h"
+#include <stdio.h>
+#include <string.h>
+
+int pipeline_classify_file(const halal_index_t *idx, const char *path,
+                           const classify_opts_t *opts, int batch_size,
+                           em_read_t **out_reads, int *out_n,
+                           classify_summary_t *summary,
+                           volatile int *progress) {
+    return pipeline_classify_file_timed(idx, path, opts, batch_size, out_reads, out_n,
+                                        summary, progress, NULL);
+}
+
+int pipeline_classify_file_timed(const halal_index_t *idx, const char *path,
+                                 const classify_opts_t *opts, int batch_size,
+                                 em_read_t **out_reads, int *out_n,
+                                 classify_summary_t *summary,
+                                 volatile int *progress,
+                                 classify_timing_t *timing) {
+    *out_reads = NULL;
+    *out_n = 0;
+    hs_seqfile_t *sf = hs_seqfile_open(path);
+    if (!sf) {
+        classify_summary_init(summary, idx->db->n_species, idx->db->n_markers);
+        return -1;
+    }
+    pipeline_classify_stream(idx, sf, opts, batch_size, out_reads, out_n,
+                             summary, progress, timing);
+    hs_seqfile_close(sf);
+    return 0;
+}
+
+int pipeline_classify_pair(const halal_index_t *idx, const char *path1, const char *path2,
+                           const classify_opts_t *opts, int batch_size,
+                           em_read_t **out_reads, int *out_n,
+                           classify_summary_t *summary,
+                           volatile int *progress) {
+    *out_reads = NULL;
+    *out_n = 0;
+    hs_seqfile_t *sf = hs_seqfile_open_paired(path1, path2);
+    if (!sf) {
+        classify_summary_init(summary, idx->db->n_species, idx->db->n_markers);
+        return -1;
+    }
+    pipeline_classify_stream(idx, sf, opts, batch_size, out_reads, out_n,
+                             summary, progress, NULL);
+    hs_seqfile_close(sf);
+    return 0;
+}
+
+/* Database mito copy numbers, for fits whose config leaves them unset */
+static double *db_mito_copy_numbers(const halal_refdb_t *db) {
+    double *cn = (double *)hs_malloc((size_t)db->n_species * sizeof(double));
+    for (int s = 0; s < db->n_species; s++) cn[s] = db->species[s].mito_copy_number;
+    return cn;
+}
+
+/* --- Online quantification --- */
+
+typedef struct {
+    em_config_t cfg;           /* interim fits */
+    double *mito_cn;           /* owned, when the config had none */
+    em_result_t *prev;         /* last interim fit, warm start for the next */
+    int next_look;             /* total_reads that triggers the next look */
+    int streak;                /* consecutive decisive looks agreeing on ... */
+    verdict_t streak_verdict;  /* ... this verdict */
+} online_state_t;
+
+static void online_init(online_state_t *st, const pipeline_online_t *online,
+                        const halal_refdb_t *db) {
+    memset(st, 0, sizeof(*st));
+    st->cfg = *online->em;
+    if (!st->cfg.mito_copy_numbers)
+        st->cfg.mito_copy_numbers = st->mito_cn = db_mito_copy_numbers(db);
+    st->cfg.use_full_lrt = 0;              /* the verdict does not use p-values */
+    st->next_look = online->check_every;
+}
+
+/* Interim fit on the rows so far; returns 1 once the verdict is settled.
+ * FAIL is decisive when some haram species' widened lower bound clears
+ * the threshold, PASS when every haram species' widened upper bound stays
+ * below it; intervals are stretched from 95% to HS_ONLINE_Z, a constant
+ * (Pocock-style) boundary for repeated looks at accumulating data. */
+static int online_look(online_state_t *st, pipeline_online_t *online,
+                       const halal_index_t *idx, const em_read_t *reads, int n,
+                       const classify_summary_t *summary) {
+    const halal_refdb_t *db = idx->db;
+    st->cfg.warm_start = st->prev;
+    st->cfg.n_restarts = st->prev ? 1 : online->em->n_restarts;
+    em_result_t *em = em_fit(reads, n, db->n_species, db->n_markers, db->amp_lens, &st->cfg);
+    online->n_looks++;
+    if (!em) { st->streak = 0; return 0; }
+
+    halal_report_t *r = report_generate_summary(em, db, summary, online->threshold);
+    verdict_t v = r->verdict;
+    report_destroy(r);
+    double stretch = HS_ONLINE_Z / 1.96;
+    int any_over = 0, all_under = 1;
+    for (int s = 0; s < db->n_species && s < em->n_species; s++) {
+        if (db->species[s].status != HARAM) continue;
+        double w = em->w[s];
+        double lo = w - (w - em->w_ci_lo[s]) * stretch;
+        double hi = w + (em->w_ci_hi[s] - w) * stretch;
+        if (lo > online->threshold) any_over = 1;
+        if (hi >= online->threshold) all_under = 0;
+    }
+    int decisive = (v == FAIL && any_over) || (v == PASS && all_under);
+    if (!decisive) st->streak = 0;
+    else if (st->streak > 0 && v == st->streak_verdict) st->streak++;
+    else { st->streak = 1; st->streak_verdict = v; }
+    online->verdict = v;
+    if (online->on_look) online->on_look(em, summary, online->look_arg);
+    HS_LOG_DEBUG("Online look %d: %d reads, %s%s", online->n_looks, summary->total_reads,
+                 verdict_str(v), decisive ? " (decisive)" : "");
+
+    em_result_destroy(st->prev);
+    st->prev = em;
+    return st->streak >= online->stable_looks && summary->total_reads >= online->min_reads;
+}
+
+static void online_free(online_state_t *st) {
+    em_result_destroy(st->prev);
+    free(st->mito_cn);
+}
+
+pipeline_online_t pipeline_online_default(const em_config_t *em, double threshold) {
+    return (pipeline_online_t){
+        .em = em, .threshold = threshold,
+        .check_every = 2000, .min_reads = 2000, .stable_looks = 3,
+    };
+}
+
+void pipeline_classify_stream(const halal_index_t *idx, hs_seqfile_t *sf,
+                              const classify_opts_t *opts, int batch_size,
+                              em_read_t **out_reads, int *out_n,
+                              classify_summary_t *summary,
+                              volatile int *progress,
+                              classify_timing_t *timing) {
+    pipeline_classify_stream_online(idx, sf, opts, batch_size, NULL, out_reads, out_n,
+                                    summary, progress, timing);
+}
+
+void pipeline_classify_stream_online(const halal_index_t *idx, hs_seqfile_t *sf,
+                                     const classify_opts_t *opts, int batch_size,
+                                     pipeline_online_t *online,
+                                     em_read_t **out_reads, int *out_n,
+                                     classify_summary_t *summary,
+                                     volatile int *progress,
+                                     classify_timing_t *timing) {
+    *out_reads = NULL;
+    *out_n = 0;
+    classify_summary_init(summary, idx->db->n_species, idx->db->n_markers);
+    if (batch_size < 1) batch_size = HS_STREAM_BATCH;
+    online_state_t ost;
+    if (online) {
+        if (online->check_every < 1) online->check_every = 2000;
+        if (online->stable_looks < 1) online->stable_looks = 3;
+        online->n_looks = 0;
+        online->stopped = 0;
+        online->verdict = INCONCLUSIVE;
+        /* Looks happen between batches */
+        if (batch_size > online->check_every) batch_size = online->check_every;
+        online_init(&ost, online, idx->db);
+    }
+
+    hs_seq_batch_t batch;
+    hs_seq_batch_init(&batch);
+    batch.pack = 1;
+    int cap = 0;
+    int *first = NULL, *counts = NULL;
+    const char **useqs = NULL;
+    int *ulens = NULL;
+    const uint64_t **upacked = NULL, **unmasks = NULL;
+    int scratch_cap = 0;
+    int next_collapse = batch_size;
+    hs_seqfile_prefetch(sf, opts->n_threads);
+    double t = timing ? hs_clock_ms() : 0.0;
+    while (!(opts->cancel && *opts->cancel) && hs_seqfile_read_batch(sf, &batch, batch_size) > 0) {
+        if (timing) { double now = hs_clock_ms(); timing->parse_ms += now - t; t = now; }
+        const char **seqs = (const char **)batch.seqs;
+        const int *lens = batch.lens;
+        const uint64_t *const *packed = (const uint64_t *const *)batch.packed;
+        const uint64_t *const *nmasks = (const uint64_t *const *)batch.nmask;
+        const int *mult = NULL;
+        int n = batch.n;
+        if (opts->dereplicate) {
+            /* Classify each distinct sequence once, carrying its count */
+            if (n > scratch_cap) {
+                scratch_cap = n;
+                first = (int *)hs_realloc(first, (size_t)n * sizeof(int));
+                counts = (int *)hs_realloc(counts, (size_t)n * sizeof(int));
+                useqs = (const char **)hs_realloc(useqs, (size_t)n * sizeof(char *));
+                ulens = (int *)hs_realloc(ulens, (size_t)n * sizeof(int));
+                upacked = (const uint64_t **)hs_realloc(upacked, (size_t)n * sizeof(uint64_t *));
+                unmasks = (const uint64_t **)hs_realloc(unmasks, (size_t)n * sizeof(uint64_t *));
+            }
+            n = classify_dereplicate(seqs, lens, batch.n, first, counts);
+            for (int u = 0; u < n; u++) {
+                useqs[u] = seqs[first[u]];
+                ulens[u] = lens[first[u]];
+                upacked[u] = packed[first[u]];
+                unmasks[u] = nmasks[first[u]];
+            }
+            seqs = useqs;
+            lens = ulens;
+            packed = upacked;
+            nmasks = unmasks;
+            mult = counts;
+            if (timing) { double now = hs_clock_ms(); timing->derep_ms += now - t; t = now; }
+        }
+        classify_results_t *results = classify_reads_packed(idx, seqs, lens, packed, nmasks,
+                                                            n, opts, timing);
+        classify_summary_add(summary, results, mult);
+        int n_before = *out_n;
+        em_reads_append_classify(out_reads, out_n, &cap, results, mult);
+        em_reads_quantize(*out_reads + n_before, *out_n - n_before, opts->eq_class_step);
+        classify_results_free(results);
+        /* Fold rows into equivalence classes whenever they have doubled, so
+         * the row array tracks sample diversity rather than depth */
+        if (*out_n >= next_collapse) {
+            *out_n = em_reads_collapse(*out_reads, *out_n);
+            next_collapse = 2 * *out_n + batch_size;
+        }
+        if (progress) *progress = summary->total_reads;
+        if (online && summary->total_reads >= ost.next_look) {
+            ost.next_look = summary->total_reads + online->check_every;
+            *out_n = em_reads_collapse(*out_reads, *out_n);
+            if (online_look(&ost, online, idx, *out_reads, *out_n, summary)) {
+                online->stopped = 1;
+                HS_LOG_INFO("Verdict %s stable over %d looks after %d reads; stopped reading",
+                            verdict_str(online->verdict), online->stable_looks,
+                            summary->total_reads);
+                break;
+            }
+        }
+        if (timing) t = hs_clock_ms();
+    }
+    if (timing) timing->parse_ms += hs_clock_ms() - t;
+    if (online) online_free(&ost);
+    *out_n = em_reads_collapse(*out_reads, *out_n);
+    free(first);
+    free(counts);
+    free(useqs);
+    free(ulens);
+    free(upacked);
+    free(unmasks);
+    hs_seq_batch_free(&batch);
+}
+
+/* EM side of the run statistics */
+static void stats_add_fit(pipeline_stats_t *st, const em_result_t *em) {
+    st->em_restarts = em->n_restarts;
+    st->em_iterations = em->n_iterations;
+    st->em_iterations_min = st->em_iterations_max = em->n_iterations;
+    double total = 0.0;
+    for (int k = 0; k < em->n_restarts; k++) {
+        int it = em->restart_iterations[k];
+        if (it < st->em_iterations_min) st->em_iterations_min = it;
+        if (it > st->em_iterations_max) st->em_iterations_max = it;
+        total += it;
+    }
+    st->em_iterations_mean = em->n_restarts > 0 ? total / em->n_restarts : 0.0;
+    st->em_extrapolations = em->n_extrapolations;
+    st->em_converged = em->converged;
+    st->ci_ms = em->ci_ms;
+    st->lrt_ms = em->lrt_ms;
+    st->em_ms = em->fit_ms;
+}
+
+void pipeline_print_stats_json(const pipeline_stats_t *st, FILE *out) {
+    const classify_timing_t *ct = &st->classify;
+    uint64_t fine_scored = ct->n_scored - ct->n_prefiltered - ct->n_coarse_rejected;
+    fprintf(out, "{\n");
+    fprintf(out, "  \"total_reads\": %d,\n", st->total_reads);
+    fprintf(out, "  \"classified_reads\": %d,\n", st->classified_reads);
+    fprintf(out, "  \"classify\": {\n");
+    fprintf(out, "    \"reads_scored\": %llu,\n", (unsigned long long)ct->n_scored);
+    fprintf(out, "    \"primer_marker\": %llu,\n", (unsigned long long)ct->n_primer);
+    fprintf(out, "    \"prefiltered\": %llu,\n", (unsigned long long)ct->n_prefiltered);
+    fprintf(out, "    \"short_all_candidates\": %llu,\n", (unsigned long long)ct->n_short);
+    fprintf(out, "    \"coarse_rejected\": %llu,\n", (unsigned long long)ct->n_coarse_rejected);
+    fprintf(out, "    \"mean_candidates\": %.2f,\n",
+            fine_scored > 0 ? (double)ct->n_candidates / (double)fine_scored : 0.0);
+    fprintf(out, "    \"fine_kmer_lookups\": %llu,\n", (unsigned long long)ct->n_fine_kmers);
+    fprintf(out, "    \"hits\": %llu\n", (unsigned long long)ct->n_hits);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"stage_ms\": {\n");
+    fprintf(out, "    \"parse\": %.1f,\n", ct->parse_ms);
+    fprintf(out, "    \"derep\": %.1f,\n", ct->derep_ms);
+    fprintf(out, "    \"classify\": %.1f,\n", ct->classify_ms);
+    fprintf(out, "    \"primer\": %.1f,\n", ct->primer_ms);
+    fprintf(out, "    \"kmer\": %.1f,\n", ct->kmer_ms);
+    fprintf(out, "    \"coarse\": %.1f,\n", ct->coarse_ms);
+    fprintf(out, "    \"fine\": %.1f,\n", ct->fine_ms);
+    fprintf(out, "    \"em\": %.1f,\n", st->em_ms);
+    fprintf(out, "    \"ci\": %.1f,\n", st->ci_ms);
+    fprintf(out, "    \"lrt\": %.1f\n", st->lrt_ms);
+    fprintf(out, "  },\n");
+    fprintf(out, "  \"em\": {\n");
+    fprintf(out, "    \"rows\": %d,\n", st->em_rows);
+    fprintf(out, "    \"restarts\": %d,\n", st->em_restarts);
+    fprintf(out, "    \"iterations\": %d,\n", st->em_iterations);
+    fprintf(out, "    \"iterations_per_restart\": %.1f,\n", st->em_iterations_mean);
+    fprintf(out, "    \"iterations_min\": %d,\n", st->em_iterations_min);
+    fprintf(out, "    \"iterations_max\": %d,\n", st->em_iterations_max);
+    fprintf(out, "    \"extrapolations\": %d,\n", st->em_extrapolations);
+    fprintf(out, "    \"converged\": %s,\n", st->em_converged ? "true" : "false");
+    fprintf(out, "    \"lrt\": \"%s\"\n", st->em_full_lrt ? "full" : "profile");
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
+}
+
+halal_report_t *pipeline_quantify(const halal_index_t *idx, em_read_t *reads, int n,
+                                  const classify_summary_t *summary,
+                                  const em_config_t *config, double threshold) {
+    return pipeline_quantify_stats(idx, reads, n, summary, config, threshold, NULL);
+}
+
+halal_report_t *pipeline_quantify_stats(const halal_index_t *idx, em_read_t *reads, int n,
+                                        const classify_summary_t *summary,
+                                        const em_config_t *config, double threshold,
+                                        pipeline_stats_t *stats) {
+    em_config_t ecfg = *config;
+    double *mito_cn = NULL;
+    if (!ecfg.mito_copy_numbers)
+        ecfg.mito_copy_numbers = mito_cn = db_mito_copy_numbers(idx->db);
+
+    /* Pack the rows into CSR form once; the per-read arrays can go */
+    em_data_t *em_data = em_data_from_reads(reads, n);
+    em_reads_free(reads, n);
+    if (ecfg.float_storage) em_data_to_float(em_data);
+    em_result_t *em = em_fit_data(em_data, idx->db->n_species, idx->db->n_markers,
+                                  idx->db->amp_lens, &ecfg);
+    em_data_destroy(em_data);
+    if (em)
+        HS_LOG_INFO("EM: %d iterations%s, %d SQUAREM extrapolations", em->n_iterations,
+                    em->converged ? "" : " (not converged)", em->n_extrapolations);
+    if (stats) {
+        stats->total_reads = summary->total_reads;
+        stats->classified_reads = summary->classified_reads;
+        stats->em_rows = n;
+        stats->em_full_lrt = ecfg.use_full_lrt;
+        if (em) stats_add_fit(stats, em);
+    }
+
+    halal_report_t *report;
+    if (em) {
+        report = report_generate_summary(em, idx->db, summary, threshold);
+    } else {
+        /* Nothing was classified: no fit, no verdict */
+        report = (halal_report_t *)hs_calloc(1, sizeof(halal_report_t));
+        snprintf(report->sample_id, sizeof(report->sample_id), "sample");
+        report->verdict = INCONCLUSIVE;
+        report->threshold_wpw = threshold;
+        report->total_reads = summary->total_reads;
+        report->classified_reads = summary->classified_reads;
+        report->n_markers = idx->db->n_markers;
+    }
+    em_result_destroy(em);
+    free(mito_cn);
+    return report;
+}
+
+/* --- Classification checkpoints ---
+ * HSCL v1 layout (native endianness):
+ *   u32 magic, u32 version, i32 S, i32 M
+ *   char species_id[S][HS_MAX_NAME_LEN], char marker_id[M][16]
+ *   i32 total_reads, classified_reads,
+ *       per_marker[M], per_species[S], per_species_marker[S*M]
+ *   i32 n_rows, n_entries
+ *   n_rows x { i32 marker, count, n_candidates }
+ *   i32 species[n_entries], f64 containment[n_entries] */
+
+#define CLASSIFIED_MAGIC 0x4853434c  /* "HSCL" */
+#define CLASSIFIED_VERSION 1
+
+int pipeline_save_classified(const char *path, const halal_refdb_t *db,
+                             const em_read_t *reads, int n,
+                             const classify_summary_t *summary) {
+    int32_t S = db->n_species, M = db->n_markers;
+    if (summary->n_species != S || summary->n_markers != M) return -1;
+    FILE *fp = fopen(path, "wb");
+    if (!fp) return -1;
+    uint32_t magic = CLASSIFIED_MAGIC, version = CLASSIFIED_VERSION;
+    fwrite(&magic, 4, 1, fp);
+    fwrite(&version, 4, 1, fp);
+    fwrite(&S, sizeof(int32_t), 1, fp);
+    fwrite(&M, sizeof(int32_t), 1, fp);
+    for (int s = 0; s < S; s++)
+        fwrite(db->species[s].species_id, 1, HS_MAX_NAME_LEN, fp);
+    fwrite(db->marker_ids, sizeof(*db->marker_ids), (size_t)M, fp);
+
+    int32_t tally[2] = { summary->total_reads, summary->classified_reads };
+    fwrite(tally, sizeof(int32_t), 2, fp);
+    fwrite(summary->per_marker, sizeof(int), (size_t)M, fp);
+    fwrite(summary->per_species, sizeof(int), (size_t)S, fp);
+    fwrite(summary->per_species_marker, sizeof(int), (size_t)S * (size_t)M, fp);
+
+    int32_t dims[2] = { n, 0 };
+    for (int r = 0; r < n; r++) dims[1] += reads[r].n_candidates;
+    fwrite(dims, sizeof(int32_t), 2, fp);
+    /* An unknown marker is stored as 0, as em_data_from_reads() maps it */
+    for (int r = 0; r < n; r++) {
+        int32_t hdr[3] = { reads[r].marker_idx > 0 ? reads[r].marker_idx : 0,
+                           reads[r].count > 0 ? reads[r].count : 1, reads[r].n_candidates };
+        fwrite(hdr, sizeof(int32_t), 3, fp);
+    }
+    for (int r = 0; r < n; r++)
+        fwrite(reads[r].species_indices, sizeof(int), (size_t)reads[r].n_candidates, fp);
+    for (int r = 0; r < n; r++)
+        fwrite(reads[r].containments, sizeof(double), (size_t)reads[r].n_candidates, fp);
+
+    int err = ferror(fp);
+    if (fclose(fp) != 0 || err) {
+        remove(path);
+        return -1;
+    }
+    return 0;
+}
+
+int pipeline_load_classified(const char *path, const halal_refdb_t *db,
+                             em_read_t **out_reads, int *out_n,
+                             classify_summary_t *summary) {
+    *out_reads = NULL;
+    *out_n = 0;
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return -1;
+    uint32_t hdr[2] = { 0, 0 };
+    int32_t dim[2] = { -1, -1 };
+    if (fread(hdr, 4, 2, fp) != 2 || hdr[0] != CLASSIFIED_MAGIC) {
+        HS_LOG_ERROR("%s is not a classification file", path);
+        fclose(fp);
+        return -1;
+    }
+    if (hdr[1] != CLASSIFIED_VERSION) {
+        HS_LOG_ERROR("Unsupported classification file version %u in %s", hdr[1], path);
+        fclose(fp);
+        return -1;
+    }
+    int S = db->n_species, M = db->n_markers;
+    int same = fread(dim, sizeof(int32_t), 2, fp) == 2 && dim[0] == S && dim[1] == M;
+    char name[HS_MAX_NAME_LEN];
+    for (int s = 0; same && s < S; s++)
+        same = fread(name, 1, HS_MAX_NAME_LEN, fp) == HS_MAX_NAME_LEN &&
+               strncmp(name, db->species[s].species_id, HS_MAX_NAME_LEN) == 0;
+    for (int m = 0; same && m < M; m++)
+        same = fread(name, 1, sizeof(*db->marker_ids), fp) == sizeof(*db->marker_ids) &&
+               strncmp(name, db->marker_ids[m], sizeof(*db->marker_ids)) == 0;
+    if (!same) {
+        HS_LOG_ERROR("%s was classified against a different database", path);
+        fclose(fp);
+        return -1;
+    }
+
+    classify_summary_init(summary, S, M);
+    int32_t tally[2];
+    int32_t dims[2] = { -1, -1 };
+    int ok = fread(tally, sizeof(int32_t), 2, fp) == 2 &&
+             fread(summary->per_marker, sizeof(int), (size_t)M, fp) == (size_t)M &&
+             fread(summary->per_species, sizeof(int), (size_t)S, fp) == (size_t)S &&
+             fread(summary->per_species_marker, sizeof(int), (size_t)S * (size_t)M, fp) ==
+                 (size_t)S * (size_t)M &&
+             fread(dims, sizeof(int32_t), 2, fp) == 2 && dims[0] >= 0 && dims[1] >= dims[0];
+    /* The rest is exactly n read headers (3 x i32) and dims[1] entries
+     * (i32 + f64), so a corrupt count cannot size the allocation */
+    if (ok) {
+        long here = ftell(fp);
+        ok = here >= 0 && fseek(fp, 0, SEEK_END) == 0 &&
+             (int64_t)ftell(fp) - here == 12 * ((int64_t)dims[0] + dims[1]) &&
+             fseek(fp, here, SEEK_SET) == 0;
+    }
+    summary->total_reads = ok ? tally[0] : 0;
+    summary->classified_reads = ok ? tally[1] : 0;
+
+    int n = ok ? dims[0] : 0;
+    em_read_t *reads = (em_read_t *)hs_calloc(n > 0 ? (size_t)n : 1, sizeof(em_read_t));
+    int64_t n_entries = 0;
+    for (int r = 0; ok && r < n; r++) {
+        int32_t rh[3];
+        ok = fread(rh, sizeof(int32_t), 3, fp) == 3 && rh[0] >= 0 && rh[0] < M && rh[1] > 0 &&
+             rh[2] > 0 && rh[2] <= S;
+        if (!ok) break;
+        reads[r].marker_idx = rh[0];
+        reads[r].count = rh[1];
+        reads[r].n_candidates = rh[2];
+        reads[r].species_indices = (int *)hs_malloc((size_t)rh[2] * sizeof(int));
+        reads[r].containments = (double *)hs_malloc((size_t)rh[2] * sizeof(double));
+        n_entries += rh[2];
+    }
+    ok = ok && n_entries == dims[1];
+    for (int r = 0; ok && r < n; r++) {
+        size_t k = (size_t)reads[r].n_candidates;
+        ok = fread(reads[r].species_indices, sizeof(int), k, fp) == k;
+        for (size_t j = 0; ok && j < k; j++)
+            ok = reads[r].species_indices[j] >= 0 && reads[r].species_indices[j] < S;
+    }
+    for (int r = 0; ok && r < n; r++) {
+        size_t k = (size_t)reads[r].n_candidates;
+        ok = fread(reads[r].containments, sizeof(double), k, fp) == k;
+    }
+    fclose(fp);
+    if (!ok) {
+        HS_LOG_ERROR("Truncated or corrupt classification file %s", path);
+        em_reads_free(reads, n);
+        classify_summary_free(summary);
+        return -1;
+    }
+    *out_reads = reads;
+    *out_n = n;
+    return 0;
+}
@@ -0,0 +1,154 @@
+#ifndef HALALSEQ_PIPELINE_H
+#define HALALSEQ_PIPELINE_H
+
+#include "index.h"
+#include "classify.h"
+#include "em.h"
+#include "fastq.h"
+#include "report.h"
+
+#define HS_STREAM_BATCH 16384   /* reads per classification batch */
+
+/* --- Streaming classification ---
+ * Reads `path` (FASTA/FASTQ, optionally gzipped, "-" = stdin) in batches
+ * of batch_size, classifies each batch and keeps only the sparse EM input
+ * and read tallies; raw reads and classify results never outlive a batch, so
+ * memory is bounded by the batch size rather than the file size.
+ * Reading runs ahead on its own threads (hs_seqfile_prefetch), so inflating
+ * and parsing the next batches overlaps classification of the current one.
+ * With opts->dereplicate, identical reads within a batch are classified
+ * once.  EM rows are merged into weighted equivalence classes as they
+ * accumulate (em_read_t.count), after rounding containments to
+ * opts->eq_class_step when that is positive.
+ * *summary is initialised first; release it with classify_summary_free()
+ * whatever the return value.  If progress is non-NULL it is updated with
+ * the number of reads processed after every batch; setting *opts->cancel
+ * stops reading before the next one, leaving the rows read so far.
+ * Returns 0 on success, -1 if the file cannot be opened. */
+int pipeline_classify_file(const halal_index_t *idx, const char *path,
+                           const classify_opts_t *opts, int batch_size,
+                           em_read_t **out_reads, int *out_n,
+                           classify_summary_t *summary,
+                           volatile int *progress);
+
+/* As pipeline_classify_file, also accumulating stage times into *timing */
+int pipeline_classify_file_timed(const halal_index_t *idx, const char *path,
+                                 const classify_opts_t *opts, int batch_size,
+                                 em_read_t **out_reads, int *out_n,
+                                 classify_summary_t *summary,
+                                 volatile int *progress,
+                                 classify_timing_t *timing);
+
+/* As pipeline_classify_file on paired-end mates: each pair is classified
+ * once, as its overlap-merged (or joined) fragment (hs_seqfile_open_paired).
+ * Returns -1 if either file cannot be opened. */
+int pipeline_classify_pair(const halal_index_t *idx, const char *path1, const char *path2,
+                           const classify_opts_t *opts, int batch_size,
+                           em_read_t **out_reads, int *out_n,
+                           classify_summary_t *summary,
+                           volatile int *progress);
+
+/* As pipeline_classify_file_timed on an already open reader (a pipe or
+ * socket); sf is left open */
+void pipeline_classify_stream(const halal_index_t *idx, hs_seqfile_t *sf,
+                              const classify_opts_t *opts, int batch_size,
+                              em_read_t **out_reads, int *out_n,
+                              classify_summary_t *summary,
+                              volatile int *progress,
+                              classify_timing_t *timing);
+
+/* --- Online quantification ---
+ * Interim EM fits every check_every reads, each warm-started from the one
+ * before, let reading stop once the verdict has settled: stable_looks
+ * consecutive looks (after at least min_reads reads) gave the same PASS
+ * or FAIL with every haram species' interval, widened from 95% to
+ * HS_ONLINE_Z standard errors for the repeated looks, on one side of
+ * threshold.  The rows read so far are returned as usual for the final
+ * fit with pipeline_quantify.  Looks assume reads arrive in no particular
+ * order, as a sequencer writes them; a file sorted by species or marker
+ * can settle on the wrong verdict. */
+#define HS_ONLINE_Z 2.576
+
+typedef struct {
+    const em_config_t *em;     /* interim fits (full-model LRT is skipped) */
+    double threshold;
+    int check_every;           /* reads between looks */
+    int min_reads;             /* never stop before this many reads */
+    int stable_looks;          /* agreeing decisive looks needed to stop
+                                  (INT_MAX: never stop, looks only report) */
+    /* Called with every interim fit, e.g. to show estimates while reading
+     * continues (NULL = none); em is freed after the next look */
+    void (*on_look)(const em_result_t *em, const classify_summary_t *summary, void *arg);
+    void *look_arg;
+    /* out */
+    int n_looks;
+    int stopped;               /* reading stopped before the end of input */
+    verdict_t verdict;         /* verdict of the last look */
+} pipeline_online_t;
+
+/* check_every 2000, min_reads 2000, stable_looks 3 */
+pipeline_online_t pipeline_online_default(const em_config_t *em, double threshold);
+
+/* As pipeline_classify_stream, stopping early as online decides (NULL:
+ * read everything) */
+void pipeline_classify_stream_online(const halal_index_t *idx, hs_seqfile_t *sf,
+                                     const classify_opts_t *opts, int batch_size,
+                                     pipeline_online_t *online,
+                                     em_read_t **out_reads, int *out_n,
+                                     classify_summary_t *summary,
+                                     volatile int *progress,
+                                     classify_timing_t *timing);
+
+/* --- Quantification ---
+ * Fit EM to classified rows (consumed) and build the report.  Without
+ * config->mito_copy_numbers the database's copy numbers are used. */
+halal_report_t *pipeline_quantify(const halal_index_t *idx, em_read_t *reads, int n,
+                                  const classify_summary_t *summary,
+                                  const em_config_t *config, double threshold);
+
+/* --- Run statistics ---
+ * Where a run's time goes: classification stage times and path counters
+ * (pass &stats->classify as the timing argument of the classify calls)
+ * and the EM fit's restarts, iterations and inference times. */
+typedef struct {
+    classify_timing_t classify;
+    int total_reads;
+    int classified_reads;
+    int em_rows;               /* equivalence classes fitted */
+    int em_restarts;
+    int em_iterations;         /* best restart */
+    int em_iterations_min, em_iterations_max;
+    double em_iterations_mean; /* per restart */
+    int em_extrapolations;
+    int em_converged;
+    int em_full_lrt;
+    double em_ms;              /* restarts */
+    double ci_ms;
+    double lrt_ms;             /* em_lrt, or em_lrt_full with full_lrt */
+} pipeline_stats_t;
+
+/* As pipeline_quantify, filling stats's EM and read fields (stats may be
+ * NULL) */
+halal_report_t *pipeline_quantify_stats(const halal_index_t *idx, em_read_t *reads, int n,
+                                        const classify_summary_t *summary,
+                                        const em_config_t *config, double threshold,
+                                        pipeline_stats_t *stats);
+
+/* One JSON object */
+void pipeline_print_stats_json(const pipeline_stats_t *stats, FILE *out);
+
+/* --- Classification checkpoints ---
+ * The output of pipeline_classify_file -- equivalence-classed EM rows
+ * and read tallies -- saved so a sample can be re-quantified under other
+ * EM options without classifying its reads again.  The file records the
+ * database's species and marker IDs and only loads against a database
+ * with the same ones.  Both return 0 on success, -1 on error; on success
+ * load initialises *summary (release with classify_summary_free()). */
+int pipeline_save_classified(const char *path, const halal_refdb_t *db,
+                             const em_read_t *reads, int n,
+                             const classify_summary_t *summary);
+int pipeline_load_classified(const char *path, const halal_refdb_t *db,
+                             em_read_t **out_reads, int *out_n,
+                             classify_summary_t *summary);
+
+#endif /* HALALSEQ_PIPELINE_H */
@@ -0,0 +1,201 @@
+#include "primer.h"
+#include "kmer.h"
+#include "utils.h"
+#include <string.h>
+
+#define SEED_SPACE (1 << (2 * PRIMER_SEED_K))
+
+/* --- Base masks --- */
+
+/* IUPAC code to the set of bases it stands for (0 = not a base) */
+static uint8_t iupac_mask(char c) {
+    switch (c) {
+        case 'A': case 'a': return 1;
+        case 'C': case 'c': return 2;
+        case 'G': case 'g': return 4;
+        case 'T': case 't': case 'U': case 'u': return 8;
+        case 'R': case 'r': return 1 | 4;
+        case 'Y': case 'y': return 2 | 8;
+        case 'S': case 's': return 2 | 4;
+        case 'W': case 'w': return 1 | 8;
+        case 'K': case 'k': return 4 | 8;
+        case 'M': case 'm': return 1 | 2;
+        case 'B': case 'b': return 2 | 4 | 8;
+        case 'D': case 'd': return 1 | 4 | 8;
+        case 'H': case 'h': return 1 | 2 | 8;
+        case 'V': case 'v': return 1 | 2 | 4;
+        case 'N': case 'n': return 15;
+        default: return 0;
+    }
+}
+
+/* Complement swaps A<->T and C<->G, i.e. reverses the four mask bits */
+static uint8_t mask_complement(uint8_t m) {
+    return (uint8_t)(((m & 1) << 3) | ((m & 2) << 1) | ((m & 4) >> 1) | ((m & 8) >> 3));
+}
+
+/* 2-bit code of a single-base mask, -1 for ambiguity codes */
+static int mask_code(uint8_t m) {
+    switch (m) {
+        case 1: return 0;
+        case 2: return 1;
+        case 4: return 2;
+        case 8: return 3;
+        default: return -1;
+    }
+}
+
+/* --- Construction --- */
+
+static void add_pattern(primer_scanner_t *ps, const char *primer, int marker_idx,
+                        int is_reverse, int revcomp, int at_3p) {
+    int len = (int)strlen(primer);
+    if (len < PRIMER_SEED_K) return;
+    ps->patterns = (primer_pattern_t *)hs_realloc(ps->patterns,
+        (size_t)(ps->n_patterns + 1) * sizeof(primer_pattern_t));
+    primer_pattern_t *pp = &ps->patterns[ps->n_patterns++];
+    pp->mask = (uint8_t *)hs_malloc((size_t)len);
+    pp->len = len;
+    pp->marker_idx = marker_idx;
+    pp->at_3p = at_3p;
+    pp->primer_id = 2 * marker_idx + is_reverse;
+    for (int i = 0; i < len; i++)
+        pp->mask[i] = revcomp ? mask_complement(iupac_mask(primer[len - 1 - i]))
+                              : iupac_mask(primer[i]);
+}
+
+/* Counts (fill = 0) or places (fill = 1) every unambiguous seed */
+static void for_each_seed(primer_scanner_t *ps, int fill) {
+    for (int p = 0; p < ps->n_patterns; p++) {
+        const primer_pattern_t *pp = &ps->patterns[p];
+        for (int i = 0; i + PRIMER_SEED_K <= pp->len; i++) {
+            int code = 0, ok = 1;
+            for (int j = 0; j < PRIMER_SEED_K && ok; j++) {
+                int b = mask_code(pp->mask[i + j]);
+                ok = b >= 0;
+                code = (code << 2) | (ok ? b : 0);
+            }
+            if (!ok) continue;
+            if (fill) {
+                int slot = ps->seed_off[code]++;
+                ps->seed_pat[slot] = p;
+                ps->seed_pos[slot] = i;
+            } else {
+                ps->seed_off[code + 1]++;
+            }
+        }
+    }
+}
+
+primer_scanner_t *primer_scanner_build(const halal_refdb_t *db) {
+    primer_scanner_t *ps = (primer_scanner_t *)hs_calloc(1, sizeof(primer_scanner_t));
+    for (int m = 0; m < db->n_markers; m++) {
+        add_pattern(ps, db->primer_f[m], m, 0, 0, 0);
+        add_pattern(ps, db->primer_r[m], m, 1, 0, 0);
+        add_pattern(ps, db->primer_r[m], m, 1, 1, 1);
+        add_pattern(ps, db->primer_f[m], m, 0, 1, 1);
+    }
+
+    /* Seed table in CSR form: count, prefix-sum, fill, then shift back */
+    ps->seed_off = (int *)hs_calloc(SEED_SPACE + 1, sizeof(int));
+    for_each_seed(ps, 0);
+    for (int c = 0; c < SEED_SPACE; c++) ps->seed_off[c + 1] += ps->seed_off[c];
+    int n_seeds = ps->seed_off[SEED_SPACE];
+    ps->seed_pat = (int *)hs_malloc((size_t)(n_seeds > 0 ? n_seeds : 1) * sizeof(int));
+    ps->seed_pos = (int *)hs_malloc((size_t)(n_seeds > 0 ? n_seeds : 1) * sizeof(int));
+    for_each_seed(ps, 1);
+    for (int c = SEED_SPACE; c > 0; c--) ps->seed_off[c] = ps->seed_off[c - 1];
+    ps->seed_off[0] = 0;
+    return ps;
+}
+
+void primer_scanner_destroy(primer_scanner_t *ps) {
+    if (!ps) return;
+    for (int p = 0; p < ps->n_patterns; p++) free(ps->patterns[p].mask);
+    free(ps->patterns);
+    free(ps->seed_off);
+    free(ps->seed_pat);
+    free(ps->seed_pos);
+    free(ps);
+}
+
+/* --- Scanning --- */
+
+typedef struct {
+    int pattern;            /* -1 = none */
+    int start;
+    int mismatches;
+    int edge;               /* bases between the primer and its read end */
+} placement_t;
+
+/* Every key reads the same on the reverse complement, where a 5'
+ * placement becomes the 3' placement of the other orientation */
+static int placement_better(const primer_scanner_t *ps, const placement_t *a,
+                            const placement_t *b) {
+    if (b->pattern < 0) return 1;
+    if (a->mismatches != b->mismatches) return a->mismatches < b->mismatches;
+    if (a->edge != b->edge) return a->edge < b->edge;
+    return ps->patterns[a->pattern].primer_id < ps->patterns[b->pattern].primer_id;
+}
+
+/* Best placement of an (at_3p) pattern wholly inside seq[lo, hi) */
+static placement_t scan_region(const primer_scanner_t *ps, const char *seq,
+                               int lo, int hi, int at_3p, int max_mismatches) {
+    placement_t best = { -1, 0, 0, 0 };
+    const int kmask = SEED_SPACE - 1;
+    int code = 0, valid = 0;
+    for (int p = lo; p < hi; p++) {
+        int b = hs_base_table[(unsigned char)seq[p]];
+        if (b < 0) { valid = 0; continue; }
+        code = ((code << 2) | b) & kmask;
+        if (++valid < PRIMER_SEED_K) continue;
+        int seed_at = p - PRIMER_SEED_K + 1;
+        for (int e = ps->seed_off[code]; e < ps->seed_off[code + 1]; e++) {
+            const primer_pattern_t *pp = &ps->patterns[ps->seed_pat[e]];
+            if (pp->at_3p != at_3p) continue;
+            int start = seed_at - ps->seed_pos[e];
+            if (start < lo || start + pp->len > hi) continue;
+            int mm = 0;
+            for (int i = 0; i < pp->len && mm <= max_mismatches; i++) {
+                int rb = hs_base_table[(unsigned char)seq[start + i]];
+                mm += rb < 0 || !(pp->mask[i] & (1 << rb));
+            }
+            if (mm > max_mismatches) continue;
+            placement_t cand = { ps->seed_pat[e], start, mm,
+                                 at_3p ? hi - start - pp->len : start - lo };
+            if (placement_better(ps, &cand, &best)) best = cand;
+        }
+    }
+    return best;
+}
+
+int primer_scan(const primer_scanner_t *ps, const char *seq, int len,
+                int window, int max_mismatches, primer_hit_t *hit) {
+    primer_hit_t h = { -1, -1, 0, 0, len };
+    if (window > len) window = len;
+    placement_t p5 = { -1, 0, 0, 0 }, p3 = { -1, 0, 0, 0 };
+    if (ps && ps->n_patterns > 0 && window >= PRIMER_SEED_K) {
+        p5 = scan_region(ps, seq, 0, window, 0, max_mismatches);
+        p3 = scan_region(ps, seq, len - window, len, 1, max_mismatches);
+    }
+    const placement_t *best = NULL;
+    /* A full tie is the same primer at both ends: same marker either way */
+    if (p5.pattern >= 0 && (p3.pattern < 0 || !placement_better(ps, &p3, &p5))) best = &p5;
+    else if (p3.pattern >= 0) best = &p3;
+    if (best) {
+        h.marker_idx = ps->patterns[best->pattern].marker_idx;
+        h.offset = best->start;
+        h.mismatches = best->mismatches;
+        /* Trim the marker's primers; if they overlap keep only the best */
+        if (p5.pattern >= 0 && ps->patterns[p5.pattern].marker_idx == h.marker_idx)
+            h.trim_start = p5.start + ps->patterns[p5.pattern].len;
+        if (p3.pattern >= 0 && ps->patterns[p3.pattern].marker_idx == h.marker_idx)
+            h.trim_end = p3.start;
+        if (h.trim_start > h.trim_end) {
+            if (best == &p5) h.trim_end = len;
+            else h.trim_start = 0;
+        }
+    }
+    if (hit) *hit = h;
+    return h.marker_idx;
+}
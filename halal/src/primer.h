@@ -0,0 +1,56 @@
+#ifndef HALALSEQ_PRIMER_H
+#define HALALSEQ_PRIMER_H
+
+#include "refdb.h"
+
+/* --- Primer scanner ---
+ * Finds marker primers near the ends of a read.  Each primer is kept in
+ * every orientation it can take in a read: the forward or reverse primer
+ * at the 5' end, or the reverse complement of either at the 3' end.  One
+ * table of PRIMER_SEED_K-mer seeds over all of them proposes placements,
+ * which are verified by Hamming distance (IUPAC codes in primers match
+ * any of their bases), so a primer is found despite a few mismatches as
+ * long as one seed survives intact. */
+#define PRIMER_SEED_K 6
+#define PRIMER_DEFAULT_WINDOW 40
+#define PRIMER_DEFAULT_MISMATCHES 3
+
+typedef struct {
+    uint8_t *mask;          /* oriented primer as base masks (A=1 C=2 G=4 T=8) */
+    int len;
+    int marker_idx;
+    int at_3p;              /* expected at the read's 3' end */
+    int primer_id;          /* 2 * marker_idx + (1 for the reverse primer),
+                               shared by both orientations of a primer */
+} primer_pattern_t;
+
+typedef struct {
+    primer_pattern_t *patterns;
+    int n_patterns;
+    int *seed_off;          /* [4^PRIMER_SEED_K + 1] into seed_pat/seed_pos */
+    int *seed_pat;          /* pattern holding the seed */
+    int *seed_pos;          /* seed position within the pattern */
+} primer_scanner_t;
+
+typedef struct {
+    int marker_idx;         /* -1: no primer in either window */
+    int offset;             /* read position of the best primer */
+    int mismatches;         /* of the best primer */
+    int trim_start;         /* read span with the marker's primers removed: */
+    int trim_end;           /*   [trim_start, trim_end) */
+} primer_hit_t;
+
+primer_scanner_t *primer_scanner_build(const halal_refdb_t *db);
+void primer_scanner_destroy(primer_scanner_t *ps);
+
+/* Search the first and last `window` bases of seq for a primer lying
+ * wholly inside the window with at most max_mismatches mismatches.  The
+ * best placement (fewest mismatches, then nearest its end of the read,
+ * then lowest primer_id, then the 5' end) names the marker, so a read and
+ * its reverse complement get the same one; primers of that marker found
+ * at either end are trimmed.  Returns the marker index or -1; hit may be
+ * NULL. */
+int primer_scan(const primer_scanner_t *ps, const char *seq, int len,
+                int window, int max_mismatches, primer_hit_t *hit);
+
+#endif /* HALALSEQ_PRIMER_H */
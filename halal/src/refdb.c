@@ -6,7 +6,7 @@
 
 /* Magic + version for serialization */
 #define REFDB_MAGIC  0x48414C41  /* "HALA" */
-#define REFDB_VERSION 1
+#define REFDB_VERSION 2  /* v1: fixed HS_LEGACY_MARKER_SLOTS marker tables */
 
 const char *halal_status_str(halal_status_t s) {
     switch (s) {
@@ -23,10 +23,39 @@ halal_refdb_t *refdb_create(void) {
     return db;
 }
 
+/* ref_slot and amp_lens are laid out [s * n_markers + m], so both are
+ * rebuilt whenever the species or marker count changes */
+void refdb_reindex(halal_refdb_t *db) {
+    size_t n = (size_t)db->n_species * (size_t)db->n_markers;
+    free(db->ref_slot);
+    free(db->amp_lens);
+    db->ref_slot = (int *)hs_calloc(n > 0 ? n : 1, sizeof(int));
+    db->amp_lens = (int *)hs_calloc(n > 0 ? n : 1, sizeof(int));
+    for (int i = 0; i < db->n_marker_refs; i++) {
+        int s = db->markers[i].species_idx, m = db->markers[i].marker_idx;
+        if (s < 0 || s >= db->n_species || m < 0 || m >= db->n_markers) continue;
+        size_t cell = (size_t)s * (size_t)db->n_markers + (size_t)m;
+        if (db->ref_slot[cell] == 0) {
+            db->ref_slot[cell] = i + 1;
+            db->amp_lens[cell] = db->markers[i].amplicon_length;
+        }
+    }
+}
+
+void refdb_alloc_markers(halal_refdb_t *db, int n_markers) {
+    size_t n = n_markers > 0 ? (size_t)n_markers : 1;
+    free(db->marker_ids);
+    free(db->primer_f);
+    free(db->primer_r);
+    db->marker_ids = (char (*)[16])hs_calloc(n, sizeof(*db->marker_ids));
+    db->primer_f = (char (*)[HS_MAX_PRIMER_LEN])hs_calloc(n, sizeof(*db->primer_f));
+    db->primer_r = (char (*)[HS_MAX_PRIMER_LEN])hs_calloc(n, sizeof(*db->primer_r));
+    db->n_markers = n_markers;
+}
+
 int refdb_add_species(halal_refdb_t *db, const char *species_id,
                       const char *common_name, halal_status_t status,
                       double mito_cn, double yield_prior) {
-    if (db->n_species >= HS_MAX_SPECIES) return -1;
     int idx = db->n_species;
     db->species = (species_info_t *)hs_realloc(db->species,
         (size_t)(idx + 1) * sizeof(species_info_t));
@@ -37,17 +66,25 @@ int refdb_add_species(halal_refdb_t *db, const char *species_id,
     db->species[idx].mito_copy_number = mito_cn;
     db->species[idx].dna_yield_prior = yield_prior;
     db->n_species++;
+    refdb_reindex(db);
     return idx;
 }
 
 int refdb_add_marker(halal_refdb_t *db, const char *marker_id,
                      const char *primer_f, const char *primer_r) {
-    if (db->n_markers >= HS_MAX_MARKERS) return -1;
     int idx = db->n_markers;
+    size_t n = (size_t)idx + 1;
+    db->marker_ids = (char (*)[16])hs_realloc(db->marker_ids, n * sizeof(*db->marker_ids));
+    db->primer_f = (char (*)[HS_MAX_PRIMER_LEN])hs_realloc(db->primer_f, n * sizeof(*db->primer_f));
+    db->primer_r = (char (*)[HS_MAX_PRIMER_LEN])hs_realloc(db->primer_r, n * sizeof(*db->primer_r));
+    memset(db->marker_ids[idx], 0, sizeof(db->marker_ids[idx]));
+    memset(db->primer_f[idx], 0, sizeof(db->primer_f[idx]));
+    memset(db->primer_r[idx], 0, sizeof(db->primer_r[idx]));
     strncpy(db->marker_ids[idx], marker_id, 15);
     if (primer_f) strncpy(db->primer_f[idx], primer_f, HS_MAX_PRIMER_LEN - 1);
     if (primer_r) strncpy(db->primer_r[idx], primer_r, HS_MAX_PRIMER_LEN - 1);
     db->n_markers++;
+    refdb_reindex(db);
     return idx;
 }
 
@@ -64,9 +101,31 @@ int refdb_add_marker_ref(halal_refdb_t *db, int species_idx, int marker_idx,
     db->markers[idx].seq_len = seq_len;
     db->markers[idx].amplicon_length = seq_len;
     db->n_marker_refs++;
+    int cell = species_idx * db->n_markers + marker_idx;
+    if (db->ref_slot[cell] == 0) {
+        db->ref_slot[cell] = idx + 1;
+        db->amp_lens[cell] = seq_len;
+    }
     return idx;
 }
 
+int refdb_remove_species(halal_refdb_t *db, int species_idx) {
+    if (species_idx < 0 || species_idx >= db->n_species) return -1;
+    memmove(&db->species[species_idx], &db->species[species_idx + 1],
+            (size_t)(db->n_species - species_idx - 1) * sizeof(species_info_t));
+    db->n_species--;
+    int n = 0;
+    for (int i = 0; i < db->n_marker_refs; i++) {
+        marker_ref_t mr = db->markers[i];
+        if (mr.species_idx == species_idx) { free(mr.sequence); continue; }
+        if (mr.species_idx > species_idx) mr.species_idx--;
+        db->markers[n++] = mr;
+    }
+    db->n_marker_refs = n;
+    refdb_reindex(db);
+    return 0;
+}
+
 int refdb_find_species(const halal_refdb_t *db, const char *species_id) {
     for (int i = 0; i < db->n_species; i++)
         if (strcmp(db->species[i].species_id, species_id) == 0) return i;
@@ -80,12 +139,10 @@ int refdb_find_marker(const halal_refdb_t *db, const char *marker_id) {
 }
 
 marker_ref_t *refdb_get_marker_ref(const halal_refdb_t *db, int species_idx, int marker_idx) {
-    for (int i = 0; i < db->n_marker_refs; i++) {
-        if (db->markers[i].species_idx == species_idx &&
-            db->markers[i].marker_idx == marker_idx)
-            return &db->markers[i];
-    }
-    return NULL;
+    if (species_idx < 0 || species_idx >= db->n_species ||
+        marker_idx < 0 || marker_idx >= db->n_markers) return NULL;
+    int slot = db->ref_slot[species_idx * db->n_markers + marker_idx];
+    return slot > 0 ? &db->markers[slot - 1] : NULL;
 }
 
 /* --- Serialization --- */
@@ -103,9 +160,9 @@ int refdb_save(const halal_refdb_t *db, const char *path) {
 
     /* Markers metadata */
     fwrite(&db->n_markers, sizeof(int), 1, fp);
-    fwrite(db->marker_ids, sizeof(db->marker_ids), 1, fp);
-    fwrite(db->primer_f, sizeof(db->primer_f), 1, fp);
-    fwrite(db->primer_r, sizeof(db->primer_r), 1, fp);
+    fwrite(db->marker_ids, sizeof(*db->marker_ids), (size_t)db->n_markers, fp);
+    fwrite(db->primer_f, sizeof(*db->primer_f), (size_t)db->n_markers, fp);
+    fwrite(db->primer_r, sizeof(*db->primer_r), (size_t)db->n_markers, fp);
 
     /* Marker references */
     fwrite(&db->n_marker_refs, sizeof(int), 1, fp);
@@ -127,18 +184,36 @@ halal_refdb_t *refdb_load(const char *path) {
     if (!fp) return NULL;
     uint32_t magic, version;
     if (fread(&magic, 4, 1, fp) != 1 || magic != REFDB_MAGIC) { fclose(fp); return NULL; }
-    if (fread(&version, 4, 1, fp) != 1 || version != REFDB_VERSION) { fclose(fp); return NULL; }
+    if (fread(&version, 4, 1, fp) != 1 || (version != REFDB_VERSION && version != 1)) {
+        fclose(fp);
+        return NULL;
+    }
 
     halal_refdb_t *db = refdb_create();
 
-    fread(&db->n_species, sizeof(int), 1, fp);
-    db->species = (species_info_t *)hs_malloc((size_t)db->n_species * sizeof(species_info_t));
-    fread(db->species, sizeof(species_info_t), (size_t)db->n_species, fp);
-
-    fread(&db->n_markers, sizeof(int), 1, fp);
-    fread(db->marker_ids, sizeof(db->marker_ids), 1, fp);
-    fread(db->primer_f, sizeof(db->primer_f), 1, fp);
-    fread(db->primer_r, sizeof(db->primer_r), 1, fp);
+    int S = 0, M = 0;
+    fread(&S, sizeof(int), 1, fp);
+    if (S < 0) { fclose(fp); refdb_destroy(db); return NULL; }
+    db->n_species = S;
+    db->species = (species_info_t *)hs_calloc((size_t)S > 0 ? (size_t)S : 1,
+                                              sizeof(species_info_t));
+    fread(db->species, sizeof(species_info_t), (size_t)S, fp);
+
+    fread(&M, sizeof(int), 1, fp);
+    if (M < 0 || (version == 1 && M > HS_LEGACY_MARKER_SLOTS)) {
+        fclose(fp);
+        refdb_destroy(db);
+        return NULL;
+    }
+    refdb_alloc_markers(db, M);
+    /* v1 always stores the full fixed-size tables; skip the unused slots */
+    long unused = version == 1 ? HS_LEGACY_MARKER_SLOTS - M : 0;
+    fread(db->marker_ids, sizeof(*db->marker_ids), (size_t)M, fp);
+    fseek(fp, unused * (long)sizeof(*db->marker_ids), SEEK_CUR);
+    fread(db->primer_f, sizeof(*db->primer_f), (size_t)M, fp);
+    fseek(fp, unused * (long)sizeof(*db->primer_f), SEEK_CUR);
+    fread(db->primer_r, sizeof(*db->primer_r), (size_t)M, fp);
+    fseek(fp, unused * (long)sizeof(*db->primer_r), SEEK_CUR);
 
     fread(&db->n_marker_refs, sizeof(int), 1, fp);
     db->markers = (marker_ref_t *)hs_malloc((size_t)db->n_marker_refs * sizeof(marker_ref_t));
@@ -154,6 +229,7 @@ halal_refdb_t *refdb_load(const char *path) {
 
     fread(&db->threshold_wpw, sizeof(double), 1, fp);
     fclose(fp);
+    refdb_reindex(db);
     return db;
 }
 
@@ -163,6 +239,11 @@ void refdb_destroy(halal_refdb_t *db) {
     for (int i = 0; i < db->n_marker_refs; i++)
         free(db->markers[i].sequence);
     free(db->markers);
+    free(db->marker_ids);
+    free(db->primer_f);
+    free(db->primer_r);
+    free(db->ref_slot);
+    free(db->amp_lens);
     free(db);
 }
 
@@ -4,10 +4,10 @@
 #include <stdio.h>
 #include <stdint.h>
 
-#define HS_MAX_SPECIES  64
-#define HS_MAX_MARKERS  8
 #define HS_MAX_NAME_LEN 64
 #define HS_MAX_PRIMER_LEN 64
+/* Marker tables in refdb v1 and index v2 files have this many fixed slots */
+#define HS_LEGACY_MARKER_SLOTS 8
 
 typedef enum { HALAL = 0, HARAM = 1, MASHBOOH = 2, HS_STATUS_UNKNOWN = 3 } halal_status_t;
 
@@ -33,10 +33,12 @@ typedef struct {
     marker_ref_t *markers;   /* n_species * n_markers entries (row-major by species) */
     int n_markers;
     int n_marker_refs;       /* actual number of marker_ref entries */
-    char marker_ids[HS_MAX_MARKERS][16];
-    char primer_f[HS_MAX_MARKERS][HS_MAX_PRIMER_LEN];
-    char primer_r[HS_MAX_MARKERS][HS_MAX_PRIMER_LEN];
+    char (*marker_ids)[16];                 /* [n_markers] */
+    char (*primer_f)[HS_MAX_PRIMER_LEN];    /* [n_markers] */
+    char (*primer_r)[HS_MAX_PRIMER_LEN];    /* [n_markers] */
     double threshold_wpw;
+    int *ref_slot;           /* [n_species * n_markers] markers[] index + 1 (0 = none) */
+    int *amp_lens;           /* [n_species * n_markers] amplicon lengths (0 = no ref) */
 } halal_refdb_t;
 
 /* Build reference database from a species TSV and FASTA directory */
@@ -48,6 +50,8 @@ int refdb_add_marker(halal_refdb_t *db, const char *marker_id,
                      const char *primer_f, const char *primer_r);
 int refdb_add_marker_ref(halal_refdb_t *db, int species_idx, int marker_idx,
                          const char *sequence, int seq_len);
+/* Drop a species and its marker refs; later species shift down by one */
+int refdb_remove_species(halal_refdb_t *db, int species_idx);
 
 /* Serialization */
 int refdb_save(const halal_refdb_t *db, const char *path);
@@ -58,6 +62,13 @@ void refdb_destroy(halal_refdb_t *db);
 int refdb_find_species(const halal_refdb_t *db, const char *species_id);
 int refdb_find_marker(const halal_refdb_t *db, const char *marker_id);
 marker_ref_t *refdb_get_marker_ref(const halal_refdb_t *db, int species_idx, int marker_idx);
+
+/* Set n_markers and allocate zeroed marker_ids/primer tables for it;
+ * for loaders that fill the tables directly */
+void refdb_alloc_markers(halal_refdb_t *db, int n_markers);
+/* Rebuild ref_slot and amp_lens from markers[]; loaders that fill
+ * markers[] directly call this once they are done */
+void refdb_reindex(halal_refdb_t *db);
 const char *halal_status_str(halal_status_t s);
 
 /* Build a default database with built-in halal food species */
@@ -14,57 +14,71 @@ const char *verdict_str(verdict_t v) {
 
 halal_report_t *report_generate(const em_result_t *em,
                                  const halal_refdb_t *db,
-                                 const read_result_t *classifications,
-                                 int n_reads, double threshold) {
+                                 const classify_results_t *classifications,
+                                 double threshold) {
+    classify_summary_t summary;
+    classify_summary_init(&summary, db->n_species, db->n_markers);
+    classify_summary_add(&summary, classifications, NULL);
+    halal_report_t *r = report_generate_summary(em, db, &summary, threshold);
+    classify_summary_free(&summary);
+    return r;
+}
+
+halal_report_t *report_generate_summary(const em_result_t *em,
+                                         const halal_refdb_t *db,
+                                         const classify_summary_t *summary,
+                                         double threshold) {
     halal_report_t *r = (halal_report_t *)hs_calloc(1, sizeof(halal_report_t));
     strncpy(r->sample_id, "sample", sizeof(r->sample_id) - 1);
     r->threshold_wpw = threshold;
-    r->total_reads = n_reads;
+    r->total_reads = summary->total_reads;
     r->degradation_lambda = em->lambda_proc;
-    r->n_species = em->n_species < HS_MAX_SPECIES ? em->n_species : HS_MAX_SPECIES;
-
-    /* Count classified reads and per-species/marker counts */
-    int classified = 0;
-    for (int i = 0; i < n_reads; i++) {
-        if (!classifications[i].is_classified) continue;
-        classified++;
-        for (int j = 0; j < classifications[i].n_hits; j++) {
-            int s = classifications[i].hits[j].species_idx;
-            int m = classifications[i].marker_idx;
-            if (s >= 0 && s < r->n_species && m >= 0 && m < HS_MAX_MARKERS)
-                r->species[s].read_counts[m]++;
-        }
-    }
+    r->n_markers = db->n_markers;
+    int S = em->n_species < db->n_species ? em->n_species : db->n_species;
+    int M = r->n_markers;
+    int classified = summary->classified_reads;
     r->classified_reads = classified;
+    r->species = (species_report_t *)hs_calloc(S > 0 ? (size_t)S : 1,
+                                               sizeof(species_report_t));
 
-    /* Fill species info */
+    /* Fill species info; species with neither weight nor reads are left out */
     int n_haram_detected = 0;
     int n_mashbooh_detected = 0;
-    for (int s = 0; s < r->n_species; s++) {
-        strncpy(r->species[s].species_id, db->species[s].species_id, HS_MAX_NAME_LEN - 1);
-        r->species[s].halal_status = db->species[s].status;
-        r->species[s].weight_pct = em->w[s] * 100.0;
-        r->species[s].ci_lo = em->w_ci_lo[s] * 100.0;
-        r->species[s].ci_hi = em->w_ci_hi[s] * 100.0;
-
-        /* Raw read proportion */
-        int total_hits = 0;
-        for (int m = 0; m < HS_MAX_MARKERS; m++) total_hits += r->species[s].read_counts[m];
-        r->species[s].read_pct = classified > 0 ? 100.0 * total_hits / classified : 0.0;
-
+    for (int s = 0; s < S; s++) {
         /* Check halal status */
         if (em->w[s] >= threshold) {
             if (db->species[s].status == HARAM) n_haram_detected++;
             if (db->species[s].status == MASHBOOH) n_mashbooh_detected++;
         }
+
+        const int *counts = s < summary->n_species && M <= summary->n_markers
+                          ? summary->per_species_marker + (size_t)s * summary->n_markers
+                          : NULL;
+        int total_hits = 0;
+        if (counts)
+            for (int m = 0; m < M; m++) total_hits += counts[m];
+        if (em->w[s] <= 0.0 && total_hits == 0) continue;
+
+        species_report_t *sp = &r->species[r->n_species++];
+        sp->species_idx = s;
+        snprintf(sp->species_id, sizeof(sp->species_id), "%s", db->species[s].species_id);
+        sp->halal_status = db->species[s].status;
+        sp->weight_pct = em->w[s] * 100.0;
+        sp->ci_lo = em->w_ci_lo[s] * 100.0;
+        sp->ci_hi = em->w_ci_hi[s] * 100.0;
+        sp->read_counts = (int *)hs_calloc(M > 0 ? (size_t)M : 1, sizeof(int));
+        if (counts) memcpy(sp->read_counts, counts, (size_t)M * sizeof(int));
+
+        /* Raw read proportion */
+        sp->read_pct = classified > 0 ? 100.0 * total_hits / classified : 0.0;
     }
 
     /* Cross-marker agreement: measure consistency of species ranking across markers */
     double agreement = 1.0;
-    if (db->n_markers >= 2) {
+    if (M >= 2) {
         int agree = 0, total_pairs = 0;
-        for (int m1 = 0; m1 < db->n_markers; m1++) {
-            for (int m2 = m1 + 1; m2 < db->n_markers; m2++) {
+        for (int m1 = 0; m1 < M; m1++) {
+            for (int m2 = m1 + 1; m2 < M; m2++) {
                 /* Check if top species is consistent */
                 int top1 = -1, top2 = -1;
                 int max1 = 0, max2 = 0;
@@ -90,7 +104,7 @@ halal_report_t *report_generate(const em_result_t *em,
     if (n_haram_detected > 0) {
         r->verdict = FAIL;
     } else if (n_mashbooh_detected > 0 || agreement < 0.5 ||
-               classified < n_reads / 10) {
+               classified < r->total_reads / 10) {
         r->verdict = INCONCLUSIVE;
     } else {
         r->verdict = PASS;
@@ -139,6 +153,30 @@ void report_print_tsv(const halal_report_t *r, FILE *out) {
     }
 }
 
+void report_print_json_batch(halal_report_t *const *reports, int n, FILE *out) {
+    fprintf(out, "[\n");
+    for (int i = 0; i < n; i++) {
+        if (i > 0) fprintf(out, ",\n");
+        report_print_json(reports[i], out);
+    }
+    fprintf(out, "]\n");
+}
+
+void report_print_tsv_batch(halal_report_t *const *reports, int n, FILE *out) {
+    fprintf(out, "sample_id\tverdict\tspecies\thalal_status\tweight_pct\tci_lo\tci_hi\tread_pct\n");
+    for (int i = 0; i < n; i++) {
+        const halal_report_t *r = reports[i];
+        for (int s = 0; s < r->n_species; s++) {
+            const species_report_t *sp = &r->species[s];
+            if (sp->weight_pct < 0.01 && sp->read_pct < 0.01) continue;
+            fprintf(out, "%s\t%s\t%s\t%s\t%.4f\t%.4f\t%.4f\t%.4f\n",
+                    r->sample_id, verdict_str(r->verdict),
+                    sp->species_id, halal_status_str(sp->halal_status),
+                    sp->weight_pct, sp->ci_lo, sp->ci_hi, sp->read_pct);
+        }
+    }
+}
+
 void report_print_summary(const halal_report_t *r, FILE *out) {
     fprintf(out, "========================================\n");
     fprintf(out, "  HalalSeq Report: %s\n", r->sample_id);
@@ -161,6 +199,15 @@ void report_print_summary(const halal_report_t *r, FILE *out) {
     fprintf(out, "========================================\n");
 }
 
+const species_report_t *report_find_species(const halal_report_t *r, int species_idx) {
+    for (int i = 0; i < r->n_species; i++)
+        if (r->species[i].species_idx == species_idx) return &r->species[i];
+    return NULL;
+}
+
 void report_destroy(halal_report_t *r) {
+    if (!r) return;
+    for (int i = 0; i < r->n_species; i++) free(r->species[i].read_counts);
+    free(r->species);
     free(r);
 }
@@ -9,19 +9,21 @@
 typedef enum { PASS = 0, FAIL = 1, INCONCLUSIVE = 2 } verdict_t;
 
 typedef struct {
+    int species_idx;           /* Index into the reference database */
     char species_id[HS_MAX_NAME_LEN];
     halal_status_t halal_status;
     double weight_pct;         /* w/w% */
     double ci_lo, ci_hi;       /* 95% CI */
     double read_pct;           /* Raw read proportion */
-    int read_counts[HS_MAX_MARKERS]; /* Per-marker read counts */
+    int *read_counts;          /* [n_markers] per-marker read counts */
 } species_report_t;
 
 typedef struct {
     char sample_id[256];
     verdict_t verdict;
-    species_report_t species[HS_MAX_SPECIES];
+    species_report_t *species; /* Only species with weight or reads, in db order */
     int n_species;
+    int n_markers;
     int total_reads;
     int classified_reads;
     double degradation_lambda;
@@ -32,14 +34,28 @@ typedef struct {
 /* Generate report from EM results */
 halal_report_t *report_generate(const em_result_t *em,
                                  const halal_refdb_t *db,
-                                 const read_result_t *classifications,
-                                 int n_reads, double threshold);
+                                 const classify_results_t *classifications,
+                                 double threshold);
+
+/* Same, from accumulated read tallies (streaming pipeline) */
+halal_report_t *report_generate_summary(const em_result_t *em,
+                                         const halal_refdb_t *db,
+                                         const classify_summary_t *summary,
+                                         double threshold);
 
 /* Output formats */
 void report_print_json(const halal_report_t *r, FILE *out);
 void report_print_tsv(const halal_report_t *r, FILE *out);
 void report_print_summary(const halal_report_t *r, FILE *out);
 
+/* Several samples in one document: a JSON array of report objects, or a
+ * TSV table with a leading sample_id column */
+void report_print_json_batch(halal_report_t *const *reports, int n, FILE *out);
+void report_print_tsv_batch(halal_report_t *const *reports, int n, FILE *out);
+
+/* Entry for database species species_idx, or NULL if it was dropped */
+const species_report_t *report_find_species(const halal_report_t *r, int species_idx);
+
 void report_destroy(halal_report_t *r);
 
 const char *verdict_str(verdict_t v);
@@ -0,0 +1,410 @@
+/* POSIX interfaces (fdopen, strtok_r, S_ISSOCK) under any -std */
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
+#include "serve.h"
+#include "pipeline.h"
+#include "utils.h"
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SERVE_MAX_LINE 4096
+#define SERVE_DEFAULT_JOBS 4
+#define SERVE_DEFAULT_IDLE_MS 30000
+
+typedef struct {
+    const serve_config_t *cfg;
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+    int active;                    /* running jobs */
+    int stop;                      /* set by a shutdown request */
+} serve_state_t;
+
+typedef struct {
+    serve_state_t *st;
+    int fd;
+} serve_job_t;
+
+/* --- Socket I/O --- */
+
+static int write_all(int fd, const char *buf, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, buf, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return -1;
+        buf += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+/* One byte at a time, so whatever follows the line is left unread for
+ * the reads parser */
+static int read_line(int fd, char *buf, int cap) {
+    int n = 0;
+    while (n < cap - 1) {
+        char ch;
+        ssize_t r = read(fd, &ch, 1);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        if (ch == '\n') { buf[n] = '\0'; return n; }
+        buf[n++] = ch;
+    }
+    buf[n] = '\0';
+    return n > 0 ? n : -1;
+}
+
+/* Append s to buf[n..] as the inside of a JSON string, stopping short of
+ * cap - 8; returns the new length */
+static int put_escaped(char *buf, int n, int cap, const char *s) {
+    for (const char *p = s; *p && n < cap - 8; p++) {
+        if (*p == '"' || *p == '\\') buf[n++] = '\\';
+        buf[n++] = (unsigned char)*p < 0x20 ? ' ' : *p;
+    }
+    return n;
+}
+
+static void reply_error(int fd, const char *msg) {
+    char buf[SERVE_MAX_LINE + 64];
+    int n = snprintf(buf, sizeof(buf), "{\"error\": \"");
+    n = put_escaped(buf, n, (int)sizeof(buf), msg);
+    n += snprintf(buf + n, sizeof(buf) - (size_t)n, "\"}\n");
+    write_all(fd, buf, (size_t)n);
+}
+
+/* --- Jobs --- */
+
+typedef struct {
+    const serve_index_t *index;
+    const char *mate_path;         /* points into the request line */
+    char sample_id[256];
+    int nanopore, degradation, advanced, squarem, max_hits;
+    double threshold, prune, eq_step;
+} serve_opts_t;
+
+/* Parse the OPTION tokens of a request (tok, then the rest of save);
+ * returns 0 or -1 with err set */
+static int parse_job_opts(const serve_config_t *cfg, char *tok, char **save, serve_opts_t *o,
+                          char *err, size_t err_len) {
+    memset(o, 0, sizeof(*o));
+    o->index = &cfg->indexes[0];
+    o->threshold = 0.001;
+    snprintf(o->sample_id, sizeof(o->sample_id), "sample");
+    for (; tok; tok = strtok_r(NULL, " \t", save)) {
+        char *eq = strchr(tok, '=');
+        const char *val = eq ? eq + 1 : "";
+        if (eq) *eq = '\0';
+        if (strcmp(tok, "index") == 0) {
+            o->index = NULL;
+            for (int i = 0; i < cfg->n_indexes; i++)
+                if (strcmp(cfg->indexes[i].name, val) == 0) o->index = &cfg->indexes[i];
+            if (!o->index) { snprintf(err, err_len, "unknown index %s", val); return -1; }
+        } else if (strcmp(tok, "sample") == 0) {
+            snprintf(o->sample_id, sizeof(o->sample_id), "%s", val);
+        } else if (strcmp(tok, "mate") == 0) {
+            o->mate_path = val;
+        } else if (strcmp(tok, "nanopore") == 0) {
+            o->nanopore = 1;
+        } else if (strcmp(tok, "degradation") == 0) {
+            o->degradation = 1;
+        } else if (strcmp(tok, "advanced") == 0) {
+            o->advanced = 1;
+        } else if (strcmp(tok, "squarem") == 0) {
+            o->squarem = 1;
+        } else if (strcmp(tok, "threshold") == 0) {
+            o->threshold = atof(val);
+        } else if (strcmp(tok, "prune") == 0) {
+            o->prune = atof(val);
+        } else if (strcmp(tok, "eq-step") == 0) {
+            o->eq_step = atof(val);
+        } else if (strcmp(tok, "max-hits") == 0) {
+            o->max_hits = atoi(val);
+        } else {
+            snprintf(err, err_len, "unknown option %s", tok);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Classify sf and write the JSON report to fd */
+static void run_job(const serve_config_t *cfg, int fd, hs_seqfile_t *sf,
+                    const serve_opts_t *o) {
+    double t0 = hs_clock_ms();
+    const halal_index_t *idx = o->index->idx;
+    classify_opts_t copts = o->nanopore ? classify_opts_nanopore() : classify_opts_default();
+    copts.n_threads = cfg->job_threads;
+    copts.eq_class_step = o->eq_step;
+    copts.max_hits = o->max_hits;
+    em_config_t ecfg = em_config_default();
+    ecfg.n_threads = cfg->job_threads;
+    ecfg.estimate_degradation = o->degradation;
+    ecfg.prune_threshold = o->prune;
+    ecfg.use_squarem = o->squarem;
+    if (o->advanced) {
+        ecfg.use_advanced_ci = 1;
+        ecfg.use_brent_lambda = 1;
+        ecfg.use_full_lrt = 1;
+    }
+
+    em_read_t *reads; int n;
+    classify_summary_t summary;
+    pipeline_classify_stream(idx, sf, &copts, HS_STREAM_BATCH, &reads, &n,
+                             &summary, NULL, NULL);
+    halal_report_t *report = pipeline_quantify(idx, reads, n, &summary, &ecfg, o->threshold);
+    snprintf(report->sample_id, sizeof(report->sample_id), "%s", o->sample_id);
+
+    int out_fd = dup(fd);
+    FILE *out = out_fd >= 0 ? fdopen(out_fd, "w") : NULL;
+    if (out) {
+        report_print_json(report, out);
+        fclose(out);
+    } else if (out_fd >= 0) {
+        close(out_fd);
+    }
+    HS_LOG_INFO("Job %s: %d reads, %s in %.1f ms", o->sample_id, summary.total_reads,
+                verdict_str(report->verdict), hs_clock_ms() - t0);
+    report_destroy(report);
+    classify_summary_free(&summary);
+}
+
+static void handle_job(serve_state_t *st, int fd) {
+    const serve_config_t *cfg = st->cfg;
+    char line[SERVE_MAX_LINE], err[SERVE_MAX_LINE + 64];
+    if (read_line(fd, line, sizeof(line)) < 0) return;
+    /* Jobs run concurrently: strtok's hidden position would be shared */
+    char *save = NULL;
+    char *verb = strtok_r(line, " \t\r", &save);
+    if (!verb) { reply_error(fd, "empty request"); return; }
+
+    if (strcmp(verb, "ping") == 0) {
+        char buf[SERVE_MAX_LINE];
+        int len = snprintf(buf, sizeof(buf), "{\"status\": \"ok\", \"indexes\": [");
+        for (int i = 0; i < cfg->n_indexes && len < (int)sizeof(buf) - 160; i++) {
+            len += snprintf(buf + len, sizeof(buf) - (size_t)len, "%s\"", i ? ", " : "");
+            len = put_escaped(buf, len, (int)sizeof(buf), cfg->indexes[i].name);
+            buf[len++] = '"';
+        }
+        len += snprintf(buf + len, sizeof(buf) - (size_t)len, "]}\n");
+        write_all(fd, buf, (size_t)len);
+        return;
+    }
+    if (strcmp(verb, "shutdown") == 0) {
+        pthread_mutex_lock(&st->lock);
+        st->stop = 1;
+        pthread_mutex_unlock(&st->lock);
+        static const char msg[] = "{\"status\": \"shutting down\"}\n";
+        write_all(fd, msg, sizeof(msg) - 1);
+        return;
+    }
+
+    int is_run = strcmp(verb, "run") == 0;
+    if (!is_run && strcmp(verb, "reads") != 0) {
+        snprintf(err, sizeof(err), "unknown request %s", verb);
+        reply_error(fd, err);
+        return;
+    }
+    char *path = is_run ? strtok_r(NULL, " \t\r", &save) : NULL;
+    if (is_run && !path) { reply_error(fd, "run needs a reads path"); return; }
+    serve_opts_t o;
+    if (parse_job_opts(cfg, strtok_r(NULL, " \t\r", &save), &save, &o, err, sizeof(err)) < 0) {
+        reply_error(fd, err);
+        return;
+    }
+
+    if (!is_run && o.mate_path) { reply_error(fd, "mate= needs a run request"); return; }
+    hs_seqfile_t *sf = NULL;
+    if (is_run) {
+        sf = o.mate_path ? hs_seqfile_open_paired(path, o.mate_path) : hs_seqfile_open(path);
+    } else {
+        int in_fd = dup(fd);
+        sf = in_fd >= 0 ? hs_seqfile_open_fd(in_fd) : NULL;
+        if (!sf && in_fd >= 0) close(in_fd);
+    }
+    if (!sf) {
+        snprintf(err, sizeof(err), "cannot read %s", is_run ? path : "uploaded reads");
+        reply_error(fd, err);
+        return;
+    }
+    run_job(cfg, fd, sf, &o);
+    hs_seqfile_close(sf);
+}
+
+static void *job_thread(void *arg) {
+    serve_job_t *job = (serve_job_t *)arg;
+    serve_state_t *st = job->st;
+    int fd = job->fd;
+    handle_job(st, fd);
+    free(job);
+    /* Free the slot before the client sees EOF, so its next request is
+     * not turned away as busy */
+    pthread_mutex_lock(&st->lock);
+    st->active--;
+    pthread_cond_broadcast(&st->idle);
+    pthread_mutex_unlock(&st->lock);
+    close(fd);
+    return NULL;
+}
+
+/* --- Server --- */
+
+int serve_run(const serve_config_t *cfg) {
+    if (cfg->n_indexes < 1) return -1;
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(cfg->socket_path) >= sizeof(addr.sun_path)) {
+        HS_LOG_ERROR("Socket path too long: %s", cfg->socket_path);
+        return -1;
+    }
+    memcpy(addr.sun_path, cfg->socket_path, strlen(cfg->socket_path) + 1);
+
+    /* Replace a stale socket from an earlier run, but nothing else */
+    struct stat sb;
+    if (stat(cfg->socket_path, &sb) == 0 && S_ISSOCK(sb.st_mode))
+        unlink(cfg->socket_path);
+
+    /* Owner-only before listen(), since run PATH reads files with the
+     * server's privileges; nobody can connect until listen() */
+    int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) return -1;
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        chmod(cfg->socket_path, S_IRUSR | S_IWUSR) != 0 || listen(lfd, 64) != 0) {
+        HS_LOG_ERROR("Cannot listen on %s: %s", cfg->socket_path, strerror(errno));
+        close(lfd);
+        return -1;
+    }
+    signal(SIGPIPE, SIG_IGN);      /* a client that hangs up fails its own job only */
+
+    serve_state_t st;
+    memset(&st, 0, sizeof(st));
+    st.cfg = cfg;
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.idle, NULL);
+    int max_jobs = cfg->max_jobs > 0 ? cfg->max_jobs : SERVE_DEFAULT_JOBS;
+    int idle_ms = cfg->idle_timeout_ms > 0 ? cfg->idle_timeout_ms : SERVE_DEFAULT_IDLE_MS;
+    struct timeval idle = { idle_ms / 1000, (idle_ms % 1000) * 1000 };
+    HS_LOG_INFO("Serving %d index(es) on %s (%d concurrent jobs)",
+                cfg->n_indexes, cfg->socket_path, max_jobs);
+
+    /* Poll with a timeout so a shutdown request is noticed promptly */
+    for (;;) {
+        pthread_mutex_lock(&st.lock);
+        int stop = st.stop;
+        pthread_mutex_unlock(&st.lock);
+        if (stop) break;
+        struct pollfd pfd = { lfd, POLLIN, 0 };
+        if (poll(&pfd, 1, 200) <= 0) continue;
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) continue;
+        /* A client that stops sending or reading loses its job instead of
+         * holding a slot for good */
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &idle, sizeof(idle));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &idle, sizeof(idle));
+
+        /* Full: turn the client away rather than stop accepting, so a
+         * shutdown request still gets through once a slot frees */
+        pthread_mutex_lock(&st.lock);
+        int busy = st.active >= max_jobs;
+        if (!busy) st.active++;
+        pthread_mutex_unlock(&st.lock);
+        if (busy) {
+            reply_error(fd, "busy");
+            close(fd);
+            continue;
+        }
+
+        serve_job_t *job = (serve_job_t *)hs_malloc(sizeof(serve_job_t));
+        job->st = &st;
+        job->fd = fd;
+        pthread_t th;
+        if (pthread_create(&th, NULL, job_thread, job) != 0) {
+            job_thread(job);       /* run inline rather than drop the job */
+        } else {
+            pthread_detach(th);
+        }
+    }
+
+    close(lfd);
+    pthread_mutex_lock(&st.lock);
+    while (st.active > 0) pthread_cond_wait(&st.idle, &st.lock);
+    pthread_mutex_unlock(&st.lock);
+    pthread_cond_destroy(&st.idle);
+    pthread_mutex_destroy(&st.lock);
+    unlink(cfg->socket_path);
+    HS_LOG_INFO("Server stopped");
+    return 0;
+}
+
+/* --- Client --- */
+
+int serve_query(const char *socket_path, const char *request,
+                const char *upload_path, FILE *out) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) return -1;
+    memcpy(addr.sun_path, socket_path, strlen(socket_path) + 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    /* A busy server or a refused request is answered and closed before
+     * everything sent is read: stop sending, and still read the reply */
+    int ok = 1;
+    int sent = write_all(fd, request, strlen(request)) == 0 && write_all(fd, "\n", 1) == 0;
+    if (sent && upload_path) {
+        FILE *in = strcmp(upload_path, "-") == 0 ? stdin : fopen(upload_path, "rb");
+        ok = in != NULL;
+        char buf[65536];
+        size_t n;
+        while (ok && (n = fread(buf, 1, sizeof(buf), in)) > 0)
+            if (write_all(fd, buf, n) != 0) break;
+        if (in && in != stdin) fclose(in);
+    }
+    shutdown(fd, SHUT_WR);
+
+    size_t total = 0;
+    char buf[65536];
+    ssize_t r;
+    while ((r = read(fd, buf, sizeof(buf))) != 0) {
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        fwrite(buf, 1, (size_t)r, out);
+        total += (size_t)r;
+    }
+    close(fd);
+    return ok && total > 0 ? 0 : -1;
+}
+
+#else /* _WIN32 */
+
+int serve_run(const serve_config_t *cfg) {
+    (void)cfg;
+    HS_LOG_ERROR("serve needs Unix-domain sockets, unavailable on this platform");
+    return -1;
+}
+
+int serve_query(const char *socket_path, const char *request,
+                const char *upload_path, FILE *out) {
+    (void)socket_path; (void)request; (void)upload_path; (void)out;
+    return -1;
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef HALALSEQ_SERVE_H
+#define HALALSEQ_SERVE_H
+
+#include "index.h"
+#include <stdio.h>
+
+/* --- Resident analysis service ---
+ * Keeps indexes loaded and answers jobs over a Unix-domain stream socket,
+ * one job per connection, several connections at once.  A job is one
+ * request line, optionally followed by reads:
+ *
+ *   run PATH [OPTION ...]    classify a FASTA/FASTQ file readable by the server
+ *   reads [OPTION ...]       classify the reads that follow the request line
+ *                            (FASTA/FASTQ, optionally gzipped) until the
+ *                            client shuts down its write side
+ *   ping                     list the resident indexes
+ *   shutdown                 stop accepting jobs, finish running ones, exit
+ *
+ * OPTIONs: index=NAME (default: the first index), sample=ID, mate=PATH
+ * (run only: PATH and this are R1/R2 of a paired-end run), nanopore,
+ * threshold=F, degradation, advanced, squarem, prune=F, eq-step=F,
+ * max-hits=N.  The reply is the report_print_json() report, or
+ * {"error": "..."}, after which the server closes the connection.
+ *
+ * The socket is created owner-only (0600): run PATH reads any file the
+ * server can, so only the server's user may connect; share it by other
+ * means (a group-owned directory, a proxy) deliberately.  With max_jobs
+ * jobs running, a new connection is answered {"error": "busy"} at once,
+ * and a client that sends or reads nothing for idle_timeout_ms loses its
+ * job. */
+
+typedef struct {
+    char name[64];
+    halal_index_t *idx;            /* borrowed */
+} serve_index_t;
+
+typedef struct {
+    const char *socket_path;
+    const serve_index_t *indexes;
+    int n_indexes;
+    int max_jobs;                  /* concurrent jobs (<= 0: 4) */
+    int job_threads;               /* classification / EM threads per job */
+    int idle_timeout_ms;           /* per-connection stall limit (<= 0: 30 s) */
+} serve_config_t;
+
+/* Serve until a shutdown request; returns 0, or -1 if the socket cannot
+ * be set up (or on platforms without Unix-domain sockets) */
+int serve_run(const serve_config_t *cfg);
+
+/* Client side: send request (one line, without the newline), then the
+ * contents of upload_path if non-NULL ("-" = stdin), and copy the reply
+ * to out.  Returns 0 if a reply was received, -1 otherwise. */
+int serve_query(const char *socket_path, const char *request,
+                const char *upload_path, FILE *out);
+
+#endif /* HALALSEQ_SERVE_H */
@@ -1,29 +1,105 @@
 #include "simulate.h"
+#include "parallel.h"
 #include "utils.h"
 #include <string.h>
 #include <math.h>
+#include <zlib.h>
 
-/* Mutate a sequence with given error rate */
-static void mutate_seq(char *seq, int len, double error_rate, hs_rng_t *rng) {
-    static const char bases[] = "ACGT";
+static const char sim_bases[] = "ACGT";
+
+/* Copy len bases of src to out with sequencing errors, returning the new
+ * length (out holds 2 * len + 1).  An error substitutes the base, or with
+ * probability indel_fraction deletes it or inserts one before it. */
+static int mutate_into(const char *src, int len, const sim_config_t *config,
+                       hs_rng_t *rng, char *out) {
+    int n = 0;
     for (int i = 0; i < len; i++) {
-        if (hs_rng_uniform(rng) < error_rate) {
-            char orig = seq[i];
-            do { seq[i] = bases[hs_rng_next(rng) & 3]; } while (seq[i] == orig);
+        char b = src[i];
+        if (hs_rng_uniform(rng) < config->error_rate) {
+            if (config->indel_fraction > 0 && hs_rng_uniform(rng) < config->indel_fraction) {
+                if (hs_rng_next(rng) & 1) continue;            /* deletion */
+                out[n++] = sim_bases[hs_rng_next(rng) & 3];   /* insertion */
+            } else {
+                char orig = b;
+                do { b = sim_bases[hs_rng_next(rng) & 3]; } while (b == orig);
+            }
         }
+        out[n++] = b;
     }
+    out[n] = '\0';
+    return n;
 }
 
-/* Extract a random substring (simulating a read) */
-static char *extract_read(const char *ref, int ref_len, int read_len, hs_rng_t *rng) {
-    if (ref_len <= read_len) {
-        return hs_strdup(ref);
+/* Target length of one read: fixed, or log-normal with the configured SD */
+static int sim_read_length(const sim_config_t *config, int ref_len, hs_rng_t *rng) {
+    int len = config->read_length > 0 ? config->read_length : ref_len;
+    if (config->read_length_sd > 0) {
+        double cv = config->read_length_sd / len;
+        double sigma2 = log(1.0 + cv * cv);
+        double x = hs_rng_lognormal(rng, log((double)len) - 0.5 * sigma2, sqrt(sigma2));
+        len = x < 1.0 ? 1 : x > ref_len ? ref_len : (int)(x + 0.5);
     }
-    int start = (int)(hs_rng_uniform(rng) * (ref_len - read_len));
-    char *read = (char *)hs_malloc((size_t)read_len + 1);
-    memcpy(read, ref + start, (size_t)read_len);
-    read[read_len] = '\0';
-    return read;
+    return len;
+}
+
+/* Simulate one read from a random window of ref into out (2 * ref_len + 1
+ * bytes); returns its length */
+static int sim_read(const sim_config_t *config, const char *ref, int ref_len,
+                    hs_rng_t *rng, char *out) {
+    int read_len = sim_read_length(config, ref_len, rng);
+    int start = 0;
+    if (ref_len <= read_len) read_len = ref_len;
+    else start = (int)(hs_rng_uniform(rng) * (ref_len - read_len));
+    return mutate_into(ref + start, read_len, config, rng, out);
+}
+
+/* Per-marker species CDFs cdf[m * S + s] from p_sm ~ w[s] * d[s] * b[s,m] */
+static double *sim_marker_cdf(const sim_config_t *config, const halal_refdb_t *db, int S) {
+    int M = db->n_markers;
+    double *p = (double *)hs_calloc((size_t)(S * M), sizeof(double));
+    for (int m = 0; m < M; m++) {
+        double sum = 0.0;
+        for (int s = 0; s < S; s++) {
+            double d = (config->dna_yield && s < config->n_species) ?
+                       config->dna_yield[s] : 1.0;
+            double b = (config->pcr_bias) ? config->pcr_bias[s * M + m] : 1.0;
+            /* Check if this species has a reference for this marker */
+            marker_ref_t *mr = refdb_get_marker_ref(db, s, m);
+            if (!mr) { p[s * M + m] = 0.0; continue; }
+            p[s * M + m] = config->composition[s] * d * b;
+            sum += p[s * M + m];
+        }
+        /* Normalize per marker */
+        if (sum > 0)
+            for (int s = 0; s < S; s++) p[s * M + m] /= sum;
+    }
+
+    double *cdf = (double *)hs_calloc((size_t)(S * M > 0 ? S * M : 1), sizeof(double));
+    for (int m = 0; m < M; m++) {
+        double *c = cdf + (size_t)m * S;
+        c[0] = p[0 * M + m];
+        for (int s = 1; s < S; s++)
+            c[s] = c[s - 1] + p[s * M + m];
+    }
+    free(p);
+    return cdf;
+}
+
+static int sim_pick_species(const double *cdf, int S, hs_rng_t *rng) {
+    double u = hs_rng_uniform(rng);
+    for (int s = 0; s < S; s++)
+        if (u <= cdf[s]) return s;
+    return S - 1;
+}
+
+static int sim_max_ref_len(const halal_refdb_t *db, int S) {
+    int max_len = 0;
+    for (int s = 0; s < S; s++)
+        for (int m = 0; m < db->n_markers; m++) {
+            marker_ref_t *mr = refdb_get_marker_ref(db, s, m);
+            if (mr && mr->seq_len > max_len) max_len = mr->seq_len;
+        }
+    return max_len;
 }
 
 sim_result_t *simulate_mixture(const sim_config_t *config, const halal_refdb_t *db) {
@@ -47,51 +123,21 @@ sim_result_t *simulate_mixture(const sim_config_t *config, const halal_refdb_t *
     sr->config.composition = (double *)hs_malloc((size_t)S * sizeof(double));
     memcpy(sr->config.composition, config->composition, (size_t)S * sizeof(double));
 
-    /* Compute effective probabilities: p_sm ~ w[s] * d[s] * b[s,m] */
-    double *p = (double *)hs_calloc((size_t)(S * M), sizeof(double));
-    for (int m = 0; m < M; m++) {
-        double sum = 0.0;
-        for (int s = 0; s < S; s++) {
-            double d = (config->dna_yield && s < config->n_species) ?
-                       config->dna_yield[s] : 1.0;
-            double b = (config->pcr_bias) ? config->pcr_bias[s * M + m] : 1.0;
-            /* Check if this species has a reference for this marker */
-            marker_ref_t *mr = refdb_get_marker_ref(db, s, m);
-            if (!mr) { p[s * M + m] = 0.0; continue; }
-            p[s * M + m] = config->composition[s] * d * b;
-            sum += p[s * M + m];
-        }
-        /* Normalize per marker */
-        if (sum > 0)
-            for (int s = 0; s < S; s++) p[s * M + m] /= sum;
-    }
+    double *cdf = sim_marker_cdf(config, db, S);
+    char *buf = (char *)hs_malloc(2 * (size_t)sim_max_ref_len(db, S) + 1);
 
     /* Generate reads */
     for (int m = 0; m < M; m++) {
-        /* Build CDF for this marker */
-        double *cdf = (double *)hs_calloc((size_t)S, sizeof(double));
-        cdf[0] = p[0 * M + m];
-        for (int s = 1; s < S; s++)
-            cdf[s] = cdf[s - 1] + p[s * M + m];
-
         for (int r = 0; r < rpm; r++) {
-            /* Pick species */
-            double u = hs_rng_uniform(&rng);
-            int sp = S - 1;
-            for (int s = 0; s < S; s++) {
-                if (u <= cdf[s]) { sp = s; break; }
-            }
+            int sp = sim_pick_species(cdf + (size_t)m * S, S, &rng);
 
             /* Get reference sequence */
             marker_ref_t *mr = refdb_get_marker_ref(db, sp, m);
             if (!mr) continue; /* skip if no ref */
 
-            int rlen = config->read_length > 0 ? config->read_length : mr->seq_len;
-            char *read = extract_read(mr->sequence, mr->seq_len, rlen, &rng);
-            int actual_len = (int)strlen(read);
-
-            /* Apply sequencing errors */
-            mutate_seq(read, actual_len, config->error_rate, &rng);
+            int actual_len = sim_read(config, mr->sequence, mr->seq_len, &rng, buf);
+            char *read = (char *)hs_malloc((size_t)actual_len + 1);
+            memcpy(read, buf, (size_t)actual_len + 1);
 
             int idx = sr->n_reads;
             sr->reads[idx] = read;
@@ -100,10 +146,10 @@ sim_result_t *simulate_mixture(const sim_config_t *config, const halal_refdb_t *
             sr->true_marker[idx] = m;
             sr->n_reads++;
         }
-        free(cdf);
     }
 
-    free(p);
+    free(buf);
+    free(cdf);
     return sr;
 }
 
@@ -140,3 +186,190 @@ int sim_write_fastq(const sim_result_t *sr, const char *path) {
     if (fp != stdout) fclose(fp);
     return 0;
 }
+
+/* --- Streaming simulation --- */
+
+typedef struct {
+    char *data;
+    size_t len, cap;
+    int n_reads;
+} sim_buf_t;
+
+static char *sim_buf_reserve(sim_buf_t *b, size_t n) {
+    if (b->len + n > b->cap) {
+        b->cap = (b->len + n) * 2;
+        b->data = (char *)hs_realloc(b->data, b->cap);
+    }
+    return b->data + b->len;
+}
+
+/* BGZF member payloads stay under 0xff00 bytes, so even incompressible
+ * input (compressBound) fits the 64 KiB block limit */
+#define SIM_BGZF_PAYLOAD 0xff00
+
+static void put_le16(unsigned char *p, unsigned v) { p[0] = v & 0xff; p[1] = (v >> 8) & 0xff; }
+
+static void put_le32(unsigned char *p, uint32_t v) {
+    put_le16(p, v & 0xffff);
+    put_le16(p + 2, v >> 16);
+}
+
+/* Deflate in[0, n) at level into BGZF blocks appended to out */
+static int bgzf_compress(const char *in, size_t n, int level, sim_buf_t *out) {
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    if (deflateInit2(&zs, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) return -1;
+    int rc = 0;
+    for (size_t off = 0; off < n && rc == 0; off += SIM_BGZF_PAYLOAD) {
+        uInt piece = (uInt)(n - off < SIM_BGZF_PAYLOAD ? n - off : SIM_BGZF_PAYLOAD);
+        unsigned char *h = (unsigned char *)sim_buf_reserve(out, 18 + compressBound(piece) + 8);
+        deflateReset(&zs);
+        zs.next_in = (Bytef *)(in + off);
+        zs.avail_in = piece;
+        zs.next_out = h + 18;
+        zs.avail_out = (uInt)compressBound(piece);
+        if (deflate(&zs, Z_FINISH) != Z_STREAM_END) { rc = -1; break; }
+        size_t bsize = 18 + zs.total_out + 8;
+        static const unsigned char hdr[16] = {
+            0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0
+        };
+        memcpy(h, hdr, sizeof(hdr));
+        put_le16(h + 16, (unsigned)(bsize - 1));
+        put_le32(h + 18 + zs.total_out, crc32(0L, (const Bytef *)(in + off), piece));
+        put_le32(h + 18 + zs.total_out + 4, piece);
+        out->len += bsize;
+    }
+    deflateEnd(&zs);
+    return rc;
+}
+
+/* The empty block that ends a BGZF file */
+static const unsigned char bgzf_eof[28] = {
+    0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+    0x1b, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+typedef struct {
+    const sim_config_t *config;
+    const halal_refdb_t *db;
+    const double *cdf;          /* sim_marker_cdf() */
+    int S, rpm, total;
+    int max_ref_len;
+    int gzip_level;
+    int block0;                 /* first block of the round */
+    const hs_rng_t *rngs;       /* [round] stream of each block */
+    sim_buf_t *text;            /* [round] FASTQ of each block */
+    sim_buf_t *packed;          /* [round] its BGZF blocks (gzip_level > 0) */
+    int *failed;                /* [round] */
+} sim_stream_t;
+
+static void sim_stream_worker(void *ctx, int tid, int begin, int end) {
+    (void)tid;
+    sim_stream_t *st = (sim_stream_t *)ctx;
+    const sim_config_t *config = st->config;
+    char *seq = (char *)hs_malloc(2 * (size_t)st->max_ref_len + 1);
+    for (int i = begin; i < end; i++) {
+        hs_rng_t rng = st->rngs[i];
+        sim_buf_t *b = &st->text[i];
+        b->len = 0;
+        b->n_reads = 0;
+        int g0 = (st->block0 + i) * SIM_STREAM_BLOCK;
+        int g1 = g0 + SIM_STREAM_BLOCK < st->total ? g0 + SIM_STREAM_BLOCK : st->total;
+        for (int g = g0; g < g1; g++) {
+            int m = g / st->rpm;
+            int sp = sim_pick_species(st->cdf + (size_t)m * st->S, st->S, &rng);
+            marker_ref_t *mr = refdb_get_marker_ref(st->db, sp, m);
+            if (!mr) continue; /* skip if no ref */
+            int len = sim_read(config, mr->sequence, mr->seq_len, &rng, seq);
+
+            /* Reads are named by slot so names do not depend on blocking */
+            char *p = sim_buf_reserve(b, 64 + 2 * (size_t)len + 4);
+            p += sprintf(p, "@read_%d species=%d marker=%d\n", g, sp, m);
+            memcpy(p, seq, (size_t)len);
+            p += len;
+            memcpy(p, "\n+\n", 3);
+            p += 3;
+            /* Fake quality scores */
+            memset(p, 'I', (size_t)len);
+            p += len;
+            *p++ = '\n';
+            b->len = (size_t)(p - b->data);
+            b->n_reads++;
+        }
+        if (st->gzip_level > 0) {
+            st->packed[i].len = 0;
+            st->failed[i] = bgzf_compress(b->data, b->len, st->gzip_level, &st->packed[i]) < 0;
+        }
+    }
+    free(seq);
+}
+
+int simulate_mixture_fastq(const sim_config_t *config, const halal_refdb_t *db,
+                           const char *path, int n_threads, int gzip_level) {
+    FILE *fp;
+    if (strcmp(path, "-") == 0) {
+        fp = stdout;
+    } else {
+        fp = fopen(path, "wb");
+        if (!fp) return -1;
+    }
+
+    int S = config->n_species < db->n_species ? config->n_species : db->n_species;
+    int rpm = config->reads_per_marker > 0 ? config->reads_per_marker : 1000;
+    n_threads = hs_resolve_threads(n_threads);
+    if (gzip_level > 9) gzip_level = 9;
+
+    sim_stream_t st;
+    memset(&st, 0, sizeof(st));
+    st.config = config;
+    st.db = db;
+    st.cdf = sim_marker_cdf(config, db, S);
+    st.S = S;
+    st.rpm = rpm;
+    st.total = rpm * db->n_markers;
+    st.max_ref_len = sim_max_ref_len(db, S);
+    st.gzip_level = gzip_level;
+
+    /* A few blocks per worker per round keeps the pool busy while only
+     * one round of output is held */
+    int n_blocks = (st.total + SIM_STREAM_BLOCK - 1) / SIM_STREAM_BLOCK;
+    int round = 4 * n_threads;
+    hs_rng_t *rngs = (hs_rng_t *)hs_malloc((size_t)round * sizeof(hs_rng_t));
+    st.rngs = rngs;
+    st.text = (sim_buf_t *)hs_calloc((size_t)round, sizeof(sim_buf_t));
+    st.packed = (sim_buf_t *)hs_calloc((size_t)round, sizeof(sim_buf_t));
+    st.failed = (int *)hs_calloc((size_t)round, sizeof(int));
+
+    hs_rng_t next;
+    hs_rng_seed(&next, config->seed);
+    int n_written = 0, rc = 0;
+    for (int b0 = 0; b0 < n_blocks && rc == 0; b0 += round) {
+        int nb = n_blocks - b0 < round ? n_blocks - b0 : round;
+        for (int i = 0; i < nb; i++) {
+            rngs[i] = next;
+            hs_rng_jump(&next);
+        }
+        st.block0 = b0;
+        hs_parallel_for(nb, 1, n_threads, sim_stream_worker, &st);
+        for (int i = 0; i < nb && rc == 0; i++) {
+            const sim_buf_t *out = gzip_level > 0 ? &st.packed[i] : &st.text[i];
+            if (st.failed[i] || fwrite(out->data, 1, out->len, fp) != out->len) rc = -1;
+            n_written += st.text[i].n_reads;
+        }
+    }
+    if (rc == 0 && gzip_level > 0 && fwrite(bgzf_eof, 1, sizeof(bgzf_eof), fp) != sizeof(bgzf_eof))
+        rc = -1;
+    if (fflush(fp) != 0) rc = -1;
+
+    for (int i = 0; i < round; i++) {
+        free(st.text[i].data);
+        free(st.packed[i].data);
+    }
+    free(st.text);
+    free(st.packed);
+    free(st.failed);
+    free(rngs);
+    free((double *)st.cdf);
+    if (fp != stdout && fclose(fp) != 0) rc = -1;
+    return rc == 0 ? n_written : -1;
+}
@@ -12,7 +12,10 @@ typedef struct {
     double degradation;     /* lambda_proc */
     int reads_per_marker;
     double error_rate;      /* 0.001 Illumina, 0.05 Nanopore */
-    int read_length;
+    int read_length;        /* <= 0: the whole reference */
+    double read_length_sd;  /* 0 = fixed length, else log-normal lengths with this SD */
+    double indel_fraction;  /* share of errors that are insertions or deletions
+                               (half each; 0 = substitutions only) */
     uint64_t seed;
 } sim_config_t;
 
@@ -31,4 +34,16 @@ void sim_result_destroy(sim_result_t *sr);
 /* Write simulated reads to a FASTQ file */
 int sim_write_fastq(const sim_result_t *sr, const char *path);
 
+/* Simulate straight to a FASTQ file ("-" = stdout) without holding the
+ * reads: blocks of SIM_STREAM_BLOCK reads are simulated on n_threads
+ * workers (<= 0: all CPUs) and written in order.  Block b draws from the
+ * stream of config->seed jumped b times (hs_rng_jump), so the file does
+ * not depend on the thread count; it is not the same read set as
+ * simulate_mixture() for that seed.  gzip_level 1-9 writes BGZF, which
+ * gzip reads and the FASTQ reader inflates in parallel; 0 writes plain
+ * text.  Returns the number of reads written, -1 on a write error. */
+#define SIM_STREAM_BLOCK 4096
+int simulate_mixture_fastq(const sim_config_t *config, const halal_refdb_t *db,
+                           const char *path, int n_threads, int gzip_level);
+
 #endif /* HALALSEQ_SIMULATE_H */
@@ -1,11 +1,14 @@
 /*
  * update.c — Database auto-update implementation for HalalSeq.
  *
- * Uses system curl for HTTP, shasum / certutil for SHA-256.
+ * Uses system curl for HTTP (whole-file, resumed and ranged requests)
+ * and hashes with a built-in SHA-256 as the bytes stream past.
  * No new library dependencies.
  */
 
 #include "update.h"
+#include "index.h"
+#include "utils.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,14 +24,21 @@
   #define HS_PATH_SEP '\\'
   #define HS_TMP_DIR_ENV "TEMP"
   #define HS_TMP_FALLBACK "C:\\Temp"
+  #define HS_POPEN_READ "rb"
 #else
   #include <unistd.h>
   #define HS_MKDIR(p) mkdir(p, 0755)
   #define HS_PATH_SEP '/'
   #define HS_TMP_DIR_ENV "TMPDIR"
   #define HS_TMP_FALLBACK "/tmp"
+  #define HS_POPEN_READ "r"
 #endif
 
+/* Copy buffer for downloads and hashing */
+#define UPDATE_IO_BUF (1u << 16)
+/* Most index sections cut separately into chunks (markers + 4) */
+#define UPDATE_MAX_SECTIONS 1024
+
 /* ================================================================== */
 /* hs_update_init                                                      */
 /* ================================================================== */
@@ -37,6 +47,16 @@ void hs_update_init(hs_update_ctx_t *ctx) {
     ctx->status = HS_UPDATE_NONE;
 }
 
+void hs_manifest_free(hs_manifest_t *m) {
+    free(m->chunks);
+    m->chunks = NULL;
+    m->n_chunks = 0;
+}
+
+void hs_update_free(hs_update_ctx_t *ctx) {
+    hs_manifest_free(&ctx->manifest);
+}
+
 /* ================================================================== */
 /* hs_config_dir                                                       */
 /* ================================================================== */
@@ -82,12 +102,265 @@ int hs_update_write_local_version(const char *config_dir, uint32_t ver) {
     return 1;
 }
 
+/* ================================================================== */
+/* SHA-256 (FIPS 180-4)                                                */
+/* ================================================================== */
+static const uint32_t sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t h[8], const uint8_t *p) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++)
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 |
+               (uint32_t)p[4 * i + 2] << 8 | (uint32_t)p[4 * i + 3];
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR32(w[i - 15], 7) ^ ROR32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR32(w[i - 2], 17) ^ ROR32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+    uint32_t e = h[4], f = h[5], g = h[6], hh = h[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = hh + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) +
+                      ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        uint32_t t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) +
+                      ((a & b) ^ (a & c) ^ (b & c));
+        hh = g; g = f; f = e; e = d + t1;
+        d = c; c = b; b = a; a = t1 + t2;
+    }
+    h[0] += a; h[1] += b; h[2] += c; h[3] += d;
+    h[4] += e; h[5] += f; h[6] += g; h[7] += hh;
+}
+
+void hs_sha256_init(hs_sha256_t *c) {
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(c->h, iv, sizeof(iv));
+    c->len = 0;
+    c->n = 0;
+}
+
+void hs_sha256_update(hs_sha256_t *c, const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t *)data;
+    c->len += n;
+    if (c->n > 0) {
+        size_t take = 64 - c->n < n ? 64 - c->n : n;
+        memcpy(c->buf + c->n, p, take);
+        c->n += take; p += take; n -= take;
+        if (c->n < 64) return;
+        sha256_block(c->h, c->buf);
+        c->n = 0;
+    }
+    for (; n >= 64; p += 64, n -= 64) sha256_block(c->h, p);
+    memcpy(c->buf, p, n);
+    c->n = n;
+}
+
+void hs_sha256_final(hs_sha256_t *c, char hex[65]) {
+    uint64_t bits = c->len * 8;
+    c->buf[c->n++] = 0x80;
+    if (c->n > 56) {
+        memset(c->buf + c->n, 0, 64 - c->n);
+        sha256_block(c->h, c->buf);
+        c->n = 0;
+    }
+    memset(c->buf + c->n, 0, 56 - c->n);
+    for (int i = 0; i < 8; i++) c->buf[56 + i] = (uint8_t)(bits >> (56 - 8 * i));
+    sha256_block(c->h, c->buf);
+    for (int i = 0; i < 8; i++) snprintf(hex + 8 * i, 9, "%08x", (unsigned)c->h[i]);
+}
+
+/* Case-insensitive comparison of two 64-char hex digests */
+static int hex_equal(const char *a, const char *b) {
+    for (int i = 0; i < 64; i++)
+        if (!a[i] || !b[i] || tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+            return 0;
+    return 1;
+}
+
+static int check_digest(const char *actual, const char *expected,
+                        char *error_msg, size_t err_sz) {
+    if (hex_equal(actual, expected)) return 1;
+    snprintf(error_msg, err_sz, "SHA-256 mismatch: expected %.16s..., got %.16s...",
+             expected, actual);
+    return 0;
+}
+
+/* ================================================================== */
+/* Streaming copy                                                      */
+/* ================================================================== */
+/*
+ * Copy up to n bytes from in to out (NULL: discard), feeding them to the
+ * hashers a and b (either may be NULL).  With ctx, download progress is
+ * advanced past the bytes already counted in bytes_fetched/bytes_reused.
+ * Returns the number of bytes copied: short on EOF or a write error.
+ */
+static uint64_t pump(FILE *in, FILE *out, uint64_t n, hs_sha256_t *a, hs_sha256_t *b,
+                     uint8_t *buf, hs_update_ctx_t *ctx) {
+    uint64_t done = 0;
+    while (done < n) {
+        size_t want = n - done < UPDATE_IO_BUF ? (size_t)(n - done) : UPDATE_IO_BUF;
+        size_t got = fread(buf, 1, want, in);
+        if (got == 0) break;
+        if (out && fwrite(buf, 1, got, out) != got) break;
+        if (a) hs_sha256_update(a, buf, got);
+        if (b) hs_sha256_update(b, buf, got);
+        done += got;
+        if (ctx && ctx->manifest.size_bytes > 0) {
+            uint64_t at = ctx->bytes_fetched + ctx->bytes_reused + done;
+            if (at > ctx->manifest.size_bytes) at = ctx->manifest.size_bytes;
+            ctx->progress_pct = 10 + (int)(60 * at / ctx->manifest.size_bytes);
+        }
+    }
+    return done;
+}
+
+/* Copy one piece, checking it against its digest.  ctx (may be NULL)
+ * receives progress and the error message. */
+static int copy_piece(FILE *in, FILE *out, const hs_manifest_chunk_t *ch,
+                      hs_sha256_t *whole, uint8_t *buf, hs_update_ctx_t *ctx) {
+    hs_sha256_t h;
+    char hex[65];
+    hs_sha256_init(&h);
+    if (pump(in, out, ch->size, whole, &h, buf, ctx) != ch->size) {
+        if (ctx)
+            snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                     "Download stopped in the block at byte %llu",
+                     (unsigned long long)ch->offset);
+        return 0;
+    }
+    hs_sha256_final(&h, hex);
+    if (!hex_equal(hex, ch->sha256)) {
+        if (ctx)
+            snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                     "Block at byte %llu failed its SHA-256 check",
+                     (unsigned long long)ch->offset);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Cut the file at path into pieces of at most chunk_bytes, starting a new
+ * piece at every section boundary of an index (one section for any other
+ * file) so that a change in one section leaves the pieces of the others
+ * intact, and hash them.  whole_hex, when set, receives the digest of the
+ * whole file.  NULL if the file cannot be read.
+ */
+static hs_manifest_chunk_t *hash_pieces(const char *path, uint64_t chunk_bytes,
+                                        int *n_out, uint64_t *size_out,
+                                        char *whole_hex) {
+    *n_out = 0;
+    struct stat st;
+    if (chunk_bytes == 0 || stat(path, &st) != 0) return NULL;
+    uint64_t size = (uint64_t)st.st_size;
+    *size_out = size;
+
+    uint64_t bounds[UPDATE_MAX_SECTIONS + 1];
+    int ns = index_file_sections(path, bounds, UPDATE_MAX_SECTIONS);
+    if (ns <= 0 || bounds[ns] != size) {
+        ns = 1;
+        bounds[0] = 0;
+        bounds[1] = size;
+    }
+    uint64_t n = 0;
+    for (int i = 0; i < ns; i++)
+        n += (bounds[i + 1] - bounds[i] + chunk_bytes - 1) / chunk_bytes;
+    if (n > INT32_MAX) return NULL;
+
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    hs_manifest_chunk_t *pc = (hs_manifest_chunk_t *)hs_calloc(n > 0 ? (size_t)n : 1,
+                                                               sizeof(hs_manifest_chunk_t));
+    uint8_t *buf = (uint8_t *)hs_malloc(UPDATE_IO_BUF);
+    hs_sha256_t whole;
+    hs_sha256_init(&whole);
+    int k = 0, ok = 1;
+    for (int i = 0; i < ns && ok; i++) {
+        for (uint64_t off = bounds[i]; off < bounds[i + 1] && ok; off += chunk_bytes) {
+            uint64_t len = bounds[i + 1] - off < chunk_bytes ? bounds[i + 1] - off : chunk_bytes;
+            hs_sha256_t h;
+            hs_sha256_init(&h);
+            ok = pump(f, NULL, len, &whole, &h, buf, NULL) == len;
+            pc[k].offset = off;
+            pc[k].size = len;
+            hs_sha256_final(&h, pc[k].sha256);
+            k++;
+        }
+    }
+    free(buf);
+    fclose(f);
+    if (!ok) { free(pc); return NULL; }
+    if (whole_hex) hs_sha256_final(&whole, whole_hex);
+    *n_out = k;
+    return pc;
+}
+
+static int cmp_chunk_sha(const void *a, const void *b) {
+    return strcmp(((const hs_manifest_chunk_t *)a)->sha256,
+                  ((const hs_manifest_chunk_t *)b)->sha256);
+}
+
 /* ================================================================== */
 /* hs_manifest_parse                                                   */
 /* ================================================================== */
+
+/* "chunks":[[offset,size,"sha256"],...], which must tile [0, size) */
+static int parse_chunks(const char *p, hs_manifest_t *m) {
+    p = strchr(p, '[');
+    if (!p) return 0;
+    p++;
+    int cap = 0;
+    uint64_t end = 0;
+    for (;;) {
+        while (*p && *p != '[' && *p != ']') p++;
+        if (*p != '[') break;
+        hs_manifest_chunk_t ch;
+        char *q;
+        ch.offset = (uint64_t)strtoull(p + 1, &q, 10);
+        q = strchr(q, ',');
+        if (!q) return 0;
+        ch.size = (uint64_t)strtoull(q + 1, &q, 10);
+        const char *h = strchr(q, '"');
+        if (!h) return 0;
+        h++;
+        if (strspn(h, "0123456789abcdefABCDEF") != 64 || h[64] != '"') return 0;
+        memcpy(ch.sha256, h, 64);
+        ch.sha256[64] = '\0';
+        if (ch.offset != end || ch.size == 0) return 0;
+        end += ch.size;
+        if (m->n_chunks == cap) {
+            cap = cap ? 2 * cap : 64;
+            m->chunks = (hs_manifest_chunk_t *)hs_realloc(m->chunks,
+                                                          (size_t)cap * sizeof(hs_manifest_chunk_t));
+        }
+        m->chunks[m->n_chunks++] = ch;
+        p = strchr(h + 65, ']');
+        if (!p) return 0;
+        p++;
+    }
+    return *p == ']' && end == m->size_bytes;
+}
+
 /*
  * Expected format (fixed keys, no nesting):
  *   {"version":3,"url":"https://...","sha256":"abc...","size":12345}
+ * optionally followed by the pieces of the file for delta updates:
+ *   "chunk_bytes":1048576,"chunks":[[0,4096,"..."],[4096,1048576,"..."],...]
+ * A chunk list that does not tile the file is dropped (whole-file
+ * download only) rather than failing the manifest.
  *
  * Uses strstr + simple extraction — no JSON library required.
  */
@@ -107,9 +380,9 @@ int hs_manifest_parse(const char *json, hs_manifest_t *out) {
     /* url (string) */
     p = strstr(json, "\"url\"");
     if (!p) return 0;
-    p = strchr(p + 5, '"');   /* opening quote of key's colon value */
+    p = strchr(p + 5, ':');
     if (!p) return 0;
-    /* skip past the colon, find the opening quote of the value */
+    /* find the opening quote of the value */
     p = strchr(p + 1, '"');
     if (!p) return 0;
     p++;  /* past opening quote */
@@ -125,7 +398,7 @@ int hs_manifest_parse(const char *json, hs_manifest_t *out) {
     /* sha256 (string, 64 hex chars) */
     p = strstr(json, "\"sha256\"");
     if (!p) return 0;
-    p = strchr(p + 8, '"');
+    p = strchr(p + 8, ':');
     if (!p) return 0;
     p = strchr(p + 1, '"');
     if (!p) return 0;
@@ -148,9 +421,42 @@ int hs_manifest_parse(const char *json, hs_manifest_t *out) {
     while (*p == ' ' || *p == '\t') p++;
     out->size_bytes = (uint64_t)strtoull(p, NULL, 10);
 
+    /* chunk_bytes and chunks (optional) */
+    p = strstr(json, "\"chunk_bytes\"");
+    if (p && (p = strchr(p + 13, ':')) != NULL)
+        out->chunk_bytes = (uint64_t)strtoull(p + 1, NULL, 10);
+    p = strstr(json, "\"chunks\"");
+    if (p && out->chunk_bytes > 0 && !parse_chunks(p + 8, out))
+        hs_manifest_free(out);
+
     return 1;
 }
 
+
+/* ================================================================== */
+/* hs_manifest_write                                                   */
+/* ================================================================== */
+int hs_manifest_write(const char *index_path, uint32_t version,
+                      const char *url, uint64_t chunk_bytes, FILE *out) {
+    if (chunk_bytes == 0) chunk_bytes = HS_UPDATE_CHUNK_BYTES;
+    int n = 0;
+    uint64_t size = 0;
+    char whole[65];
+    hs_manifest_chunk_t *pc = hash_pieces(index_path, chunk_bytes, &n, &size, whole);
+    if (!pc) return 0;
+    fprintf(out, "{\"version\":%u,\"url\":\"%s\",\"sha256\":\"%s\",\"size\":%llu,\n"
+                 " \"chunk_bytes\":%llu,\"chunks\":[",
+            version, url, whole, (unsigned long long)size,
+            (unsigned long long)chunk_bytes);
+    for (int i = 0; i < n; i++)
+        fprintf(out, "%s\n  [%llu,%llu,\"%s\"]", i ? "," : "",
+                (unsigned long long)pc[i].offset, (unsigned long long)pc[i].size,
+                pc[i].sha256);
+    fprintf(out, "]}\n");
+    free(pc);
+    return !ferror(out);
+}
+
 /* ================================================================== */
 /* hs_update_fetch_manifest                                            */
 /* ================================================================== */
@@ -167,12 +473,15 @@ int hs_update_fetch_manifest(hs_update_ctx_t *ctx) {
         return 0;
     }
 
-    char buf[4096];
-    size_t total = 0;
-    while (total < sizeof(buf) - 1) {
-        size_t n = fread(buf + total, 1, sizeof(buf) - 1 - total, fp);
-        if (n == 0) break;
+    /* Grows with the chunk list of a large index */
+    size_t cap = 4096, total = 0, n;
+    char *buf = (char *)hs_malloc(cap);
+    while ((n = fread(buf + total, 1, cap - 1 - total, fp)) > 0) {
         total += n;
+        if (total == cap - 1) {
+            cap *= 2;
+            buf = (char *)hs_realloc(buf, cap);
+        }
     }
     buf[total] = '\0';
     int ret = pclose(fp);
@@ -180,10 +489,14 @@ int hs_update_fetch_manifest(hs_update_ctx_t *ctx) {
     if (ret != 0) {
         snprintf(ctx->error_msg, sizeof(ctx->error_msg),
                  "curl failed: %.200s", buf);
+        free(buf);
         return 0;
     }
 
-    if (!hs_manifest_parse(buf, &ctx->manifest)) {
+    hs_manifest_free(&ctx->manifest);
+    int ok = hs_manifest_parse(buf, &ctx->manifest);
+    free(buf);
+    if (!ok) {
         snprintf(ctx->error_msg, sizeof(ctx->error_msg),
                  "Failed to parse manifest JSON");
         return 0;
@@ -195,159 +508,222 @@ int hs_update_fetch_manifest(hs_update_ctx_t *ctx) {
 /* ================================================================== */
 /* hs_update_download                                                  */
 /* ================================================================== */
-int hs_update_download(hs_update_ctx_t *ctx,
-                       char *tmp_path_out, size_t tmp_sz) {
-    const char *tmp_dir = getenv(HS_TMP_DIR_ENV);
-    if (!tmp_dir || !tmp_dir[0]) tmp_dir = HS_TMP_FALLBACK;
 
-    snprintf(tmp_path_out, tmp_sz, "%s%c_hs_update.idx.tmp",
-             tmp_dir, HS_PATH_SEP);
-
-    char cmd[2200];
+/* Stream the index URL on curl's stdout; opts adds a range or resume
+ * offset.  -f turns HTTP errors into a failed exit instead of a body. */
+static FILE *curl_open(const char *url, const char *opts) {
+    char cmd[1200];
     snprintf(cmd, sizeof(cmd),
-             "curl -sS --connect-timeout 15 --max-time 600 "
-             "-o \"%s\" \"%s\" 2>&1",
-             tmp_path_out, ctx->manifest.url);
+             "curl -sS -f --connect-timeout 15 --max-time 600 %s \"%s\"",
+             opts, url);
+    return popen(cmd, HS_POPEN_READ);
+}
 
-    FILE *fp = popen(cmd, "r");
-    if (!fp) {
+/* Whole file, resuming after the first `have` bytes of a partial one */
+static int download_whole(hs_update_ctx_t *ctx, FILE *out, uint64_t have,
+                          hs_sha256_t *whole, uint8_t *buf) {
+    hs_sha256_init(whole);
+    if (have > 0 && pump(out, NULL, have, whole, NULL, buf, NULL) != have) {
+        have = 0;
+        hs_sha256_init(whole);
+    }
+    fseek(out, (long)have, SEEK_SET);
+    ctx->bytes_reused = have;
+    ctx->bytes_fetched = 0;
+
+    char opts[48] = "";
+    if (have > 0) snprintf(opts, sizeof(opts), "-C %llu", (unsigned long long)have);
+    FILE *in = curl_open(ctx->manifest.url, opts);
+    if (!in) {
         snprintf(ctx->error_msg, sizeof(ctx->error_msg),
                  "Failed to run curl for download");
         return 0;
     }
-
-    /* Read any error output */
-    char err_buf[1024];
-    size_t total = 0;
-    while (total < sizeof(err_buf) - 1) {
-        size_t n = fread(err_buf + total, 1, sizeof(err_buf) - 1 - total, fp);
-        if (n == 0) break;
-        total += n;
+    uint64_t got = pump(in, out, UINT64_MAX, whole, NULL, buf, ctx);
+    ctx->bytes_fetched = got;
+    int ret = pclose(in);
+
+    /* A server without range support refuses the resume: start over */
+    if (ret != 0 && have > 0 && got == 0) {
+        fseek(out, 0, SEEK_SET);
+        return download_whole(ctx, out, 0, whole, buf);
     }
-    err_buf[total] = '\0';
-    int ret = pclose(fp);
-
     if (ret != 0) {
         snprintf(ctx->error_msg, sizeof(ctx->error_msg),
-                 "Download failed: %.200s", err_buf);
+                 "Download failed after %llu bytes",
+                 (unsigned long long)(have + got));
         return 0;
     }
-
-    /* Verify file exists and has non-zero size */
-    struct stat st;
-    if (stat(tmp_path_out, &st) != 0 || st.st_size == 0) {
+    if (have + got == 0) {
         snprintf(ctx->error_msg, sizeof(ctx->error_msg),
                  "Downloaded file is missing or empty");
         return 0;
     }
-
     return 1;
 }
 
-/* ================================================================== */
-/* hs_update_verify_sha256                                             */
-/* ================================================================== */
-int hs_update_verify_sha256(const char *file_path,
-                            const char *expected_hex,
-                            char *error_msg, size_t err_sz) {
-    char cmd[1200];
-#ifdef _WIN32
-    /* certutil -hashfile <file> SHA256 outputs the hash on line 2 */
-    snprintf(cmd, sizeof(cmd),
-             "certutil -hashfile \"%s\" SHA256 2>&1", file_path);
-#else
-    /* shasum -a 256 outputs: <hash>  <filename> */
-    snprintf(cmd, sizeof(cmd),
-             "shasum -a 256 \"%s\" 2>&1", file_path);
-#endif
-
-    FILE *fp = popen(cmd, "r");
-    if (!fp) {
-        snprintf(error_msg, err_sz, "Failed to run hash command");
+/* Chunks [i, j) of the manifest with one ranged request */
+static int fetch_run(hs_update_ctx_t *ctx, FILE *out, int i, int j,
+                     hs_sha256_t *whole, uint8_t *buf) {
+    const hs_manifest_chunk_t *ch = ctx->manifest.chunks;
+    char opts[64];
+    snprintf(opts, sizeof(opts), "-r %llu-%llu",
+             (unsigned long long)ch[i].offset,
+             (unsigned long long)(ch[j - 1].offset + ch[j - 1].size - 1));
+    FILE *in = curl_open(ctx->manifest.url, opts);
+    if (!in) {
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                 "Failed to run curl for download");
         return 0;
     }
-
-    char output[2048];
-    size_t total = 0;
-    while (total < sizeof(output) - 1) {
-        size_t n = fread(output + total, 1, sizeof(output) - 1 - total, fp);
-        if (n == 0) break;
-        total += n;
+    int ok = 1;
+    for (int k = i; k < j && ok; k++) {
+        ok = copy_piece(in, out, &ch[k], whole, buf, ctx);
+        if (ok) ctx->bytes_fetched += ch[k].size;
     }
-    output[total] = '\0';
-    int ret = pclose(fp);
-
-    if (ret != 0) {
-        snprintf(error_msg, err_sz,
-                 "Hash command failed: %.200s", output);
-        return 0;
+    /* A server that ignores the range sends more than was asked for */
+    if (ok && fgetc(in) != EOF) {
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                 "Server ignored the byte range request");
+        ok = 0;
     }
+    int ret = pclose(in);
+    if (ok && ret != 0) {
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                 "Ranged download failed");
+        ok = 0;
+    }
+    return ok;
+}
 
-    /* Extract hex digest from output */
-    char actual_hex[65] = {0};
-
-#ifdef _WIN32
-    /* certutil output:
-     * SHA256 hash of <file>:
-     * <hex string with possible spaces>
-     * CertUtil: -hashfile command completed successfully.
-     *
-     * The hash is on the second line. */
-    {
-        const char *line2 = strchr(output, '\n');
-        if (line2) {
-            line2++;
-            /* Skip whitespace */
-            while (*line2 == ' ' || *line2 == '\r' || *line2 == '\t')
-                line2++;
-            /* Copy hex chars, skipping spaces */
-            int j = 0;
-            for (int i = 0; line2[i] && j < 64; i++) {
-                if (isxdigit((unsigned char)line2[i]))
-                    actual_hex[j++] = (char)tolower((unsigned char)line2[i]);
-                else if (line2[i] == '\n' || line2[i] == '\r')
-                    break;
-            }
-            actual_hex[j] = '\0';
+/* Chunked download: keep the verified prefix of a partial file, copy the
+ * pieces the installed index already has, fetch runs of the rest */
+static int download_chunks(hs_update_ctx_t *ctx, FILE *out, uint64_t have,
+                           hs_sha256_t *whole, uint8_t *buf) {
+    const hs_manifest_t *m = &ctx->manifest;
+    int n = m->n_chunks, i = 0;
+    hs_sha256_init(whole);
+    for (; i < n && m->chunks[i].offset + m->chunks[i].size <= have; i++) {
+        hs_sha256_t save = *whole;
+        if (!copy_piece(out, NULL, &m->chunks[i], whole, buf, NULL)) {
+            *whole = save;
+            break;
         }
+        ctx->bytes_reused += m->chunks[i].size;
     }
-#else
-    /* shasum output: "<64 hex>  filename\n" */
-    {
-        int j = 0;
-        for (int i = 0; output[i] && j < 64; i++) {
-            if (isxdigit((unsigned char)output[i]))
-                actual_hex[j++] = (char)tolower((unsigned char)output[i]);
-            else
-                break;
+    fseek(out, (long)(i < n ? m->chunks[i].offset : m->size_bytes), SEEK_SET);
+
+    int n_local = 0;
+    uint64_t local_size = 0;
+    hs_manifest_chunk_t *local = NULL;
+    FILE *src = NULL;
+    if (i < n && ctx->index_path[0]) {
+        local = hash_pieces(ctx->index_path, m->chunk_bytes, &n_local, &local_size, NULL);
+        if (local) {
+            qsort(local, (size_t)n_local, sizeof(*local), cmp_chunk_sha);
+            src = fopen(ctx->index_path, "rb");
         }
-        actual_hex[j] = '\0';
     }
-#endif
 
-    /* Compare (case-insensitive) */
-    if (strlen(actual_hex) != 64) {
-        snprintf(error_msg, err_sz,
-                 "Failed to extract SHA-256 (got %zu chars)", strlen(actual_hex));
-        return 0;
+    int ok = 1;
+    while (ok && i < n) {
+        const hs_manifest_chunk_t *ch = &m->chunks[i];
+        const hs_manifest_chunk_t *hit = src
+            ? (const hs_manifest_chunk_t *)bsearch(ch, local, (size_t)n_local,
+                                                   sizeof(*local), cmp_chunk_sha)
+            : NULL;
+        if (hit && hit->size == ch->size) {
+            ok = fseek(src, (long)hit->offset, SEEK_SET) == 0 &&
+                 copy_piece(src, out, ch, whole, buf, ctx);
+            if (ok) ctx->bytes_reused += ch->size;
+            i++;
+            continue;
+        }
+        int j = i + 1;
+        while (j < n && !(src && bsearch(&m->chunks[j], local, (size_t)n_local,
+                                         sizeof(*local), cmp_chunk_sha)))
+            j++;
+        ok = fetch_run(ctx, out, i, j, whole, buf);
+        i = j;
     }
+    if (src) fclose(src);
+    free(local);
+    return ok;
+}
 
-    /* Lowercase the expected for comparison */
-    char expected_lower[65];
-    for (int i = 0; i < 64 && expected_hex[i]; i++)
-        expected_lower[i] = (char)tolower((unsigned char)expected_hex[i]);
-    expected_lower[64] = '\0';
+int hs_update_download(hs_update_ctx_t *ctx,
+                       char *tmp_path_out, size_t tmp_sz) {
+    const hs_manifest_t *m = &ctx->manifest;
+    const char *tmp_dir = getenv(HS_TMP_DIR_ENV);
+    if (!tmp_dir || !tmp_dir[0]) tmp_dir = HS_TMP_FALLBACK;
 
-    if (strncmp(actual_hex, expected_lower, 64) != 0) {
-        snprintf(error_msg, err_sz,
-                 "SHA-256 mismatch: expected %.16s..., got %.16s...",
-                 expected_lower, actual_hex);
+    /* Named for the version, so a later attempt at it can resume */
+    snprintf(tmp_path_out, tmp_sz, "%s%c_hs_update-%u.idx.part",
+             tmp_dir, HS_PATH_SEP, m->version);
+    ctx->bytes_fetched = 0;
+    ctx->bytes_reused = 0;
+    ctx->digest[0] = '\0';
+
+    uint64_t have = 0;
+    struct stat st;
+    if (stat(tmp_path_out, &st) == 0) {
+        if ((uint64_t)st.st_size < m->size_bytes) have = (uint64_t)st.st_size;
+        else remove(tmp_path_out);
+    }
+    FILE *out = fopen(tmp_path_out, have > 0 ? "r+b" : "wb");
+    if (!out) {
+        snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                 "Cannot write %.200s", tmp_path_out);
         return 0;
     }
 
+    uint8_t *buf = (uint8_t *)hs_malloc(UPDATE_IO_BUF);
+    hs_sha256_t whole;
+    int ok = m->n_chunks > 0 ? download_chunks(ctx, out, have, &whole, buf)
+                             : download_whole(ctx, out, have, &whole, buf);
+    free(buf);
+    int err = ferror(out);
+    if (fclose(out) != 0 || err) {
+        if (ok)
+            snprintf(ctx->error_msg, sizeof(ctx->error_msg),
+                     "Failed to write %.200s", tmp_path_out);
+        ok = 0;
+    }
+    /* On failure the partial file is left for the next attempt */
+    if (!ok) return 0;
+
+    hs_sha256_final(&whole, ctx->digest);
     return 1;
 }
 
+/* ================================================================== */
+/* hs_update_verify_sha256                                             */
+/* ================================================================== */
+int hs_update_verify_sha256(const char *file_path,
+                            const char *expected_hex,
+                            char *error_msg, size_t err_sz) {
+    FILE *f = fopen(file_path, "rb");
+    if (!f) {
+        snprintf(error_msg, err_sz, "Cannot open %.200s", file_path);
+        return 0;
+    }
+    uint8_t *buf = (uint8_t *)hs_malloc(UPDATE_IO_BUF);
+    hs_sha256_t h;
+    hs_sha256_init(&h);
+    pump(f, NULL, UINT64_MAX, &h, NULL, buf, NULL);
+    int err = ferror(f);
+    free(buf);
+    fclose(f);
+    if (err) {
+        snprintf(error_msg, err_sz, "Failed to read %.200s", file_path);
+        return 0;
+    }
+
+    char actual_hex[65];
+    hs_sha256_final(&h, actual_hex);
+    return check_digest(actual_hex, expected_hex, error_msg, err_sz);
+}
+
 /* ================================================================== */
 /* Copy file (fallback for cross-filesystem rename)                    */
 /* ================================================================== */
@@ -462,11 +838,11 @@ void hs_update_run_download(hs_update_ctx_t *ctx) {
     }
     ctx->progress_pct = 70;
 
-    /* Verify SHA-256 */
+    /* Verify SHA-256, computed while downloading */
     ctx->status = HS_UPDATE_VERIFYING;
     ctx->progress_pct = 75;
-    if (!hs_update_verify_sha256(tmp_path, ctx->manifest.sha256,
-                                  ctx->error_msg, sizeof(ctx->error_msg))) {
+    if (!check_digest(ctx->digest, ctx->manifest.sha256,
+                      ctx->error_msg, sizeof(ctx->error_msg))) {
         remove(tmp_path);
         ctx->status = HS_UPDATE_ERROR;
         return;
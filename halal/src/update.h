@@ -3,8 +3,11 @@
  *
  * Fetches a JSON manifest from a remote server, compares versions,
  * downloads the new index file, verifies its SHA-256 digest, and
- * atomically installs it.  No new dependencies: uses curl (built
- * into macOS and Windows 10+) and shasum / certutil for hashing.
+ * atomically installs it.  Only the blocks that changed since the
+ * installed index are fetched when the manifest lists per-chunk digests,
+ * and an interrupted full download resumes where it stopped.  No new
+ * dependencies: uses curl (built into macOS and Windows 10+) for HTTP
+ * and hashes in-process while streaming.
  */
 
 #ifndef HALALSEQ_UPDATE_H
@@ -12,6 +15,7 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdio.h>
 
 /* ------------------------------------------------------------------ */
 /* Compile-time configurable server URL                                */
@@ -38,11 +42,27 @@ typedef enum {
 /* ------------------------------------------------------------------ */
 /* Manifest (parsed from server JSON)                                  */
 /* ------------------------------------------------------------------ */
+/* One byte range of the new index with its digest.  The server cuts
+ * each section of the index (index_file_sections) into chunk_bytes
+ * pieces; the client cuts its installed index the same way and copies
+ * every piece whose size and digest match instead of downloading it. */
+typedef struct {
+    uint64_t offset;
+    uint64_t size;
+    char     sha256[65];
+} hs_manifest_chunk_t;
+
+/* Default piece size for hs_manifest_write() */
+#define HS_UPDATE_CHUNK_BYTES (1u << 20)
+
 typedef struct {
     uint32_t version;           /* monotonically increasing          */
     char     url[1024];         /* download URL for the .idx file    */
     char     sha256[65];        /* hex-encoded SHA-256 digest        */
     uint64_t size_bytes;        /* expected file size                */
+    uint64_t chunk_bytes;       /* piece size of chunks (0: none)    */
+    int      n_chunks;          /* 0: whole-file download only       */
+    hs_manifest_chunk_t *chunks; /* [n_chunks] in file order, owned  */
 } hs_manifest_t;
 
 /* ------------------------------------------------------------------ */
@@ -56,6 +76,10 @@ typedef struct {
     uint32_t            local_version;  /* currently installed ver    */
     char                index_path[1024]; /* path to installed .idx  */
     char                config_dir[1024]; /* ~/.halalseq or %APPDATA%*/
+    char                digest[65];     /* SHA-256 of the download   */
+    uint64_t            bytes_fetched;  /* network bytes of it       */
+    uint64_t            bytes_reused;   /* bytes copied from the
+                                           installed index / resumed */
 } hs_update_ctx_t;
 
 /* ------------------------------------------------------------------ */
@@ -65,6 +89,10 @@ typedef struct {
 /* Zero-initialise the update context. */
 void hs_update_init(hs_update_ctx_t *ctx);
 
+/* Release the manifest's chunk list (ctx->manifest included). */
+void hs_update_free(hs_update_ctx_t *ctx);
+void hs_manifest_free(hs_manifest_t *m);
+
 /* Resolve the platform config directory.
  * Unix:    $HOME/.halalseq/
  * Windows: %APPDATA%\HalalSeq\
@@ -83,17 +111,42 @@ int hs_update_write_local_version(const char *config_dir, uint32_t ver);
  * Returns 1 on success, 0 on failure (sets ctx->error_msg). */
 int hs_update_fetch_manifest(hs_update_ctx_t *ctx);
 
-/* Parse a fixed-format manifest JSON string into *out.
- * Returns 1 on success, 0 on parse error. */
+/* Parse a fixed-format manifest JSON string into *out (release with
+ * hs_manifest_free).  Returns 1 on success, 0 on parse error. */
 int hs_manifest_parse(const char *json, hs_manifest_t *out);
 
-/* Download the index file to a temporary path.
- * Returns 1 on success.  tmp_path_out receives the path. */
+/* Write the manifest of index_path, served at url as version, to out:
+ * whole-file digest and size, plus one chunk per chunk_bytes piece of
+ * each section (0: HS_UPDATE_CHUNK_BYTES; files without a section table
+ * are cut from offset 0).  Returns 1 on success. */
+int hs_manifest_write(const char *index_path, uint32_t version,
+                      const char *url, uint64_t chunk_bytes, FILE *out);
+
+/* ------------------------------------------------------------------ */
+/* SHA-256 (FIPS 180-4), streamed                                      */
+/* ------------------------------------------------------------------ */
+typedef struct {
+    uint32_t h[8];
+    uint64_t len;               /* bytes hashed so far               */
+    uint8_t  buf[64];
+    size_t   n;                 /* bytes waiting in buf              */
+} hs_sha256_t;
+
+void hs_sha256_init(hs_sha256_t *c);
+void hs_sha256_update(hs_sha256_t *c, const void *data, size_t n);
+/* Lowercase hex digest into hex[65] */
+void hs_sha256_final(hs_sha256_t *c, char hex[65]);
+
+/* Download the index file to a temporary path, hashing it into
+ * ctx->digest on the way.  With manifest chunks and an installed index at
+ * ctx->index_path, unchanged pieces are copied from it and only the rest
+ * is fetched with ranged requests; otherwise the whole file is fetched,
+ * resuming a partial one left by an interrupted attempt at the same
+ * version.  Returns 1 on success.  tmp_path_out receives the path. */
 int hs_update_download(hs_update_ctx_t *ctx,
                        char *tmp_path_out, size_t tmp_sz);
 
-/* Verify SHA-256 of a file.  Expected digest in hex (lowercase).
- * Uses shasum on macOS/Linux, certutil on Windows.
+/* Verify SHA-256 of a file.  Expected digest in hex (case-insensitive).
  * Returns 1 if digest matches. */
 int hs_update_verify_sha256(const char *file_path,
                             const char *expected_hex,
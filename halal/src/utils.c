@@ -2,6 +2,15 @@
 #include <stdarg.h>
 #include <time.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <fcntl.h>
+#include <unistd.h>
+#else
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 /* --- Memory allocation --- */
 
@@ -121,6 +130,21 @@ uint64_t hs_rng_next(hs_rng_t *rng) {
     return result;
 }
 
+void hs_rng_jump(hs_rng_t *rng) {
+    static const uint64_t jump[4] = {
+        0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+        0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL
+    };
+    uint64_t s[4] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++)
+        for (int b = 0; b < 64; b++) {
+            if (jump[i] & (1ULL << b))
+                for (int j = 0; j < 4; j++) s[j] ^= rng->s[j];
+            hs_rng_next(rng);
+        }
+    for (int j = 0; j < 4; j++) rng->s[j] = s[j];
+}
+
 double hs_rng_uniform(hs_rng_t *rng) {
     return (double)(hs_rng_next(rng) >> 11) * 0x1.0p-53;
 }
@@ -195,3 +219,71 @@ double hs_clock_ms(void) {
     clock_gettime(CLOCK_MONOTONIC, &ts);
     return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
 }
+
+long hs_peak_rss_kb(void) {
+#ifndef _WIN32
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#ifdef __APPLE__
+    return (long)(ru.ru_maxrss / 1024);   /* bytes on macOS */
+#else
+    return (long)ru.ru_maxrss;
+#endif
+#else
+    return 0;
+#endif
+}
+
+#ifndef _WIN32
+void *hs_map_file(const char *path, size_t *len) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) { close(fd); return NULL; }
+    void *addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) return NULL;
+    *len = (size_t)st.st_size;
+    return addr;
+}
+
+void hs_unmap_file(void *addr, size_t len) {
+    if (addr) munmap(addr, len);
+}
+#else
+void *hs_map_file(const char *path, size_t *len) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return NULL;
+    fseek(fp, 0, SEEK_END);
+    long n = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    if (n <= 0) { fclose(fp); return NULL; }
+    void *buf = hs_malloc((size_t)n);
+    if (fread(buf, 1, (size_t)n, fp) != (size_t)n) { free(buf); fclose(fp); return NULL; }
+    fclose(fp);
+    *len = (size_t)n;
+    return buf;
+}
+
+void hs_unmap_file(void *addr, size_t len) {
+    (void)len;
+    free(addr);
+}
+#endif
+
+#ifndef _WIN32
+int hs_make_temp(char *tmpl) {
+    int fd = mkstemp(tmpl);
+    if (fd < 0) return -1;
+    close(fd);
+    return 0;
+}
+#else
+int hs_make_temp(char *tmpl) {
+    if (_mktemp_s(tmpl, strlen(tmpl) + 1) != 0) return -1;
+    int fd = _open(tmpl, _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY, _S_IREAD | _S_IWRITE);
+    if (fd < 0) return -1;
+    _close(fd);
+    return 0;
+}
+#endif
@@ -38,6 +38,9 @@ typedef struct {
 
 void hs_rng_seed(hs_rng_t *rng, uint64_t seed);
 uint64_t hs_rng_next(hs_rng_t *rng);
+/* Advance by 2^128 draws: successive jumps from one seed give
+ * non-overlapping streams for parallel work */
+void hs_rng_jump(hs_rng_t *rng);
 double hs_rng_uniform(hs_rng_t *rng);       /* [0, 1) */
 double hs_rng_normal(hs_rng_t *rng);        /* standard normal */
 double hs_rng_lognormal(hs_rng_t *rng, double mu, double sigma);
@@ -47,5 +50,17 @@ int hs_rng_categorical(hs_rng_t *rng, const double *probs, int n);
 /* --- Misc --- */
 int hs_file_exists(const char *path);
 double hs_clock_ms(void);
+/* Peak resident set size of this process in KiB (0 if unavailable) */
+long hs_peak_rss_kb(void);
+
+/* Read-only whole-file mapping (mmap where available, otherwise a heap
+ * copy).  Returns NULL on failure; release with hs_unmap_file(). */
+void *hs_map_file(const char *path, size_t *len);
+void hs_unmap_file(void *addr, size_t len);
+
+/* Create a new, empty, owner-only file named by tmpl, whose trailing
+ * "XXXXXX" is replaced in place (mkstemp); it never opens an existing
+ * file or symlink.  Returns 0, or -1 on failure. */
+int hs_make_temp(char *tmpl);
 
 #endif /* HALALSEQ_UTILS_H */
@@ -35,23 +35,26 @@ static void test_classify_reference_reads(void) {
     classify_opts_t opts = classify_opts_default();
     opts.min_containment = 0.2; /* relaxed for pseudo-random seqs */
     opts.coarse_threshold = 0.01;
-    read_result_t *results = classify_reads(idx, seqs, lens, 1, &opts);
+    classify_results_t *results = classify_reads(idx, seqs, lens, 1, &opts);
+    const read_result_t *rr = &results->reads[0];
+    const species_hit_t *hits = classify_read_hits(results, 0);
 
-    ASSERT(results[0].is_classified, "Reference seq classified");
-    if (results[0].is_classified) {
+    ASSERT(rr->n_hits > 0, "Reference seq classified");
+    if (rr->n_hits > 0) {
         /* Should have beef as a hit */
         int found_beef = 0;
-        for (int j = 0; j < results[0].n_hits; j++) {
-            if (results[0].hits[j].species_idx == beef) {
+        for (int j = 0; j < rr->n_hits; j++) {
+            if (hits[j].species_idx == beef) {
                 found_beef = 1;
-                ASSERT(results[0].hits[j].containment > 0.5,
+                ASSERT(hits[j].containment > 0.5,
                        "Beef self-containment high");
             }
         }
         ASSERT(found_beef, "Beef found in hits");
     }
+    ASSERT(results->n_hits == (size_t)rr->n_hits, "Hit arena sized exactly");
 
-    classify_results_free(results, 1);
+    classify_results_free(results);
     index_destroy(idx);
 }
 
@@ -74,26 +77,30 @@ static void test_classify_multiple_species(void) {
     classify_opts_t opts = classify_opts_default();
     opts.min_containment = 0.2;
     opts.coarse_threshold = 0.01;
-    read_result_t *results = classify_reads(idx, seqs, lens, 2, &opts);
+    classify_results_t *results = classify_reads(idx, seqs, lens, 2, &opts);
 
     /* Both should be classified */
-    ASSERT(results[0].is_classified, "Beef read classified");
-    ASSERT(results[1].is_classified, "Pork read classified");
+    ASSERT(results->reads[0].n_hits > 0, "Beef read classified");
+    ASSERT(results->reads[1].n_hits > 0, "Pork read classified");
 
     /* Check beef read has beef hit with highest containment */
-    if (results[0].is_classified && results[0].n_hits > 0) {
-        int best_species = results[0].hits[0].species_idx;
-        double best_cont = results[0].hits[0].containment;
-        for (int j = 1; j < results[0].n_hits; j++) {
-            if (results[0].hits[j].containment > best_cont) {
-                best_cont = results[0].hits[j].containment;
-                best_species = results[0].hits[j].species_idx;
+    if (results->reads[0].n_hits > 0) {
+        const species_hit_t *hits = classify_read_hits(results, 0);
+        int best_species = hits[0].species_idx;
+        double best_cont = hits[0].containment;
+        for (int j = 1; j < results->reads[0].n_hits; j++) {
+            if (hits[j].containment > best_cont) {
+                best_cont = hits[j].containment;
+                best_species = hits[j].species_idx;
             }
         }
         ASSERT(best_species == beef, "Beef read best match is beef");
     }
+    ASSERT(results->reads[1].offset == (uint32_t)results->reads[0].n_hits &&
+           results->n_hits == (size_t)(results->reads[0].n_hits + results->reads[1].n_hits),
+           "Hits packed in read order");
 
-    classify_results_free(results, 2);
+    classify_results_free(results);
     index_destroy(idx);
 }
 
@@ -111,14 +118,251 @@ static void test_classify_summary(void) {
     classify_opts_t opts = classify_opts_default();
     opts.min_containment = 0.2;
     opts.coarse_threshold = 0.01;
-    read_result_t *results = classify_reads(idx, seqs, lens, 3, &opts);
+    classify_results_t *results = classify_reads(idx, seqs, lens, 3, &opts);
 
     classify_summary_t summary;
-    classify_summarize(results, 3, idx, &summary);
+    classify_summarize(results, idx, &summary);
     ASSERT(summary.total_reads == 3, "Total reads = 3");
     ASSERT(summary.classified_reads >= 0, "Classified reads >= 0");
+    ASSERT(summary.n_species == idx->db->n_species &&
+           summary.n_markers == idx->db->n_markers, "Summary sized to the database");
 
-    classify_results_free(results, 3);
+    classify_summary_free(&summary);
+    classify_results_free(results);
+    index_destroy(idx);
+}
+
+static void test_classify_threads(void) {
+    printf("  test_classify_threads...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+
+    /* Overlapping 100 bp windows of every marker reference */
+    int cap = 4096, n = 0;
+    const char **seqs = (const char **)hs_calloc((size_t)cap, sizeof(char *));
+    int *lens = (int *)hs_calloc((size_t)cap, sizeof(int));
+    for (int s = 0; s < idx->db->n_species; s++) {
+        for (int m = 0; m < idx->db->n_markers; m++) {
+            marker_ref_t *mr = refdb_get_marker_ref(idx->db, s, m);
+            if (!mr || !mr->sequence) continue;
+            for (int off = 0; off + 100 <= mr->seq_len && n < cap; off += 7) {
+                seqs[n] = mr->sequence + off;
+                lens[n] = 100;
+                n++;
+            }
+        }
+    }
+    ASSERT(n > 256, "Enough reads to span several chunks");
+
+    classify_opts_t opts = classify_opts_default();
+    opts.n_threads = 1;
+    classify_results_t *serial = classify_reads(idx, seqs, lens, n, &opts);
+    opts.n_threads = 4;
+    classify_results_t *threaded = classify_reads(idx, seqs, lens, n, &opts);
+
+    /* The arena is gathered in read order, so even offsets agree */
+    int mismatches = serial->n_hits != threaded->n_hits;
+    for (int r = 0; r < n; r++) {
+        const read_result_t *a = &serial->reads[r], *b = &threaded->reads[r];
+        if (a->marker_idx != b->marker_idx || a->n_hits != b->n_hits ||
+            a->offset != b->offset) { mismatches++; continue; }
+        const species_hit_t *ha = classify_read_hits(serial, r);
+        const species_hit_t *hb = classify_read_hits(threaded, r);
+        for (int j = 0; j < a->n_hits; j++)
+            if (ha[j].species_idx != hb[j].species_idx ||
+                ha[j].containment != hb[j].containment)
+                mismatches++;
+    }
+    ASSERT(mismatches == 0, "Threaded classification matches serial");
+
+    classify_results_free(serial);
+    classify_results_free(threaded);
+    free(seqs);
+    free(lens);
+    index_destroy(idx);
+}
+
+static void test_classify_bounded(void) {
+    printf("  test_classify_bounded...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+
+    int cap = 2048, n = 0;
+    const char **seqs = (const char **)hs_calloc((size_t)cap, sizeof(char *));
+    int *lens = (int *)hs_calloc((size_t)cap, sizeof(int));
+    for (int s = 0; s < idx->db->n_species; s++) {
+        for (int m = 0; m < idx->db->n_markers; m++) {
+            marker_ref_t *mr = refdb_get_marker_ref(idx->db, s, m);
+            if (!mr || !mr->sequence) continue;
+            for (int off = 0; off + 80 <= mr->seq_len && n < cap; off += 23) {
+                seqs[n] = mr->sequence + off;
+                lens[n] = 80;
+                n++;
+            }
+        }
+    }
+
+    classify_opts_t opts = classify_opts_default();
+    opts.min_containment = 0.2;
+    classify_results_t *full = classify_reads(idx, seqs, lens, n, &opts);
+
+    /* Without the posting table every set is scored with early exit;
+     * hits above the threshold must be unchanged */
+    kmer_posting_t *posting = idx->fine_posting;
+    idx->fine_posting = NULL;
+    classify_results_t *bounded = classify_reads(idx, seqs, lens, n, &opts);
+    idx->fine_posting = posting;
+
+    opts.max_hits = 1;
+    classify_results_t *top = classify_reads(idx, seqs, lens, n, &opts);
+
+    int mismatches = 0, bad_top = 0, multi = 0, no_primer = 0, bad_marker = 0;
+    for (int r = 0; r < n; r++) {
+        const read_result_t *f = &full->reads[r], *b = &bounded->reads[r];
+        const species_hit_t *hf = classify_read_hits(full, r);
+        const species_hit_t *hb = classify_read_hits(bounded, r);
+        if (f->marker_idx != b->marker_idx || f->n_hits != b->n_hits) { mismatches++; continue; }
+        for (int j = 0; j < f->n_hits; j++)
+            if (hf[j].species_idx != hb[j].species_idx ||
+                fabs(hf[j].containment - hb[j].containment) > 1e-12)
+                mismatches++;
+
+        if (f->n_hits > 1) multi++;
+        if (top->reads[r].n_hits != (f->n_hits > 0 ? 1 : 0)) { bad_top++; continue; }
+        if (f->n_hits == 0) continue;
+        int best = 0;
+        for (int j = 1; j < f->n_hits; j++)
+            if (hf[j].containment > hf[best].containment) best = j;
+        const species_hit_t *ht = classify_read_hits(top, r);
+        if (ht[0].species_idx != hf[best].species_idx) bad_top++;
+        /* Without a primer the marker is the kept species' own best */
+        if (index_detect_marker(idx, seqs[r], lens[r]) < 0) {
+            no_primer++;
+            double c = index_query_fine(idx, seqs[r], lens[r], top->reads[r].marker_idx,
+                                        ht[0].species_idx);
+            if (fabs(c - ht[0].containment) > 1e-12) bad_marker++;
+        }
+    }
+    ASSERT(mismatches == 0, "Early-exit scoring keeps every hit above threshold");
+    ASSERT(multi > 0, "Some reads hit several species");
+    ASSERT(bad_top == 0, "Top-1 keeps the best-scoring species");
+    ASSERT(no_primer > 0 && bad_marker == 0, "Top-1 reports the kept species' marker");
+
+    classify_results_free(full);
+    classify_results_free(bounded);
+    classify_results_free(top);
+    free(seqs);
+    free(lens);
+    index_destroy(idx);
+}
+
+/* Reads near the containment floor -- reference windows with a random
+ * tail of growing length -- and pure off-target reads classify the same
+ * with and without the prefilter */
+static void test_classify_prefilter(void) {
+    printf("  test_classify_prefilter...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+    ASSERT(idx->fine_filter != NULL, "Default index has a prefilter");
+
+    enum { LEN = 100, CAP = 1200 };
+    static char buf[CAP][LEN + 1];
+    const char *seqs[CAP];
+    int lens[CAP], n = 0;
+    uint64_t st = 11;
+    for (int s = 0; s < idx->db->n_species && n < CAP; s++) {
+        for (int m = 0; m < idx->db->n_markers && n < CAP; m++) {
+            marker_ref_t *mr = refdb_get_marker_ref(idx->db, s, m);
+            if (!mr || !mr->sequence || mr->seq_len < LEN) continue;
+            for (int keep = 0; keep <= LEN && n < CAP; keep += 10, n++) {
+                memcpy(buf[n], mr->sequence + (mr->seq_len - LEN) / 2, (size_t)keep);
+                for (int i = keep; i < LEN; i++) {
+                    st = st * 6364136223846793005ULL + 1442695040888963407ULL;
+                    buf[n][i] = "ACGT"[st >> 62];
+                }
+                seqs[n] = buf[n];
+                lens[n] = LEN;
+            }
+        }
+    }
+
+    classify_opts_t opts = classify_opts_default();
+    classify_results_t *filtered = classify_reads(idx, seqs, lens, n, &opts);
+    kmer_bloom_t *filter = idx->fine_filter;
+    idx->fine_filter = NULL;
+    classify_results_t *plain = classify_reads(idx, seqs, lens, n, &opts);
+    idx->fine_filter = filter;
+
+    int mismatches = 0, classified = 0;
+    for (int r = 0; r < n; r++) {
+        const read_result_t *f = &filtered->reads[r], *p = &plain->reads[r];
+        if (f->marker_idx != p->marker_idx || f->n_hits != p->n_hits) { mismatches++; continue; }
+        for (int j = 0; j < f->n_hits; j++)
+            if (classify_read_hits(filtered, r)[j].species_idx !=
+                classify_read_hits(plain, r)[j].species_idx)
+                mismatches++;
+        classified += f->n_hits > 0;
+    }
+    ASSERT(n > 0 && classified > 0 && classified < n, "Mix of on- and off-target reads");
+    ASSERT(mismatches == 0, "Prefilter changes no result");
+
+    classify_results_free(filtered);
+    classify_results_free(plain);
+    index_destroy(idx);
+}
+
+static void test_classify_timed(void) {
+    printf("  test_classify_timed...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+
+    int cap = 512, n = 0;
+    const char **seqs = (const char **)hs_calloc((size_t)cap, sizeof(char *));
+    int *lens = (int *)hs_calloc((size_t)cap, sizeof(int));
+    for (int s = 0; s < idx->db->n_species; s++) {
+        for (int m = 0; m < idx->db->n_markers; m++) {
+            marker_ref_t *mr = refdb_get_marker_ref(idx->db, s, m);
+            if (!mr || !mr->sequence) continue;
+            for (int off = 0; off + 120 <= mr->seq_len && n < cap; off += 31) {
+                seqs[n] = mr->sequence + off;
+                lens[n] = 120;
+                n++;
+            }
+        }
+    }
+
+    classify_opts_t opts = classify_opts_default();
+    opts.n_threads = 2;
+    classify_results_t *plain = classify_reads(idx, seqs, lens, n, &opts);
+    classify_timing_t tm;
+    memset(&tm, 0, sizeof(tm));
+    classify_results_t *timed = classify_reads_timed(idx, seqs, lens, n, &opts, &tm);
+
+    int mismatches = 0;
+    for (int r = 0; r < n; r++) {
+        if (plain->reads[r].marker_idx != timed->reads[r].marker_idx ||
+            plain->reads[r].n_hits != timed->reads[r].n_hits) mismatches++;
+    }
+    ASSERT(mismatches == 0, "Timing does not change classification");
+    ASSERT(tm.classify_ms > 0.0, "Batch wall time recorded");
+    ASSERT(tm.primer_ms >= 0.0 && tm.kmer_ms >= 0.0 && tm.coarse_ms >= 0.0 && tm.fine_ms > 0.0,
+           "Per-read stage times recorded");
+    ASSERT(tm.parse_ms == 0.0 && tm.derep_ms == 0.0, "Pipeline-only stages left alone");
+
+    uint64_t hits = 0;
+    int classified = 0;
+    for (int r = 0; r < n; r++) {
+        hits += (uint64_t)timed->reads[r].n_hits;
+        classified += timed->reads[r].n_hits > 0;
+    }
+    ASSERT(tm.n_scored == (uint64_t)n && tm.n_hits == hits, "Every read and hit counted");
+    ASSERT(tm.n_prefiltered + tm.n_coarse_rejected <= tm.n_scored - (uint64_t)classified &&
+           tm.n_candidates >= hits && tm.n_fine_kmers > 0, "Path counters consistent");
+
+    classify_results_free(plain);
+    classify_results_free(timed);
+    free(seqs);
+    free(lens);
     index_destroy(idx);
 }
 
@@ -129,12 +373,33 @@ static void test_classify_nanopore_opts(void) {
     ASSERT(opts.min_containment < 0.3, "Nanopore threshold relaxed");
 }
 
+static void test_classify_dereplicate(void) {
+    printf("  test_classify_dereplicate...\n");
+    /* ACGTTG reverse-complements to CAACGT; case and N/other codes fold */
+    const char *seqs[] = { "ACGTTG", "acgttg", "CAACGT", "ACGTTA",
+                           "ACNTTG", "ACRTTG", "ACGTT" };
+    int lens[7];
+    for (int i = 0; i < 7; i++) lens[i] = (int)strlen(seqs[i]);
+    int first[7], counts[7];
+    int n = classify_dereplicate(seqs, lens, 7, first, counts);
+    ASSERT(n == 4, "Duplicates, revcomps, case and ambiguity codes grouped");
+    ASSERT(first[0] == 0 && counts[0] == 3, "Forward, lowercase and revcomp merged");
+    ASSERT(first[1] == 3 && counts[1] == 1, "Single mismatch kept apart");
+    ASSERT(first[2] == 4 && counts[2] == 2, "Ambiguity codes merged");
+    ASSERT(first[3] == 6 && counts[3] == 1, "Different length kept apart");
+}
+
 int main(void) {
     printf("=== test_classify ===\n");
     test_classify_reference_reads();
     test_classify_multiple_species();
     test_classify_summary();
+    test_classify_threads();
+    test_classify_bounded();
+    test_classify_prefilter();
+    test_classify_timed();
     test_classify_nanopore_opts();
+    test_classify_dereplicate();
     printf("=== %d passed, %d failed ===\n", tests_passed, tests_failed);
     return tests_failed > 0 ? 1 : 0;
 }
@@ -615,6 +615,334 @@ static void test_em_full_lrt_vs_profile(void) {
     em_reads_free(reads, n_reads);
 }
 
+static void test_em_weighted_reads(void) {
+    printf("  test_em_weighted_reads...\n");
+    int n_reads;
+    em_read_t *reads = make_reads_2species(600, 3, 0.7, 0.3, NULL, 99, &n_reads);
+    int amp_lens[6] = { 658, 425, 560, 658, 425, 560 };
+
+    /* Each row repeated three times vs. the same row carried once with count 3 */
+    int n_dup = 3 * n_reads;
+    em_read_t *dup = (em_read_t *)hs_calloc((size_t)n_dup, sizeof(em_read_t));
+    for (int i = 0; i < n_dup; i++) {
+        const em_read_t *src = &reads[i % n_reads];
+        dup[i].marker_idx = src->marker_idx;
+        dup[i].n_candidates = src->n_candidates;
+        dup[i].species_indices = (int *)hs_malloc(2 * sizeof(int));
+        dup[i].containments = (double *)hs_malloc(2 * sizeof(double));
+        memcpy(dup[i].species_indices, src->species_indices, 2 * sizeof(int));
+        memcpy(dup[i].containments, src->containments, 2 * sizeof(double));
+    }
+    for (int i = 0; i < n_reads; i++) reads[i].count = 3;
+    ASSERT_NEAR(em_reads_total(reads, n_reads), (double)n_dup, 1e-9,
+                "Weighted total counts every read");
+
+    em_config_t cfg = em_config_default();
+    em_result_t *a = em_fit(dup, n_dup, 2, 3, amp_lens, &cfg);
+    em_result_t *b = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+    ASSERT(a && b, "Both fits converged");
+    if (a && b) {
+        ASSERT_NEAR(b->w[0], a->w[0], 1e-6, "Weighted w[0] matches duplicated reads");
+        ASSERT_NEAR(b->log_likelihood, a->log_likelihood, 1e-4,
+                    "Weighted log-likelihood matches duplicated reads");
+        ASSERT_NEAR(b->w_ci_hi[0] - b->w_ci_lo[0], a->w_ci_hi[0] - a->w_ci_lo[0], 1e-6,
+                    "Weighted CI width matches duplicated reads");
+    }
+    em_result_destroy(a);
+    em_result_destroy(b);
+
+    /* Collapsing the duplicated rows recovers one weighted row per original */
+    int n_col = em_reads_collapse(dup, n_dup);
+    ASSERT(n_col <= n_reads, "Collapse merges identical rows");
+    ASSERT_NEAR(em_reads_total(dup, n_col), (double)n_dup, 1e-9,
+                "Collapse preserves total read count");
+
+    /* Nudged containments only share a class once quantised */
+    for (int i = 0; i < n_col; i++) dup[i].count = 1;
+    for (int i = 0; i < n_col; i++)
+        for (int j = 0; j < dup[i].n_candidates; j++)
+            dup[i].containments[j] += (i % 3) * 1e-4;
+    int n_exact = em_reads_collapse(dup, n_col);
+    ASSERT(n_exact == n_col, "Exact classes keep nudged rows apart");
+    em_reads_quantize(dup, n_exact, 0.01);
+    int n_q = em_reads_collapse(dup, n_exact);
+    ASSERT(n_q < n_exact, "Quantised containments merge near-identical rows");
+    ASSERT_NEAR(em_reads_total(dup, n_q), (double)n_exact, 1e-9,
+                "Quantised classes preserve total read count");
+    int on_grid = 1;
+    for (int i = 0; i < n_q; i++)
+        for (int j = 0; j < dup[i].n_candidates; j++) {
+            double q = dup[i].containments[j] / 0.01;
+            if (fabs(q - floor(q + 0.5)) > 1e-9 || dup[i].containments[j] < 0.01) on_grid = 0;
+        }
+    ASSERT(on_grid, "Quantised containments lie on the grid");
+
+    em_reads_free(dup, n_q);
+    em_reads_free(reads, n_reads);
+}
+
+static void test_em_squarem(void) {
+    printf("  test_em_squarem...\n");
+    /* Minority species with PCR bias: plain EM creeps along the w-b ridge */
+    double bias[6] = { 1.0, 1.0, 1.0,
+                       2.0, 0.5, 1.0 };
+    int n_reads;
+    em_read_t *reads = make_reads_2species(6000, 3, 0.9, 0.1, bias, 2024, &n_reads);
+    int amp_lens[6] = { 658, 425, 560, 658, 425, 560 };
+
+    em_config_t cfg = em_config_default();
+    cfg.conv_threshold = 1e-10;
+    cfg.max_iter = 2000;
+    em_result_t *plain = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+    cfg.use_squarem = 1;
+    em_result_t *fast = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+    ASSERT(plain && fast, "Both fits returned");
+    if (plain && fast) {
+        ASSERT(fast->converged, "SQUAREM fit converged");
+        ASSERT(plain->n_extrapolations == 0, "Plain EM never extrapolates");
+        ASSERT(2 * fast->n_iterations <= plain->n_iterations,
+               "SQUAREM at least halves the EM steps");
+        ASSERT_NEAR(fast->w[1], plain->w[1], 1e-3, "Same minor-species weight");
+        ASSERT(fast->log_likelihood >= plain->log_likelihood - 1e-6 * fabs(plain->log_likelihood),
+               "SQUAREM likelihood is no worse");
+    }
+    em_result_destroy(plain);
+    em_result_destroy(fast);
+    em_reads_free(reads, n_reads);
+}
+
+static void test_em_warm_start(void) {
+    printf("  test_em_warm_start...\n");
+    double bias[6] = { 1.0, 1.0, 1.0,
+                       2.0, 0.5, 1.0 };
+    int n_reads;
+    em_read_t *reads = make_reads_2species(6000, 3, 0.9, 0.1, bias, 77, &n_reads);
+    int amp_lens[6] = { 658, 425, 560, 658, 425, 560 };
+
+    em_config_t cfg = em_config_default();
+    cfg.conv_threshold = 1e-10;
+    cfg.max_iter = 2000;
+    /* Fit the first half, then the whole set warm-started from it */
+    em_result_t *half = em_fit(reads, n_reads / 2, 2, 3, amp_lens, &cfg);
+    em_result_t *cold = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+    cfg.warm_start = half;
+    cfg.n_restarts = 1;
+    em_result_t *warm = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+    ASSERT(half && cold && warm, "All fits returned");
+    if (half && cold && warm) {
+        ASSERT(warm->n_iterations < cold->n_iterations, "Warm start needs fewer EM steps");
+        ASSERT_NEAR(warm->w[1], cold->w[1], 1e-3, "Warm start reaches the same weights");
+    }
+    em_result_destroy(half);
+    em_result_destroy(cold);
+    em_result_destroy(warm);
+    em_reads_free(reads, n_reads);
+}
+
+static void test_em_data_csr(void) {
+    printf("  test_em_data_csr...\n");
+    int n_reads;
+    em_read_t *reads = make_reads_2species(300, 3, 0.6, 0.4, NULL, 5, &n_reads);
+    reads[1].count = 4;
+    reads[2].marker_idx = -1;
+    reads[3].containments[1] = 0.0;
+
+    em_data_t *data = em_data_from_reads(reads, n_reads);
+    ASSERT(data->n_rows == n_reads, "One CSR row per read");
+    ASSERT(data->n_entries == 2 * n_reads, "One CSR entry per candidate");
+    ASSERT(data->offsets[0] == 0 && data->offsets[n_reads] == data->n_entries,
+           "Offsets span all entries");
+    ASSERT(data->n_markers_seen == 3, "Distinct markers counted");
+    ASSERT(data->weight[0] == 1.0 && data->weight[1] == 4.0, "Row weights from counts");
+    ASSERT(data->marker[2] == 0, "Negative marker mapped to 0");
+    int same = 1;
+    for (int r = 0; same && r < n_reads; r++)
+        for (int j = 0; j < 2; j++) {
+            int e = data->offsets[r] + j;
+            same = same && data->species[e] == reads[r].species_indices[j] &&
+                   data->containments[e] == reads[r].containments[j];
+        }
+    ASSERT(same, "Entries preserve candidate order");
+    ASSERT(isfinite(data->log_c[data->offsets[3] + 1]), "Zero containment log clamped");
+
+    int amp_lens[6] = { 658, 425, 560, 658, 425, 560 };
+    em_config_t cfg = em_config_default();
+    cfg.use_full_lrt = 1;
+    em_result_t *a = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+    em_result_t *b = em_fit_data(data, 2, 3, amp_lens, &cfg);
+    ASSERT(a && b, "Both entry points fit");
+    if (a && b) {
+        ASSERT(a->w[0] == b->w[0] && a->log_likelihood == b->log_likelihood &&
+               a->lrt_scores[0] == b->lrt_scores[0],
+               "em_fit matches em_fit_data on the packed rows");
+    }
+    em_result_destroy(a);
+    em_result_destroy(b);
+    em_data_destroy(data);
+    em_reads_free(reads, n_reads);
+}
+
+static void test_em_float_storage(void) {
+    printf("  test_em_float_storage...\n");
+    double bias[6] = { 1.0, 1.0, 1.0,
+                       2.0, 0.5, 1.0 };
+    int n_reads;
+    em_read_t *reads = make_reads_2species(4000, 3, 0.85, 0.15, bias, 39, &n_reads);
+    int amp_lens[6] = { 658, 425, 560, 658, 425, 560 };
+
+    em_config_t cfg = em_config_default();
+    cfg.use_advanced_ci = 1;
+    cfg.use_full_lrt = 1;
+    em_result_t *d = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+    cfg.float_storage = 1;
+    em_result_t *f = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+
+    /* Converted data fits the same as the float view em_fit_data takes */
+    em_data_t *data = em_data_from_reads(reads, n_reads);
+    em_data_to_float(data);
+    ASSERT(data->log_c_f && !data->log_c && !data->containments,
+           "Conversion keeps only float log-containments");
+    em_data_to_float(data);
+    ASSERT(data->log_c_f != NULL, "Converting twice is a no-op");
+    cfg.float_storage = 0;
+    em_result_t *g = em_fit_data(data, 2, 3, amp_lens, &cfg);
+
+    ASSERT(d && f && g, "All fits returned");
+    if (d && f && g) {
+        for (int s = 0; s < 2; s++) {
+            ASSERT_NEAR(f->w[s], d->w[s], 1e-4, "Float storage keeps the weights");
+            ASSERT_NEAR(f->w_ci_lo[s], d->w_ci_lo[s], 1e-3, "Float storage keeps the CI");
+            ASSERT_NEAR(f->w_ci_hi[s], d->w_ci_hi[s], 1e-3, "Float storage keeps the CI");
+        }
+        ASSERT_NEAR(f->log_likelihood, d->log_likelihood, 1e-6 * fabs(d->log_likelihood),
+                    "Float storage keeps the likelihood");
+        ASSERT(f->w[1] == g->w[1] && f->log_likelihood == g->log_likelihood,
+               "Float data fits as float storage");
+    }
+    em_result_destroy(d);
+    em_result_destroy(f);
+    em_result_destroy(g);
+    em_data_destroy(data);
+    em_reads_free(reads, n_reads);
+}
+
+static void test_em_threads_deterministic(void) {
+    printf("  test_em_threads_deterministic...\n");
+    int n_reads;
+    double bias[6] = { 1.3, 0.8, 1.0, 0.7, 1.2, 1.1 };
+    /* Enough rows for several E-step chunks */
+    em_read_t *reads = make_reads_2species(5000, 3, 0.8, 0.2, bias, 17, &n_reads);
+    int amp_lens[6] = { 658, 425, 560, 658, 425, 560 };
+
+    em_config_t cfg = em_config_default();
+    cfg.n_restarts = 4;
+    cfg.estimate_degradation = 1;
+    cfg.use_brent_lambda = 1;
+    em_result_t *a = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+    cfg.n_threads = 3;
+    em_result_t *b = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+    cfg.n_threads = 8;
+    em_result_t *c = em_fit(reads, n_reads, 2, 3, amp_lens, &cfg);
+    ASSERT(a && b && c, "Threaded fits converged");
+    if (a && b && c) {
+        ASSERT(a->w[0] == b->w[0] && a->w[0] == c->w[0] &&
+               a->log_likelihood == b->log_likelihood &&
+               a->log_likelihood == c->log_likelihood &&
+               a->lambda_proc == b->lambda_proc && a->lambda_proc == c->lambda_proc &&
+               a->n_iterations == b->n_iterations && a->n_iterations == c->n_iterations,
+               "Fit is identical for any thread count");
+        ASSERT_NEAR(a->w[0], 0.8, 0.1, "Threaded w[0] near 0.8");
+        int same = a->n_restarts == 4 && c->n_restarts == 4, has_best = 0;
+        for (int k = 0; same && k < 4; k++) {
+            same = a->restart_iterations[k] == c->restart_iterations[k];
+            has_best |= a->restart_iterations[k] == a->n_iterations;
+        }
+        ASSERT(same && has_best, "Per-restart iterations recorded, independent of threads");
+    }
+    em_result_destroy(a);
+    em_result_destroy(b);
+    em_result_destroy(c);
+    em_reads_free(reads, n_reads);
+}
+
+static void test_em_full_lrt_masked_refit(void) {
+    printf("  test_em_full_lrt_masked_refit...\n");
+    /* 3 species; some reads list only species 2, which must drop out of
+     * the nested model without species 2 */
+    const int S = 3, M = 2, n_reads = 1200;
+    hs_rng_t rng;
+    hs_rng_seed(&rng, 71);
+    em_read_t *reads = (em_read_t *)hs_calloc((size_t)n_reads, sizeof(em_read_t));
+    for (int r = 0; r < n_reads; r++) {
+        int true_sp = r % 10 < 6 ? 0 : (r % 10 < 9 ? 1 : 2);
+        int only = (true_sp == 2 && r % 20 == 9);
+        int nc = only ? 1 : S;
+        reads[r].marker_idx = r % M;
+        reads[r].n_candidates = nc;
+        reads[r].species_indices = (int *)hs_malloc((size_t)nc * sizeof(int));
+        reads[r].containments = (double *)hs_malloc((size_t)nc * sizeof(double));
+        for (int j = 0; j < nc; j++) {
+            int sp = only ? 2 : j;
+            reads[r].species_indices[j] = sp;
+            reads[r].containments[j] = sp == true_sp ? 0.8 + 0.2 * hs_rng_uniform(&rng)
+                                                     : 0.3 * hs_rng_uniform(&rng);
+        }
+    }
+    int amp_lens[6] = { 658, 425, 658, 425, 658, 425 };
+
+    em_config_t cfg = em_config_default();
+    cfg.use_full_lrt = 1;
+    em_result_t *full = em_fit(reads, n_reads, S, M, amp_lens, &cfg);
+    ASSERT(full != NULL, "Full model fit");
+
+    /* Reference: physically reduced copies fitted from scratch */
+    for (int s_test = 0; full && s_test < S; s_test++) {
+        em_read_t *red = (em_read_t *)hs_calloc((size_t)n_reads, sizeof(em_read_t));
+        int n_red = 0;
+        for (int r = 0; r < n_reads; r++) {
+            int nc = 0;
+            for (int j = 0; j < reads[r].n_candidates; j++)
+                if (reads[r].species_indices[j] != s_test) nc++;
+            if (nc == 0) continue;
+            red[n_red].marker_idx = reads[r].marker_idx;
+            red[n_red].n_candidates = nc;
+            red[n_red].species_indices = (int *)hs_malloc((size_t)nc * sizeof(int));
+            red[n_red].containments = (double *)hs_malloc((size_t)nc * sizeof(double));
+            int k = 0;
+            for (int j = 0; j < reads[r].n_candidates; j++) {
+                int sp = reads[r].species_indices[j];
+                if (sp == s_test) continue;
+                red[n_red].species_indices[k] = sp > s_test ? sp - 1 : sp;
+                red[n_red].containments[k] = reads[r].containments[j];
+                k++;
+            }
+            n_red++;
+        }
+        em_config_t rcfg = em_config_default();
+        rcfg.max_iter = 1000;
+        rcfg.conv_threshold = 1e-10;
+        em_result_t *ref = em_fit(red, n_red, S - 1, M, amp_lens, &rcfg);
+        double want = 2.0 * (full->log_likelihood - ref->log_likelihood);
+        if (want < 0) want = 0;
+        ASSERT_NEAR(full->lrt_scores[s_test], want, 1e-3 * want + 0.05,
+                    "Masked warm-started refit matches reduced-copy refit");
+        em_result_destroy(ref);
+        em_reads_free(red, n_red);
+    }
+
+    /* Refits run concurrently but give the same scores */
+    cfg.n_threads = 4;
+    em_result_t *par = em_fit(reads, n_reads, S, M, amp_lens, &cfg);
+    int same = full && par;
+    for (int s = 0; same && s < S; s++)
+        same = full->lrt_scores[s] == par->lrt_scores[s];
+    ASSERT(same, "Nested refits independent of thread count");
+
+    em_result_destroy(full);
+    em_result_destroy(par);
+    em_reads_free(reads, n_reads);
+}
+
 int main(void) {
     printf("=== test_em ===\n");
     test_em_basic_50_50();
@@ -633,6 +961,13 @@ int main(void) {
     test_em_fisher_vs_wald();
     test_em_brent_vs_closedform();
     test_em_full_lrt_vs_profile();
+    test_em_weighted_reads();
+    test_em_squarem();
+    test_em_warm_start();
+    test_em_data_csr();
+    test_em_float_storage();
+    test_em_threads_deterministic();
+    test_em_full_lrt_masked_refit();
     printf("=== %d passed, %d failed ===\n", tests_passed, tests_failed);
     return tests_failed > 0 ? 1 : 0;
 }
@@ -5,6 +5,8 @@
 #include <assert.h>
 #include "refdb.h"
 #include "index.h"
+#include "primer.h"
+#include "update.h"
 #include "utils.h"
 
 static int tests_passed = 0;
@@ -71,6 +73,25 @@ static void test_refdb_save_load(void) {
     ASSERT(mr != NULL, "Found beef COI marker ref");
     ASSERT(mr->seq_len > 0, "Marker ref has sequence");
 
+    /* Dense lookup and amplicon-length table survive the round trip */
+    int same = 1;
+    for (int s = 0; s < db->n_species; s++)
+        for (int m = 0; m < db->n_markers; m++) {
+            const marker_ref_t *a = refdb_get_marker_ref(db, s, m);
+            const marker_ref_t *b = refdb_get_marker_ref(db2, s, m);
+            int want = a ? a->amplicon_length : 0;
+            same = same && (a == NULL) == (b == NULL) &&
+                   (!a || (a->species_idx == s && a->marker_idx == m &&
+                           b->seq_len == a->seq_len)) &&
+                   db->amp_lens[s * db->n_markers + m] == want &&
+                   db2->amp_lens[s * db->n_markers + m] == want;
+        }
+    ASSERT(same, "Marker ref lookup and amplicon lengths match after load");
+    ASSERT(refdb_get_marker_ref(db2, -1, 0) == NULL &&
+           refdb_get_marker_ref(db2, 0, db2->n_markers) == NULL &&
+           refdb_get_marker_ref(db2, db2->n_species, 0) == NULL,
+           "Out-of-range marker ref lookup returns NULL");
+
     refdb_destroy(db);
     refdb_destroy(db2);
     remove(path);
@@ -83,7 +104,8 @@ static void test_index_build(void) {
     ASSERT(idx != NULL, "Index built");
     ASSERT(idx->coarse != NULL, "Coarse sketches exist");
     ASSERT(idx->fine != NULL, "Fine k-mer sets exist");
-    ASSERT(idx->primer_index != NULL, "Primer index exists");
+    ASSERT(idx->primers != NULL && idx->primers->n_patterns == 4 * db->n_markers,
+           "Primer scanner holds every primer orientation");
 
     /* Each species should have a non-empty coarse sketch */
     for (int s = 0; s < db->n_species; s++) {
@@ -138,6 +160,36 @@ static void test_index_query_fine(void) {
     index_destroy(idx);
 }
 
+static void test_index_fine_posting(void) {
+    printf("  test_index_fine_posting...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+    ASSERT(idx->fine_posting != NULL, "Posting table built");
+
+    int S = idx->db->n_species, M = idx->db->n_markers;
+    double *all = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+
+    /* One-pass scores must equal the per-set queries for every read */
+    int mismatches = 0;
+    for (int i = 0; i < idx->db->n_marker_refs; i++) {
+        marker_ref_t *mr = &idx->db->markers[i];
+        int len = mr->seq_len > 120 ? 120 : mr->seq_len;
+        kmer_profile_set_seq(&qp, mr->sequence, len);
+        index_query_fine_all_profile(idx, &qp, all);
+        for (int m = 0; m < M; m++)
+            for (int s = 0; s < S; s++)
+                if (all[m * S + s] != index_query_fine(idx, mr->sequence, len, m, s))
+                    mismatches++;
+    }
+    ASSERT(mismatches == 0, "Posting scores match per-set containment");
+
+    kmer_profile_free(&qp);
+    free(all);
+    index_destroy(idx);
+}
+
 static void test_index_save_load(void) {
     printf("  test_index_save_load...\n");
     halal_refdb_t *db = refdb_build_default();
@@ -161,6 +213,463 @@ static void test_index_save_load(void) {
     remove(path);
 }
 
+static void test_index_sampled(void) {
+    printf("  test_index_sampled...\n");
+    halal_index_t *dense = index_build(refdb_build_default());
+    halal_index_t *idx = index_build_sampled(refdb_build_default(), 1, HS_SYNCMER_S);
+    ASSERT(idx->fine_syncmer_s == HS_SYNCMER_S && dense->fine_syncmer_s == 0,
+           "Sampling recorded");
+    long nd = 0, ns = 0;
+    int M = idx->db->n_markers, S = idx->db->n_species;
+    for (int m = 0; m < M; m++)
+        for (int s = 0; s < S; s++) {
+            if (dense->fine[m][s]) nd += dense->fine[m][s]->n_kmers;
+            if (idx->fine[m][s]) ns += idx->fine[m][s]->n_kmers;
+        }
+    ASSERT(ns > 0 && ns * 6 < nd, "Sampled fine sets are several times smaller");
+
+    /* A reference read finds every one of its syncmers, against either
+     * index, and its own species still scores highest */
+    int beef = refdb_find_species(idx->db, "Bos_taurus");
+    int pork = refdb_find_species(idx->db, "Sus_scrofa");
+    marker_ref_t *mr = refdb_get_marker_ref(idx->db, beef, 0);
+    double *a = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+    int *counts = (int *)hs_malloc((size_t)M * (size_t)S * sizeof(int));
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+    kmer_profile_set_seq(&qp, mr->sequence, mr->seq_len);
+    index_query_fine_all_profile(idx, &qp, a);
+    ASSERT_NEAR(a[beef], 1.0, 1e-12, "Sampled self-containment");
+    ASSERT(a[pork] < a[beef], "Other species lower on a sampled index");
+    index_query_fine_bounded(dense, &qp, NULL, 0, 0.0, HS_SYNCMER_S, a, counts);
+    ASSERT_NEAR(a[beef], 1.0, 1e-12, "Sampled read against a dense index");
+
+    const char *path = "/tmp/test_halal_sampled.idx";
+    ASSERT(index_save(idx, path) == 0, "Sampled index saved");
+    halal_index_t *idx2 = index_load(path);
+    ASSERT(idx2 && idx2->fine_syncmer_s == HS_SYNCMER_S, "Sampling survives a reload");
+    if (idx2) {
+        double *b = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+        index_query_fine_all_profile(idx, &qp, a);
+        index_query_fine_all_profile(idx2, &qp, b);
+        ASSERT(memcmp(a, b, (size_t)M * (size_t)S * sizeof(double)) == 0,
+               "Reloaded sampled index scores alike");
+        free(b);
+    }
+
+    kmer_profile_free(&qp);
+    free(a);
+    free(counts);
+    index_destroy(idx2);
+    index_destroy(idx);
+    index_destroy(dense);
+    remove(path);
+}
+
+static void test_index_v3_mapped(void) {
+    printf("  test_index_v3_mapped...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+    const char *path = "/tmp/test_halal_v3.idx";
+    ASSERT(index_save(idx, path) == 0, "v3 index saved");
+
+    halal_index_t *idx2 = index_load(path);
+    ASSERT(idx2 != NULL && idx2->map != NULL, "v3 index mapped");
+    if (idx2) {
+        int S = idx->db->n_species, M = idx->db->n_markers;
+        double *a = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+        double *b = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+        double *ca = (double *)hs_malloc((size_t)S * sizeof(double));
+        double *cb = (double *)hs_malloc((size_t)S * sizeof(double));
+        kmer_profile_t qp;
+        kmer_profile_init(&qp);
+        int mismatches = 0;
+        for (int i = 0; i < idx->db->n_marker_refs; i++) {
+            marker_ref_t *mr = &idx->db->markers[i];
+            kmer_profile_set_seq(&qp, mr->sequence, mr->seq_len);
+            index_query_fine_all_profile(idx, &qp, a);
+            index_query_fine_all_profile(idx2, &qp, b);
+            index_query_coarse_profile(idx, &qp, ca, S);
+            index_query_coarse_profile(idx2, &qp, cb, S);
+            for (int j = 0; j < M * S; j++) if (a[j] != b[j]) mismatches++;
+            for (int j = 0; j < S; j++) if (ca[j] != cb[j]) mismatches++;
+            /* Sorted-array fine sets answer single-pair queries too */
+            if (index_query_fine(idx, mr->sequence, mr->seq_len, mr->marker_idx, mr->species_idx) !=
+                index_query_fine(idx2, mr->sequence, mr->seq_len, mr->marker_idx, mr->species_idx))
+                mismatches++;
+            if (index_detect_marker_profile(idx, &qp) != index_detect_marker_profile(idx2, &qp))
+                mismatches++;
+        }
+        ASSERT(mismatches == 0, "Mapped index scores match built index");
+
+        /* Re-saving a mapped index reproduces the file */
+        const char *path2 = "/tmp/test_halal_v3b.idx";
+        ASSERT(index_save(idx2, path2) == 0, "Mapped index re-saved");
+        size_t n1 = 0, n2 = 0;
+        void *m1 = hs_map_file(path, &n1), *m2 = hs_map_file(path2, &n2);
+        ASSERT(m1 && m2 && n1 == n2 && memcmp(m1, m2, n1) == 0, "Re-saved file identical");
+        hs_unmap_file(m1, n1);
+        hs_unmap_file(m2, n2);
+        remove(path2);
+
+        kmer_profile_free(&qp);
+        free(ca);
+        free(cb);
+        free(a);
+        free(b);
+        index_destroy(idx2);
+    }
+
+    /* A truncated file is rejected */
+    size_t n = 0;
+    void *m = hs_map_file(path, &n);
+    char *half = (char *)hs_malloc(n / 2);
+    memcpy(half, m, n / 2);
+    hs_unmap_file(m, n);
+    FILE *fp = fopen(path, "wb");
+    fwrite(half, 1, n / 2, fp);
+    fclose(fp);
+    free(half);
+    ASSERT(index_load(path) == NULL, "Truncated index rejected");
+
+    remove(path);
+    index_destroy(idx);
+}
+
+/* Overwrite the u32 at pool[word] of a saved index's posting table */
+static void poke_pool(const char *path, const halal_index_t *idx, uint64_t word, uint32_t v) {
+    uint64_t bounds[64];
+    int n = index_file_sections(path, bounds, 63);
+    const kmer_posting_t *pt = idx->fine_posting;
+    uint64_t nb = ((uint64_t)1 << pt->dir_bits) + 1;
+    /* Posting block: u64 n_keys, pool_n, i32 x 4, keys, dir_key, dir_pool */
+    uint64_t off = bounds[n - 2] + 32 + 8 * (pt->n_keys + 2 * nb) + 4 * word;
+    FILE *fp = fopen(path, "r+b");
+    fseek(fp, (long)off, SEEK_SET);
+    fwrite(&v, sizeof(v), 1, fp);
+    fclose(fp);
+}
+
+static void test_index_posting_corrupt(void) {
+    printf("  test_index_posting_corrupt...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+    ASSERT(idx->fine_posting && kmer_posting_valid(idx->fine_posting), "Built table is valid");
+    const char *path = "/tmp/test_halal_posting.idx";
+    const marker_ref_t *mr = &idx->db->markers[0];
+    int M = idx->db->n_markers, S = idx->db->n_species;
+    double *a = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+    double *b = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+    kmer_profile_set_seq(&qp, mr->sequence, mr->seq_len);
+    index_query_fine_all_profile(idx, &qp, a);
+
+    /* A cell past M * S, then an entry count running past the pool: the
+     * mapped table is dropped and rebuilt, and scores are unchanged */
+    uint32_t bad[2][2] = { { 1, 0xFFFFFFFFu }, { 0, 0x7FFFFFFFu } };
+    for (int t = 0; t < 2; t++) {
+        ASSERT(index_save(idx, path) == 0, "Index saved");
+        poke_pool(path, idx, bad[t][0], bad[t][1]);
+        halal_index_t *idx2 = index_load(path);
+        ASSERT(idx2 && idx2->fine_posting && !idx2->fine_posting->borrowed,
+               t ? "Overlong posting entry rebuilt" : "Out-of-range posting cell rebuilt");
+        if (idx2) {
+            index_query_fine_all_profile(idx2, &qp, b);
+            ASSERT(memcmp(a, b, (size_t)M * (size_t)S * sizeof(double)) == 0,
+                   "Rebuilt table scores match");
+            index_destroy(idx2);
+        }
+    }
+
+    kmer_profile_free(&qp);
+    free(a);
+    free(b);
+    remove(path);
+    index_destroy(idx);
+}
+
+static void test_index_load_markers(void) {
+    printf("  test_index_load_markers...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+    const char *path = "/tmp/test_halal_markers.idx";
+    ASSERT(index_save(idx, path) == 0, "Index saved");
+    int S = idx->db->n_species, M = idx->db->n_markers;
+    ASSERT(M >= 2, "Default database has several markers");
+
+    halal_index_t *all = index_load(path);
+    ASSERT(all && !all->marker_loaded && all->fine_filter && all->fine_filter->borrowed,
+           "Full load maps the saved prefilter");
+
+    /* Keep the second marker only */
+    halal_index_t *one = index_load_markers(path, idx->db->marker_ids[1]);
+    ASSERT(one && one->marker_loaded && one->marker_loaded[1] && !one->marker_loaded[0],
+           "Marker-restricted load");
+    if (all && one) {
+        int stray = 0, mismatches = 0, kept = 0;
+        for (int m = 0; m < M; m++)
+            for (int s = 0; s < S; s++)
+                if (m != 1 && one->fine[m][s]) stray++;
+        double *a = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+        double *b = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+        kmer_profile_t qp;
+        kmer_profile_init(&qp);
+        for (int i = 0; i < idx->db->n_marker_refs; i++) {
+            marker_ref_t *mr = &idx->db->markers[i];
+            kmer_profile_set_seq(&qp, mr->sequence, mr->seq_len);
+            index_query_fine_all_profile(all, &qp, a);
+            index_query_fine_all_profile(one, &qp, b);
+            for (int j = 0; j < M * S; j++) {
+                double expect = j / S == 1 ? a[j] : 0.0;
+                if (b[j] != expect) mismatches++;
+                kept += j / S == 1 && b[j] > 0.0;
+            }
+        }
+        ASSERT(stray == 0, "Other markers' fine sets not loaded");
+        ASSERT(mismatches == 0 && kept > 0, "Kept marker scores as in the full index");
+        ASSERT(index_save(one, "/tmp/test_halal_markers2.idx") < 0 &&
+               index_remove_species(one, 0) < 0, "Restricted index is read-only");
+        kmer_profile_free(&qp);
+        free(a);
+        free(b);
+    }
+    index_destroy(one);
+    index_destroy(all);
+
+    char list[64];
+    snprintf(list, sizeof(list), "%s,%s", idx->db->marker_ids[0], idx->db->marker_ids[1]);
+    halal_index_t *two = index_load_markers(path, list);
+    ASSERT(two && two->marker_loaded[0] && two->marker_loaded[1], "Marker list parsed");
+    index_destroy(two);
+    ASSERT(index_load_markers(path, "no_such_marker") == NULL, "Unknown marker rejected");
+
+    remove(path);
+    index_destroy(idx);
+}
+
+/* Random 120 bp amplicon for (s, m) */
+static void random_amplicon(char *seq, int len, uint64_t seed) {
+    for (int i = 0; i < len; i++) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        seq[i] = "ACGT"[(seed >> 33) & 3];
+    }
+    seq[len] = '\0';
+}
+
+static halal_refdb_t *build_wide_db(int S, int M) {
+    halal_refdb_t *db = refdb_create();
+    char name[32], seq[121];
+    for (int m = 0; m < M; m++) {
+        snprintf(name, sizeof(name), "MK%d", m);
+        refdb_add_marker(db, name, NULL, NULL);
+    }
+    for (int s = 0; s < S; s++) {
+        snprintf(name, sizeof(name), "Species_%d", s);
+        refdb_add_species(db, name, name, s % 7 == 0 ? HARAM : HALAL, 1.0, 1.0);
+    }
+    /* Leave every third cell empty */
+    for (int s = 0; s < S; s++)
+        for (int m = 0; m < M; m++) {
+            if ((s + m) % 3 == 0) continue;
+            random_amplicon(seq, 120, (uint64_t)(s * M + m + 1));
+            refdb_add_marker_ref(db, s, m, seq, 120);
+        }
+    return db;
+}
+
+static void test_refdb_wide(void) {
+    printf("  test_refdb_wide...\n");
+    /* Past the old 64-species / 8-marker limits */
+    int S = 100, M = 12;
+    halal_refdb_t *db = build_wide_db(S, M);
+    ASSERT(db->n_species == S && db->n_markers == M, "Wide database built");
+    ASSERT(refdb_find_marker(db, "MK11") == 11, "Marker past slot 8 found");
+
+    const char *path = "/tmp/test_halal_wide.db";
+    ASSERT(refdb_save(db, path) == 0, "Wide database saved");
+    halal_refdb_t *db2 = refdb_load(path);
+    ASSERT(db2 && db2->n_species == S && db2->n_markers == M, "Wide database loaded");
+    int same = db2 != NULL;
+    for (int s = 0; same && s < S; s++)
+        for (int m = 0; same && m < M; m++) {
+            const marker_ref_t *a = refdb_get_marker_ref(db, s, m);
+            const marker_ref_t *b = refdb_get_marker_ref(db2, s, m);
+            same = (a == NULL) == ((s + m) % 3 == 0) && (a == NULL) == (b == NULL) &&
+                   (!a || strcmp(a->sequence, b->sequence) == 0) &&
+                   db2->amp_lens[s * M + m] == (a ? 120 : 0);
+        }
+    ASSERT(same, "Wide marker refs survive the round trip");
+    ASSERT(db2 && strcmp(db2->marker_ids[11], "MK11") == 0 &&
+           strcmp(db2->species[99].species_id, "Species_99") == 0,
+           "Wide marker and species names survive the round trip");
+    refdb_destroy(db2);
+    remove(path);
+
+    /* Index round trip; every reference is its own best fine hit */
+    halal_index_t *idx = index_build(db);
+    const char *ipath = "/tmp/test_halal_wide.idx";
+    ASSERT(index_save(idx, ipath) == 0, "Wide index saved");
+    halal_index_t *idx2 = index_load(ipath);
+    ASSERT(idx2 != NULL, "Wide index loaded");
+    if (idx2) {
+        double *a = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+        double *b = (double *)hs_malloc((size_t)M * (size_t)S * sizeof(double));
+        kmer_profile_t qp;
+        kmer_profile_init(&qp);
+        int mismatches = 0, self_hits = 0;
+        for (int i = 0; i < db->n_marker_refs; i++) {
+            const marker_ref_t *mr = &db->markers[i];
+            kmer_profile_set_seq(&qp, mr->sequence, mr->seq_len);
+            index_query_fine_all_profile(idx, &qp, a);
+            index_query_fine_all_profile(idx2, &qp, b);
+            for (int j = 0; j < M * S; j++) if (a[j] != b[j]) mismatches++;
+            if (b[mr->marker_idx * S + mr->species_idx] > 0.99) self_hits++;
+        }
+        ASSERT(mismatches == 0, "Wide mapped index scores match built index");
+        ASSERT(self_hits == db->n_marker_refs, "Every wide reference finds itself");
+        kmer_profile_free(&qp);
+        free(a);
+        free(b);
+        index_destroy(idx2);
+    }
+    remove(ipath);
+    index_destroy(idx);
+
+    /* Posting cells are not limited to 64 markers */
+    halal_refdb_t *many = build_wide_db(3, 70);
+    halal_index_t *midx = index_build(many);
+    ASSERT(midx->fine_posting != NULL, "Posting table past 64 markers");
+    ASSERT(index_save(midx, ipath) == 0, "Many-marker index saved");
+    halal_index_t *midx2 = index_load(ipath);
+    ASSERT(midx2 != NULL && midx2->fine_posting != NULL, "Many-marker index loaded");
+    if (midx2) {
+        const marker_ref_t *mr = refdb_get_marker_ref(many, 2, 69);
+        double all[70 * 3];
+        kmer_profile_t qp;
+        kmer_profile_init(&qp);
+        kmer_profile_set_seq(&qp, mr->sequence, mr->seq_len);
+        index_query_fine_all_profile(midx2, &qp, all);
+        kmer_profile_free(&qp);
+        ASSERT(mr && index_query_fine(midx2, mr->sequence, mr->seq_len, 69, 2) > 0.99 &&
+               all[69 * 3 + 2] > 0.99, "Marker 69 scored through the posting table");
+        index_destroy(midx2);
+    }
+    remove(ipath);
+    index_destroy(midx);
+}
+
+/* Species sa of a and sb of b have identical sketches and fine sets */
+static int same_species_tables(const halal_index_t *a, int sa,
+                               const halal_index_t *b, int sb) {
+    const fmh_sketch_t *ca = a->coarse[sa], *cb = b->coarse[sb];
+    if (ca->n != cb->n || memcmp(ca->hashes, cb->hashes, (size_t)ca->n * sizeof(uint64_t)))
+        return 0;
+    for (int m = 0; m < a->db->n_markers; m++) {
+        const kmer_set_t *fa = a->fine[m][sa], *fb = b->fine[m][sb];
+        if (!fa || !fb) { if (fa != fb) return 0; continue; }
+        if (fa->k != fb->k || fa->n_kmers != fb->n_kmers) return 0;
+        size_t n = (size_t)fa->n_kmers;
+        uint64_t *ka = (uint64_t *)hs_malloc((n ? n : 1) * sizeof(uint64_t));
+        uint64_t *kb = (uint64_t *)hs_malloc((n ? n : 1) * sizeof(uint64_t));
+        kmer_set_sorted_keys(fa, ka);
+        kmer_set_sorted_keys(fb, kb);
+        int same = memcmp(ka, kb, n * sizeof(uint64_t)) == 0;
+        free(ka);
+        free(kb);
+        if (!same) return 0;
+    }
+    return 1;
+}
+
+static void test_index_build_threads(void) {
+    printf("  test_index_build_threads...\n");
+    halal_index_t *a = index_build_threads(refdb_build_default(), 1);
+    halal_index_t *b = index_build_threads(refdb_build_default(), 4);
+    int same = a->coarse_scale == b->coarse_scale;
+    for (int s = 0; s < a->db->n_species; s++) same &= same_species_tables(a, s, b, s);
+    ASSERT(same, "Threaded build matches serial build");
+    ASSERT(b->fine_posting != NULL && b->coarse_multi != NULL, "Derived tables built");
+    index_destroy(a);
+    index_destroy(b);
+}
+
+static void test_index_incremental(void) {
+    printf("  test_index_incremental...\n");
+    halal_index_t *full = index_build(refdb_build_default());
+    halal_refdb_t *src = refdb_build_default();
+    int chicken = refdb_find_species(src, "Gallus_gallus");
+
+    /* Removing a species matches building without it */
+    halal_refdb_t *db = refdb_build_default();
+    ASSERT(refdb_remove_species(db, chicken) == 0, "Species removed from refdb");
+    ASSERT(db->n_species == src->n_species - 1 && refdb_find_species(db, "Gallus_gallus") < 0,
+           "Refdb shrinks by one");
+    ASSERT(refdb_get_marker_ref(db, chicken, 0) != NULL &&
+           refdb_get_marker_ref(db, chicken, 0)->species_idx == chicken,
+           "Later species shift down with their refs");
+    halal_index_t *without = index_build(db);
+    halal_index_t *patched = index_build(refdb_build_default());
+    ASSERT(index_remove_species(patched, chicken) == 0, "Species removed from index");
+    int same = patched->db->n_species == without->db->n_species;
+    for (int s = 0; same && s < without->db->n_species; s++)
+        same &= same_species_tables(patched, s, without, s);
+    ASSERT(same, "Removal matches a rebuild");
+
+    /* Adding it back appends it with the tables a full build gives it */
+    int s = index_add_species(without, src, chicken);
+    ASSERT(s == src->n_species - 1, "Added species appended");
+    ASSERT(index_add_species(without, src, chicken) == -1, "Duplicate add rejected");
+    ASSERT(same_species_tables(without, s, full, chicken), "Added species matches full build");
+    ASSERT(without->db->species[s].status == src->species[chicken].status,
+           "Species metadata copied");
+
+    /* Posting table rebuilt: every read scores as against the full build */
+    marker_ref_t *mr = NULL;
+    for (int m = 0; !mr && m < src->n_markers; m++) mr = refdb_get_marker_ref(src, chicken, m);
+    int S = full->db->n_species, M = full->db->n_markers;
+    double *a = (double *)hs_calloc((size_t)(S * M), sizeof(double));
+    double *b = (double *)hs_calloc((size_t)(S * M), sizeof(double));
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+    kmer_profile_set_seq(&qp, mr->sequence, mr->seq_len);
+    index_query_fine_all_profile(full, &qp, a);
+    index_query_fine_all_profile(without, &qp, b);
+    int ok = 1;
+    for (int m = 0; m < M; m++) {
+        for (int t = 0; t < S; t++) {
+            int u = refdb_find_species(without->db, full->db->species[t].species_id);
+            ok &= u >= 0 && a[m * S + t] == b[m * S + u];
+        }
+    }
+    ASSERT(ok, "Patched index scores like the full build");
+    kmer_profile_free(&qp);
+    free(a);
+    free(b);
+
+    /* A loaded (mapped) index can be patched and saved over its own file */
+    const char *path = "/tmp/test_halal_patch.idx";
+    ASSERT(index_save(full, path) == 0, "Saved index");
+    halal_index_t *loaded = index_load(path);
+    ASSERT(loaded != NULL && index_remove_species(loaded, chicken) == 0, "Patched loaded index");
+    ASSERT(loaded && index_save(loaded, path) == 0, "Saved over mapped file");
+    index_destroy(loaded);
+    halal_index_t *reloaded = index_load(path);
+    ASSERT(reloaded != NULL && reloaded->db->n_species == S - 1 &&
+           refdb_find_species(reloaded->db, "Gallus_gallus") < 0, "Reloaded patched index");
+    same = reloaded != NULL;
+    for (int t = 0; same && t < S - 1; t++)
+        same &= same_species_tables(reloaded, t, patched, t);
+    ASSERT(same, "Reloaded patch matches in-memory patch");
+    remove(path);
+
+    index_destroy(reloaded);
+    index_destroy(patched);
+    index_destroy(without);
+    index_destroy(full);
+    refdb_destroy(src);
+}
+
 static void test_index_detect_marker(void) {
     printf("  test_index_detect_marker...\n");
     halal_refdb_t *db = refdb_build_default();
@@ -178,6 +687,186 @@ static void test_index_detect_marker(void) {
     index_destroy(idx);
 }
 
+static void revcomp_str(const char *in, int n, char *out) {
+    for (int i = 0; i < n; i++) {
+        char b = in[n - 1 - i];
+        out[i] = b == 'A' ? 'T' : b == 'C' ? 'G' : b == 'G' ? 'C' : b == 'T' ? 'A' : 'N';
+    }
+    out[n] = '\0';
+}
+
+static void test_primer_scan(void) {
+    printf("  test_primer_scan...\n");
+    halal_refdb_t *db = refdb_build_default();
+    primer_scanner_t *ps = primer_scanner_build(db);
+    ASSERT(ps != NULL && ps->n_patterns == 4 * db->n_markers, "Scanner built");
+
+    /* read = forward primer + insert + revcomp(reverse primer) */
+    const char *pf = db->primer_f[1], *pr = db->primer_r[1];
+    int lf = (int)strlen(pf), lr = (int)strlen(pr), ins = 120;
+    char read[512], rc[512], rpr[64];
+    memcpy(read, pf, (size_t)lf);
+    uint32_t st = 12345;
+    for (int i = 0; i < ins; i++) {
+        st = st * 1103515245u + 12345u;
+        read[lf + i] = "ACGT"[(st >> 16) & 3];
+    }
+    revcomp_str(pr, lr, rpr);
+    memcpy(read + lf + ins, rpr, (size_t)lr);
+    int len = lf + ins + lr;
+    read[len] = '\0';
+
+    primer_hit_t h;
+    int m = primer_scan(ps, read, len, PRIMER_DEFAULT_WINDOW, PRIMER_DEFAULT_MISMATCHES, &h);
+    ASSERT(m == 1 && h.marker_idx == 1, "Forward read assigned to its marker");
+    ASSERT(h.offset == 0 && h.mismatches == 0, "Exact primer at read start");
+    ASSERT(h.trim_start == lf && h.trim_end == lf + ins, "Both primers trimmed");
+
+    /* A mismatch inside the forward primer is tolerated */
+    int pos = lf / 2;
+    while (strchr("ACGT", read[pos]) == NULL) pos++;
+    read[pos] = read[pos] == 'A' ? 'C' : 'A';
+    m = primer_scan(ps, read, len, PRIMER_DEFAULT_WINDOW, PRIMER_DEFAULT_MISMATCHES, &h);
+    ASSERT(m == 1 && h.trim_start == lf, "Primer found with one mismatch");
+    ASSERT(primer_scan(ps, read, len, PRIMER_DEFAULT_WINDOW, 0, NULL) == 1,
+           "Exact reverse primer still found at 3' end");
+
+    /* Reverse-strand read: reverse primer leads, revcomp(forward) trails */
+    revcomp_str(read, len, rc);
+    m = primer_scan(ps, rc, len, PRIMER_DEFAULT_WINDOW, PRIMER_DEFAULT_MISMATCHES, &h);
+    ASSERT(m == 1, "Reverse-strand read assigned to its marker");
+    ASSERT(h.trim_start == lr && h.trim_end == lr + ins, "Reverse-strand primers trimmed");
+
+    /* Exact primers of two markers tie; both strands break it the same
+     * way (marker 0's forward primer ranks first) */
+    const char *pf0 = db->primer_f[0];
+    int lf0 = (int)strlen(pf0);
+    char tie[512], tie_rc[512], rpf[64];
+    memcpy(tie, pf0, (size_t)lf0);
+    memcpy(tie + lf0, read + lf, (size_t)ins);
+    revcomp_str(pf, lf, rpf);
+    memcpy(tie + lf0 + ins, rpf, (size_t)lf);
+    int tlen = lf0 + ins + lf;
+    tie[tlen] = '\0';
+    revcomp_str(tie, tlen, tie_rc);
+    int mt = primer_scan(ps, tie, tlen, PRIMER_DEFAULT_WINDOW, PRIMER_DEFAULT_MISMATCHES, NULL);
+    int mr = primer_scan(ps, tie_rc, tlen, PRIMER_DEFAULT_WINDOW, PRIMER_DEFAULT_MISMATCHES, NULL);
+    ASSERT(mt == 0 && mr == 0, "Tied primers give a read and its reverse complement one marker");
+
+    /* Insert alone carries no primer */
+    m = primer_scan(ps, read + lf, ins, PRIMER_DEFAULT_WINDOW, PRIMER_DEFAULT_MISMATCHES, &h);
+    ASSERT(m == -1 && h.marker_idx == -1, "No primer in bare insert");
+    ASSERT(h.trim_start == 0 && h.trim_end == ins, "Untrimmed span is the whole read");
+
+    primer_scanner_destroy(ps);
+    refdb_destroy(db);
+}
+
+static void test_index_update_delta(void) {
+    printf("  test_index_update_delta...\n");
+    hs_sha256_t h;
+    char hex[65];
+    hs_sha256_init(&h);
+    hs_sha256_update(&h, "abc", 3);
+    hs_sha256_final(&h, hex);
+    ASSERT(strcmp(hex, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad") == 0,
+           "SHA-256 of abc");
+    const char *two = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    hs_sha256_init(&h);
+    for (const char *c = two; *c; c++) hs_sha256_update(&h, c, 1);
+    hs_sha256_final(&h, hex);
+    ASSERT(strcmp(hex, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1") == 0,
+           "SHA-256 fed byte by byte across two blocks");
+
+    /* Old index without chicken; the new one adds it */
+    halal_refdb_t *src = refdb_build_default();
+    int chicken = refdb_find_species(src, "Gallus_gallus");
+    halal_index_t *idx = index_build(refdb_build_default());
+    index_remove_species(idx, chicken);
+    const char *old_path = "/tmp/test_halal_update_old.idx";
+    const char *new_path = "/tmp/test_halal_update_new.idx";
+    ASSERT(index_save(idx, old_path) == 0, "Saved old index");
+    index_add_species(idx, src, chicken);
+    ASSERT(index_save(idx, new_path) == 0, "Saved new index");
+    int M = idx->db->n_markers;
+    index_destroy(idx);
+    refdb_destroy(src);
+
+    uint64_t bounds[16];
+    int n = index_file_sections(new_path, bounds, 15);
+    FILE *fp = fopen(new_path, "rb");
+    fseek(fp, 0, SEEK_END);
+    uint64_t size = (uint64_t)ftell(fp);
+    fclose(fp);
+    ASSERT(n == M + 4 && bounds[0] == 0 && bounds[n] == size, "Sections tile the file");
+    ASSERT(index_file_sections(new_path, bounds, M + 3) == 0, "Too many sections for max");
+
+    /* Manifest round trip */
+    const char *man_path = "/tmp/test_halal_update.json";
+    fp = fopen(man_path, "w");
+    ASSERT(hs_manifest_write(new_path, 999999, "file:///tmp/test_halal_update_new.idx",
+                             4096, fp) == 1, "Manifest written");
+    fclose(fp);
+    fp = fopen(man_path, "rb");
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *json = (char *)hs_calloc((size_t)len + 1, 1);
+    ASSERT(fread(json, 1, (size_t)len, fp) == (size_t)len, "Manifest read");
+    fclose(fp);
+    hs_update_ctx_t ctx;
+    hs_update_init(&ctx);
+    ASSERT(hs_manifest_parse(json, &ctx.manifest) == 1, "Manifest parsed");
+    free(json);
+    remove(man_path);
+    ASSERT(ctx.manifest.version == 999999 && ctx.manifest.size_bytes == size &&
+           ctx.manifest.chunk_bytes == 4096 && ctx.manifest.n_chunks > n,
+           "Manifest fields and chunks");
+    char err[256];
+    ASSERT(hs_update_verify_sha256(new_path, ctx.manifest.sha256, err, sizeof(err)) == 1,
+           "Whole-file digest verifies");
+    ASSERT(hs_update_verify_sha256(old_path, ctx.manifest.sha256, err, sizeof(err)) == 0,
+           "Other file does not verify");
+
+    if (system("curl --version > /dev/null 2>&1") == 0) {
+        /* Delta: only the changed chunks are fetched */
+        char tmp[1024];
+        snprintf(ctx.index_path, sizeof(ctx.index_path), "%s", old_path);
+        ASSERT(hs_update_download(&ctx, tmp, sizeof(tmp)) == 1, "Delta download");
+        ASSERT(strcmp(ctx.digest, ctx.manifest.sha256) == 0, "Delta digest matches");
+        ASSERT(ctx.bytes_reused > 0 && ctx.bytes_fetched > 0 &&
+               ctx.bytes_reused + ctx.bytes_fetched == size, "Delta reuses unchanged chunks");
+        ASSERT(hs_update_verify_sha256(tmp, ctx.manifest.sha256, err, sizeof(err)) == 1,
+               "Delta result is the new index");
+        remove(tmp);
+
+        /* Whole file, resumed from a partial download */
+        int n_chunks = ctx.manifest.n_chunks;
+        ctx.manifest.n_chunks = 0;
+        ctx.index_path[0] = '\0';
+        const char *tmp_dir = getenv("TMPDIR");
+        snprintf(tmp, sizeof(tmp), "%s/_hs_update-999999.idx.part",
+                 tmp_dir && tmp_dir[0] ? tmp_dir : "/tmp");
+        FILE *in = fopen(new_path, "rb");
+        FILE *out = fopen(tmp, "wb");
+        char buf[1000];
+        ASSERT(fread(buf, 1, sizeof(buf), in) == sizeof(buf), "Read prefix");
+        fwrite(buf, 1, sizeof(buf), out);
+        fclose(in);
+        fclose(out);
+        ASSERT(hs_update_download(&ctx, tmp, sizeof(tmp)) == 1, "Resumed download");
+        ASSERT(ctx.bytes_reused == sizeof(buf) && ctx.bytes_fetched == size - sizeof(buf),
+               "Resume keeps the partial file");
+        ASSERT(strcmp(ctx.digest, ctx.manifest.sha256) == 0, "Resumed digest matches");
+        remove(tmp);
+        ctx.manifest.n_chunks = n_chunks;
+    }
+
+    hs_update_free(&ctx);
+    remove(old_path);
+    remove(new_path);
+}
+
 int main(void) {
     printf("=== test_index ===\n");
     test_refdb_create();
@@ -185,8 +874,18 @@ int main(void) {
     test_index_build();
     test_index_query_coarse();
     test_index_query_fine();
+    test_index_fine_posting();
     test_index_save_load();
+    test_index_sampled();
+    test_index_v3_mapped();
+    test_index_posting_corrupt();
+    test_index_load_markers();
+    test_refdb_wide();
+    test_index_build_threads();
+    test_index_incremental();
+    test_index_update_delta();
     test_index_detect_marker();
+    test_primer_scan();
     printf("=== %d passed, %d failed ===\n", tests_passed, tests_failed);
     return tests_failed > 0 ? 1 : 0;
 }
@@ -1,7 +1,14 @@
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <zlib.h>
 #include "refdb.h"
 #include "index.h"
 #include "classify.h"
@@ -10,6 +17,9 @@
 #include "simulate.h"
 #include "degrade.h"
 #include "calibrate.h"
+#include "pipeline.h"
+#include "serve.h"
+#include "fastq.h"
 #include "utils.h"
 
 static int tests_passed = 0;
@@ -64,28 +74,23 @@ static void test_e2e_pipeline(void) {
     classify_opts_t copts = classify_opts_default();
     copts.min_containment = 0.2;
     copts.coarse_threshold = 0.01;
-    read_result_t *results = classify_reads(idx,
+    classify_results_t *results = classify_reads(idx,
         (const char **)sr->reads, sr->read_lengths, sr->n_reads, &copts);
 
     int classified = 0;
     for (int i = 0; i < sr->n_reads; i++)
-        if (results[i].is_classified) classified++;
+        if (results->reads[i].n_hits > 0) classified++;
     ASSERT(classified > 0, "Some reads classified");
 
     /* 4. Run EM */
     int n_em_reads;
-    em_read_t *em_reads = em_reads_from_classify(results, sr->n_reads, &n_em_reads);
+    em_read_t *em_reads = em_reads_from_classify(results, &n_em_reads);
 
     em_config_t ecfg = em_config_default();
     ecfg.n_restarts = 3;
     int n_sp = idx->db->n_species;
     int n_mk = idx->db->n_markers;
-    int *amp_lens = (int *)calloc((size_t)(n_sp * n_mk), sizeof(int));
-    for (int i = 0; i < idx->db->n_marker_refs; i++) {
-        int si = idx->db->markers[i].species_idx;
-        int mi = idx->db->markers[i].marker_idx;
-        amp_lens[si * n_mk + mi] = idx->db->markers[i].amplicon_length;
-    }
+    const int *amp_lens = idx->db->amp_lens;
 
     em_result_t *em = NULL;
     if (n_em_reads > 0) {
@@ -95,7 +100,7 @@ static void test_e2e_pipeline(void) {
 
     /* 5. Generate report */
     if (em) {
-        halal_report_t *report = report_generate(em, idx->db, results, sr->n_reads, 0.001);
+        halal_report_t *report = report_generate(em, idx->db, results, 0.001);
         ASSERT(report != NULL, "Report generated");
 
         /* Verdict should be FAIL (pork detected) */
@@ -104,7 +109,8 @@ static void test_e2e_pipeline(void) {
         /* Pork should be detected above threshold */
         int pork2 = refdb_find_species(idx->db, "Sus_scrofa");
         if (pork2 >= 0) {
-            ASSERT(report->species[pork2].weight_pct > 0.1,
+            const species_report_t *sp = report_find_species(report, pork2);
+            ASSERT(sp != NULL && sp->weight_pct > 0.1,
                    "Pork weight > 0.1%");
         }
 
@@ -118,8 +124,7 @@ static void test_e2e_pipeline(void) {
     /* Cleanup */
     if (em) em_result_destroy(em);
     em_reads_free(em_reads, n_em_reads);
-    classify_results_free(results, sr->n_reads);
-    free(amp_lens);
+    classify_results_free(results);
     sim_result_destroy(sr);
     free(scfg.composition);
     index_destroy(idx);
@@ -151,37 +156,30 @@ static void test_e2e_halal_pass(void) {
     classify_opts_t copts = classify_opts_default();
     copts.min_containment = 0.2;
     copts.coarse_threshold = 0.01;
-    read_result_t *results = classify_reads(idx,
+    classify_results_t *results = classify_reads(idx,
         (const char **)sr->reads, sr->read_lengths, sr->n_reads, &copts);
 
     int n_em_reads;
-    em_read_t *em_reads = em_reads_from_classify(results, sr->n_reads, &n_em_reads);
+    em_read_t *em_reads = em_reads_from_classify(results, &n_em_reads);
 
     if (n_em_reads > 0) {
         em_config_t ecfg = em_config_default();
         int n_sp = idx->db->n_species;
         int n_mk = idx->db->n_markers;
-        int *amp_lens = (int *)calloc((size_t)(n_sp * n_mk), sizeof(int));
-        for (int i = 0; i < idx->db->n_marker_refs; i++) {
-            int si = idx->db->markers[i].species_idx;
-            int mi = idx->db->markers[i].marker_idx;
-            amp_lens[si * n_mk + mi] = idx->db->markers[i].amplicon_length;
-        }
+        const int *amp_lens = idx->db->amp_lens;
 
         em_result_t *em = em_fit(em_reads, n_em_reads, n_sp, n_mk, amp_lens, &ecfg);
         if (em) {
-            halal_report_t *report = report_generate(em, idx->db, results,
-                                                      sr->n_reads, 0.001);
+            halal_report_t *report = report_generate(em, idx->db, results, 0.001);
             /* Pure beef should pass or be inconclusive (not fail) */
             ASSERT(report->verdict != FAIL, "Pure beef not FAIL");
             report_destroy(report);
             em_result_destroy(em);
         }
-        free(amp_lens);
     }
 
     em_reads_free(em_reads, n_em_reads);
-    classify_results_free(results, sr->n_reads);
+    classify_results_free(results);
     sim_result_destroy(sr);
     free(scfg.composition);
     index_destroy(idx);
@@ -189,6 +187,202 @@ static void test_e2e_halal_pass(void) {
 }
 
 /* Test degradation model */
+/* Streaming batches must give the same EM input as classifying in memory */
+static void test_streaming_pipeline(void) {
+    printf("  test_streaming_pipeline...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+
+    sim_config_t scfg;
+    memset(&scfg, 0, sizeof(scfg));
+    scfg.n_species = idx->db->n_species;
+    scfg.composition = (double *)calloc((size_t)idx->db->n_species, sizeof(double));
+    scfg.composition[refdb_find_species(idx->db, "Bos_taurus")] = 0.7;
+    scfg.composition[refdb_find_species(idx->db, "Sus_scrofa")] = 0.3;
+    scfg.reads_per_marker = 100;
+    scfg.error_rate = 0.001;
+    scfg.read_length = 150;
+    scfg.seed = 7;
+    sim_result_t *sr = simulate_mixture(&scfg, idx->db);
+
+    const char *path = "/tmp/test_halal_stream.fa";
+    FILE *fp = fopen(path, "w");
+    for (int i = 0; i < sr->n_reads; i++)
+        fprintf(fp, ">r%d\n%s\n", i, sr->reads[i]);
+    fclose(fp);
+
+    classify_opts_t copts = classify_opts_default();
+    classify_results_t *results = classify_reads(idx,
+        (const char **)sr->reads, sr->read_lengths, sr->n_reads, &copts);
+    int n_ref;
+    em_read_t *ref = em_reads_from_classify(results, &n_ref);
+    n_ref = em_reads_collapse(ref, n_ref);
+    classify_summary_t want;
+    classify_summarize(results, idx, &want);
+
+    em_read_t *got; int n_got;
+    classify_summary_t summary;
+    volatile int progress = 0;
+    int ret = pipeline_classify_file(idx, path, &copts, 37, &got, &n_got,
+                                     &summary, &progress);
+    ASSERT(ret == 0, "Streaming pipeline ran");
+    ASSERT(progress == sr->n_reads, "Progress counts every read");
+    ASSERT(summary.total_reads == want.total_reads &&
+           summary.classified_reads == want.classified_reads &&
+           summary.n_species == want.n_species && summary.n_markers == want.n_markers &&
+           memcmp(summary.per_species_marker, want.per_species_marker,
+                  (size_t)want.n_species * (size_t)want.n_markers * sizeof(int)) == 0,
+           "Streaming summary matches in-memory summary");
+    int same = n_got == n_ref;
+    for (int i = 0; same && i < n_ref; i++) {
+        same = got[i].marker_idx == ref[i].marker_idx &&
+               got[i].n_candidates == ref[i].n_candidates &&
+               got[i].count == ref[i].count;
+        for (int j = 0; same && j < ref[i].n_candidates; j++)
+            same = got[i].species_indices[j] == ref[i].species_indices[j] &&
+                   got[i].containments[j] == ref[i].containments[j];
+    }
+    ASSERT(same, "Streaming EM input matches in-memory EM input");
+    ASSERT_NEAR(em_reads_total(got, n_got), (double)want.classified_reads, 0.5,
+                "Collapsed EM rows keep every classified read");
+    em_reads_free(got, n_got);
+    classify_summary_free(&summary);
+
+    copts.dereplicate = 0;
+    ret = pipeline_classify_file(idx, path, &copts, 37, &got, &n_got,
+                                 &summary, NULL);
+    ASSERT(ret == 0 && summary.classified_reads == want.classified_reads &&
+           summary.n_species == want.n_species && summary.n_markers == want.n_markers &&
+           memcmp(summary.per_species_marker, want.per_species_marker,
+                  (size_t)want.n_species * (size_t)want.n_markers * sizeof(int)) == 0,
+           "Summary unchanged without dereplication");
+    ASSERT_NEAR(em_reads_total(got, n_got), (double)want.classified_reads, 0.5,
+                "One EM row per read without dereplication");
+    em_reads_free(got, n_got);
+    classify_summary_free(&summary);
+    copts.dereplicate = 1;
+
+    ASSERT(pipeline_classify_file(idx, "/nonexistent/reads.fq", &copts, 37,
+                                  &got, &n_got, &summary, NULL) == -1,
+           "Missing reads file reported");
+    classify_summary_free(&summary);
+
+    classify_summary_free(&want);
+    em_reads_free(ref, n_ref);
+    classify_results_free(results);
+    sim_result_destroy(sr);
+    free(scfg.composition);
+    remove(path);
+    index_destroy(idx);
+}
+
+/* A saved classification must reload to the same EM input and tallies */
+static void test_classified_checkpoint(void) {
+    printf("  test_classified_checkpoint...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+
+    sim_config_t scfg;
+    memset(&scfg, 0, sizeof(scfg));
+    scfg.n_species = idx->db->n_species;
+    scfg.composition = (double *)calloc((size_t)idx->db->n_species, sizeof(double));
+    scfg.composition[refdb_find_species(idx->db, "Bos_taurus")] = 0.8;
+    scfg.composition[refdb_find_species(idx->db, "Sus_scrofa")] = 0.2;
+    scfg.reads_per_marker = 60;
+    scfg.error_rate = 0.001;
+    scfg.read_length = 150;
+    scfg.seed = 11;
+    sim_result_t *sr = simulate_mixture(&scfg, idx->db);
+
+    const char *reads_path = "/tmp/test_halal_ckpt.fa";
+    const char *path = "/tmp/test_halal_ckpt.hscl";
+    FILE *fp = fopen(reads_path, "w");
+    for (int i = 0; i < sr->n_reads; i++)
+        fprintf(fp, ">r%d\n%s\n", i, sr->reads[i]);
+    fclose(fp);
+
+    classify_opts_t copts = classify_opts_default();
+    em_read_t *ref; int n_ref;
+    classify_summary_t want;
+    ASSERT(pipeline_classify_file(idx, reads_path, &copts, 50, &ref, &n_ref,
+                                  &want, NULL) == 0, "Reads classified");
+    ASSERT(pipeline_save_classified(path, idx->db, ref, n_ref, &want) == 0,
+           "Classification saved");
+
+    em_read_t *got; int n_got;
+    classify_summary_t summary;
+    ASSERT(pipeline_load_classified(path, idx->db, &got, &n_got, &summary) == 0,
+           "Classification loaded");
+    int same = n_got == n_ref;
+    for (int i = 0; same && i < n_ref; i++) {
+        same = got[i].marker_idx == ref[i].marker_idx &&
+               got[i].n_candidates == ref[i].n_candidates &&
+               got[i].count == ref[i].count;
+        for (int j = 0; same && j < ref[i].n_candidates; j++)
+            same = got[i].species_indices[j] == ref[i].species_indices[j] &&
+                   got[i].containments[j] == ref[i].containments[j];
+    }
+    ASSERT(same, "Reloaded EM rows match");
+    ASSERT(summary.total_reads == want.total_reads &&
+           summary.classified_reads == want.classified_reads &&
+           memcmp(summary.per_marker, want.per_marker,
+                  (size_t)want.n_markers * sizeof(int)) == 0 &&
+           memcmp(summary.per_species_marker, want.per_species_marker,
+                  (size_t)want.n_species * (size_t)want.n_markers * sizeof(int)) == 0,
+           "Reloaded tallies match");
+    em_reads_free(got, n_got);
+    classify_summary_free(&summary);
+
+    /* A database with other species must be refused */
+    char saved[HS_MAX_NAME_LEN];
+    memcpy(saved, idx->db->species[0].species_id, HS_MAX_NAME_LEN);
+    snprintf(idx->db->species[0].species_id, HS_MAX_NAME_LEN, "Not_a_species");
+    ASSERT(pipeline_load_classified(path, idx->db, &got, &n_got, &summary) == -1 &&
+           got == NULL && n_got == 0, "Mismatched database rejected");
+    memcpy(idx->db->species[0].species_id, saved, HS_MAX_NAME_LEN);
+
+    /* A read count the file cannot hold, and a marker outside [0, M), are
+     * rejected: dims sit after the header, names, marker ids and tallies */
+    int S = idx->db->n_species, M = idx->db->n_markers;
+    long dims_off = 16 + (long)S * HS_MAX_NAME_LEN + (long)M * (long)sizeof(*idx->db->marker_ids) +
+                    8 + 4L * (M + S + (long)S * M);
+    struct { long off; int32_t value; const char *what; } bad[2] = {
+        { dims_off, 0x7fffffff, "Oversized read count rejected" },
+        { dims_off + 8, -1, "Negative marker rejected" },   /* first read's marker */
+    };
+    for (int i = 0; i < 2; i++) {
+        pipeline_save_classified(path, idx->db, ref, n_ref, &want);
+        fp = fopen(path, "r+b");
+        fseek(fp, bad[i].off, SEEK_SET);
+        fwrite(&bad[i].value, sizeof(int32_t), 1, fp);
+        fclose(fp);
+        ASSERT(pipeline_load_classified(path, idx->db, &got, &n_got, &summary) == -1 &&
+               got == NULL, bad[i].what);
+    }
+    pipeline_save_classified(path, idx->db, ref, n_ref, &want);
+
+    /* A truncated file is rejected */
+    size_t n = 0;
+    void *m = hs_map_file(path, &n);
+    char *head = (char *)hs_malloc(n - 4);
+    memcpy(head, m, n - 4);
+    hs_unmap_file(m, n);
+    fp = fopen(path, "wb");
+    fwrite(head, 1, n - 4, fp);
+    fclose(fp);
+    free(head);
+    ASSERT(pipeline_load_classified(path, idx->db, &got, &n_got, &summary) == -1,
+           "Truncated checkpoint rejected");
+
+    em_reads_free(ref, n_ref);
+    classify_summary_free(&want);
+    sim_result_destroy(sr);
+    free(scfg.composition);
+    remove(reads_path);
+    remove(path);
+    index_destroy(idx);
+}
+
 static void test_degradation(void) {
     printf("  test_degradation...\n");
     int insert_sizes[] = { 200, 180, 220, 190, 210, 150, 250, 170, 230, 195 };
@@ -227,10 +421,520 @@ static void test_calibration(void) {
     calibrate_result_destroy(cal);
 }
 
+/* --- Compressed input --- */
+
+/* Write data as BGZF: raw-deflate blocks of <= 60000 bytes, each a gzip
+ * member with the "BC" block-size subfield, then the empty EOF block */
+static void write_bgzf(const char *path, const char *data, size_t n) {
+    FILE *fp = fopen(path, "wb");
+    unsigned char out[70000];
+    for (size_t off = 0;; ) {
+        size_t len = n - off < 60000 ? n - off : 60000;
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        deflateInit2(&zs, 6, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+        zs.next_in = (Bytef *)(data + off);
+        zs.avail_in = (uInt)len;
+        zs.next_out = out + 18;
+        zs.avail_out = sizeof(out) - 26;
+        deflate(&zs, Z_FINISH);
+        size_t clen = zs.total_out;
+        deflateEnd(&zs);
+        int bsize = (int)(18 + clen + 8);
+        unsigned char h[18] = { 0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0,
+                                'B', 'C', 2, 0, (unsigned char)((bsize - 1) & 0xff),
+                                (unsigned char)((bsize - 1) >> 8) };
+        memcpy(out, h, 18);
+        uint32_t crc = (uint32_t)crc32(0L, (const Bytef *)(data + off), (uInt)len);
+        for (int k = 0; k < 4; k++) {
+            out[18 + clen + k] = (unsigned char)(crc >> (8 * k));
+            out[22 + clen + k] = (unsigned char)((uint32_t)len >> (8 * k));
+        }
+        fwrite(out, 1, (size_t)bsize, fp);
+        if (len == 0) break;
+        off += len;
+    }
+    fclose(fp);
+}
+
+/* gzip, multi-member gzip and BGZF input must classify like plain text */
+static void test_compressed_input(void) {
+    printf("  test_compressed_input...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+
+    sim_config_t scfg;
+    memset(&scfg, 0, sizeof(scfg));
+    scfg.n_species = idx->db->n_species;
+    scfg.composition = (double *)calloc((size_t)idx->db->n_species, sizeof(double));
+    scfg.composition[refdb_find_species(idx->db, "Bos_taurus")] = 0.6;
+    scfg.composition[refdb_find_species(idx->db, "Ovis_aries")] = 0.4;
+    scfg.reads_per_marker = 80;
+    scfg.error_rate = 0.001;
+    scfg.read_length = 150;
+    scfg.seed = 17;
+    sim_result_t *sr = simulate_mixture(&scfg, idx->db);
+
+    size_t n = 0, cap = 1 << 16;
+    char *text = (char *)malloc(cap);
+    for (int i = 0; i < sr->n_reads; i++) {
+        size_t need = n + (size_t)sr->read_lengths[i] + 32;
+        while (need > cap) text = (char *)realloc(text, cap *= 2);
+        n += (size_t)sprintf(text + n, ">r%d\n%s\n", i, sr->reads[i]);
+    }
+    const char *plain = "/tmp/test_halal_zin.fa";
+    const char *gz = "/tmp/test_halal_zin.fa.gz";
+    const char *multi = "/tmp/test_halal_zin_mm.fa.gz";
+    const char *bgzf = "/tmp/test_halal_zin_bgzf.fa.gz";
+    FILE *fp = fopen(plain, "wb");
+    fwrite(text, 1, n, fp);
+    fclose(fp);
+    gzFile gfp = gzopen(gz, "wb");
+    gzwrite(gfp, text, (unsigned)n);
+    gzclose(gfp);
+    size_t half = n / 2;
+    gfp = gzopen(multi, "wb");
+    gzwrite(gfp, text, (unsigned)half);
+    gzclose(gfp);
+    gfp = gzopen(multi, "ab");
+    gzwrite(gfp, text + half, (unsigned)(n - half));
+    gzclose(gfp);
+    write_bgzf(bgzf, text, n);
+
+    classify_opts_t copts = classify_opts_default();
+    copts.n_threads = 3;
+    em_read_t *ref; int n_ref;
+    classify_summary_t want;
+    ASSERT(pipeline_classify_file(idx, plain, &copts, 101, &ref, &n_ref, &want, NULL) == 0 &&
+           want.total_reads == sr->n_reads, "Plain input read");
+
+    const char *paths[3] = { gz, multi, bgzf };
+    const char *labels[3] = { "gzip input matches plain", "Multi-member gzip matches plain",
+                              "BGZF input matches plain" };
+    for (int f = 0; f < 3; f++) {
+        em_read_t *got; int n_got;
+        classify_summary_t summary;
+        int ret = pipeline_classify_file(idx, paths[f], &copts, 101, &got, &n_got,
+                                         &summary, NULL);
+        int same = ret == 0 && n_got == n_ref && summary.total_reads == want.total_reads &&
+                   summary.classified_reads == want.classified_reads;
+        for (int i = 0; same && i < n_ref; i++)
+            same = got[i].marker_idx == ref[i].marker_idx &&
+                   got[i].n_candidates == ref[i].n_candidates &&
+                   got[i].count == ref[i].count;
+        ASSERT(same, labels[f]);
+        em_reads_free(got, n_got);
+        classify_summary_free(&summary);
+    }
+
+    em_reads_free(ref, n_ref);
+    classify_summary_free(&want);
+    free(text);
+    sim_result_destroy(sr);
+    free(scfg.composition);
+    remove(plain);
+    remove(gz);
+    remove(multi);
+    remove(bgzf);
+    index_destroy(idx);
+}
+
+/* --- Paired-end input --- */
+
+static void revcomp_into(const char *s, int len, char *out) {
+    for (int i = 0; i < len; i++) {
+        char c = s[len - 1 - i];
+        out[i] = c == 'A' ? 'T' : c == 'C' ? 'G' : c == 'G' ? 'C' : c == 'T' ? 'A' : 'N';
+    }
+    out[len] = '\0';
+}
+
+/* Pairs cut from known fragments must merge back to those fragments */
+static void test_paired_input(void) {
+    printf("  test_paired_input...\n");
+    char frag[161], r2[161], out[400];
+    const char *unit = "ACGTTGCAGGATCCATGCAAGTCCGATTACGGATCAGCTTAGGCTAACCGTA";
+    for (int i = 0; i < 160; i++) frag[i] = unit[(i * 7 + i / 13) % 52];
+    frag[160] = '\0';
+    int ov;
+
+    /* Mates 0..100 and 60..160: a 40-base overlap */
+    revcomp_into(frag + 60, 100, r2);
+    int n = hs_merge_pair(frag, NULL, 100, r2, NULL, 100, out, &ov);
+    ASSERT(ov == 40 && n == 160 && memcmp(out, frag, 160) == 0,
+           "Overlapping mates merge to the fragment");
+
+    /* A mismatch in the overlap goes to the higher-quality mate */
+    char q1[101], q2[101];
+    memset(q1, 'I', 100); q1[100] = '\0';
+    memset(q2, 'I', 100); q2[100] = '\0';
+    char r1[101];
+    memcpy(r1, frag, 100); r1[100] = '\0';
+    r1[80] = r1[80] == 'A' ? 'C' : 'A';
+    q1[80] = '#';
+    n = hs_merge_pair(r1, q1, 100, r2, q2, 100, out, &ov);
+    ASSERT(ov == 40 && memcmp(out, frag, 160) == 0, "Consensus keeps the better base");
+
+    /* Insert (90) shorter than the reads (100): adapter read-through clipped */
+    char a1[101], a2[101];
+    memcpy(a1, frag, 90); memset(a1 + 90, 'G', 10); a1[100] = '\0';
+    revcomp_into(frag, 90, a2); memset(a2 + 90, 'C', 10); a2[100] = '\0';
+    n = hs_merge_pair(a1, NULL, 100, a2, NULL, 100, out, &ov);
+    ASSERT(ov == 90 && n == 90 && memcmp(out, frag, 90) == 0, "Read-through trimmed to the insert");
+
+    /* No overlap: R1, one N, then R2 reverse-complemented */
+    revcomp_into(frag + 100, 60, r2);
+    n = hs_merge_pair(frag, NULL, 60, r2, NULL, 60, out, &ov);
+    ASSERT(ov == 0 && n == 121 && out[60] == 'N' && memcmp(out, frag, 60) == 0 &&
+           memcmp(out + 61, frag + 100, 60) == 0, "Disjoint mates joined by N");
+
+    /* Pipeline: pairs from simulated reads classify like the reads themselves */
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+    sim_config_t scfg;
+    memset(&scfg, 0, sizeof(scfg));
+    scfg.n_species = idx->db->n_species;
+    scfg.composition = (double *)calloc((size_t)idx->db->n_species, sizeof(double));
+    scfg.composition[refdb_find_species(idx->db, "Bos_taurus")] = 0.5;
+    scfg.composition[refdb_find_species(idx->db, "Sus_scrofa")] = 0.5;
+    scfg.reads_per_marker = 60;
+    scfg.error_rate = 0.0;
+    scfg.read_length = 150;
+    scfg.seed = 23;
+    sim_result_t *sr = simulate_mixture(&scfg, idx->db);
+
+    const char *single = "/tmp/test_halal_pe.fa";
+    const char *p1 = "/tmp/test_halal_pe_R1.fq", *p2 = "/tmp/test_halal_pe_R2.fq";
+    FILE *fs = fopen(single, "w"), *f1 = fopen(p1, "w"), *f2 = fopen(p2, "w");
+    char mate[400];
+    for (int i = 0; i < sr->n_reads; i++) {
+        int len = sr->read_lengths[i], m = len * 2 / 3;
+        fprintf(fs, ">r%d\n%s\n", i, sr->reads[i]);
+        fprintf(f1, "@r%d/1\n%.*s\n+\n%.*s\n", i, m, sr->reads[i], m,
+                "IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII");
+        revcomp_into(sr->reads[i] + (len - m), m, mate);
+        fprintf(f2, "@r%d/2\n%s\n+\n%.*s\n", i, mate, m,
+                "IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII");
+    }
+    fclose(fs); fclose(f1); fclose(f2);
+
+    classify_opts_t copts = classify_opts_default();
+    em_read_t *ref; int n_ref;
+    classify_summary_t want;
+    ASSERT(pipeline_classify_file(idx, single, &copts, 64, &ref, &n_ref, &want, NULL) == 0,
+           "Single-end reference classified");
+    em_read_t *got; int n_got;
+    classify_summary_t summary;
+    ASSERT(pipeline_classify_pair(idx, p1, p2, &copts, 64, &got, &n_got, &summary, NULL) == 0,
+           "Paired input classified");
+    int same = n_got == n_ref && summary.total_reads == sr->n_reads &&
+               summary.classified_reads == want.classified_reads;
+    for (int i = 0; same && i < n_ref; i++)
+        same = got[i].marker_idx == ref[i].marker_idx &&
+               got[i].n_candidates == ref[i].n_candidates && got[i].count == ref[i].count;
+    ASSERT(same, "Merged pairs classify like the original fragments");
+    em_reads_free(got, n_got);
+    classify_summary_free(&summary);
+    ASSERT(pipeline_classify_pair(idx, p1, "/nonexistent/R2.fq", &copts, 64, &got, &n_got,
+                                  &summary, NULL) == -1, "Missing mate file reported");
+    classify_summary_free(&summary);
+
+    em_reads_free(ref, n_ref);
+    classify_summary_free(&want);
+    sim_result_destroy(sr);
+    free(scfg.composition);
+    remove(single);
+    remove(p1);
+    remove(p2);
+    index_destroy(idx);
+}
+
+/* --- Online quantification --- */
+
+/* Reads in shuffled (sequencer-like) order, as FASTA */
+static void write_shuffled(const char *path, const sim_result_t *sr, uint64_t seed) {
+    int *order = (int *)malloc((size_t)sr->n_reads * sizeof(int));
+    for (int i = 0; i < sr->n_reads; i++) order[i] = i;
+    hs_rng_t rng;
+    hs_rng_seed(&rng, seed);
+    for (int i = sr->n_reads - 1; i > 0; i--) {
+        int j = (int)(hs_rng_next(&rng) % (uint64_t)(i + 1));
+        int t = order[i]; order[i] = order[j]; order[j] = t;
+    }
+    FILE *fp = fopen(path, "w");
+    for (int i = 0; i < sr->n_reads; i++)
+        fprintf(fp, ">r%d\n%s\n", order[i], sr->reads[order[i]]);
+    fclose(fp);
+    free(order);
+}
+
+/* A clear-cut sample stops early with the verdict of the full read set */
+static void test_online_early_stop(void) {
+    printf("  test_online_early_stop...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+    const char *path = "/tmp/test_halal_online.fa";
+    const char *pure[2] = { "Bos_taurus", NULL };
+    const char *mixed[2] = { "Bos_taurus", "Sus_scrofa" };
+    const char **samples[2] = { mixed, pure };
+    verdict_t expect[2] = { FAIL, PASS };
+
+    for (int k = 0; k < 2; k++) {
+        sim_config_t scfg;
+        memset(&scfg, 0, sizeof(scfg));
+        scfg.n_species = idx->db->n_species;
+        scfg.composition = (double *)calloc((size_t)idx->db->n_species, sizeof(double));
+        scfg.composition[refdb_find_species(idx->db, samples[k][0])] = samples[k][1] ? 0.9 : 1.0;
+        if (samples[k][1]) scfg.composition[refdb_find_species(idx->db, samples[k][1])] = 0.1;
+        scfg.reads_per_marker = 2000;
+        scfg.error_rate = 0.001;
+        scfg.read_length = 150;
+        scfg.seed = 31 + (uint64_t)k;
+        sim_result_t *sr = simulate_mixture(&scfg, idx->db);
+        write_shuffled(path, sr, 5);
+
+        classify_opts_t copts = classify_opts_default();
+        em_config_t ecfg = em_config_default();
+        pipeline_online_t online = pipeline_online_default(&ecfg, 0.001);
+        online.check_every = online.min_reads = 300;
+        hs_seqfile_t *sf = hs_seqfile_open(path);
+        em_read_t *rows; int n_rows;
+        classify_summary_t summary;
+        pipeline_classify_stream_online(idx, sf, &copts, 0, &online, &rows, &n_rows,
+                                        &summary, NULL, NULL);
+        hs_seqfile_close(sf);
+        ASSERT(online.stopped && summary.total_reads < sr->n_reads,
+               expect[k] == FAIL ? "Haram mixture stops early" : "Clean sample stops early");
+        halal_report_t *r = pipeline_quantify(idx, rows, n_rows, &summary, &ecfg, 0.001);
+        ASSERT(r->verdict == expect[k] && online.verdict == expect[k],
+               "Early verdict matches the sample");
+        report_destroy(r);
+        classify_summary_free(&summary);
+
+        /* Without online settings everything is read */
+        sf = hs_seqfile_open(path);
+        pipeline_classify_stream_online(idx, sf, &copts, 0, NULL, &rows, &n_rows,
+                                        &summary, NULL, NULL);
+        hs_seqfile_close(sf);
+        ASSERT(summary.total_reads == sr->n_reads, "No online settings: whole input read");
+        em_reads_free(rows, n_rows);
+        classify_summary_free(&summary);
+
+        sim_result_destroy(sr);
+        free(scfg.composition);
+    }
+    remove(path);
+    index_destroy(idx);
+}
+
+/* Looks that never stop reading, for interim estimates; cancel stops the
+ * stream and the fit */
+typedef struct {
+    int n_calls, last_reads;
+    volatile int *cancel;
+} look_log_t;
+
+static void log_look(const em_result_t *em, const classify_summary_t *summary, void *arg) {
+    look_log_t *log = (look_log_t *)arg;
+    if (em && em->w) log->n_calls++;
+    log->last_reads = summary->total_reads;
+    if (log->cancel) *log->cancel = 1;
+}
+
+static void test_online_interim_cancel(void) {
+    printf("  test_online_interim_cancel...\n");
+    halal_index_t *idx = index_build(refdb_build_default());
+    const char *path = "/tmp/test_halal_interim.fa";
+    sim_config_t scfg;
+    memset(&scfg, 0, sizeof(scfg));
+    scfg.n_species = idx->db->n_species;
+    scfg.composition = (double *)calloc((size_t)idx->db->n_species, sizeof(double));
+    scfg.composition[refdb_find_species(idx->db, "Bos_taurus")] = 1.0;
+    scfg.reads_per_marker = 1000;
+    scfg.error_rate = 0.001;
+    scfg.read_length = 150;
+    scfg.seed = 41;
+    sim_result_t *sr = simulate_mixture(&scfg, idx->db);
+    write_shuffled(path, sr, 7);
+
+    volatile int cancel = 0;
+    classify_opts_t copts = classify_opts_default();
+    copts.cancel = &cancel;
+    em_config_t ecfg = em_config_default();
+    ecfg.cancel = &cancel;
+    look_log_t log = { 0, 0, NULL };
+    pipeline_online_t online = pipeline_online_default(&ecfg, 0.001);
+    online.check_every = online.min_reads = 500;
+    online.stable_looks = INT_MAX;
+    online.on_look = log_look;
+    online.look_arg = &log;
+    hs_seqfile_t *sf = hs_seqfile_open(path);
+    em_read_t *rows; int n_rows;
+    classify_summary_t summary;
+    pipeline_classify_stream_online(idx, sf, &copts, 0, &online, &rows, &n_rows,
+                                    &summary, NULL, NULL);
+    hs_seqfile_close(sf);
+    ASSERT(!online.stopped && summary.total_reads == sr->n_reads,
+           "Looks without stopping read the whole input");
+    ASSERT(log.n_calls == online.n_looks && log.n_calls >= 2, "Every look reported");
+    em_reads_free(rows, n_rows);
+    classify_summary_free(&summary);
+
+    /* Cancelling from the first look stops before the next batch */
+    log.n_calls = 0;
+    log.cancel = &cancel;
+    sf = hs_seqfile_open(path);
+    pipeline_classify_stream_online(idx, sf, &copts, 0, &online, &rows, &n_rows,
+                                    &summary, NULL, NULL);
+    hs_seqfile_close(sf);
+    ASSERT(cancel && log.n_calls == 1 && summary.total_reads == log.last_reads &&
+           summary.total_reads < sr->n_reads, "Cancel stops reading");
+    ASSERT(em_fit(rows, n_rows, idx->db->n_species, idx->db->n_markers,
+                  idx->db->amp_lens, &ecfg) == NULL, "Cancelled fit returns NULL");
+    cancel = 0;
+    em_result_t *em = em_fit(rows, n_rows, idx->db->n_species, idx->db->n_markers,
+                             idx->db->amp_lens, &ecfg);
+    ASSERT(em != NULL, "Fit runs once cancel is cleared");
+    em_result_destroy(em);
+    em_reads_free(rows, n_rows);
+    classify_summary_free(&summary);
+
+    sim_result_destroy(sr);
+    free(scfg.composition);
+    remove(path);
+    index_destroy(idx);
+}
+
+/* --- Resident service --- */
+
+static void *serve_thread(void *arg) {
+    return (void *)(intptr_t)serve_run((const serve_config_t *)arg);
+}
+
+/* Send request and return the reply (caller frees), or NULL */
+static char *query_reply(const char *sock, const char *request, const char *upload) {
+    FILE *tmp = tmpfile();
+    if (serve_query(sock, request, upload, tmp) < 0) { fclose(tmp); return NULL; }
+    long n = ftell(tmp);
+    rewind(tmp);
+    char *buf = (char *)calloc((size_t)n + 1, 1);
+    if (fread(buf, 1, (size_t)n, tmp) != (size_t)n) buf[0] = '\0';
+    fclose(tmp);
+    return buf;
+}
+
+/* Connection that sends nothing, holding a job slot */
+static int idle_connect(const char *sock) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", sock);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* Jobs answered by a resident index must report like a direct run */
+static void test_serve(void) {
+    printf("  test_serve...\n");
+    halal_refdb_t *db = refdb_build_default();
+    halal_index_t *idx = index_build(db);
+
+    sim_config_t scfg;
+    memset(&scfg, 0, sizeof(scfg));
+    scfg.n_species = idx->db->n_species;
+    scfg.composition = (double *)calloc((size_t)idx->db->n_species, sizeof(double));
+    scfg.composition[refdb_find_species(idx->db, "Bos_taurus")] = 1.0;
+    scfg.reads_per_marker = 40;
+    scfg.error_rate = 0.001;
+    scfg.read_length = 150;
+    scfg.seed = 13;
+    sim_result_t *sr = simulate_mixture(&scfg, idx->db);
+    const char *reads_path = "/tmp/test_halal_serve.fa";
+    FILE *fp = fopen(reads_path, "w");
+    for (int i = 0; i < sr->n_reads; i++)
+        fprintf(fp, ">r%d\n%s\n", i, sr->reads[i]);
+    fclose(fp);
+
+    const char *sock = "/tmp/test_halal_serve.sock";
+    serve_index_t si[2] = { { "main", idx }, { "q\"x", idx } };
+    serve_config_t cfg = { sock, si, 2, 2, 1, 300 };
+    pthread_t th;
+    pthread_create(&th, NULL, serve_thread, &cfg);
+
+    char *reply = NULL;
+    for (int tries = 0; !reply && tries < 100; tries++) {
+        reply = query_reply(sock, "ping", NULL);
+        if (!reply) usleep(20000);
+    }
+    ASSERT(reply && strstr(reply, "\"main\""), "Server lists its index");
+    ASSERT(reply && strstr(reply, "\"q\\\"x\""), "Index names are JSON-escaped");
+    free(reply);
+    struct stat sb;
+    ASSERT(stat(sock, &sb) == 0 && (sb.st_mode & 0777) == 0600, "Socket is owner-only");
+
+    /* Idle clients fill both slots: others are turned away, not queued,
+     * until the idle ones time out */
+    int idle1 = idle_connect(sock), idle2 = idle_connect(sock);
+    usleep(50000);
+    reply = query_reply(sock, "ping", NULL);
+    ASSERT(idle1 >= 0 && idle2 >= 0 && reply && strstr(reply, "\"busy\""),
+           "Full server answers busy");
+    free(reply);
+    reply = NULL;
+    for (int tries = 0; tries < 100; tries++) {
+        free(reply);
+        reply = query_reply(sock, "ping", NULL);
+        if (reply && strstr(reply, "\"main\"")) break;
+        usleep(20000);
+    }
+    ASSERT(reply && strstr(reply, "\"main\""), "Idle clients time out and free their slots");
+    free(reply);
+    close(idle1);
+    close(idle2);
+
+    char request[256];
+    snprintf(request, sizeof(request), "run %s sample=S1", reads_path);
+    reply = query_reply(sock, request, NULL);
+    ASSERT(reply && strstr(reply, "\"sample_id\": \"S1\"") && strstr(reply, "Bos_taurus"),
+           "run job reports the sample");
+    free(reply);
+
+    reply = query_reply(sock, "reads index=main sample=S2", reads_path);
+    ASSERT(reply && strstr(reply, "\"sample_id\": \"S2\"") && strstr(reply, "Bos_taurus"),
+           "Uploaded reads reported");
+    free(reply);
+
+    reply = query_reply(sock, "reads index=other", reads_path);
+    ASSERT(reply && strstr(reply, "\"error\""), "Unknown index refused");
+    free(reply);
+
+    reply = query_reply(sock, "shutdown", NULL);
+    free(reply);
+    void *ret = NULL;
+    pthread_join(th, &ret);
+    ASSERT((intptr_t)ret == 0 && !hs_file_exists(sock), "Server shut down cleanly");
+
+    sim_result_destroy(sr);
+    free(scfg.composition);
+    remove(reads_path);
+    index_destroy(idx);
+}
+
 int main(void) {
     printf("=== test_integration ===\n");
     test_e2e_pipeline();
     test_e2e_halal_pass();
+    test_streaming_pipeline();
+    test_classified_checkpoint();
+    test_compressed_input();
+    test_paired_input();
+    test_online_early_stop();
+    test_online_interim_cancel();
+    test_serve();
     test_degradation();
     test_calibration();
     printf("=== %d passed, %d failed ===\n", tests_passed, tests_failed);
@@ -67,6 +67,96 @@ static void test_kmer_canonical(void) {
     ASSERT(h2 == h3, "Canonical hash symmetric for revcomp");
 }
 
+static void test_kmer_iter(void) {
+    printf("  test_kmer_iter...\n");
+    /* Rolling hashes must match hs_kmer_canonical at every valid offset,
+     * including around N bases and lowercase input */
+    const char *seq = "ACGTTGCAAGGCTNACGTACGGATCCAAgtcaNNTTGACCAGTAGGCATTA";
+    int len = (int)strlen(seq);
+    int ks[3] = { 4, 15, 21 };
+    for (int t = 0; t < 3; t++) {
+        int k = ks[t];
+        hs_kmer_iter_t it;
+        hs_kmer_iter_init(&it, seq, len, k);
+        uint64_t h;
+        int pos, mismatches = 0, n_iter = 0, n_ref = 0;
+        for (int i = 0; i + k <= len; i++)
+            if (hs_kmer_canonical(seq + i, k) != UINT64_MAX) n_ref++;
+        while (hs_kmer_iter_next(&it, &h, &pos)) {
+            if (h != hs_kmer_canonical(seq + pos, k)) mismatches++;
+            n_iter++;
+        }
+        ASSERT(mismatches == 0, "Rolling hash matches canonical hash");
+        ASSERT(n_iter == n_ref, "Rolling iterator visits every valid k-mer");
+    }
+
+    /* Whole-sequence kernels, specialised (15, 21) or not, match it */
+    int kk[5] = { 4, 15, 17, 21, 32 };
+    uint64_t out[64];
+    for (int t = 0; t < 5; t++) {
+        hs_kmer_iter_t it;
+        uint64_t h;
+        int n = hs_kmer_hash_seq(seq, len, kk[t], out), i = 0, same = 1;
+        hs_kmer_iter_init(&it, seq, len, kk[t]);
+        while (hs_kmer_iter_next(&it, &h, NULL)) same &= i < n && out[i++] == h;
+        ASSERT(same && i == n, "Sequence kernel matches the iterator");
+    }
+
+    /* Sequence shorter than k yields nothing */
+    hs_kmer_iter_t it;
+    uint64_t h;
+    hs_kmer_iter_init(&it, "ACGT", 4, 5);
+    ASSERT(!hs_kmer_iter_next(&it, &h, NULL), "Short sequence yields no k-mers");
+
+    /* k = 32 uses the full 64-bit word */
+    const char *long_seq = "ACGTTGCAAGGCTACGTACGGATCCAAGTCATTGACC";
+    hs_kmer_iter_init(&it, long_seq, (int)strlen(long_seq), 32);
+    int ok = 1, pos;
+    while (hs_kmer_iter_next(&it, &h, &pos))
+        if (h != hs_kmer_canonical(long_seq + pos, 32)) ok = 0;
+    ASSERT(ok, "k=32 rolling hash matches canonical hash");
+}
+
+static void test_pack_bases(void) {
+    printf("  test_pack_bases...\n");
+    /* Vector and tail paths agree with hs_base_encode on mixed case,
+     * N and other IUPAC codes, at lengths around the word sizes */
+    char seq[200];
+    const char *alpha = "ACGTacgtNnRY-";
+    hs_rng_t rng;
+    hs_rng_seed(&rng, 37);
+    for (int i = 0; i < 200; i++)
+        seq[i] = alpha[hs_rng_uniform(&rng) < 0.9 ? hs_rng_next(&rng) % 8
+                                                  : 8 + hs_rng_next(&rng) % 5];
+    int lens[6] = { 1, 31, 32, 33, 64, 200 }, ok = 1;
+    uint64_t packed[8], nmask[4];
+    for (int t = 0; t < 6; t++) {
+        hs_pack_bases(seq, lens[t], packed, nmask);
+        for (int i = 0; i < lens[t]; i++) {
+            int code = hs_base_encode(seq[i]);
+            int bad = (int)(nmask[i / 64] >> (i % 64) & 1);
+            int b = (int)(packed[i / 32] >> (2 * (i % 32)) & 3);
+            if (bad != (code < 0) || b != (code < 0 ? 0 : code)) ok = 0;
+        }
+    }
+    ASSERT(ok, "Packed bases match hs_base_encode");
+
+    /* Packed kernels from an offset match the ASCII ones on the suffix */
+    uint64_t a[200], b[200];
+    hs_pack_bases(seq, 200, packed, nmask);
+    int same = 1;
+    for (int off = 0; off < 70; off += 23) {
+        int n = hs_kmer_hash_seq(seq + off, 200 - off, 21, a);
+        same &= n == hs_kmer_hash_packed(packed, nmask, off, 200 - off, 21, b) &&
+                !memcmp(a, b, (size_t)n * sizeof(uint64_t));
+        n = hs_syncmer_hashes(seq + off, 200 - off, 21, HS_SYNCMER_S, a);
+        same &= n == hs_syncmer_hashes_packed(packed, nmask, off, 200 - off, 21,
+                                              HS_SYNCMER_S, b) &&
+                !memcmp(a, b, (size_t)n * sizeof(uint64_t));
+    }
+    ASSERT(same, "Packed kernels match from an offset");
+}
+
 static void test_fmh_basic(void) {
     printf("  test_fmh_basic...\n");
     fmh_sketch_t *sk = fmh_init(4, 1.0); /* scale=1.0 keeps all */
@@ -127,6 +217,87 @@ static void test_fmh_scale(void) {
     fmh_destroy(half);
 }
 
+/* Sorted, duplicate-free sample of [0, range) with ~density fraction kept */
+static int random_sorted(uint64_t *out, uint64_t range, int density_pct, uint64_t *state) {
+    int n = 0;
+    for (uint64_t v = 0; v < range; v++) {
+        *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+        if ((int)((*state >> 33) % 100) < density_pct) out[n++] = v << 40 | v;
+    }
+    return n;
+}
+
+static void test_sorted_intersect(void) {
+    printf("  test_sorted_intersect...\n");
+    uint64_t state = 42;
+    uint64_t *a = (uint64_t *)malloc(2000 * sizeof(uint64_t));
+    uint64_t *b = (uint64_t *)malloc(2000 * sizeof(uint64_t));
+    int *match = (int *)malloc(2000 * sizeof(int));
+    int bad = 0;
+    /* Sizes around the block widths, then long runs */
+    for (int trial = 0; trial < 200; trial++) {
+        uint64_t range = trial < 150 ? (uint64_t)(trial % 40) : 2000;
+        int na = random_sorted(a, range, 30 + trial % 60, &state);
+        int nb = random_sorted(b, range, 20 + (trial * 7) % 70, &state);
+        int want = 0, pos_ok = 1;
+        int k = kmer_sorted_intersect(a, na, b, nb, match);
+        for (int i = 0, j = 0; i < na && j < nb;) {
+            if (a[i] == b[j]) {
+                pos_ok = pos_ok && want < k && match[want] == j;
+                want++; i++; j++;
+            } else if (a[i] < b[j]) i++;
+            else j++;
+        }
+        if (k != want || !pos_ok || kmer_sorted_intersect(a, na, b, nb, NULL) != want) bad++;
+    }
+    ASSERT(bad == 0, "Sorted intersection matches the reference merge");
+    free(a);
+    free(b);
+    free(match);
+}
+
+static void test_fmh_multi(void) {
+    printf("  test_fmh_multi...\n");
+    /* Overlapping reference sketches and a query longer than one merge block */
+    uint64_t state = 7;
+    uint64_t *buf = (uint64_t *)malloc(3000 * sizeof(uint64_t));
+    fmh_sketch_t *refs[6];
+    for (int r = 0; r < 6; r++) {
+        refs[r] = fmh_init(21, 1.0);
+        int n = random_sorted(buf, 3000, r == 5 ? 0 : 10 + 8 * r, &state);
+        for (int i = 0; i < n; i++) fmh_add_hash(refs[r], buf[i]);
+        fmh_sort(refs[r]);
+    }
+    fmh_sketch_t *q = fmh_init(21, 1.0);
+    int nq = random_sorted(buf, 3000, 40, &state);
+    for (int i = 0; i < nq; i++) fmh_add_hash(q, buf[i]);
+    fmh_sort(q);
+    ASSERT(q->n > 256, "Query spans several merge blocks");
+
+    fmh_multi_t *mt = fmh_multi_build(refs, 6);
+    double scores[6];
+    fmh_multi_containment(mt, q, scores, 6);
+    int same = 1;
+    for (int r = 0; r < 6; r++) same = same && scores[r] == fmh_containment(q, refs[r]);
+    ASSERT(same, "Batched coarse scores equal per-reference containment");
+    ASSERT(scores[5] == 0.0, "Empty reference scores zero");
+
+    /* Fewer outputs than references */
+    double first[2];
+    fmh_multi_containment(mt, q, first, 2);
+    ASSERT(first[0] == scores[0] && first[1] == scores[1], "Truncated batch matches");
+
+    fmh_sketch_t *empty = fmh_init(21, 1.0);
+    fmh_multi_containment(mt, empty, scores, 6);
+    ASSERT(scores[0] == 0.0 && scores[4] == 0.0, "Empty query scores zero");
+
+    fmh_destroy(empty);
+    fmh_multi_destroy(mt);
+    fmh_destroy(q);
+    for (int r = 0; r < 6; r++) fmh_destroy(refs[r]);
+    free(buf);
+}
+
 static void test_kmer_set(void) {
     printf("  test_kmer_set...\n");
     kmer_set_t *ks = kmer_set_init(4);
@@ -140,6 +311,41 @@ static void test_kmer_set(void) {
     kmer_set_destroy(ks);
 }
 
+static void test_kmer_set_sorted(void) {
+    printf("  test_kmer_set_sorted...\n");
+    /* Keys at both ends of the hash range and clustered runs stress the
+     * interpolated starting point */
+    enum { N = 2000 };
+    static uint64_t keys[N];
+    uint64_t st = 7;
+    for (int i = 0; i < N; i++) {
+        st = st * 6364136223846793005ULL + 1442695040888963407ULL;
+        keys[i] = i < 100 ? (uint64_t)i * 3 : i < 200 ? UINT64_MAX - (uint64_t)i : st;
+    }
+    kmer_set_t *ks = kmer_set_init(21);
+    kmer_set_add_hashes(ks, keys, N / 2);
+    kmer_set_add_hashes(ks, keys + N / 2, N - N / 2);
+    kmer_set_add_hashes(ks, keys, 10);                  /* duplicates ignored */
+    ASSERT(ks->n_kmers == N, "Merged adds keep each key once");
+    int sorted = 1;
+    for (int i = 1; i < ks->n_kmers; i++) sorted &= ks->sorted[i - 1] < ks->sorted[i];
+    ASSERT(sorted, "Keys kept ascending");
+
+    int missing = 0, false_hits = 0;
+    for (int i = 0; i < N; i++) {
+        missing += !kmer_set_contains(ks, keys[i]);
+        if (i < 100) false_hits += kmer_set_contains(ks, keys[i] + 1);
+    }
+    ASSERT(missing == 0, "Every key found");
+    ASSERT(false_hits == 0, "Neighbours of keys not found");
+
+    kmer_set_t *view = kmer_set_view(21, ks->sorted, ks->n_kmers);
+    ASSERT(kmer_set_contains(view, UINT64_MAX - 150) && !kmer_set_contains(view, 1),
+           "Views answer the same lookups");
+    kmer_set_destroy(view);
+    kmer_set_destroy(ks);
+}
+
 static void test_kmer_set_containment(void) {
     printf("  test_kmer_set_containment...\n");
     kmer_set_t *ref = kmer_set_init(4);
@@ -161,6 +367,332 @@ static void test_kmer_set_containment(void) {
     kmer_set_destroy(ref);
 }
 
+static void test_kmer_profile(void) {
+    printf("  test_kmer_profile...\n");
+    const char *ref = "ACGTTGCAAGGCTACGTACGGATCCAAGTCATTGACCAGTAGGCATTACG";
+    const char *q1  = "GCAAGGCTACGTACGGATCCAAGTCANNTTGACC";
+    const char *q2  = "TTTTTTTTTTTTTTTTTTTTTTTTT";
+    kmer_set_t *ks = kmer_set_init(15);
+    kmer_set_add_seq(ks, ref, (int)strlen(ref));
+
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+    kmer_profile_set_seq(&qp, q1, (int)strlen(q1));
+    int n;
+    const uint64_t *h = kmer_profile_hashes(&qp, 15, &n);
+    ASSERT_NEAR(kmer_set_containment_hashes(h, n, ks),
+                kmer_set_containment(q1, (int)strlen(q1), ks, 15), 1e-12,
+                "Profile containment matches sequence containment");
+    /* Several k values coexist; re-requesting returns the cached slot */
+    int n21;
+    kmer_profile_hashes(&qp, 21, &n21);
+    const uint64_t *h2 = kmer_profile_hashes(&qp, 15, &n);
+    ASSERT(h2 == h, "Profile reuses cached hashes for the same k");
+
+    /* A new sequence invalidates the cache but keeps the buffers */
+    kmer_profile_set_seq(&qp, q2, (int)strlen(q2));
+    h = kmer_profile_hashes(&qp, 15, &n);
+    ASSERT(n == (int)strlen(q2) - 14, "Profile recomputes for new sequence");
+    ASSERT_NEAR(kmer_set_containment_hashes(h, n, ks), 0.0, 1e-12,
+                "Unrelated query has zero containment");
+    /* Half reference, half junk: bounded scoring is exact at or above
+     * its floor and stays below an unreachable one */
+    const char *q3 = "ACGTTGCAAGGCTACGTACGGATCCTTTTTTTTTTTTTTTTTTTTTTTTT";
+    kmer_profile_set_seq(&qp, q3, (int)strlen(q3));
+    h = kmer_profile_hashes(&qp, 15, &n);
+    double exact = kmer_set_containment_hashes(h, n, ks);
+    ASSERT(exact > 0.0 && exact < 1.0, "Partial containment");
+    ASSERT_NEAR(kmer_set_containment_bounded(h, n, ks, exact), exact, 1e-12,
+                "Bounded containment exact at its floor");
+    ASSERT_NEAR(kmer_set_containment_bounded(h, n, ks, 0.0), exact, 1e-12,
+                "Zero floor scores exactly");
+    ASSERT(kmer_set_containment_bounded(h, n, ks, exact + 1e-9) < exact + 1e-9,
+           "Unreachable floor stays below it");
+    kmer_profile_set_seq(&qp, "ACGT", 4);
+    kmer_profile_hashes(&qp, 15, &n);
+    ASSERT(n == 0, "Short sequence yields empty profile");
+
+    kmer_profile_free(&qp);
+    kmer_set_destroy(ks);
+}
+
+static void test_kmer_profile_sketch(void) {
+    printf("  test_kmer_profile_sketch...\n");
+    /* Random 2 kb read: enough sketch hashes for the radix path at
+     * scale 1, a handful at scale 0.05 */
+    char seq[2001];
+    uint64_t state = 11;
+    for (int i = 0; i < 2000; i++) {
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        seq[i] = "ACGT"[(state >> 33) & 3];
+    }
+    seq[2000] = '\0';
+    memcpy(seq + 1000, seq, 200); /* repeated k-mers must deduplicate */
+
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+    const double scales[3] = { 1.0, 0.05, 1.0 };
+    const int lens[3] = { 2000, 2000, 60 };
+    int same = 1;
+    for (int t = 0; t < 3; t++) {
+        fmh_sketch_t *want = fmh_init(21, scales[t]);
+        fmh_add_seq(want, seq, lens[t]);
+        fmh_sort(want);
+        kmer_profile_set_seq(&qp, seq, lens[t]);
+        const fmh_sketch_t *got = kmer_profile_sketch(&qp, 21, scales[t]);
+        same = same && got->n == want->n &&
+               memcmp(got->hashes, want->hashes, (size_t)want->n * sizeof(uint64_t)) == 0;
+        for (int i = 1; i < got->n; i++) same = same && got->hashes[i - 1] < got->hashes[i];
+        same = same && kmer_profile_sketch(&qp, 21, scales[t]) == got;
+        fmh_destroy(want);
+    }
+    ASSERT(same, "Profile sketch matches fmh_add_seq + fmh_sort");
+    kmer_profile_free(&qp);
+}
+
+static void test_kmer_posting(void) {
+    printf("  test_kmer_posting...\n");
+    /* 2 markers x 70 species so species bits span two words */
+    enum { M = 2, S = 70 };
+    const char *a = "ACGTTGCAAGGCTACGTACGGATCCAAGTCATTGACC";
+    const char *b = "TTGACCAGTAGGCATTACGGATCCAAGTCATTGACCA";
+    kmer_set_t **rows[M];
+    for (int m = 0; m < M; m++) {
+        rows[m] = (kmer_set_t **)hs_calloc(S, sizeof(kmer_set_t *));
+        for (int s = 0; s < S; s += (m == 0 ? 3 : 5)) {
+            rows[m][s] = kmer_set_init(11);
+            const char *src = (s % 2 == 0) ? a : b;
+            kmer_set_add_seq(rows[m][s], src, (int)strlen(src));
+        }
+    }
+    rows[1][66] = kmer_set_init(9);          /* different k: not posted */
+    kmer_set_add_seq(rows[1][66], a, (int)strlen(a));
+
+    kmer_posting_t *pt = kmer_posting_build((kmer_set_t *const *const *)rows, M, S, 11);
+    ASSERT(pt != NULL && pt->n_keys > 0 && pt->n_species == S, "Posting table built");
+
+    const char *q = "CGTACGGATCCAAGTCATTGACCAGTAGG";
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+    kmer_profile_set_seq(&qp, q, (int)strlen(q));
+    int n;
+    const uint64_t *h = kmer_profile_hashes(&qp, 11, &n);
+    int counts[M * S];
+    memset(counts, 0, sizeof(counts));
+    kmer_posting_count(pt, h, n, counts);
+
+    int mismatches = 0;
+    for (int m = 0; m < M; m++) {
+        for (int s = 0; s < S; s++) {
+            int expect = 0;
+            if (rows[m][s] && rows[m][s]->k == 11)
+                for (int i = 0; i < n; i++) expect += kmer_set_contains(rows[m][s], h[i]);
+            if (counts[m * S + s] != expect) mismatches++;
+        }
+    }
+    ASSERT(mismatches == 0, "Posting counts match per-set lookups");
+    ASSERT(kmer_posting_get(pt, hs_kmer_canonical("TTTTTTTTTTT", 11)) == NULL,
+           "Absent k-mer has no posting");
+
+    kmer_profile_free(&qp);
+    kmer_posting_destroy(pt);
+    for (int m = 0; m < M; m++) {
+        for (int s = 0; s < S; s++) kmer_set_destroy(rows[m][s]);
+        free(rows[m]);
+    }
+
+    /* Thousands of keys spread over a many-bucket directory */
+    enum { N = 3000 };
+    static uint64_t big[3][N];
+    kmer_set_t *cols[3], **grid[1] = { cols };
+    uint64_t st = 99;
+    for (int s = 0; s < 3; s++) {
+        for (int i = 0; i < N; i++) {
+            st = st * 6364136223846793005ULL + 1442695040888963407ULL;
+            big[s][i] = i < N / 3 && s > 0 ? big[0][i] : st;   /* a third shared */
+        }
+        cols[s] = kmer_set_init(21);
+        kmer_set_add_hashes(cols[s], big[s], N);
+    }
+    pt = kmer_posting_build((kmer_set_t *const *const *)grid, 1, 3, 21);
+    ASSERT(pt != NULL && pt->dir_bits > 4 && pt->n_keys == (uint64_t)(N / 3 + 3 * (N - N / 3)),
+           "Large posting table built");
+    int bad = 0;
+    for (int s = 0; s < 3; s++) {
+        for (int i = 0; i < N; i++) {
+            const uint32_t *e = kmer_posting_get(pt, big[s][i]);
+            int shared = i < N / 3;
+            if (!e || e[0] != (uint32_t)(shared ? 3 : 1) ||
+                (shared ? e[1] != 0 || e[3] != 2 : e[1] != (uint32_t)s)) bad++;
+        }
+    }
+    ASSERT(bad == 0, "Every key finds its cells");
+    ASSERT(kmer_posting_get(pt, big[0][0] + 1) == NULL && kmer_posting_get(pt, 0) == NULL &&
+           kmer_posting_get(pt, UINT64_MAX) == NULL, "Absent keys are not found");
+
+    /* Batched probes over reads of uneven length, empty ones included,
+     * count as one read at a time does */
+    int lens[5] = { 7, 0, 40, 1, 300 }, one[5][3], batch[5][3];
+    const uint64_t *reads[5];
+    int *cnt[5];
+    uint64_t qh[348];
+    for (int i = 0; i < 348; i++) qh[i] = i % 2 ? big[i % 3][(i * 7) % N] : big[0][i] + 1;
+    for (int r = 0, o = 0; r < 5; o += lens[r++]) {
+        reads[r] = qh + o;
+        cnt[r] = batch[r];
+        memset(one[r], 0, sizeof(one[r]));
+        memset(batch[r], 0, sizeof(batch[r]));
+        kmer_posting_count(pt, reads[r], lens[r], one[r]);
+    }
+    kmer_posting_count_batch(pt, reads, lens, 5, cnt);
+    ASSERT(!memcmp(one, batch, sizeof(one)) && one[4][0] > 0, "Batched counts match");
+    kmer_posting_destroy(pt);
+    for (int s = 0; s < 3; s++) kmer_set_destroy(cols[s]);
+
+    /* Same on a table too large to stay cached, which is prefetched */
+    enum { L = 200000 };
+    uint64_t *keys = (uint64_t *)hs_malloc(L * sizeof(uint64_t));
+    for (int s = 0; s < 3; s++) {
+        for (int i = 0; i < L; i++) {
+            st = st * 6364136223846793005ULL + 1442695040888963407ULL;
+            keys[i] = st;
+        }
+        if (s == 2) memcpy(keys, big[0], sizeof(big[0]));   /* shares big[0] */
+        cols[s] = kmer_set_init(21);
+        kmer_set_add_hashes(cols[s], keys, L);
+    }
+    free(keys);
+    pt = kmer_posting_build((kmer_set_t *const *const *)grid, 1, 3, 21);
+    for (int i = 0; i < 348; i++) qh[i] = i % 3 ? cols[i % 3]->sorted[i * 571] : big[0][i] + 1;
+    for (int r = 0; r < 5; r++) {
+        memset(one[r], 0, sizeof(one[r]));
+        memset(batch[r], 0, sizeof(batch[r]));
+        kmer_posting_count(pt, reads[r], lens[r], one[r]);
+    }
+    kmer_posting_count_batch(pt, reads, lens, 5, cnt);
+    ASSERT(!memcmp(one, batch, sizeof(one)) && one[4][1] > 0 && one[4][2] > 0,
+           "Batched counts match on a large table");
+    kmer_posting_destroy(pt);
+    for (int s = 0; s < 3; s++) kmer_set_destroy(cols[s]);
+}
+
+static void revcomp(const char *in, int n, char *out) {
+    for (int i = 0; i < n; i++) {
+        char c = in[n - 1 - i];
+        out[i] = c == 'A' ? 'T' : c == 'C' ? 'G' : c == 'G' ? 'C' : c == 'T' ? 'A' : c;
+    }
+}
+
+/* hs_syncmer_order of the s-mer at seq */
+static uint64_t smer_order(const char *seq, int s) {
+    uint64_t f = 0, r = 0;
+    for (int i = 0; i < s; i++) {
+        f = (f << 2) | (uint64_t)hs_base_encode(seq[i]);
+        r = (r << 2) | (uint64_t)(3 - hs_base_encode(seq[s - 1 - i]));
+    }
+    return hs_syncmer_order(f < r ? f : r);
+}
+
+static void test_syncmers(void) {
+    printf("  test_syncmers...\n");
+    enum { L = 3000, K = 21, S = HS_SYNCMER_S };
+    static char seq[L + 1], rc[L + 1];
+    uint64_t st = 11;
+    for (int i = 0; i < L; i++) {
+        st = st * 6364136223846793005ULL + 1442695040888963407ULL;
+        seq[i] = "ACGT"[st >> 62];
+    }
+    seq[1500] = 'N';
+    static uint64_t got[L], want[L], rgot[L];
+    int n = hs_syncmer_hashes(seq, L, K, S, got);
+
+    /* Brute force: the middle s-mer holds the window's minimum */
+    int nw = 0;
+    for (int p = 0; p + K <= L; p++) {
+        uint64_t h = hs_kmer_canonical(seq + p, K);
+        if (h == UINT64_MAX) continue;
+        uint64_t min = UINT64_MAX;
+        for (int j = 0; j <= K - S; j++) {
+            uint64_t o = smer_order(seq + p + j, S);
+            if (o < min) min = o;
+        }
+        if (smer_order(seq + p + (K - S) / 2, S) == min) want[nw++] = h;
+    }
+    ASSERT(n == nw && memcmp(got, want, (size_t)n * sizeof(uint64_t)) == 0,
+           "Syncmers match the brute-force selection");
+    ASSERT(n > (L - K) / 14 && n < (L - K) / 9, "About 1 in k - s + 1 k-mers kept");
+
+    /* The reverse complement selects the same k-mers, in reverse */
+    revcomp(seq, L, rc);
+    ASSERT(hs_syncmer_hashes(rc, L, K, S, rgot) == n, "Same count on either strand");
+    int same = 1;
+    for (int i = 0; i < n; i++) same &= rgot[i] == got[n - 1 - i];
+    ASSERT(same, "Strand-symmetric selection");
+    ASSERT(hs_syncmer_hashes(seq, K - 1, K, S, got) == 0, "Short sequence has no syncmers");
+
+    /* Cached beside the dense hashes; s = 0 is the dense slot */
+    kmer_profile_t qp;
+    kmer_profile_init(&qp);
+    kmer_profile_set_seq(&qp, seq, L);
+    int nd, ns, n0;
+    const uint64_t *dense = kmer_profile_hashes(&qp, K, &nd);
+    const uint64_t *samp = kmer_profile_syncmers(&qp, K, S, &ns);
+    ASSERT(samp != dense && ns == nw && memcmp(samp, want, (size_t)ns * sizeof(uint64_t)) == 0,
+           "Profile syncmers cached in their own slot");
+    ASSERT(kmer_profile_syncmers(&qp, K, 0, &n0) == dense && n0 == nd, "s = 0 is every k-mer");
+
+    kmer_set_t *ks = kmer_set_init(K);
+    kmer_set_add_syncmers(ks, seq, L, S);
+    ASSERT(ks->n_kmers <= n && kmer_set_containment_hashes(samp, ns, ks) == 1.0,
+           "Syncmer set holds every read syncmer");
+    kmer_set_destroy(ks);
+    kmer_profile_free(&qp);
+}
+
+static void test_kmer_bloom(void) {
+    printf("  test_kmer_bloom...\n");
+    enum { N = 5000 };
+    static uint64_t keys[2][N];
+    kmer_set_t *cols[3], **grid[1] = { cols };
+    uint64_t st = 7;
+    for (int s = 0; s < 2; s++) {
+        for (int i = 0; i < N; i++) {
+            st = st * 6364136223846793005ULL + 1442695040888963407ULL;
+            keys[s][i] = st;
+        }
+        cols[s] = kmer_set_init(21);
+        kmer_set_add_hashes(cols[s], keys[s], N);
+    }
+    cols[2] = kmer_set_init(15);                 /* other k: not filtered */
+    kmer_set_add_hashes(cols[2], &st, 1);
+    kmer_bloom_t *bf = kmer_bloom_build((kmer_set_t *const *const *)grid, 1, 3, 21);
+    ASSERT(bf != NULL && bf->k == 21, "Bloom filter built");
+
+    int missing = 0;
+    for (int s = 0; s < 2; s++)
+        for (int i = 0; i < N; i++) missing += !kmer_bloom_contains(bf, keys[s][i]);
+    ASSERT(missing == 0, "No false negatives");
+    static uint64_t absent[N];               /* true negatives */
+    int fp = 0, n_absent = 0;
+    for (int i = 0; i < N; i++) {
+        st = st * 6364136223846793005ULL + 1442695040888963407ULL;
+        if (kmer_bloom_contains(bf, st)) fp++;
+        else absent[n_absent++] = st;
+    }
+    ASSERT(fp < N / 50, "False positive rate under 2%");
+
+    /* 30 of 100 present: reaches 0.3 but not 0.31 */
+    uint64_t q[100];
+    for (int i = 0; i < 100; i++) q[i] = i < 30 ? keys[i % 2][i] : absent[i];
+    ASSERT(kmer_bloom_may_reach(bf, q, 100, 0.3), "Present fraction reaches floor");
+    ASSERT(!kmer_bloom_may_reach(bf, q, 100, 0.31), "Short fraction rejected");
+    ASSERT(!kmer_bloom_may_reach(bf, absent, 100, 0.1), "Off-target hashes rejected");
+    ASSERT(kmer_bloom_may_reach(bf, absent, 100, 0.0) && !kmer_bloom_may_reach(bf, q, 0, 0.1),
+           "Zero floor passes, empty query fails");
+    kmer_bloom_destroy(bf);
+    for (int s = 0; s < 3; s++) kmer_set_destroy(cols[s]);
+}
+
 static void test_fmh_merge(void) {
     printf("  test_fmh_merge...\n");
     fmh_sketch_t *a = fmh_init(4, 1.0);
@@ -188,11 +720,21 @@ int main(void) {
     test_base_encode();
     test_kmer_hash();
     test_kmer_canonical();
+    test_kmer_iter();
+    test_pack_bases();
     test_fmh_basic();
     test_fmh_containment();
     test_fmh_scale();
+    test_sorted_intersect();
+    test_fmh_multi();
     test_kmer_set();
+    test_kmer_set_sorted();
     test_kmer_set_containment();
+    test_kmer_profile();
+    test_kmer_profile_sketch();
+    test_syncmers();
+    test_kmer_posting();
+    test_kmer_bloom();
     test_fmh_merge();
     printf("=== %d passed, %d failed ===\n", tests_passed, tests_failed);
     return tests_failed > 0 ? 1 : 0;
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include "fastq.h"
 #include "refdb.h"
 #include "simulate.h"
 #include "utils.h"
@@ -181,12 +182,169 @@ static void test_simulate_write_fastq(void) {
     remove(path);
 }
 
+static char *slurp(const char *path, size_t *n) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) { *n = 0; return NULL; }
+    fseek(fp, 0, SEEK_END);
+    *n = (size_t)ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    char *buf = (char *)malloc(*n + 1);
+    *n = fread(buf, 1, *n, fp);
+    fclose(fp);
+    return buf;
+}
+
+/* Reads of path through the FASTQ reader, with inflate_threads prefetch
+ * workers (0 = inline) */
+static int read_all(const char *path, int inflate_threads, char ***seqs) {
+    hs_seqfile_t *sf = hs_seqfile_open(path);
+    if (!sf) return -1;
+    if (inflate_threads > 0) hs_seqfile_prefetch(sf, inflate_threads);
+    hs_seq_batch_t b;
+    hs_seq_batch_init(&b);
+    int n = 0, cap = 0;
+    *seqs = NULL;
+    int got;
+    while ((got = hs_seqfile_read_batch(sf, &b, 1000)) > 0) {
+        for (int i = 0; i < got; i++) {
+            if (n == cap) {
+                cap = cap ? 2 * cap : 1024;
+                *seqs = (char **)realloc(*seqs, (size_t)cap * sizeof(char *));
+            }
+            (*seqs)[n] = (char *)malloc((size_t)b.lens[i] + 1);
+            memcpy((*seqs)[n], b.seqs[i], (size_t)b.lens[i]);
+            (*seqs)[n++][b.lens[i]] = '\0';
+        }
+    }
+    hs_seq_batch_free(&b);
+    hs_seqfile_close(sf);
+    return n;
+}
+
+static void free_all(char **seqs, int n) {
+    for (int i = 0; i < n; i++) free(seqs[i]);
+    free(seqs);
+}
+
+static void test_simulate_stream(void) {
+    printf("  test_simulate_stream...\n");
+    halal_refdb_t *db = refdb_build_default();
+
+    sim_config_t cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.n_species = db->n_species;
+    cfg.composition = (double *)calloc((size_t)db->n_species, sizeof(double));
+    cfg.composition[refdb_find_species(db, "Bos_taurus")] = 0.7;
+    cfg.composition[refdb_find_species(db, "Sus_scrofa")] = 0.3;
+    /* Several blocks per marker, the last one partial */
+    cfg.reads_per_marker = 3 * SIM_STREAM_BLOCK + 123;
+    cfg.error_rate = 0.01;
+    cfg.read_length = 120;
+    cfg.seed = 7;
+
+    const char *p1 = "/tmp/test_sim_stream1.fq", *p4 = "/tmp/test_sim_stream4.fq";
+    const char *pz = "/tmp/test_sim_stream.fq.gz";
+    int expect = 3 * cfg.reads_per_marker;
+    ASSERT(simulate_mixture_fastq(&cfg, db, p1, 1, 0) == expect, "All reads written");
+    ASSERT(simulate_mixture_fastq(&cfg, db, p4, 4, 0) == expect, "All reads written on 4 threads");
+    ASSERT(simulate_mixture_fastq(&cfg, db, pz, 3, 6) == expect, "All reads written compressed");
+
+    size_t n1, n4;
+    char *f1 = slurp(p1, &n1), *f4 = slurp(p4, &n4);
+    ASSERT(f1 && f4 && n1 == n4 && memcmp(f1, f4, n1) == 0,
+           "Output does not depend on the thread count");
+    free(f1);
+    free(f4);
+
+    char **plain, **inline_z, **bgzf;
+    int np = read_all(p1, 0, &plain);
+    int ni = read_all(pz, 0, &inline_z);
+    int nb = read_all(pz, 4, &bgzf);
+    ASSERT(np == expect, "Plain output reads back");
+    ASSERT(ni == np && nb == np, "BGZF output reads back, inline and in parallel");
+    int same = ni == np && nb == np;
+    for (int i = 0; same && i < np; i++)
+        same = strcmp(plain[i], inline_z[i]) == 0 && strcmp(plain[i], bgzf[i]) == 0;
+    ASSERT(same, "Compressed output holds the same reads");
+    free_all(plain, np > 0 ? np : 0);
+    free_all(inline_z, ni > 0 ? ni : 0);
+    free_all(bgzf, nb > 0 ? nb : 0);
+
+    /* Nanopore profile: varying lengths, indels */
+    cfg.reads_per_marker = 200;
+    cfg.error_rate = 0.05;
+    cfg.read_length = 0;
+    cfg.read_length_sd = 60;
+    cfg.indel_fraction = 0.5;
+    ASSERT(simulate_mixture_fastq(&cfg, db, p1, 2, 0) == 600, "Nanopore reads written");
+    char **np_reads;
+    int nn = read_all(p1, 0, &np_reads);
+    int min_len = 1 << 30, max_len = 0;
+    for (int i = 0; i < nn; i++) {
+        int len = (int)strlen(np_reads[i]);
+        if (len < min_len) min_len = len;
+        if (len > max_len) max_len = len;
+    }
+    ASSERT(nn == 600 && max_len - min_len > 50, "Read lengths vary");
+    free_all(np_reads, nn > 0 ? nn : 0);
+
+    sim_result_t *sr = simulate_mixture(&cfg, db);
+    int longer = 0;
+    for (int i = 0; i < sr->n_reads; i++) {
+        marker_ref_t *mr = refdb_get_marker_ref(db, sr->true_species[i], sr->true_marker[i]);
+        if (sr->read_lengths[i] > mr->seq_len) longer = 1;
+    }
+    ASSERT(longer, "Insertions can lengthen a read past its reference");
+    sim_result_destroy(sr);
+
+    free(cfg.composition);
+    refdb_destroy(db);
+    remove(p1);
+    remove(p4);
+    remove(pz);
+}
+
+/* Turning keep_qual on after a batch has grown without it */
+static void test_batch_late_keep_qual(void) {
+    printf("  test_batch_late_keep_qual...\n");
+    const char *p1 = "/tmp/test_halal_lateq_1.fq", *p2 = "/tmp/test_halal_lateq_2.fq";
+    FILE *f1 = fopen(p1, "w"), *f2 = fopen(p2, "w");
+    for (int i = 0; i < 8; i++) {
+        fprintf(f1, "@r%d/1\nACGTACGTAC\n+\nIIIIIIIIII\n", i);
+        fprintf(f2, "@r%d/2\nTTTTGGGGCC\n+\nIIIIIIIIII\n", i);
+    }
+    fclose(f1);
+    fclose(f2);
+
+    for (int paired = 0; paired < 2; paired++) {
+        hs_seqfile_t *sf = paired ? hs_seqfile_open_paired(p1, p2) : hs_seqfile_open(p1);
+        hs_seq_batch_t b;
+        hs_seq_batch_init(&b);
+        int n1 = hs_seqfile_read_batch(sf, &b, 4);
+        b.keep_qual = 1;
+        int n2 = hs_seqfile_read_batch(sf, &b, 4);
+        int ok = n1 == 4 && n2 == 4 && b.quals != NULL;
+        /* Merged fragments carry no quality */
+        for (int i = 0; ok && i < n2; i++)
+            ok = paired ? b.quals[i] == NULL
+                        : b.quals[i] && strncmp(b.quals[i], "IIIIIIIIII", 10) == 0;
+        ASSERT(ok, paired ? "Paired batch gets quals when keep_qual turns on"
+                          : "Batch gets quals when keep_qual turns on");
+        hs_seq_batch_free(&b);
+        hs_seqfile_close(sf);
+    }
+    remove(p1);
+    remove(p2);
+}
+
 int main(void) {
     printf("=== test_simulate ===\n");
     test_simulate_basic();
     test_simulate_markers();
     test_simulate_deterministic();
     test_simulate_write_fastq();
+    test_simulate_stream();
+    test_batch_late_keep_qual();
     printf("=== %d passed, %d failed ===\n", tests_passed, tests_failed);
     return tests_failed > 0 ? 1 : 0;
 }